@@ -1,10 +1,27 @@
 
 Texture2D texDiffuse : register(t0);
+Texture2D texNormal : register(t1);
+Texture2D texSpecular : register(t2);
+SamplerState texSampler : register(s0);
+
+// Features of the variant, defined to 1 or 0 by the application (see ShaderFeature)
+#ifndef DIFFUSE_TEXTURE
+#define DIFFUSE_TEXTURE 0
+#endif
+#ifndef NORMAL_MAP
+#define NORMAL_MAP 0
+#endif
+#ifndef SPECULAR_MAP
+#define SPECULAR_MAP 0
+#endif
 
 struct PSIn
 {
 	float4 Pos  : SV_Position;
 	float3 Normal : NORMAL;
+	float3 Tangent : TANGENT;
+	float3 Binormal : BINORMAL;
+	float3 ToEye : TOEYE;
 	float2 TexCoord : TEX;
 };
 
@@ -14,10 +31,32 @@ struct PSIn
 
 float4 PS_main(PSIn input) : SV_Target
 {
+	// Fixed directional light, in world space
+	const float3 L = normalize(float3(0.3, 1.0, 0.5));
+
+	float3 N = normalize(input.Normal);
+#if NORMAL_MAP
+	// Tangent space normal, mapped from [0,1] to [-1,1]
+	float3 tangentNormal = texNormal.Sample(texSampler, input.TexCoord).xyz * 2 - 1;
+	N = normalize(tangentNormal.x * normalize(input.Tangent) + tangentNormal.y * normalize(input.Binormal) + tangentNormal.z * N);
+#endif
+
+#if DIFFUSE_TEXTURE
+	float3 color = texDiffuse.Sample(texSampler, input.TexCoord).rgb * (0.2 + 0.8 * saturate(dot(N, L)));
+#else
 	// Debug shading #1: map and return normal as a color, i.e. from [-1,1]->[0,1] per component
-	// The 4:th component is opacity and should be = 1
-	return float4(input.Normal*0.5+0.5, 1);
-	
+	float3 color = N * 0.5 + 0.5;
+
 	// Debug shading #2: map and return texture coordinates as a color (blue = 0)
-//	return float4(input.TexCoord, 0, 1);
-}
\ No newline at end of file
+//	float3 color = float3(input.TexCoord, 0);
+#endif
+
+#if SPECULAR_MAP
+	// Blinn-Phong highlight, scaled by the specular map
+	float3 H = normalize(L + normalize(input.ToEye));
+	color += texSpecular.Sample(texSampler, input.TexCoord).rgb * pow(saturate(dot(N, H)), 32);
+#endif
+
+	// The 4:th component is opacity and should be = 1
+	return float4(color, 1);
+}
@@ -4,6 +4,9 @@ cbuffer TransformationBuffer : register(b0)
 	matrix ModelToWorldMatrix;
 	matrix WorldToViewMatrix;
 	matrix ProjectionMatrix;
+	matrix ModelViewProjectionMatrix; // Computed once per draw on the CPU, see FillTransformationBuffers
+	matrix NormalMatrix;
+	float4 CameraPosition;
 };
 
 struct VSIn
@@ -15,10 +18,23 @@ struct VSIn
 	float2 TexCoord : TEX;
 };
 
+// Per-instance inputs of instanced draws, see InstanceBuffer::Layout
+struct VSInstance
+{
+	float4 Transform0 : INSTANCE_TRANSFORM0; // Columns of the model-to-world matrix
+	float4 Transform1 : INSTANCE_TRANSFORM1;
+	float4 Transform2 : INSTANCE_TRANSFORM2;
+	float4 Transform3 : INSTANCE_TRANSFORM3;
+	float4 Data : INSTANCE_DATA;
+};
+
 struct PSIn
 {
 	float4 Pos  : SV_Position;
 	float3 Normal : NORMAL;
+	float3 Tangent : TANGENT;
+	float3 Binormal : BINORMAL;
+	float3 ToEye : TOEYE;
 	float2 TexCoord : TEX;
 };
 
@@ -26,21 +42,37 @@ struct PSIn
 // Vertex Shader
 //-----------------------------------------------------------------------------------------
 
-PSIn VS_main(VSIn input)
+// Outputs other than the position, from the world space position and the matrices for normals and tangents
+PSIn Transform(VSIn input, float3 worldPos, float3x3 normalMatrix, float3x3 tangentMatrix)
 {
 	PSIn output = (PSIn)0;
-	
-	// Model->View transformation
-	matrix MV = mul(WorldToViewMatrix, ModelToWorldMatrix);
+	output.Normal = normalize(mul(normalMatrix, input.Normal));
+	output.Tangent = normalize(mul(tangentMatrix, input.Tangent));
+	output.Binormal = normalize(mul(tangentMatrix, input.Binormal));
+	output.ToEye = CameraPosition.xyz - worldPos;
+	output.TexCoord = input.TexCoord;
+	return output;
+}
+
+PSIn VS_main(VSIn input)
+{
+	float3 worldPos = mul(ModelToWorldMatrix, float4(input.Pos, 1)).xyz;
+	PSIn output = Transform(input, worldPos, (float3x3)NormalMatrix, (float3x3)ModelToWorldMatrix);
 
-	// Model->View->Projection (clip space) transformation
 	// SV_Position expects the output position to be in clip space
-	matrix MVP = mul(ProjectionMatrix, MV);
-	
-	// Perform transformations and send to output
-	output.Pos = mul(MVP, float4(input.Pos, 1));
-	output.Normal = normalize( mul(ModelToWorldMatrix, float4(input.Normal,0)).xyz );
-	output.TexCoord = input.TexCoord;
-		
+	output.Pos = mul(ModelViewProjectionMatrix, float4(input.Pos, 1));
+	return output;
+}
+
+// The model-to-world matrix comes from the instance buffer instead of the constant buffer
+PSIn VS_instanced(VSIn input, VSInstance instance)
+{
+	// The matrix constructor takes rows, the instance holds columns
+	matrix modelToWorld = transpose(matrix(instance.Transform0, instance.Transform1, instance.Transform2, instance.Transform3));
+	float4 worldPos = mul(modelToWorld, float4(input.Pos, 1));
+
+	// Instances are rotated and uniformly scaled, so their own 3x3 transforms normals
+	PSIn output = Transform(input, worldPos.xyz, (float3x3)modelToWorld, (float3x3)modelToWorld);
+	output.Pos = mul(ProjectionMatrix, mul(WorldToViewMatrix, worldPos));
 	return output;
-}
\ No newline at end of file
+}
@@ -0,0 +1,297 @@
+//
+// Deterministic benchmark runs along a camera path
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include "benchmark.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+#include "vec/math.h"
+
+using namespace linalg;
+
+namespace
+{
+	struct TimeSeries
+	{
+		const char* Name;
+		double BenchmarkFrame::* Member;
+	};
+
+	const TimeSeries Series[] =
+	{
+		{ "update_ms", &BenchmarkFrame::UpdateMilliseconds },
+		{ "cull_ms", &BenchmarkFrame::CullMilliseconds },
+		{ "submit_ms", &BenchmarkFrame::SubmitMilliseconds },
+		{ "frame_ms", &BenchmarkFrame::FrameMilliseconds },
+	};
+
+	// Uniform Catmull-Rom spline through p1 at t = 0 and p2 at t = 1
+	template<class T>
+	T CatmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t)
+	{
+		const float t2 = t * t, t3 = t2 * t;
+		return (p1 * 2.0f + (p2 - p0) * t + (p0 * 2.0f - p1 * 5.0f + p2 * 4.0f - p3) * t2 + (p1 * 3.0f - p0 - p2 * 3.0f + p3) * t3) * 0.5f;
+	}
+}
+
+void CameraPath::AddKey(float time, const vec3f& position, float yaw, float pitch)
+{
+	if (!m_keys.empty())
+		yaw = m_keys.back().Yaw + std::remainder(yaw - m_keys.back().Yaw, 2.0f * fPI);
+
+	Key key;
+	key.Time = time;
+	key.Position = position;
+	key.Yaw = yaw;
+	key.Pitch = pitch;
+	m_keys.push_back(key);
+}
+
+CameraPath::Key CameraPath::Evaluate(float time) const
+{
+	if (m_keys.empty())
+		return Key();
+	if (time <= m_keys.front().Time)
+		return m_keys.front();
+	if (time >= m_keys.back().Time)
+		return m_keys.back();
+
+	// Segment [k1, k2] containing the time, with the neighbours clamped at the ends
+	const auto next = std::upper_bound(m_keys.begin(), m_keys.end(), time,
+		[](float t, const Key& key) { return t < key.Time; });
+	const size_t i2 = next - m_keys.begin();
+	const size_t i1 = i2 - 1;
+	const size_t i0 = i1 > 0 ? i1 - 1 : i1;
+	const size_t i3 = i2 + 1 < m_keys.size() ? i2 + 1 : i2;
+
+	const Key& k0 = m_keys[i0];
+	const Key& k1 = m_keys[i1];
+	const Key& k2 = m_keys[i2];
+	const Key& k3 = m_keys[i3];
+	const float span = k2.Time - k1.Time;
+	const float t = span > 0.0f ? (time - k1.Time) / span : 0.0f;
+
+	Key key;
+	key.Time = time;
+	key.Position = CatmullRom(k0.Position, k1.Position, k2.Position, k3.Position, t);
+	key.Yaw = CatmullRom(k0.Yaw, k1.Yaw, k2.Yaw, k3.Yaw, t);
+	key.Pitch = CatmullRom(k0.Pitch, k1.Pitch, k2.Pitch, k3.Pitch, t);
+	return key;
+}
+
+bool CameraPath::Load(const std::string& filename)
+{
+	std::ifstream in(filename);
+	if (!in)
+		return false;
+
+	m_keys.clear();
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::istringstream fields(line);
+		Key key;
+		if (!(fields >> key.Time >> key.Position.x >> key.Position.y >> key.Position.z))
+			continue;
+		if (!(fields >> key.Yaw >> key.Pitch))
+			key.Yaw = key.Pitch = 0.0f;
+		AddKey(key.Time, key.Position, key.Yaw, key.Pitch);
+	}
+	return !m_keys.empty();
+}
+
+bool CameraPath::Save(const std::string& filename) const
+{
+	std::ofstream out(filename);
+	if (!out)
+		return false;
+
+	for (const Key& key : m_keys)
+	{
+		out << key.Time << ' ' << key.Position.x << ' ' << key.Position.y << ' ' << key.Position.z << ' '
+			<< key.Yaw << ' ' << key.Pitch << '\n';
+	}
+	return (bool)out;
+}
+
+BenchmarkSummary BenchmarkSummary::Compute(std::vector<double> values)
+{
+	BenchmarkSummary summary;
+	if (values.empty())
+		return summary;
+
+	std::sort(values.begin(), values.end());
+	auto percentile = [&](double p)
+	{
+		const size_t rank = (size_t)std::ceil(p / 100.0 * values.size());
+		return values[rank > 0 ? rank - 1 : 0];
+	};
+
+	double sum = 0.0;
+	for (double value : values)
+		sum += value;
+
+	summary.Mean = sum / values.size();
+	summary.P50 = percentile(50.0);
+	summary.P95 = percentile(95.0);
+	summary.P99 = percentile(99.0);
+	summary.Max = values.back();
+	return summary;
+}
+
+double MillisecondsSince(int64_t start)
+{
+	return (Profiler::Now() - start) * 1e-6;
+}
+
+bool FailCheck(std::string& failure, const std::string& message)
+{
+	failure = message;
+	return false;
+}
+
+bool WriteBenchmarkReport(const std::string& filename, const std::function<void(JsonWriter&)>& write)
+{
+	std::ofstream out(filename);
+	if (!out)
+		return false;
+	JsonWriter json(out, 2);
+	json.BeginObject();
+	write(json);
+	json.EndObject();
+	out << "\n";
+	return (bool)out;
+}
+
+BenchmarkArguments::BenchmarkArguments(int argc, const wchar_t* const* argv, const wchar_t* name)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::wcscmp(argv[i], name) != 0)
+			continue;
+		m_present = true;
+		for (int j = i + 1; j < argc && argv[j][0] != L'-'; j++)
+		{
+			const std::wstring argument(argv[j]);
+			std::string value;
+			for (wchar_t c : argument)
+				value.push_back((char)c);
+			m_values.push_back(value);
+		}
+		break;
+	}
+}
+
+std::string BenchmarkArguments::GetString(size_t index, const std::string& fallback) const
+{
+	return index < m_values.size() ? m_values[index] : fallback;
+}
+
+unsigned BenchmarkArguments::GetUnsigned(size_t index, unsigned fallback) const
+{
+	return index < m_values.size() ? (unsigned)std::strtoul(m_values[index].c_str(), nullptr, 10) : fallback;
+}
+
+bool RunBenchmarkMode(const BenchmarkMode* modes, size_t mode_count, int argc, const wchar_t* const* argv, int& exit_code)
+{
+	for (size_t i = 0; i < mode_count; i++)
+	{
+		const BenchmarkMode& mode = modes[i];
+		const BenchmarkArguments arguments(argc, argv, mode.Switch);
+		if (!arguments.IsPresent())
+			continue;
+
+		bool passed = false;
+		try
+		{
+			passed = mode.Run(arguments, mode.ReportFilename);
+			printf("%s\n", passed ? ("Results saved to " + std::string(mode.ReportFilename)).c_str() : mode.Failure);
+		}
+		catch (const std::exception& e)
+		{
+			printf("%ls failed: %s\n", mode.Switch, e.what());
+		}
+		exit_code = passed ? 0 : -1;
+		return true;
+	}
+	return false;
+}
+
+Benchmark::Benchmark(const CameraPath& path, unsigned frame_count, float timestep)
+	: m_path(path), m_frame_count(frame_count), m_timestep(timestep)
+{
+	m_frames.reserve(frame_count);
+}
+
+CameraPath::Key Benchmark::GetCameraKey() const
+{
+	const float duration = m_path.GetDuration();
+	const float time = GetFrameIndex() * m_timestep;
+	return m_path.Evaluate(duration > 0.0f ? std::fmod(time, duration) : 0.0f);
+}
+
+BenchmarkSummary Benchmark::Summarize(double BenchmarkFrame::* time) const
+{
+	std::vector<double> values;
+	values.reserve(m_frames.size());
+	for (const BenchmarkFrame& frame : m_frames)
+		values.push_back(frame.*time);
+	return BenchmarkSummary::Compute(values);
+}
+
+void Benchmark::WriteJSON(std::ostream& out) const
+{
+	JsonWriter json(out, 2);
+	json.BeginObject();
+
+	json.Key("metadata").BeginObject();
+	for (const auto& entry : m_metadata)
+		json.Key(entry.first.c_str()).Value(entry.second);
+	json.EndObject();
+
+	json.Key("frames").Value((unsigned)m_frames.size());
+	json.Key("timestep").Value((double)m_timestep);
+
+	json.Key("summary").BeginObject();
+	for (const TimeSeries& series : Series)
+	{
+		const BenchmarkSummary summary = Summarize(series.Member);
+		json.Key(series.Name).BeginObject();
+		json.Key("mean").Value(summary.Mean);
+		json.Key("p50").Value(summary.P50);
+		json.Key("p95").Value(summary.P95);
+		json.Key("p99").Value(summary.P99);
+		json.Key("max").Value(summary.Max);
+		json.EndObject();
+	}
+	json.EndObject();
+
+	json.Key("per_frame").BeginArray();
+	for (const BenchmarkFrame& frame : m_frames)
+	{
+		json.BeginObject();
+		for (const TimeSeries& series : Series)
+			json.Key(series.Name).Value(frame.*series.Member);
+		json.EndObject();
+	}
+	json.EndArray();
+
+	json.EndObject();
+}
+
+bool Benchmark::WriteJSON(const std::string& filename) const
+{
+	std::ofstream out(filename);
+	if (!out)
+		return false;
+	WriteJSON(out);
+	return (bool)out;
+}
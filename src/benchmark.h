@@ -0,0 +1,286 @@
+/**
+ * @file benchmark.h
+ * @brief Deterministic benchmark runs along a camera path
+ * @details A benchmark replaces user input with a camera path and steps a fixed number of frames
+ * with a fixed timestep, so that every run renders the same frames. Per-frame CPU times are
+ * summarized with percentiles and written as JSON for comparisons across builds.
+ *
+ * The self tests and benchmarks of the other modules run from the command line instead, as rows of a
+ * BenchmarkMode table. Each has a test function that returns false with the first failed check described
+ * through FailCheck(), a benchmark function that runs the test and the timings, prints both and writes them
+ * with WriteBenchmarkReport(), and DEFAULT macros for the arguments the command line leaves out.
+*/
+
+#pragma once
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "vec/vec.h"
+
+class JsonWriter;
+
+//! Number of frames of a benchmark run
+#define BENCHMARK_DEFAULT_FRAMES 1000
+
+//! Timestep of a benchmark run, in seconds
+#define BENCHMARK_DEFAULT_TIMESTEP (1.0f / 60.0f)
+
+/**
+ * @brief Camera positions and orientations over time, interpolated with a Catmull-Rom spline.
+ * @details The yaw of each key is unwrapped against the key before it, so the camera turns the short way
+ * round between keys that straddle the wrap at pi.
+*/
+class CameraPath
+{
+public:
+	/**
+	 * @brief Key of the path.
+	*/
+	struct Key
+	{
+		float Time = 0.0f; //!< Seconds from the start of the path
+		linalg::vec3f Position = { 0.0f, 0.0f, 0.0f }; //!< Camera position
+		float Yaw = 0.0f; //!< Camera yaw in radians, see Camera::SetOrientation()
+		float Pitch = 0.0f; //!< Camera pitch in radians
+	};
+
+	/**
+	 * @brief Add a key, later than all keys already added.
+	 * @param[in] time Seconds from the start of the path.
+	 * @param[in] position Camera position.
+	 * @param[in] yaw Camera yaw in radians, any multiple of 2 pi away from the one meant.
+	 * @param[in] pitch Camera pitch in radians.
+	*/
+	void AddKey(float time, const linalg::vec3f& position, float yaw = 0.0f, float pitch = 0.0f);
+
+	/**
+	 * @brief Remove all keys.
+	*/
+	void Clear() noexcept { m_keys.clear(); }
+
+	/**
+	 * @brief Get the position and orientation at a time, clamped to the first and last key.
+	*/
+	Key Evaluate(float time) const;
+
+	/**
+	 * @brief Time of the last key.
+	*/
+	float GetDuration() const noexcept { return m_keys.empty() ? 0.0f : m_keys.back().Time; }
+
+	/**
+	 * @brief Get the keys of the path.
+	*/
+	const std::vector<Key>& GetKeys() const noexcept { return m_keys; }
+
+	/**
+	 * @brief Load a path saved with Save(): one key per line, "time x y z yaw pitch".
+	 * @details Keys without yaw and pitch, as saved before those were recorded, look along -z.
+	 * @return True on success.
+	*/
+	bool Load(const std::string& filename);
+
+	/**
+	 * @brief Save the path as text.
+	 * @return True on success.
+	*/
+	bool Save(const std::string& filename) const;
+
+private:
+	std::vector<Key> m_keys;
+};
+
+/**
+ * @brief CPU times of one frame, in milliseconds.
+*/
+struct BenchmarkFrame
+{
+	double UpdateMilliseconds = 0.0; //!< Scene update
+	double CullMilliseconds = 0.0; //!< Frustum and occlusion culling
+	double SubmitMilliseconds = 0.0; //!< Scene rendering, excluding culling
+	double FrameMilliseconds = 0.0; //!< Whole frame, including presenting
+};
+
+/**
+ * @brief Summary of a series of times.
+*/
+struct BenchmarkSummary
+{
+	double Mean = 0.0; //!< Average
+	double P50 = 0.0; //!< Median
+	double P95 = 0.0; //!< 95th percentile
+	double P99 = 0.0; //!< 99th percentile
+	double Max = 0.0; //!< Maximum
+
+	/**
+	 * @brief Summarize a series, using nearest-rank percentiles.
+	*/
+	static BenchmarkSummary Compute(std::vector<double> values);
+};
+
+/**
+ * @brief Milliseconds from a Profiler::Now() timestamp until now.
+*/
+double MillisecondsSince(int64_t start);
+
+/**
+ * @brief Record why a check of a self test failed.
+ * @param[out] failure Set to the message.
+ * @param[in] message Description of the failed check.
+ * @return False, to return from the check.
+*/
+bool FailCheck(std::string& failure, const std::string& message);
+
+/**
+ * @brief Write a JSON report of a benchmark or self test to a file.
+ * @param[in] filename File to create or replace.
+ * @param[in] write Writes the members of the top level object.
+ * @return True if the whole report was written.
+*/
+bool WriteBenchmarkReport(const std::string& filename, const std::function<void(JsonWriter&)>& write);
+
+/**
+ * @brief The arguments that follow a switch on the command line, up to the next switch.
+ * @details Arguments are expected to be ASCII, e.g. "-lodbenchmark 20000 100".
+*/
+class BenchmarkArguments
+{
+public:
+	/**
+	 * @brief Find a switch among the command line arguments and collect the arguments after it.
+	 * @param[in] argc Number of arguments, the first being the program.
+	 * @param[in] argv The arguments.
+	 * @param[in] name The switch, e.g. L"-benchmark".
+	*/
+	BenchmarkArguments(int argc, const wchar_t* const* argv, const wchar_t* name);
+
+	/**
+	 * @brief True if the switch was on the command line.
+	*/
+	bool IsPresent() const noexcept { return m_present; }
+
+	/**
+	 * @brief Get an argument as text.
+	 * @param[in] index Position after the switch, from 0.
+	 * @param[in] fallback Returned when the argument was not given.
+	*/
+	std::string GetString(size_t index, const std::string& fallback) const;
+
+	/**
+	 * @brief Get an argument as a number, e.g. a frame count.
+	 * @param[in] index Position after the switch, from 0.
+	 * @param[in] fallback Returned when the argument was not given.
+	*/
+	unsigned GetUnsigned(size_t index, unsigned fallback) const;
+
+private:
+	std::vector<std::string> m_values;
+	bool m_present = false;
+};
+
+/**
+ * @brief A mode that runs a self test or benchmark instead of the application, and writes a report.
+*/
+struct BenchmarkMode
+{
+	const wchar_t* Switch; //!< Command line switch, e.g. L"-lodbenchmark"
+	const char* ReportFilename; //!< Report written by Run
+	const char* Failure; //!< Printed when Run returns false
+
+	/**
+	 * @brief Run the mode.
+	 * @return True if every check passed and the report was written.
+	*/
+	bool (*Run)(const BenchmarkArguments& arguments, const std::string& report_filename);
+};
+
+/**
+ * @brief Run the first mode of a table whose switch is on the command line.
+ * @details Prints where the report was saved, or the mode's failure message or exception.
+ * @param[out] exit_code 0 if the mode passed, -1 otherwise.
+ * @return True if a mode was run.
+*/
+bool RunBenchmarkMode(const BenchmarkMode* modes, size_t mode_count, int argc, const wchar_t* const* argv, int& exit_code);
+
+/**
+ * @brief A benchmark run in progress.
+ * @details Each frame: read GetTimestep() and GetCameraKey(), run the frame, then AddFrame().
+*/
+class Benchmark
+{
+public:
+	/**
+	 * @brief Start a run.
+	 * @param[in] path Camera path, looped if the run is longer than the path.
+	 * @param[in] frame_count Number of frames to run.
+	 * @param[in] timestep Simulated seconds per frame.
+	*/
+	Benchmark(const CameraPath& path, unsigned frame_count = BENCHMARK_DEFAULT_FRAMES, float timestep = BENCHMARK_DEFAULT_TIMESTEP);
+
+	/**
+	 * @brief True when all frames have been added.
+	*/
+	bool IsFinished() const noexcept { return m_frames.size() >= m_frame_count; }
+
+	/**
+	 * @brief Index of the current frame.
+	*/
+	unsigned GetFrameIndex() const noexcept { return (unsigned)m_frames.size(); }
+
+	/**
+	 * @brief Fixed timestep to update the scene with.
+	*/
+	float GetTimestep() const noexcept { return m_timestep; }
+
+	/**
+	 * @brief Camera position and orientation of the current frame.
+	*/
+	CameraPath::Key GetCameraKey() const;
+
+	/**
+	 * @brief Record the times of the current frame and advance to the next.
+	*/
+	void AddFrame(const BenchmarkFrame& frame) { m_frames.push_back(frame); }
+
+	/**
+	 * @brief Add a string to the report, e.g. the build configuration.
+	*/
+	void SetMetadata(const std::string& key, const std::string& value) { m_metadata[key] = value; }
+
+	/**
+	 * @brief Get the frames recorded so far.
+	*/
+	const std::vector<BenchmarkFrame>& GetFrames() const noexcept { return m_frames; }
+
+	/**
+	 * @brief Summarize one of the times of all recorded frames.
+	 * @param[in] time Pointer to the member to summarize, e.g. &BenchmarkFrame::FrameMilliseconds.
+	*/
+	BenchmarkSummary Summarize(double BenchmarkFrame::* time) const;
+
+	/**
+	 * @brief Write metadata, summaries and per-frame times as JSON.
+	*/
+	void WriteJSON(std::ostream& out) const;
+
+	/**
+	 * @brief Write the JSON report to a file.
+	 * @return True on success.
+	*/
+	bool WriteJSON(const std::string& filename) const;
+
+private:
+	CameraPath m_path;
+	unsigned m_frame_count;
+	float m_timestep;
+	std::vector<BenchmarkFrame> m_frames;
+	std::map<std::string, std::string> m_metadata;
+};
+
+#endif
@@ -0,0 +1,289 @@
+//
+// Content-addressed blob cache
+//
+// The directory is listed once when the cache is opened; after that the
+// cache keeps its own index of the files, so lookups and evictions never list
+// it again. A file written by another process meanwhile is still found by
+// Load(), which opens the file of the key whether it is indexed or not.
+//
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include "blobcache.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <utime.h>
+#endif
+
+namespace
+{
+	const uint32_t Magic = 0x424C4F42; // "BLOB"
+	const uint32_t Version = 1;
+	const char* const Extension = ".blob";
+	const char* const TemporaryExtension = ".tmp";
+
+	// Temporary files this old are left over from a writer that did not finish
+	const time_t AbandonedSeconds = 60;
+
+	struct FileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint64_t Key;
+		uint64_t Size;
+		uint64_t Hash;
+		double CostMilliseconds;
+	};
+
+	struct FileInfo
+	{
+		std::string Name;
+		uint64_t Size;
+		time_t WriteTime;
+	};
+
+	bool EndsWith(const std::string& text, const char* suffix)
+	{
+		const size_t length = strlen(suffix);
+		return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+	}
+
+	void MakeDirectory(const std::string& path)
+	{
+#ifdef _WIN32
+		_mkdir(path.c_str());
+#else
+		mkdir(path.c_str(), 0755);
+#endif
+	}
+
+	std::vector<FileInfo> ListFiles(const std::string& directory)
+	{
+		std::vector<FileInfo> files;
+#ifdef _WIN32
+		WIN32_FIND_DATAA data;
+		HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &data);
+		if (find == INVALID_HANDLE_VALUE)
+			return files;
+		do
+		{
+			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				continue;
+			// FILETIME counts 100 ns intervals from 1601, time_t seconds from 1970
+			const uint64_t writeTime = (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 | data.ftLastWriteTime.dwLowDateTime;
+			files.push_back({ data.cFileName, (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow,
+				(time_t)(writeTime / 10000000 - 11644473600ull) });
+		} while (FindNextFileA(find, &data));
+		FindClose(find);
+#else
+		DIR* dir = opendir(directory.c_str());
+		if (!dir)
+			return files;
+		while (const dirent* entry = readdir(dir))
+		{
+			struct stat status;
+			const std::string name = entry->d_name;
+			if (stat((directory + "/" + name).c_str(), &status) == 0 && S_ISREG(status.st_mode))
+				files.push_back({ name, (uint64_t)status.st_size, status.st_mtime });
+		}
+		closedir(dir);
+#endif
+		return files;
+	}
+
+	// Set the write time of a file to now
+	void Touch(const std::string& path)
+	{
+#ifdef _WIN32
+		_utime(path.c_str(), nullptr);
+#else
+		utime(path.c_str(), nullptr);
+#endif
+	}
+
+	bool ParseKey(const std::string& name, uint64_t& key)
+	{
+		if (name.size() != 16 + strlen(Extension) || !EndsWith(name, Extension))
+			return false;
+		key = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			const char c = name[i];
+			const int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+			if (digit < 0)
+				return false;
+			key = key << 4 | (uint64_t)digit;
+		}
+		return true;
+	}
+}
+
+BlobHasher& BlobHasher::Add(const void* data, size_t size) noexcept
+{
+	const uint64_t length = size;
+	m_hash = Hash(&length, sizeof(length), m_hash);
+	m_hash = Hash(data, size, m_hash);
+	return *this;
+}
+
+uint64_t BlobHasher::Hash(const void* data, size_t size, uint64_t seed) noexcept
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	uint64_t hash = seed;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
+BlobCache::BlobCache(const std::string& directory, uint64_t max_bytes)
+	: m_directory(directory), m_max_bytes(max_bytes)
+{
+	MakeDirectory(m_directory);
+
+	const time_t now = time(nullptr);
+	for (const FileInfo& file : ListFiles(m_directory))
+	{
+		uint64_t key = 0;
+		if (ParseKey(file.Name, key))
+		{
+			m_entries[key] = { file.Size, file.WriteTime, 0 };
+			m_size += file.Size;
+		}
+		else if (EndsWith(file.Name, TemporaryExtension) && now - file.WriteTime > AbandonedSeconds)
+			std::remove((m_directory + "/" + file.Name).c_str());
+	}
+	Evict();
+}
+
+bool BlobCache::Load(uint64_t key, std::vector<char>& data)
+{
+	const auto start = std::chrono::steady_clock::now();
+	data.clear();
+
+	const std::string path = GetPath(key);
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+	{
+		Remove(key);
+		m_stats.Misses++;
+		return false;
+	}
+
+	FileHeader header;
+	bool valid = in.read((char*)&header, sizeof(header)) && header.Magic == Magic && header.Version == Version &&
+		header.Key == key && header.Size <= m_max_bytes;
+	if (valid)
+	{
+		data.resize((size_t)header.Size);
+		valid = in.read(data.data(), data.size()) && in.peek() == EOF && BlobHasher::Hash(data.data(), data.size()) == header.Hash;
+	}
+	in.close();
+
+	if (!valid)
+	{
+		// Truncated, corrupt or from an older version
+		data.clear();
+		Remove(key);
+		std::remove(path.c_str());
+		m_stats.Misses++;
+		return false;
+	}
+
+	// The file may have been written by another process since the directory was listed
+	Touch(path);
+	Remove(key);
+	m_entries[key] = { sizeof(FileHeader) + header.Size, time(nullptr), ++m_sequence };
+	m_size += sizeof(FileHeader) + header.Size;
+	m_stats.Hits++;
+	m_stats.SavedMilliseconds += header.CostMilliseconds -
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return true;
+}
+
+bool BlobCache::Store(uint64_t key, const void* data, size_t size, double cost_milliseconds)
+{
+	const std::string path = GetPath(key);
+
+	// Unique among the processes sharing the directory, so writers never share a temporary file
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".%" PRIx64 ".%u%s", (uint64_t)std::chrono::steady_clock::now().time_since_epoch().count(),
+		m_temporary_count++, TemporaryExtension);
+	const std::string temporaryPath = path + suffix;
+
+	FileHeader header = { Magic, Version, key, (uint64_t)size, BlobHasher::Hash(data, size), cost_milliseconds };
+	{
+		std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+		out.write((const char*)&header, sizeof(header));
+		out.write((const char*)data, size);
+		out.close();
+		if (!out)
+		{
+			std::remove(temporaryPath.c_str());
+			return false;
+		}
+	}
+
+	// Renaming over an existing file fails on Windows, the old blob is replaced then
+	if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+	{
+		std::remove(path.c_str());
+		if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+		{
+			std::remove(temporaryPath.c_str());
+			Remove(key);
+			return false;
+		}
+	}
+
+	Remove(key);
+	m_entries[key] = { sizeof(FileHeader) + size, time(nullptr), ++m_sequence };
+	m_size += sizeof(FileHeader) + size;
+	m_stats.Stores++;
+	Evict();
+	return true;
+}
+
+std::string BlobCache::GetPath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016" PRIx64 "%s", key, Extension);
+	return m_directory + "/" + name;
+}
+
+void BlobCache::Remove(uint64_t key)
+{
+	const auto entry = m_entries.find(key);
+	if (entry == m_entries.end())
+		return;
+	m_size -= entry->second.Size;
+	m_entries.erase(entry);
+}
+
+void BlobCache::Evict()
+{
+	while (m_size > m_max_bytes && !m_entries.empty())
+	{
+		auto oldest = m_entries.begin();
+		for (auto entry = m_entries.begin(); entry != m_entries.end(); ++entry)
+		{
+			if (entry->second.LastUse < oldest->second.LastUse ||
+				(entry->second.LastUse == oldest->second.LastUse && entry->second.Sequence < oldest->second.Sequence))
+				oldest = entry;
+		}
+		const uint64_t key = oldest->first;
+		std::remove(GetPath(key).c_str());
+		Remove(key);
+		m_stats.Evictions++;
+	}
+}
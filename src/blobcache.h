@@ -0,0 +1,131 @@
+/**
+ * @file blobcache.h
+ * @brief Content-addressed cache of binary blobs on disk
+ * @details Blobs are stored under a 64-bit key, normally a BlobHasher hash of everything that determines
+ * the blob, one file per key. A file is written under a temporary name and renamed into place, so readers
+ * never see a partial blob and concurrent writers of the same key both leave a complete file. Each file
+ * starts with a header holding the key, size and hash of the payload, and files that fail to match are
+ * treated as misses and deleted.
+ *
+ * When the files in the directory exceed the size limit, the least recently used are deleted. Use is
+ * tracked through the write time of the files, which a hit updates, so it carries over between runs.
+*/
+
+#pragma once
+#ifndef BLOBCACHE_H
+#define BLOBCACHE_H
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//! Size limit of the files of a cache, in bytes
+#define BLOBCACHE_DEFAULT_MAX_BYTES (64ull * 1024 * 1024)
+
+/**
+ * @brief 64-bit FNV-1a hash of a sequence of fields.
+ * @details Every field is hashed with its length first, so different splits of the same bytes hash differently.
+*/
+class BlobHasher
+{
+public:
+	BlobHasher& Add(const void* data, size_t size) noexcept; //!< Add a field of bytes
+	BlobHasher& Add(const std::string& text) noexcept { return Add(text.data(), text.size()); } //!< Add a string field
+	BlobHasher& Add(uint64_t value) noexcept { return Add(&value, sizeof(value)); } //!< Add an integer field, in host byte order
+
+	/**
+	 * @brief Hash of the fields added so far.
+	*/
+	uint64_t Get() const noexcept { return m_hash; }
+
+	/**
+	 * @brief Hash of a single block of bytes, without a length.
+	*/
+	static uint64_t Hash(const void* data, size_t size, uint64_t seed = 14695981039346656037ull) noexcept;
+
+private:
+	uint64_t m_hash = 14695981039346656037ull;
+};
+
+/**
+ * @brief Lookups and writes of a BlobCache.
+*/
+struct BlobCacheStats
+{
+	unsigned Hits = 0; //!< Load() found the blob
+	unsigned Misses = 0; //!< Load() did not find the blob, or it was corrupt
+	unsigned Stores = 0; //!< Blobs written
+	unsigned Evictions = 0; //!< Files deleted to stay under the size limit
+	double SavedMilliseconds = 0.0; //!< Cost recorded with the hit blobs, minus the time to load them
+};
+
+/**
+ * @brief Directory of blobs keyed by hash.
+*/
+class BlobCache
+{
+public:
+	/**
+	 * @brief Open a cache directory, creating it if needed, and evict down to the size limit.
+	 * @param[in] directory Directory of the cache files.
+	 * @param[in] max_bytes Size limit of the cache files.
+	*/
+	explicit BlobCache(const std::string& directory, uint64_t max_bytes = BLOBCACHE_DEFAULT_MAX_BYTES);
+
+	BlobCache(const BlobCache&) = delete;
+	BlobCache& operator=(const BlobCache&) = delete;
+
+	/**
+	 * @brief Read the blob of a key.
+	 * @param[in] key Key the blob was stored with.
+	 * @param[out] data The blob.
+	 * @return False on a miss, data is left empty then.
+	*/
+	bool Load(uint64_t key, std::vector<char>& data);
+
+	/**
+	 * @brief Write the blob of a key, replacing any blob of the key.
+	 * @param[in] cost_milliseconds Time it took to produce the blob, counted as saved by every hit.
+	 * @return False if the file could not be written.
+	*/
+	bool Store(uint64_t key, const void* data, size_t size, double cost_milliseconds = 0.0);
+
+	/**
+	 * @brief Total size of the cache files.
+	*/
+	uint64_t GetSize() const noexcept { return m_size; }
+
+	/**
+	 * @brief Number of cache files.
+	*/
+	size_t GetCount() const noexcept { return m_entries.size(); }
+
+	/**
+	 * @brief Get the lookups and writes since the cache was opened.
+	*/
+	const BlobCacheStats& GetStats() const noexcept { return m_stats; }
+
+private:
+	struct Entry
+	{
+		uint64_t Size;
+		time_t LastUse; // Write time of the file, in seconds
+		uint64_t Sequence; // Orders uses within the same second
+	};
+
+	std::string GetPath(uint64_t key) const;
+	void Remove(uint64_t key);
+	void Evict();
+
+	std::string m_directory;
+	uint64_t m_max_bytes;
+	uint64_t m_size = 0;
+	uint64_t m_sequence = 0;
+	unsigned m_temporary_count = 0;
+	std::unordered_map<uint64_t, Entry> m_entries;
+	BlobCacheStats m_stats;
+};
+
+#endif
@@ -0,0 +1,228 @@
+//
+// Blob cache self test and benchmark
+//
+// Every check opens its own cache on the scratch directory, so what one
+// check leaves on disk is what the next one finds, as between runs of the
+// program. Opening a cache with a size limit of zero empties the directory.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include "blobcachebenchmark.h"
+#include "benchmark.h"
+#include "blobcache.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+namespace
+{
+	std::vector<char> MakeBlob(size_t size, unsigned seed)
+	{
+		std::vector<char> blob(size);
+		for (size_t i = 0; i < size; i++)
+			blob[i] = (char)((i * 31 + seed * 17) >> 3);
+		return blob;
+	}
+
+	std::string BlobPath(const std::string& directory, uint64_t key)
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.blob", (unsigned long long)key);
+		return directory + name;
+	}
+
+	void Empty(const std::string& directory)
+	{
+		BlobCache cache(directory, 0);
+	}
+
+	bool CheckRoundTrip(const std::string& directory, std::string& failure)
+	{
+		const std::vector<char> blob = MakeBlob(5000, 1);
+		std::vector<char> loaded;
+		{
+			BlobCache cache(directory);
+			if (cache.Load(1, loaded) || !loaded.empty())
+				return FailCheck(failure, "round trip: hit in an empty cache");
+			if (!cache.Store(1, blob.data(), blob.size(), 10.0))
+				return FailCheck(failure, "round trip: store failed");
+			if (!cache.Load(1, loaded) || loaded != blob)
+				return FailCheck(failure, "round trip: loaded blob differs");
+			if (cache.Load(2, loaded))
+				return FailCheck(failure, "round trip: hit for a key never stored");
+			const BlobCacheStats& stats = cache.GetStats();
+			if (stats.Hits != 1 || stats.Misses != 2 || stats.Stores != 1)
+				return FailCheck(failure, "round trip: wrong stats");
+		}
+
+		// A new cache on the same directory, as in the next run
+		BlobCache cache(directory);
+		if (cache.GetCount() != 1)
+			return FailCheck(failure, "persistence: " + std::to_string(cache.GetCount()) + " files found instead of 1");
+		if (!cache.Load(1, loaded) || loaded != blob)
+			return FailCheck(failure, "persistence: blob not found after reopening");
+		if (cache.GetStats().SavedMilliseconds <= 0.0 || cache.GetStats().SavedMilliseconds > 10.0)
+			return FailCheck(failure, "persistence: saved time not taken from the stored cost");
+		return true;
+	}
+
+	bool CheckCorruption(const std::string& directory, std::string& failure)
+	{
+		const std::vector<char> blob = MakeBlob(3000, 2);
+		std::vector<char> loaded;
+		const uint64_t truncated = 10, flipped = 11, moved = 12, stale = 13;
+		{
+			BlobCache cache(directory);
+			cache.Store(truncated, blob.data(), blob.size());
+			cache.Store(flipped, blob.data(), blob.size());
+			cache.Store(moved, blob.data(), blob.size());
+		}
+
+		// Cut a file short, change a byte of another, and move a third to the name of a different key
+		{
+			std::ifstream in(BlobPath(directory, truncated), std::ios::binary);
+			std::vector<char> contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+			in.close();
+			std::ofstream out(BlobPath(directory, truncated), std::ios::binary | std::ios::trunc);
+			out.write(contents.data(), contents.size() / 2);
+		}
+		{
+			std::fstream file(BlobPath(directory, flipped), std::ios::binary | std::ios::in | std::ios::out);
+			file.seekg(-100, std::ios::end);
+			const char byte = (char)file.get();
+			file.seekp(-100, std::ios::end);
+			file.put(byte ^ 0x55);
+		}
+		std::rename(BlobPath(directory, moved).c_str(), BlobPath(directory, stale).c_str());
+
+		BlobCache cache(directory);
+		const uint64_t keys[] = { truncated, flipped, stale };
+		const char* names[] = { "truncated", "corrupt", "wrong key" };
+		for (int i = 0; i < 3; i++)
+		{
+			if (cache.Load(keys[i], loaded) || !loaded.empty())
+				return FailCheck(failure, std::string("corruption: ") + names[i] + " file was a hit");
+			if (std::ifstream(BlobPath(directory, keys[i])))
+				return FailCheck(failure, std::string("corruption: ") + names[i] + " file was not deleted");
+		}
+		return true;
+	}
+
+	bool CheckEviction(const std::string& directory, std::string& failure)
+	{
+		Empty(directory);
+		const size_t BlobBytes = 3000;
+		const std::vector<char> blob = MakeBlob(BlobBytes, 3);
+		std::vector<char> loaded;
+
+		// Room for three blobs with their headers, not four
+		BlobCache cache(directory, 3 * (BlobBytes + 64));
+		for (uint64_t key = 1; key <= 3; key++)
+			cache.Store(key, blob.data(), blob.size());
+		if (cache.GetCount() != 3 || cache.GetStats().Evictions != 0)
+			return FailCheck(failure, "eviction: blobs evicted below the limit");
+
+		// Using the oldest makes the second oldest the one to go
+		cache.Load(1, loaded);
+		cache.Store(4, blob.data(), blob.size());
+		if (cache.GetCount() != 3 || cache.GetStats().Evictions != 1)
+			return FailCheck(failure, "eviction: expected one eviction, " + std::to_string(cache.GetStats().Evictions) + " happened");
+		if (std::ifstream(BlobPath(directory, 2)))
+			return FailCheck(failure, "eviction: the least recently used blob was kept");
+		if (!std::ifstream(BlobPath(directory, 1)) || !std::ifstream(BlobPath(directory, 4)))
+			return FailCheck(failure, "eviction: a recently used blob was deleted");
+		if (cache.GetSize() > 3 * (BlobBytes + 64))
+			return FailCheck(failure, "eviction: cache over its limit");
+		return true;
+	}
+
+	bool CheckHasher(std::string& failure)
+	{
+		if (BlobHasher().Add("ab", 2).Add("c", 1).Get() == BlobHasher().Add("a", 1).Add("bc", 2).Get())
+			return FailCheck(failure, "hasher: moving a field boundary does not change the hash");
+		if (BlobHasher().Add(std::string("shader")).Get() != BlobHasher().Add(std::string("shader")).Get())
+			return FailCheck(failure, "hasher: not deterministic");
+		if (BlobHasher().Add((uint64_t)1).Get() == BlobHasher().Add((uint64_t)2).Get())
+			return FailCheck(failure, "hasher: integers collide");
+		return true;
+	}
+}
+
+bool RunBlobCacheTest(const std::string& directory, std::string& failure)
+{
+	Empty(directory);
+	const bool passed = CheckHasher(failure) && CheckRoundTrip(directory, failure) &&
+		CheckCorruption(directory, failure) && CheckEviction(directory, failure);
+	Empty(directory);
+	return passed;
+}
+
+std::vector<BlobCacheTiming> RunBlobCacheTimings(const std::string& directory)
+{
+	const unsigned Repeats = 200;
+	std::vector<BlobCacheTiming> timings;
+	Empty(directory);
+	{
+		BlobCache cache(directory);
+		std::vector<char> loaded;
+		uint64_t key = 0;
+		for (size_t kilobytes : { 1, 4, 16, 64 })
+		{
+			BlobCacheTiming timing;
+			timing.Bytes = kilobytes * 1024;
+			const std::vector<char> blob = MakeBlob(timing.Bytes, (unsigned)kilobytes);
+
+			uint64_t checksum = 0;
+			int64_t start = Profiler::Now();
+			for (unsigned i = 0; i < Repeats; i++)
+				checksum += BlobHasher().Add(blob.data(), blob.size()).Add((uint64_t)i).Get();
+			timing.HashMicroseconds = checksum ? (Profiler::Now() - start) * 1e-3 / Repeats : 0.0;
+
+			start = Profiler::Now();
+			for (unsigned i = 0; i < Repeats; i++)
+				cache.Store(++key, blob.data(), blob.size());
+			timing.StoreMicroseconds = (Profiler::Now() - start) * 1e-3 / Repeats;
+
+			start = Profiler::Now();
+			for (unsigned i = 0; i < Repeats; i++)
+				cache.Load(key - i, loaded);
+			timing.LoadMicroseconds = (Profiler::Now() - start) * 1e-3 / Repeats;
+
+			timings.push_back(timing);
+		}
+	}
+	Empty(directory);
+	return timings;
+}
+
+bool RunBlobCacheBenchmark(const std::string& report_filename)
+{
+	const std::string directory = "blob_cache_test";
+	std::string failure;
+	const bool passed = RunBlobCacheTest(directory, failure);
+	printf("Blob cache self test: %s\n", passed ? "passed" : failure.c_str());
+
+	const std::vector<BlobCacheTiming> timings = RunBlobCacheTimings(directory);
+	printf("\t%8s %10s %10s %10s\n", "KB", "Hash us", "Hit us", "Store us");
+	for (const BlobCacheTiming& timing : timings)
+		printf("\t%8zu %10.2f %10.2f %10.2f\n", timing.Bytes / 1024, timing.HashMicroseconds, timing.LoadMicroseconds, timing.StoreMicroseconds);
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(failure);
+		json.Key("timings").BeginArray();
+		for (const BlobCacheTiming& timing : timings)
+		{
+			json.BeginObject();
+			json.Key("bytes").Value((unsigned)timing.Bytes);
+			json.Key("hash_us").Value(timing.HashMicroseconds);
+			json.Key("hit_us").Value(timing.LoadMicroseconds);
+			json.Key("store_us").Value(timing.StoreMicroseconds);
+			json.EndObject();
+		}
+		json.EndArray();
+	});
+	return passed && written;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file blobcachebenchmark.h
+ * @brief Self test and benchmark of the blob cache
+ * @details The test checks round trips, persistence across opens, rejection of truncated and corrupt
+ * files, least recently used eviction and the field boundaries of the hash, in a scratch directory it
+ * empties afterwards. The benchmark times hashing, hits and stores for blobs of shader bytecode size.
+*/
+
+#pragma once
+#ifndef BLOBCACHEBENCHMARK_H
+#define BLOBCACHEBENCHMARK_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Times for one blob size.
+*/
+struct BlobCacheTiming
+{
+	size_t Bytes = 0; //!< Blob size
+	double HashMicroseconds = 0.0; //!< BlobHasher over the blob
+	double LoadMicroseconds = 0.0; //!< BlobCache::Load() of a hit
+	double StoreMicroseconds = 0.0; //!< BlobCache::Store() of a new key
+};
+
+/**
+ * @brief Run the self test of BlobHasher and BlobCache.
+ * @param[in] directory Scratch directory, created if needed, emptied afterwards.
+*/
+bool RunBlobCacheTest(const std::string& directory, std::string& failure);
+
+/**
+ * @brief Time hashing, hits and stores at 1, 4, 16 and 64 KB.
+ * @param[in] directory Scratch directory, created if needed, emptied afterwards.
+*/
+std::vector<BlobCacheTiming> RunBlobCacheTimings(const std::string& directory);
+
+/**
+ * @brief Run the self test and the timings in a scratch directory of the working directory.
+*/
+bool RunBlobCacheBenchmark(const std::string& report_filename);
+
+#endif
@@ -0,0 +1,459 @@
+//
+// Bounding volume self test and batched test benchmark
+//
+// Every batched result is compared with the scalar test of the same volume,
+// which must agree exactly, and with a reference in double precision that
+// tests all eight corners of a box or the slabs of a ray by division. The
+// reference is skipped for volumes within a small margin of a plane, where
+// rounding may decide either way. Rays along the axes of boxes with integer
+// corners are exact in float, so there the reference is used without margin.
+//
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include "boundsbenchmark.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+#include "vec/bounds.h"
+
+using namespace linalg;
+
+namespace
+{
+	const unsigned TestCount = 1003; // Not a multiple of four, so the scalar tail of each batch is tested too
+	const double Margin = 1e-3;
+
+	float Random(std::mt19937& random, float low, float high)
+	{
+		return std::uniform_real_distribution<float>(low, high)(random);
+	}
+
+	vec3f RandomPoint(std::mt19937& random, float range)
+	{
+		return vec3f(Random(random, -range, range), Random(random, -range, range), Random(random, -range, range));
+	}
+
+	aabb RandomBox(std::mt19937& random, float range, float size)
+	{
+		const vec3f extents(Random(random, 0.0f, size), Random(random, 0.0f, size), Random(random, 0.0f, size));
+		return aabb::from_center_extents(RandomPoint(random, range), extents);
+	}
+
+	// Looking down -z from z = 10, turned about y so that no plane is aligned with the axes
+	frustum TestFrustum()
+	{
+		return frustum::from_matrix(mat4f::projection(fPI / 3.0f, 1.5f, 1.0f, 50.0f) *
+			mat4f::rotation(0.3f, 0.0f, 1.0f, 0.0f) * mat4f::translation(0.0f, 0.0f, -10.0f));
+	}
+
+	double Distance(const plane& p, double x, double y, double z)
+	{
+		return (double)p.n.x * x + (double)p.n.y * y + (double)p.n.z * z + p.d;
+	}
+
+	// 1 for inside, 2 for straddling, 0 for outside, -1 for within the margin of a plane
+	int ReferenceCull(const frustum& f, const aabb& b)
+	{
+		int result = 1;
+		for (const plane& p : f.planes)
+		{
+			double nearest = DBL_MAX, farthest = -DBL_MAX;
+			for (int corner = 0; corner < 8; corner++)
+			{
+				const double d = Distance(p, corner & 1 ? b.max.x : b.min.x, corner & 2 ? b.max.y : b.min.y, corner & 4 ? b.max.z : b.min.z);
+				nearest = std::min(nearest, d);
+				farthest = std::max(farthest, d);
+			}
+			if (farthest < -Margin)
+				return 0;
+			if (farthest < Margin)
+				result = -1;
+			else if (nearest < 0.0 && result == 1)
+				result = 2;
+		}
+		return result;
+	}
+
+	// As ReferenceCull(), for a sphere
+	int ReferenceCull(const frustum& f, const sphere& s)
+	{
+		int result = 1;
+		for (const plane& p : f.planes)
+		{
+			const double d = Distance(p, s.center.x, s.center.y, s.center.z);
+			if (d < -s.radius - Margin)
+				return 0;
+			if (d < -s.radius + Margin)
+				result = -1;
+			else if (d < s.radius && result == 1)
+				result = 2;
+		}
+		return result;
+	}
+
+	// Slab test by division, a ray parallel to a slab is within it if its origin is. 1 for a hit,
+	// 0 for a miss, -1 for entry and exit closer than the margin
+	int ReferenceIntersect(const ray& r, const aabb& b, float t_max, double margin, double& t_hit)
+	{
+		double t0 = 0.0, t1 = t_max;
+		for (int a = 0; a < 3; a++)
+		{
+			const double origin = r.origin.vec[a], dir = r.dir.vec[a];
+			if (dir == 0.0)
+			{
+				if (origin < b.min.vec[a] || origin > b.max.vec[a])
+					return 0;
+				continue;
+			}
+			double tn = (b.min.vec[a] - origin) / dir, tf = (b.max.vec[a] - origin) / dir;
+			if (tn > tf)
+				std::swap(tn, tf);
+			t0 = std::max(t0, tn);
+			t1 = std::min(t1, tf);
+		}
+		t_hit = t0;
+		if (margin > 0.0 && std::fabs(t1 - t0) < margin)
+			return -1;
+		return t0 <= t1 ? 1 : 0;
+	}
+
+	bool SameBounds(const aabb& a, const aabb& b)
+	{
+		return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+			a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+	}
+
+	bool CheckFrustum(std::string& failure)
+	{
+		std::mt19937 random(1);
+		const frustum f = TestFrustum();
+		std::vector<aabb> boxes(TestCount);
+		std::vector<sphere> spheres(TestCount);
+		for (unsigned i = 0; i < TestCount; i++)
+		{
+			boxes[i] = RandomBox(random, 40.0f, 4.0f);
+			spheres[i] = sphere(RandomPoint(random, 40.0f), Random(random, 0.0f, 4.0f));
+		}
+
+		std::vector<uint8_t> out(TestCount);
+		unsigned kinds[3] = {};
+		size_t visible = frustum_cull(f, boxes.data(), TestCount, out.data()), expected = 0;
+		for (unsigned i = 0; i < TestCount; i++)
+		{
+			if (out[i] != (uint8_t)f.intersects(boxes[i]))
+				return FailCheck(failure, "frustum_aabb: box " + std::to_string(i) + " differs from the scalar test");
+			const int reference = ReferenceCull(f, boxes[i]);
+			if (reference >= 0 && out[i] != (reference ? 1 : 0))
+				return FailCheck(failure, "frustum_aabb: box " + std::to_string(i) + " differs from the corner reference");
+			if (reference >= 0)
+				kinds[reference]++;
+			expected += out[i];
+		}
+		if (visible != expected)
+			return FailCheck(failure, "frustum_aabb: wrong visible count");
+		if (!kinds[0] || !kinds[1] || !kinds[2])
+			return FailCheck(failure, "frustum_aabb: the boxes were not inside, outside and straddling");
+
+		visible = frustum_cull(f, spheres.data(), TestCount, out.data());
+		expected = 0;
+		for (unsigned i = 0; i < TestCount; i++)
+		{
+			if (out[i] != (uint8_t)f.intersects(spheres[i]))
+				return FailCheck(failure, "frustum_sphere: sphere " + std::to_string(i) + " differs from the scalar test");
+			const int reference = ReferenceCull(f, spheres[i]);
+			if (reference >= 0 && out[i] != (reference ? 1 : 0))
+				return FailCheck(failure, "frustum_sphere: sphere " + std::to_string(i) + " differs from the reference");
+			expected += out[i];
+		}
+		if (visible != expected)
+			return FailCheck(failure, "frustum_sphere: wrong visible count");
+		return true;
+	}
+
+	// Compare the batched test of one ray with the scalar test and the reference
+	bool CheckRay(const ray& r, const std::vector<aabb>& boxes, float t_max, double margin, std::string& failure)
+	{
+		std::vector<uint8_t> out(boxes.size());
+		std::vector<float> tHits(boxes.size());
+		const size_t hits = intersect(r, boxes.data(), boxes.size(), t_max, out.data(), tHits.data());
+		size_t expected = 0;
+		for (size_t i = 0; i < boxes.size(); i++)
+		{
+			float t = (float)fINF;
+			const bool scalar = intersect(r, boxes[i], t_max, t);
+			if (out[i] != (uint8_t)scalar || tHits[i] != (scalar ? t : (float)fINF))
+				return FailCheck(failure, "ray_aabb: box " + std::to_string(i) + " differs from the scalar test");
+			double reference = 0.0;
+			const int hit = ReferenceIntersect(r, boxes[i], t_max, margin, reference);
+			if (hit >= 0 && (out[i] != hit || (hit && std::fabs(tHits[i] - reference) > Margin * (1.0 + reference))))
+				return FailCheck(failure, "ray_aabb: box " + std::to_string(i) + " differs from the reference");
+			expected += out[i];
+		}
+		if (hits != expected)
+			return FailCheck(failure, "ray_aabb: wrong hit count");
+		return true;
+	}
+
+	bool CheckRays(std::string& failure)
+	{
+		std::mt19937 random(2);
+		std::vector<aabb> boxes(TestCount);
+		for (aabb& b : boxes)
+			b = RandomBox(random, 20.0f, 3.0f);
+		for (int i = 0; i < 50; i++)
+		{
+			const vec3f origin = RandomPoint(random, 30.0f);
+			if (!CheckRay(ray(origin, RandomPoint(random, 10.0f) - origin), boxes, 2.0f, Margin, failure))
+				return false;
+		}
+
+		// Boxes with integer corners, and rays along and between the axes from integer points, many of
+		// them parallel to a face they start on. The direction has both signs of zero
+		std::vector<aabb> grid;
+		for (int x = -2; x <= 1; x++)
+			for (int y = -2; y <= 1; y++)
+				grid.push_back(aabb(vec3f((float)x, (float)y, -1.0f), vec3f(x + 1.0f + (y & 1), y + 1.0f, 1.0f + (x & 1))));
+		const float components[] = { -1.0f, -0.0f, 0.0f, 1.0f };
+		unsigned onFace = 0;
+		for (float dx : components)
+		{
+			for (float dy : components)
+			{
+				for (float dz : components)
+				{
+					if (dx == 0.0f && dy == 0.0f && dz == 0.0f)
+						continue;
+					for (int o = 0; o < 27; o++)
+					{
+						const ray r(vec3f(o % 3 - 1.0f, o / 3 % 3 - 1.0f, o / 9 - 1.0f), vec3f(dx, dy, dz));
+						if (!CheckRay(r, grid, 10.0f, 0.0, failure))
+							return false;
+						for (const aabb& b : grid)
+						{
+							for (int a = 0; a < 3; a++)
+								onFace += r.dir.vec[a] == 0.0f && (r.origin.vec[a] == b.min.vec[a] || r.origin.vec[a] == b.max.vec[a]);
+						}
+					}
+				}
+			}
+		}
+		if (!onFace)
+			return FailCheck(failure, "ray_aabb: no ray started on a face parallel to it");
+		return true;
+	}
+
+	bool CheckOverlap(std::string& failure)
+	{
+		std::mt19937 random(3);
+		std::vector<aabb> boxes(TestCount);
+		for (aabb& b : boxes)
+			b = RandomBox(random, 20.0f, 3.0f);
+		// Touching faces count as overlapping
+		boxes[0] = aabb(vec3f(5.0f, -1.0f, -1.0f), vec3f(6.0f, 1.0f, 1.0f));
+		const aabb query(vec3f(-5.0f, -5.0f, -5.0f), vec3f(5.0f, 5.0f, 5.0f));
+
+		std::vector<uint8_t> out(TestCount);
+		const size_t hits = overlap(query, boxes.data(), TestCount, out.data());
+		size_t expected = 0;
+		for (unsigned i = 0; i < TestCount; i++)
+		{
+			if (out[i] != (uint8_t)query.overlaps(boxes[i]))
+				return FailCheck(failure, "aabb_overlap: box " + std::to_string(i) + " differs from the scalar test");
+			expected += out[i];
+		}
+		if (hits != expected || !out[0] || !hits || hits == TestCount)
+			return FailCheck(failure, "aabb_overlap: wrong overlap count");
+		return true;
+	}
+
+	bool CheckMerge(std::string& failure)
+	{
+		// Points padded to 16 bytes as well as packed, and a point with a NaN coordinate, which both skip
+		struct PaddedPoint
+		{
+			vec3f Position;
+			float Padding;
+		};
+		std::mt19937 random(4);
+		std::vector<PaddedPoint> padded(TestCount);
+		std::vector<vec3f> packed(TestCount);
+		for (unsigned i = 0; i < TestCount; i++)
+		{
+			packed[i] = RandomPoint(random, 100.0f);
+			padded[i] = { packed[i], NAN };
+		}
+		packed[TestCount / 2].y = NAN;
+		padded[TestCount / 2].Position.y = NAN;
+
+		for (size_t count : { 0, 1, 2, 5, (int)TestCount })
+		{
+			aabb reference;
+			for (size_t i = 0; i < count; i++)
+				reference.merge(packed[i]);
+			if (!SameBounds(merge(packed.data(), count), reference) || !SameBounds(merge(&padded[0].Position, count, sizeof(PaddedPoint)), reference))
+				return FailCheck(failure, "merge_points: " + std::to_string(count) + " points differ from merging them one by one");
+		}
+
+		std::vector<aabb> boxes(TestCount);
+		aabb reference;
+		for (aabb& b : boxes)
+			reference.merge(b = RandomBox(random, 50.0f, 5.0f));
+		if (!SameBounds(merge(boxes.data(), boxes.size()), reference) || !merge(boxes.data(), 0).empty())
+			return FailCheck(failure, "merge_boxes: differ from merging them one by one");
+		return true;
+	}
+
+	template<class Batched, class Scalar>
+	BoundsTiming TimeTest(const char* name, unsigned volumes, unsigned frames, Batched batched, Scalar scalar)
+	{
+		BoundsTiming timing;
+		timing.Name = name;
+		timing.Volumes = volumes;
+		timing.Matched = true;
+		std::vector<double> batchedTimes, scalarTimes;
+		for (unsigned frame = 0; frame < frames; frame++)
+		{
+			int64_t start = Profiler::Now();
+			const size_t positives = batched();
+			batchedTimes.push_back(MillisecondsSince(start));
+
+			start = Profiler::Now();
+			const size_t scalarPositives = scalar();
+			scalarTimes.push_back(MillisecondsSince(start));
+
+			timing.Positives = (unsigned)positives;
+			timing.Matched = timing.Matched && positives == scalarPositives;
+		}
+		timing.BatchedMilliseconds = BenchmarkSummary::Compute(batchedTimes);
+		timing.ScalarMilliseconds = BenchmarkSummary::Compute(scalarTimes);
+		return timing;
+	}
+}
+
+bool RunBoundsTest(std::string& failure)
+{
+	return CheckFrustum(failure) && CheckRays(failure) && CheckOverlap(failure) && CheckMerge(failure);
+}
+
+std::vector<BoundsTiming> RunBoundsTimings(unsigned volumes, unsigned frames)
+{
+	std::mt19937 random(5);
+	std::vector<aabb> boxes(volumes);
+	std::vector<sphere> spheres(volumes);
+	std::vector<vec3f> points(volumes);
+	for (unsigned i = 0; i < volumes; i++)
+	{
+		boxes[i] = RandomBox(random, 60.0f, 2.0f);
+		spheres[i] = sphere::from_aabb(boxes[i]);
+		points[i] = boxes[i].center();
+	}
+	std::vector<uint8_t> out(volumes);
+
+	const frustum f = TestFrustum();
+	const ray r(vec3f(-60.0f, -50.0f, -40.0f), vec3f(1.0f, 0.9f, 0.7f));
+	const aabb query(vec3f(-20.0f, -20.0f, -20.0f), vec3f(20.0f, 20.0f, 20.0f));
+	std::vector<BoundsTiming> timings;
+
+	timings.push_back(TimeTest("frustum_aabb", volumes, frames,
+		[&]() { return frustum_cull(f, boxes.data(), volumes, out.data()); },
+		[&]()
+		{
+			size_t visible = 0;
+			for (unsigned i = 0; i < volumes; i++)
+				visible += out[i] = (uint8_t)f.intersects(boxes[i]);
+			return visible;
+		}));
+
+	timings.push_back(TimeTest("frustum_sphere", volumes, frames,
+		[&]() { return frustum_cull(f, spheres.data(), volumes, out.data()); },
+		[&]()
+		{
+			size_t visible = 0;
+			for (unsigned i = 0; i < volumes; i++)
+				visible += out[i] = (uint8_t)f.intersects(spheres[i]);
+			return visible;
+		}));
+
+	std::vector<float> tHits(volumes);
+	timings.push_back(TimeTest("ray_aabb", volumes, frames,
+		[&]() { return intersect(r, boxes.data(), volumes, 200.0f, out.data(), tHits.data()); },
+		[&]()
+		{
+			size_t hits = 0;
+			for (unsigned i = 0; i < volumes; i++)
+			{
+				float t = (float)fINF;
+				hits += out[i] = (uint8_t)intersect(r, boxes[i], 200.0f, t);
+				tHits[i] = out[i] ? t : (float)fINF;
+			}
+			return hits;
+		}));
+
+	timings.push_back(TimeTest("aabb_overlap", volumes, frames,
+		[&]() { return overlap(query, boxes.data(), volumes, out.data()); },
+		[&]()
+		{
+			size_t hits = 0;
+			for (unsigned i = 0; i < volumes; i++)
+				hits += out[i] = (uint8_t)query.overlaps(boxes[i]);
+			return hits;
+		}));
+
+	aabb batchedBounds, scalarBounds;
+	timings.push_back(TimeTest("merge_points", volumes, frames,
+		[&]() { batchedBounds = merge(points.data(), volumes); return (size_t)0; },
+		[&]()
+		{
+			scalarBounds = aabb();
+			for (unsigned i = 0; i < volumes; i++)
+				scalarBounds.merge(points[i]);
+			return (size_t)0;
+		}));
+	timings.back().Matched = SameBounds(batchedBounds, scalarBounds);
+	return timings;
+}
+
+bool RunBoundsBenchmark(unsigned volumes, unsigned frames, const std::string& report_filename)
+{
+	std::string testFailure;
+	const bool passed = RunBoundsTest(testFailure);
+	printf("Bounds self test: %s\n", passed ? "passed" : testFailure.c_str());
+
+	printf("Bounds tests, %u volumes, %u frames...\n", volumes, frames);
+	printf("\t%14s %12s %12s %10s %14s\n", "Test", "Batched ms", "Scalar ms", "Speedup", "Mvolumes/s");
+	const std::vector<BoundsTiming> timings = RunBoundsTimings(volumes, frames);
+	bool matched = true;
+	for (const BoundsTiming& timing : timings)
+	{
+		const double batched = timing.BatchedMilliseconds.P50, scalar = timing.ScalarMilliseconds.P50;
+		printf("\t%14s %12.3f %12.3f %10.2f %14.1f%s\n", timing.Name, batched, scalar, batched > 0.0 ? scalar / batched : 0.0,
+			batched > 0.0 ? timing.Volumes / batched * 1e-3 : 0.0, timing.Matched ? "" : "  MISMATCH");
+		matched = matched && timing.Matched;
+	}
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(testFailure);
+		json.Key("volumes").Value(volumes);
+		json.Key("frames").Value(frames);
+		json.Key("tests").BeginArray();
+		for (const BoundsTiming& timing : timings)
+		{
+			json.BeginObject();
+			json.Key("name").Value(timing.Name);
+			json.Key("positives").Value(timing.Positives);
+			json.Key("matched").Value(timing.Matched);
+			json.Key("batched_p50_ms").Value(timing.BatchedMilliseconds.P50);
+			json.Key("batched_p95_ms").Value(timing.BatchedMilliseconds.P95);
+			json.Key("scalar_p50_ms").Value(timing.ScalarMilliseconds.P50);
+			json.Key("scalar_p95_ms").Value(timing.ScalarMilliseconds.P95);
+			json.EndObject();
+		}
+		json.EndArray();
+	});
+	return passed && matched && written;
+}
@@ -0,0 +1,53 @@
+/**
+ * @file boundsbenchmark.h
+ * @brief Self test of the batched bounding volume tests and their throughput
+ * @details The test runs the batched frustum, ray, overlap and merge functions of vec/bounds.h, which take
+ * four volumes at a time with SSE2, over volumes inside, outside and straddling the query, and checks every
+ * result against the single-volume scalar test and against a brute-force reference in double precision.
+ * Rays parallel to an axis that start on a face of a box, where the slab distances are 0 * inf = NaN, are
+ * tested explicitly. The benchmark times each batched function against a loop of the scalar tests.
+*/
+
+#pragma once
+#ifndef BOUNDSBENCHMARK_H
+#define BOUNDSBENCHMARK_H
+
+#include <string>
+#include <vector>
+#include "benchmark.h"
+
+//! Volumes per batch of -boundsbenchmark
+#define BOUNDSBENCHMARK_DEFAULT_VOLUMES 100000
+
+//! Frames per function of -boundsbenchmark
+#define BOUNDSBENCHMARK_DEFAULT_FRAMES 100
+
+/**
+ * @brief Cost of one batched test over all volumes, against the scalar test of each volume.
+*/
+struct BoundsTiming
+{
+	const char* Name = ""; //!< "frustum_aabb", "frustum_sphere", "ray_aabb", "aabb_overlap" or "merge_points"
+	unsigned Volumes = 0; //!< Volumes per frame
+	unsigned Positives = 0; //!< Visible, hit or overlapping volumes per frame, 0 for merge_points
+	bool Matched = false; //!< True if the batched and the scalar test gave the same result
+	BenchmarkSummary BatchedMilliseconds; //!< Batched function per frame
+	BenchmarkSummary ScalarMilliseconds; //!< Scalar test of each volume per frame
+};
+
+/**
+ * @brief Run the self test of the batched tests of vec/bounds.h.
+*/
+bool RunBoundsTest(std::string& failure);
+
+/**
+ * @brief Time every batched test against its scalar loop.
+*/
+std::vector<BoundsTiming> RunBoundsTimings(unsigned volumes, unsigned frames);
+
+/**
+ * @brief Run the self test and time every batched test.
+*/
+bool RunBoundsBenchmark(unsigned volumes, unsigned frames, const std::string& report_filename);
+
+#endif
@@ -0,0 +1,119 @@
+//
+// Batched transformation buffers
+//
+// The normal matrix of a model with columns a, b, c in its upper 3x3 has the
+// columns b x c, c x a and a x b divided by the determinant a . (b x c): the
+// rows of the inverse, as columns. With SSE2 one matrix column fits in one
+// register, so a model is its four columns loaded once, and both products
+// are broadcasts and shuffles of them.
+//
+
+#include "buffers.h"
+
+#ifdef LINALG_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace linalg;
+
+namespace
+{
+	// Position of the camera, -R^T t for the rotation R and translation t of the view matrix
+	vec4f CameraPosition(const mat4f& world_to_view)
+	{
+		const vec3f t = world_to_view.col[3].xyz();
+		return vec4f(-world_to_view.col[0].xyz().dot(t), -world_to_view.col[1].xyz().dot(t), -world_to_view.col[2].xyz().dot(t), 1.0f);
+	}
+
+#ifdef LINALG_SSE2
+	inline __m128 Splat(__m128 v, int lane)
+	{
+		switch (lane)
+		{
+		case 0: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+		case 1: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+		case 2: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+		default: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+	}
+
+	// Cross product of the xyz of two columns, 0 in w
+	inline __m128 Cross(__m128 a, __m128 b)
+	{
+		const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+		return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+#endif
+}
+
+void FillTransformationBuffers(const mat4f* model_to_world, size_t count, const mat4f& world_to_view, const mat4f& projection,
+	TransformationBuffer* out, size_t stride)
+{
+	const mat4f viewProjection = projection * world_to_view;
+	const vec4f cameraPosition = CameraPosition(world_to_view);
+	char* buffer = (char*)out;
+
+#ifdef LINALG_SSE2
+	const __m128 vp0 = _mm_loadu_ps(&viewProjection.col[0].x), vp1 = _mm_loadu_ps(&viewProjection.col[1].x);
+	const __m128 vp2 = _mm_loadu_ps(&viewProjection.col[2].x), vp3 = _mm_loadu_ps(&viewProjection.col[3].x);
+	const __m128 lastColumn = _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f);
+	const __m128 xyzMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+
+	for (size_t i = 0; i < count; i++, buffer += stride)
+	{
+		TransformationBuffer* target = (TransformationBuffer*)buffer;
+		const float* m = &model_to_world[i].col[0].x;
+		const __m128 c[4] = { _mm_loadu_ps(m), _mm_loadu_ps(m + 4), _mm_loadu_ps(m + 8), _mm_loadu_ps(m + 12) };
+
+		// Members are written in order, whole matrices at a time
+		float* model = &target->ModelToWorldMatrix.col[0].x;
+		for (int j = 0; j < 4; j++)
+			_mm_storeu_ps(model + 4 * j, c[j]);
+		target->WorldToViewMatrix = world_to_view;
+		target->ProjectionMatrix = projection;
+
+		// Each column of the product is the view-projection columns weighted by a model column
+		float* mvp = &target->ModelViewProjectionMatrix.col[0].x;
+		for (int j = 0; j < 4; j++)
+		{
+			const __m128 column = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(vp0, Splat(c[j], 0)), _mm_mul_ps(vp1, Splat(c[j], 1))),
+				_mm_add_ps(_mm_mul_ps(vp2, Splat(c[j], 2)), _mm_mul_ps(vp3, Splat(c[j], 3))));
+			_mm_storeu_ps(mvp + 4 * j, column);
+		}
+
+		// A degenerate model gets a zero normal matrix rather than infinities
+		const __m128 a = _mm_and_ps(c[0], xyzMask), b = _mm_and_ps(c[1], xyzMask), d = _mm_and_ps(c[2], xyzMask);
+		const __m128 bd = Cross(b, d), da = Cross(d, a), ab = Cross(a, b);
+		__m128 det = _mm_mul_ps(a, bd);
+		det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(2, 3, 0, 1)));
+		det = _mm_add_ps(det, _mm_shuffle_ps(det, det, _MM_SHUFFLE(0, 1, 2, 3)));
+		const __m128 inverseDet = _mm_and_ps(_mm_div_ps(_mm_set1_ps(1.0f), det), _mm_cmpneq_ps(det, _mm_setzero_ps()));
+
+		float* normal = &target->NormalMatrix.col[0].x;
+		_mm_storeu_ps(normal, _mm_mul_ps(bd, inverseDet));
+		_mm_storeu_ps(normal + 4, _mm_mul_ps(da, inverseDet));
+		_mm_storeu_ps(normal + 8, _mm_mul_ps(ab, inverseDet));
+		_mm_storeu_ps(normal + 12, lastColumn);
+		target->CameraPosition = cameraPosition;
+	}
+#else
+	for (size_t i = 0; i < count; i++, buffer += stride)
+	{
+		TransformationBuffer* target = (TransformationBuffer*)buffer;
+		const mat4f& m = model_to_world[i];
+		const vec3f a = m.col[0].xyz(), b = m.col[1].xyz(), c = m.col[2].xyz();
+		const float det = a.dot(b % c);
+		const float inverseDet = det != 0.0f ? 1.0f / det : 0.0f;
+
+		target->ModelToWorldMatrix = m;
+		target->WorldToViewMatrix = world_to_view;
+		target->ProjectionMatrix = projection;
+		target->ModelViewProjectionMatrix = viewProjection * m;
+		target->NormalMatrix = mat4f(mat3f((b % c) * inverseDet, (c % a) * inverseDet, (a % b) * inverseDet));
+		target->CameraPosition = cameraPosition;
+	}
+#endif
+}
@@ -5,14 +5,34 @@
 
 #pragma once
 
+#include <cstddef>
 #include "vec/mat.h"
 
 /**
  * @brief Contains transformation matrices.
+ * @details The last three members are derived from the first three by FillTransformationBuffers(),
+ * once per draw on the CPU instead of for every vertex in the vertex shader.
 */
 struct TransformationBuffer
 {
 	linalg::mat4f ModelToWorldMatrix; //!< Matrix for converting from object space to world space.
 	linalg::mat4f WorldToViewMatrix; //!< Matrix for converting from world space to view space.
 	linalg::mat4f ProjectionMatrix; //!< Matrix for converting from view space to clip cpace.
-};
\ No newline at end of file
+	linalg::mat4f ModelViewProjectionMatrix; //!< ProjectionMatrix * WorldToViewMatrix * ModelToWorldMatrix.
+	linalg::mat4f NormalMatrix; //!< Inverse transpose of the upper 3x3 of ModelToWorldMatrix, for normals.
+	linalg::vec4f CameraPosition; //!< Position of the camera in world space, w = 1.
+};
+
+/**
+ * @brief Fill the transformation buffers of many models seen by one camera.
+ * @details The model-view-projection and normal matrices are computed in one batched pass, with SSE2
+ * where available. The buffers are written in order and never read, so they may be mapped memory.
+ * @param[in] model_to_world Model-to-world matrix of each model.
+ * @param[in] count Number of models.
+ * @param[in] world_to_view View matrix of the camera.
+ * @param[in] projection Projection matrix of the camera.
+ * @param[out] out Buffer of the first model.
+ * @param[in] stride Bytes from one buffer to the next, e.g. the alignment of a constant buffer range.
+*/
+void FillTransformationBuffers(const linalg::mat4f* model_to_world, size_t count, const linalg::mat4f& world_to_view,
+	const linalg::mat4f& projection, TransformationBuffer* out, size_t stride = sizeof(TransformationBuffer));
@@ -0,0 +1,360 @@
+//
+// Bounding volume hierarchy, binned SAH build
+//
+// Nodes are allocated in pairs from an atomic counter, so a parent always
+// has a lower index than its children. Refit relies on this and can update
+// the whole tree with a single backwards pass over the node array.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "bvh.h"
+#include "jobsystem.h"
+
+using namespace linalg;
+
+struct BVH::BuildContext
+{
+	const aabb* PrimitiveBounds;
+	std::vector<vec3f> Centroids;
+	unsigned MaxLeafSize;
+	std::atomic<uint32_t> NodeCount;
+	std::atomic<unsigned> Leaves;
+	std::atomic<unsigned> MaxDepth;
+};
+
+namespace
+{
+	struct SAHBin
+	{
+		aabb Bounds;
+		uint32_t Count = 0;
+	};
+
+	// Cost of traversing an inner node, relative to testing one primitive
+	const float TraversalCost = 1.0f;
+
+	// Classification of a box against a frustum
+	enum class FrustumTest { Outside, Intersecting, Inside };
+
+	FrustumTest Classify(const frustum& f, const aabb& box)
+	{
+		const vec3f c = box.center(), e = box.extents();
+		FrustumTest result = FrustumTest::Inside;
+		for (const plane& p : f.planes)
+		{
+			const float d = p.distance(c);
+			const float r = e.x * std::fabs(p.n.x) + e.y * std::fabs(p.n.y) + e.z * std::fabs(p.n.z);
+			if (d + r < 0.0f)
+				return FrustumTest::Outside;
+			if (d - r < 0.0f)
+				result = FrustumTest::Intersecting;
+		}
+		return result;
+	}
+}
+
+void BVH::Build(const aabb* primitive_bounds, size_t count, unsigned max_leaf_size)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	m_nodes.clear();
+	m_primitive_indices.resize(count);
+	m_primitive_bounds.assign(primitive_bounds, primitive_bounds + count);
+	m_build_stats = BVHBuildStats();
+	if (!count)
+		return;
+
+	BuildContext context;
+	context.PrimitiveBounds = primitive_bounds;
+	context.Centroids.resize(count);
+	context.MaxLeafSize = std::max(max_leaf_size, 1u);
+	context.NodeCount = 1;
+	context.Leaves = 0;
+	context.MaxDepth = 0;
+
+	for (uint32_t i = 0; i < (uint32_t)count; i++)
+	{
+		m_primitive_indices[i] = i;
+		context.Centroids[i] = primitive_bounds[i].center();
+	}
+
+	// A binary tree with N leaves has 2N-1 nodes
+	m_nodes.resize(2 * count - 1);
+	BuildNode(context, 0, 0, (uint32_t)count, 0);
+	m_nodes.resize(context.NodeCount);
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	m_build_stats.Nodes = (unsigned)m_nodes.size();
+	m_build_stats.Leaves = context.Leaves;
+	m_build_stats.MaxDepth = context.MaxDepth;
+	m_build_stats.Milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void BVH::BuildNode(BuildContext& context, uint32_t node_index, uint32_t first, uint32_t count, unsigned depth)
+{
+	BVHNode& node = m_nodes[node_index];
+	uint32_t* indices = m_primitive_indices.data() + first;
+
+	// Bounds of the primitives and of their centroids
+	aabb centroidBounds;
+	node.Bounds = aabb();
+	for (uint32_t i = 0; i < count; i++)
+	{
+		node.Bounds.merge(context.PrimitiveBounds[indices[i]]);
+		centroidBounds.merge(context.Centroids[indices[i]]);
+	}
+
+	auto makeLeaf = [&]()
+	{
+		node.Index = first;
+		node.Count = count;
+		context.Leaves++;
+		unsigned maxDepth = context.MaxDepth;
+		while (depth > maxDepth && !context.MaxDepth.compare_exchange_weak(maxDepth, depth));
+	};
+
+	if (count == 1 || depth >= BVH_MAX_DEPTH)
+	{
+		makeLeaf();
+		return;
+	}
+
+	// Evaluate the SAH for splits between bins along each axis
+	float bestCost = (float)fINF;
+	int bestAxis = -1, bestSplit = 0;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float cmin = centroidBounds.min.vec[axis];
+		const float extent = centroidBounds.max.vec[axis] - cmin;
+		if (extent < 1e-12f)
+			continue;
+
+		const float scale = BVH_SAH_BINS / extent;
+		SAHBin bins[BVH_SAH_BINS];
+		for (uint32_t i = 0; i < count; i++)
+		{
+			const int b = std::min(BVH_SAH_BINS - 1, (int)((context.Centroids[indices[i]].vec[axis] - cmin) * scale));
+			bins[b].Bounds.merge(context.PrimitiveBounds[indices[i]]);
+			bins[b].Count++;
+		}
+
+		// Sweep from the right to get the area and count right of each split...
+		float rightCost[BVH_SAH_BINS - 1];
+		aabb rightBounds;
+		uint32_t rightCount = 0;
+		for (int b = BVH_SAH_BINS - 1; b > 0; b--)
+		{
+			rightBounds.merge(bins[b].Bounds);
+			rightCount += bins[b].Count;
+			rightCost[b - 1] = rightCount ? rightBounds.surface_area() * rightCount : 0.0f;
+		}
+
+		// ...and from the left to combine them
+		aabb leftBounds;
+		uint32_t leftCount = 0;
+		for (int b = 0; b < BVH_SAH_BINS - 1; b++)
+		{
+			leftBounds.merge(bins[b].Bounds);
+			leftCount += bins[b].Count;
+			if (!leftCount || leftCount == count)
+				continue;
+
+			const float cost = leftBounds.surface_area() * leftCount + rightCost[b];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = b;
+			}
+		}
+	}
+
+	// Make a leaf if splitting is not expected to pay off
+	const float area = node.Bounds.surface_area();
+	const float splitCost = area > 0.0f ? TraversalCost + bestCost / area : (float)fINF;
+	if (count <= context.MaxLeafSize && splitCost >= (float)count)
+	{
+		makeLeaf();
+		return;
+	}
+
+	uint32_t leftCount = 0;
+	if (bestAxis >= 0)
+	{
+		const float cmin = centroidBounds.min.vec[bestAxis];
+		const float scale = BVH_SAH_BINS / (centroidBounds.max.vec[bestAxis] - cmin);
+		uint32_t* mid = std::partition(indices, indices + count, [&](uint32_t i)
+		{
+			return std::min(BVH_SAH_BINS - 1, (int)((context.Centroids[i].vec[bestAxis] - cmin) * scale)) <= bestSplit;
+		});
+		leftCount = (uint32_t)(mid - indices);
+	}
+	if (leftCount == 0 || leftCount == count)
+	{
+		// All centroids coincide: split in the middle
+		leftCount = count / 2;
+	}
+
+	const uint32_t children = context.NodeCount.fetch_add(2);
+	node.Index = children;
+	node.Count = 0;
+
+	// Build the left subtree as a job if it is large, idle workers steal it
+	if (leftCount > BVH_PARALLEL_THRESHOLD)
+	{
+		JobCounter left;
+		JobSystem::Run([&]()
+		{
+			BuildNode(context, children, first, leftCount, depth + 1);
+		}, &left);
+		BuildNode(context, children + 1, first + leftCount, count - leftCount, depth + 1);
+		JobSystem::Wait(left);
+	}
+	else
+	{
+		BuildNode(context, children, first, leftCount, depth + 1);
+		BuildNode(context, children + 1, first + leftCount, count - leftCount, depth + 1);
+	}
+}
+
+void BVH::Refit(const aabb* primitive_bounds)
+{
+	m_primitive_bounds.assign(primitive_bounds, primitive_bounds + m_primitive_bounds.size());
+
+	// Children always follow their parent, so a backwards pass visits children first
+	for (size_t n = m_nodes.size(); n-- > 0; )
+	{
+		BVHNode& node = m_nodes[n];
+		node.Bounds = aabb();
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.Index; i < node.Index + node.Count; i++)
+				node.Bounds.merge(m_primitive_bounds[m_primitive_indices[i]]);
+		}
+		else
+		{
+			node.Bounds.merge(m_nodes[node.Index].Bounds);
+			node.Bounds.merge(m_nodes[node.Index + 1].Bounds);
+		}
+	}
+}
+
+size_t BVH::QueryFrustum(const frustum& f, std::vector<uint32_t>& result) const
+{
+	if (m_nodes.empty())
+		return 0;
+
+	// Stack entries carry a flag (high bit) telling if the node is known to be fully inside
+	const uint32_t InsideBit = 0x80000000u;
+	uint32_t stack[BVH_MAX_DEPTH + 2];
+	unsigned stackSize = 0;
+	size_t visited = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize)
+	{
+		const uint32_t entry = stack[--stackSize];
+		const BVHNode& node = m_nodes[entry & ~InsideBit];
+		bool inside = (entry & InsideBit) != 0;
+		visited++;
+
+		if (!inside)
+		{
+			const FrustumTest test = Classify(f, node.Bounds);
+			if (test == FrustumTest::Outside)
+				continue;
+			inside = test == FrustumTest::Inside;
+		}
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.Index; i < node.Index + node.Count; i++)
+			{
+				const uint32_t primitive = m_primitive_indices[i];
+				if (inside || node.Count == 1 || f.intersects(m_primitive_bounds[primitive]))
+					result.push_back(primitive);
+			}
+		}
+		else
+		{
+			const uint32_t flag = inside ? InsideBit : 0;
+			stack[stackSize++] = (node.Index + 1) | flag;
+			stack[stackSize++] = node.Index | flag;
+		}
+	}
+	return visited;
+}
+
+size_t BVH::QueryOverlap(const aabb& box, std::vector<uint32_t>& result) const
+{
+	if (m_nodes.empty())
+		return 0;
+
+	uint32_t stack[BVH_MAX_DEPTH + 2];
+	unsigned stackSize = 0;
+	size_t visited = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize)
+	{
+		const BVHNode& node = m_nodes[stack[--stackSize]];
+		visited++;
+
+		if (!box.overlaps(node.Bounds))
+			continue;
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.Index; i < node.Index + node.Count; i++)
+			{
+				const uint32_t primitive = m_primitive_indices[i];
+				if (node.Count == 1 || box.overlaps(m_primitive_bounds[primitive]))
+					result.push_back(primitive);
+			}
+		}
+		else
+		{
+			stack[stackSize++] = node.Index + 1;
+			stack[stackSize++] = node.Index;
+		}
+	}
+	return visited;
+}
+
+BVHRayHit BVH::Raycast(const ray& r, float t_max) const
+{
+	return Raycast(r, t_max, [this](uint32_t primitive, const ray& r, float t_max, float& t_hit)
+	{
+		return intersect(r, m_primitive_bounds[primitive], t_max, t_hit);
+	});
+}
+
+bool IntersectTriangle(const ray& r, const vec3f& v0, const vec3f& v1, const vec3f& v2, float t_max, float& t_hit)
+{
+	const vec3f e1 = v1 - v0;
+	const vec3f e2 = v2 - v0;
+	const vec3f p = r.dir % e2;
+	const float det = e1.dot(p);
+	if (std::fabs(det) < 1e-12f)
+		return false;
+
+	const float idet = 1.0f / det;
+	const vec3f s = r.origin - v0;
+	const float u = s.dot(p) * idet;
+	if (u < 0.0f || u > 1.0f)
+		return false;
+
+	const vec3f q = s % e1;
+	const float v = r.dir.dot(q) * idet;
+	if (v < 0.0f || u + v > 1.0f)
+		return false;
+
+	const float t = e2.dot(q) * idet;
+	if (t < 0.0f || t > t_max)
+		return false;
+
+	t_hit = t;
+	return true;
+}
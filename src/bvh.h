@@ -0,0 +1,216 @@
+/**
+ * @file bvh.h
+ * @brief Bounding volume hierarchy over primitive bounds
+ * @details Builds over any set of primitives given by their AABBs, e.g. drawcalls or triangles.
+ * Nodes are stored in a flat array where the two children of a node are adjacent,
+ * so traversal and refitting never follow pointers.
+*/
+
+#pragma once
+#ifndef BVH_H
+#define BVH_H
+
+#include <cstdint>
+#include <vector>
+#include "vec/bounds.h"
+
+//! Maximum depth of the tree, bounds the traversal stacks
+#define BVH_MAX_DEPTH 48
+
+//! Number of SAH bins per axis
+#define BVH_SAH_BINS 16
+
+//! Subtrees with more primitives than this are built as a separate job
+#define BVH_PARALLEL_THRESHOLD 4096
+
+/**
+ * @brief Node of a BVH.
+ * @details 32 bytes, two nodes per cache line.
+*/
+struct BVHNode
+{
+	linalg::aabb Bounds; //!< Bounds of everything below the node
+	uint32_t Index = 0; //!< Leaf: first entry in the primitive index array. Inner node: index of the left child, the right child follows it.
+	uint32_t Count = 0; //!< Number of primitives in a leaf, 0 for inner nodes
+
+	/**
+	 * @brief True if the node is a leaf.
+	*/
+	bool IsLeaf() const noexcept { return Count > 0; }
+};
+
+/**
+ * @brief Result of a ray query.
+*/
+struct BVHRayHit
+{
+	uint32_t Primitive = UINT32_MAX; //!< Index of the closest primitive hit, UINT32_MAX on miss
+	float Distance = (float)fINF; //!< Ray parameter of the hit
+};
+
+/**
+ * @brief Statistics of the last build.
+*/
+struct BVHBuildStats
+{
+	unsigned Nodes = 0; //!< Number of nodes in the tree
+	unsigned Leaves = 0; //!< Number of leaves
+	unsigned MaxDepth = 0; //!< Depth of the deepest leaf
+	double Milliseconds = 0.0; //!< Wall time of the build
+};
+
+/**
+ * @brief Bounding volume hierarchy built with binned SAH.
+*/
+class BVH
+{
+public:
+	/**
+	 * @brief Build the hierarchy.
+	 * @details Uses the surface area heuristic evaluated over a fixed number of bins per axis.
+	 * Large subtrees are built in parallel as JobSystem jobs.
+	 * @param[in] primitive_bounds Bounds of each primitive.
+	 * @param[in] count Number of primitives.
+	 * @param[in] max_leaf_size Maximum number of primitives in a leaf, only exceeded at the depth limit (BVH_MAX_DEPTH).
+	*/
+	void Build(const linalg::aabb* primitive_bounds, size_t count, unsigned max_leaf_size = 4);
+
+	/**
+	 * @brief Update the node bounds after the primitives have moved, keeping the topology.
+	 * @details Much cheaper than a rebuild, but the tree degrades if primitives move far.
+	 * @param[in] primitive_bounds New bounds of each primitive, same count and order as in Build().
+	*/
+	void Refit(const linalg::aabb* primitive_bounds);
+
+	/**
+	 * @brief Find all primitives whose bounds intersect a frustum.
+	 * @details Subtrees fully inside the frustum are added without further tests.
+	 * @param[in] frustum Frustum in the same space as the primitives.
+	 * @param[out] result Indices of the primitives are appended to this.
+	 * @return Number of nodes visited.
+	*/
+	size_t QueryFrustum(const linalg::frustum& frustum, std::vector<uint32_t>& result) const;
+
+	/**
+	 * @brief Find all primitives whose bounds overlap a box.
+	 * @param[in] box Query box.
+	 * @param[out] result Indices of the primitives are appended to this.
+	 * @return Number of nodes visited.
+	*/
+	size_t QueryOverlap(const linalg::aabb& box, std::vector<uint32_t>& result) const;
+
+	/**
+	 * @brief Find the closest primitive hit by a ray.
+	 * @details Children are visited near to far so that far subtrees can be skipped.
+	 * @param[in] ray Ray to trace.
+	 * @param[in] t_max Hits further away than this are ignored.
+	 * @param[in] primitive_test Callable bool(uint32_t primitive, const linalg::ray&, float t_max, float& t_hit)
+	 * doing the exact test against a primitive, e.g. a ray-triangle test.
+	 * @return Closest hit, if any.
+	*/
+	template<class PrimitiveTest>
+	BVHRayHit Raycast(const linalg::ray& ray, float t_max, PrimitiveTest primitive_test) const;
+
+	/**
+	 * @brief Find the closest primitive hit by a ray, using the primitive bounds as exact shape.
+	*/
+	BVHRayHit Raycast(const linalg::ray& ray, float t_max) const;
+
+	/**
+	 * @brief Get the flat node array, the root is at index 0.
+	*/
+	const std::vector<BVHNode>& GetNodes() const noexcept { return m_nodes; }
+
+	/**
+	 * @brief Get the primitive indices referenced by the leaves.
+	*/
+	const std::vector<uint32_t>& GetPrimitiveIndices() const noexcept { return m_primitive_indices; }
+
+	/**
+	 * @brief Get statistics of the last build.
+	*/
+	const BVHBuildStats& GetBuildStats() const noexcept { return m_build_stats; }
+
+	/**
+	 * @brief Get the bounds of the whole tree.
+	*/
+	linalg::aabb GetBounds() const noexcept { return m_nodes.empty() ? linalg::aabb() : m_nodes[0].Bounds; }
+
+private:
+	struct BuildContext;
+
+	void BuildNode(BuildContext& context, uint32_t node_index, uint32_t first, uint32_t count, unsigned depth);
+
+	std::vector<BVHNode> m_nodes;
+	std::vector<uint32_t> m_primitive_indices;
+	std::vector<linalg::aabb> m_primitive_bounds;
+	BVHBuildStats m_build_stats;
+};
+
+/**
+ * @brief Ray vs. triangle test (Moller-Trumbore).
+ * @param[in] ray Ray to test.
+ * @param[in] v0 First triangle vertex.
+ * @param[in] v1 Second triangle vertex.
+ * @param[in] v2 Third triangle vertex.
+ * @param[in] t_max Hits further away than this are ignored.
+ * @param[out] t_hit Ray parameter of the hit.
+ * @return True on hit, from either side of the triangle.
+*/
+bool IntersectTriangle(const linalg::ray& ray, const linalg::vec3f& v0, const linalg::vec3f& v1, const linalg::vec3f& v2, float t_max, float& t_hit);
+
+template<class PrimitiveTest>
+BVHRayHit BVH::Raycast(const linalg::ray& ray, float t_max, PrimitiveTest primitive_test) const
+{
+	BVHRayHit hit;
+	hit.Distance = t_max;
+	if (m_nodes.empty())
+		return hit;
+
+	float t_node;
+	if (!linalg::intersect(ray, m_nodes[0].Bounds, hit.Distance, t_node))
+		return hit;
+
+	uint32_t stack[BVH_MAX_DEPTH + 2];
+	unsigned stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize)
+	{
+		const BVHNode& node = m_nodes[stack[--stackSize]];
+
+		if (node.IsLeaf())
+		{
+			for (uint32_t i = node.Index; i < node.Index + node.Count; i++)
+			{
+				float t;
+				const uint32_t primitive = m_primitive_indices[i];
+				if (primitive_test(primitive, ray, hit.Distance, t) && t < hit.Distance)
+				{
+					hit.Distance = t;
+					hit.Primitive = primitive;
+				}
+			}
+			continue;
+		}
+
+		// Push the far child first so that the near child is visited first
+		float t_left, t_right;
+		const bool left = linalg::intersect(ray, m_nodes[node.Index].Bounds, hit.Distance, t_left);
+		const bool right = linalg::intersect(ray, m_nodes[node.Index + 1].Bounds, hit.Distance, t_right);
+
+		if (left && right)
+		{
+			const bool leftFirst = t_left <= t_right;
+			stack[stackSize++] = leftFirst ? node.Index + 1 : node.Index;
+			stack[stackSize++] = leftFirst ? node.Index : node.Index + 1;
+		}
+		else if (left)
+			stack[stackSize++] = node.Index;
+		else if (right)
+			stack[stackSize++] = node.Index + 1;
+	}
+	return hit;
+}
+
+#endif
@@ -4,27 +4,131 @@ using namespace linalg;
 
 void Camera::MoveTo(const vec3f& position) noexcept
 {
+	if (position == m_position)
+		return;
 	m_position = position;
+	m_dirty |= DirtyView;
 }
 
 void Camera::Move(const vec3f& direction) noexcept
 {
-	m_position += direction;
+	MoveTo(m_position + direction);
 }
 
-mat4f Camera::WorldToViewMatrix() const noexcept
+void Camera::MoveLocal(const vec3f& direction) noexcept
 {
-	// Assuming a camera's position and rotation is defined by matrices T(p) and R,
-	// the View-to-World transform is T(p)*R (for a first-person style camera).
-	//
-	// World-to-View then is the inverse of T(p)*R;
-	//		inverse(T(p)*R) = inverse(R)*inverse(T(p)) = transpose(R)*T(-p)
-	// Since now there is no rotation, this matrix is simply T(-p)
+	Move((ViewToWorldMatrix() * direction.xyz0()).xyz());
+}
+
+void Camera::SetOrientation(float yaw, float pitch) noexcept
+{
+	// Looking straight up or down would leave the yaw without meaning
+	const float MaxPitch = fPI / 2 - 0.01f;
+	yaw = std::remainder(yaw, 2.0f * fPI);
+	pitch = clamp(pitch, -MaxPitch, MaxPitch);
+	if (yaw == m_yaw && pitch == m_pitch)
+		return;
+	m_yaw = yaw;
+	m_pitch = pitch;
+	m_dirty |= DirtyView;
+}
+
+void Camera::SetAspect(float aspect_ratio) noexcept
+{
+	if (aspect_ratio == m_aspect_ratio)
+		return;
+	m_aspect_ratio = aspect_ratio;
+	m_dirty |= DirtyProjection;
+}
+
+void Camera::SetPlanes(float near_plane, float far_plane) noexcept
+{
+	if (near_plane == m_near_plane && far_plane == m_far_plane)
+		return;
+	m_near_plane = near_plane;
+	m_far_plane = far_plane;
+	m_dirty |= DirtyProjection;
+}
 
-	return mat4f::translation(-m_position);
+const mat4f& Camera::WorldToViewMatrix() const noexcept
+{
+	UpdateMatrices();
+	return m_world_to_view;
+}
+
+const mat4f& Camera::ViewToWorldMatrix() const noexcept
+{
+	UpdateMatrices();
+	return m_view_to_world;
 }
 
-mat4f Camera::ProjectionMatrix() const noexcept
+const mat4f& Camera::ProjectionMatrix() const noexcept
 {
-	return mat4f::projection(m_vertical_fov, m_aspect_ratio, m_near_plane, m_far_plane);
-}
\ No newline at end of file
+	UpdateMatrices();
+	return m_projection;
+}
+
+const mat4f& Camera::InverseProjectionMatrix() const noexcept
+{
+	UpdateMatrices();
+	return m_inverse_projection;
+}
+
+const mat4f& Camera::ViewProjectionMatrix() const noexcept
+{
+	UpdateMatrices();
+	return m_view_projection;
+}
+
+const mat4f& Camera::InverseViewProjectionMatrix() const noexcept
+{
+	UpdateMatrices();
+	return m_inverse_view_projection;
+}
+
+const frustum& Camera::Frustum() const noexcept
+{
+	UpdateMatrices();
+	return m_frustum;
+}
+
+const vec3f* Camera::FrustumCorners() const noexcept
+{
+	UpdateMatrices();
+	return m_frustum_corners;
+}
+
+void Camera::UpdateMatrices() const noexcept
+{
+	if (!m_dirty)
+		return;
+
+	if (m_dirty & DirtyView)
+	{
+		// Assuming a camera's position and rotation is defined by matrices T(p) and R,
+		// the View-to-World transform is T(p)*R (for a first-person style camera).
+		//
+		// World-to-View then is the inverse of T(p)*R;
+		//		inverse(T(p)*R) = inverse(R)*inverse(T(p)) = transpose(R)*T(-p)
+		const mat4f rotation = mat4f::rotation(m_yaw, 0.0f, 1.0f, 0.0f) * mat4f::rotation(m_pitch, 1.0f, 0.0f, 0.0f);
+		mat4f inverseRotation = rotation;
+		inverseRotation.transpose();
+		m_view_to_world = mat4f::translation(m_position) * rotation;
+		m_world_to_view = inverseRotation * mat4f::translation(-m_position);
+	}
+	if (m_dirty & DirtyProjection)
+	{
+		m_projection = mat4f::projection(m_vertical_fov, m_aspect_ratio, m_near_plane, m_far_plane);
+		m_inverse_projection = m_projection.inverse();
+	}
+
+	m_view_projection = m_projection * m_world_to_view;
+	m_inverse_view_projection = m_view_to_world * m_inverse_projection;
+	m_frustum = frustum::from_matrix(m_view_projection);
+	for (int i = 0; i < 8; i++)
+	{
+		const vec4f corner = m_inverse_view_projection * vec4f(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f, 1.0f);
+		m_frustum_corners[i] = corner.xyz() / corner.w;
+	}
+	m_dirty = 0;
+}
@@ -9,9 +9,14 @@
 
 #include "vec\vec.h"
 #include "vec\mat.h"
+#include "vec/bounds.h"
 
 /**
  * @brief Manages camera data, also handles generation of view and projection matrices.
+ * @details The matrices, their inverses and the view frustum are computed when first asked for after the
+ * position, orientation, aspect ratio or clip planes changed, and reused until the next change.
+ * The camera is oriented by a yaw around the world y axis and then a pitch around its own x axis;
+ * with both 0 it looks down -z.
 */
 class Camera
 {
@@ -23,7 +28,7 @@ public:
 	 * @param[in] near_plane Near plane distance.
 	 * @param[in] far_plane Far plane distance, must be larger than the near plane.
 	*/
-	inline constexpr Camera(float vertical_fov, float aspect_ratio, float near_plane, float far_plane) noexcept 
+	inline Camera(float vertical_fov, float aspect_ratio, float near_plane, float far_plane) noexcept
 		: m_vertical_fov(vertical_fov), m_aspect_ratio(aspect_ratio), m_near_plane(near_plane), m_far_plane(far_plane), m_position(0.0f) {}
 
 	/**
@@ -38,27 +43,108 @@ public:
 	*/
 	void Move(const linalg::vec3f& direction) noexcept;
 
+	/**
+	 * @brief Move the camera along a vector in view space, e.g. (0,0,-1) is forward
+	 * @param[in] direction Direction to move along
+	*/
+	void MoveLocal(const linalg::vec3f& direction) noexcept;
+
+	/**
+	 * @brief Set the orientation of the camera.
+	 * @param[in] yaw Angle around the world y axis in radians, positive turns left.
+	 * @param[in] pitch Angle around the camera x axis in radians, positive looks up. Clamped to just short of straight up or down.
+	*/
+	void SetOrientation(float yaw, float pitch) noexcept;
+
+	/**
+	 * @brief Turn the camera, e.g. by mouse movement.
+	 * @param[in] yaw Radians to add to the yaw.
+	 * @param[in] pitch Radians to add to the pitch.
+	*/
+	void Rotate(float yaw, float pitch) noexcept { SetOrientation(m_yaw + yaw, m_pitch + pitch); }
+
 	/**
 	 * @brief Changes the camera aspect ratio.
 	 * @param[in] aspect_ratio New aspect ratio, calculate with width / height
 	*/
-	inline void SetAspect(float aspect_ratio) noexcept { m_aspect_ratio = aspect_ratio; }
+	void SetAspect(float aspect_ratio) noexcept;
+
+	/**
+	 * @brief Changes the clip planes.
+	 * @param[in] near_plane Near plane distance.
+	 * @param[in] far_plane Far plane distance, must be larger than the near plane.
+	*/
+	void SetPlanes(float near_plane, float far_plane) noexcept;
+
+	/**
+	 * @brief Get the position of the camera.
+	*/
+	inline const linalg::vec3f& GetPosition() const noexcept { return m_position; }
+
+	/**
+	 * @brief Get the yaw of the camera in radians, in [-pi, pi].
+	*/
+	inline float GetYaw() const noexcept { return m_yaw; }
+
+	/**
+	 * @brief Get the pitch of the camera in radians.
+	*/
+	inline float GetPitch() const noexcept { return m_pitch; }
 
 	/**
 	 * @brief Get the World-to-View matrix of the camera.
 	 * @return World-to-View matrix.
 	*/
-	linalg::mat4f WorldToViewMatrix() const noexcept;
+	const linalg::mat4f& WorldToViewMatrix() const noexcept;
+
+	/**
+	 * @brief Get the View-to-World matrix, the inverse of WorldToViewMatrix().
+	*/
+	const linalg::mat4f& ViewToWorldMatrix() const noexcept;
 
 	/**
 	 * @brief get the Matrix transforming from View space to Clip space
 	 * @return Projection matrix.
-	 * 
-	 * @note In a performance sensitive situation this matrix should be precomputed if possible
 	*/
-	linalg::mat4f ProjectionMatrix() const noexcept;
+	const linalg::mat4f& ProjectionMatrix() const noexcept;
+
+	/**
+	 * @brief Get the matrix transforming from Clip space to View space, the inverse of ProjectionMatrix().
+	*/
+	const linalg::mat4f& InverseProjectionMatrix() const noexcept;
+
+	/**
+	 * @brief Get ProjectionMatrix() * WorldToViewMatrix(), transforming from World space to Clip space.
+	*/
+	const linalg::mat4f& ViewProjectionMatrix() const noexcept;
+
+	/**
+	 * @brief Get the inverse of ViewProjectionMatrix(), e.g. to unproject a point of the screen.
+	*/
+	const linalg::mat4f& InverseViewProjectionMatrix() const noexcept;
+
+	/**
+	 * @brief Get the view frustum, with its planes in world space.
+	*/
+	const linalg::frustum& Frustum() const noexcept;
+
+	/**
+	 * @brief Get the corners of the view frustum in world space.
+	 * @return Eight corners, near plane first. Corner i has x at the right if bit 0 is set,
+	 * y at the top if bit 1 is set and lies on the far plane if bit 2 is set.
+	*/
+	const linalg::vec3f* FrustumCorners() const noexcept;
 
 private:
+	enum Dirty : unsigned
+	{
+		DirtyView = 1 << 0,
+		DirtyProjection = 1 << 1,
+	};
+
+	// Recompute what changed since the last call
+	void UpdateMatrices() const noexcept;
+
 	// Aperture attributes
 	float m_vertical_fov;
 	float m_aspect_ratio;
@@ -73,6 +159,19 @@ private:
 	float m_far_plane;
 
 	linalg::vec3f m_position;
+	float m_yaw = 0.0f;
+	float m_pitch = 0.0f;
+
+	// Derived from the above when first asked for after a change
+	mutable unsigned m_dirty = DirtyView | DirtyProjection;
+	mutable linalg::mat4f m_world_to_view;
+	mutable linalg::mat4f m_view_to_world;
+	mutable linalg::mat4f m_projection;
+	mutable linalg::mat4f m_inverse_projection;
+	mutable linalg::mat4f m_view_projection;
+	mutable linalg::mat4f m_inverse_view_projection;
+	mutable linalg::frustum m_frustum;
+	mutable linalg::vec3f m_frustum_corners[8];
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,51 @@
+//
+// Constant allocator
+//
+// A pointer bump with the size rounded up to the alignment, so every offset
+// stays aligned without padding the start of an allocation. Offsets are kept
+// in 32 bits, as the constant ranges they become are.
+//
+
+#include "constantallocator.h"
+
+size_t ConstantAllocator::AlignSize(size_t size) noexcept
+{
+	return (size + CONSTANTALLOCATOR_ALIGNMENT - 1) & ~(size_t)(CONSTANTALLOCATOR_ALIGNMENT - 1);
+}
+
+void ConstantAllocator::GetConstantRange(uint32_t offset, size_t size, uint32_t& first_constant, uint32_t& constant_count) noexcept
+{
+	first_constant = offset / CONSTANTALLOCATOR_CONSTANT_SIZE;
+	constant_count = (uint32_t)(AlignSize(size) / CONSTANTALLOCATOR_CONSTANT_SIZE);
+}
+
+void ConstantAllocator::Begin(void* data, size_t capacity) noexcept
+{
+	m_data = (char*)data;
+	m_capacity = data ? capacity : 0;
+	m_used = 0;
+	m_frame = ConstantAllocatorStats();
+	m_frame.CapacityBytes = m_capacity;
+}
+
+void* ConstantAllocator::Allocate(size_t size, uint32_t& offset) noexcept
+{
+	const size_t aligned = AlignSize(size);
+	if (!m_data || aligned == 0 || aligned > m_capacity - m_used)
+	{
+		m_frame.Failures++;
+		return nullptr;
+	}
+	offset = (uint32_t)m_used;
+	m_used += aligned;
+	m_frame.Allocations++;
+	return m_data + offset;
+}
+
+void ConstantAllocator::End() noexcept
+{
+	m_frame.UsedBytes = m_used;
+	m_last_frame = m_frame;
+	m_data = nullptr;
+	m_capacity = 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file constantallocator.h
+ * @brief Frame-scoped linear allocator for shader constants
+ * @details The constants of every draw of a frame are packed one after the other into one large constant
+ * buffer that is mapped once per frame, instead of mapping a small buffer for each draw. Allocations start
+ * at multiples of CONSTANTALLOCATOR_ALIGNMENT bytes, the granularity at which a range of a constant buffer
+ * can be bound, and are never freed one by one; the next Begin() starts over at offset 0.
+*/
+
+#pragma once
+#ifndef CONSTANTALLOCATOR_H
+#define CONSTANTALLOCATOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+//! Alignment of allocations in bytes, 16 constants of 16 bytes
+#define CONSTANTALLOCATOR_ALIGNMENT 256
+
+//! Bytes per shader constant, the unit of bound ranges
+#define CONSTANTALLOCATOR_CONSTANT_SIZE 16
+
+/**
+ * @brief Allocations of one frame of a ConstantAllocator.
+*/
+struct ConstantAllocatorStats
+{
+	unsigned Allocations = 0; //!< Successful calls to Allocate()
+	unsigned Failures = 0; //!< Calls to Allocate() that did not fit
+	size_t UsedBytes = 0; //!< Bytes allocated, including alignment padding
+	size_t CapacityBytes = 0; //!< Bytes of the memory allocated from
+};
+
+/**
+ * @brief Linear allocator over the mapped memory of a constant buffer.
+ * @details Not thread safe.
+*/
+class ConstantAllocator
+{
+public:
+	/**
+	 * @brief Round a size up to a multiple of CONSTANTALLOCATOR_ALIGNMENT.
+	*/
+	static size_t AlignSize(size_t size) noexcept;
+
+	/**
+	 * @brief Get the range of shader constants of an allocation, as VSSetConstantBuffers1() takes it.
+	 * @param[in] offset Offset returned by Allocate().
+	 * @param[in] size Size passed to Allocate().
+	 * @param[out] first_constant Index of the first constant.
+	 * @param[out] constant_count Number of constants, a multiple of 16.
+	*/
+	static void GetConstantRange(uint32_t offset, size_t size, uint32_t& first_constant, uint32_t& constant_count) noexcept;
+
+	/**
+	 * @brief Start allocating from memory, e.g. a mapped constant buffer.
+	 * @param[in] data Memory to allocate from, at least CONSTANTALLOCATOR_CONSTANT_SIZE aligned.
+	 * @param[in] capacity Size of the memory in bytes.
+	*/
+	void Begin(void* data, size_t capacity) noexcept;
+
+	/**
+	 * @brief Allocate aligned memory for constants.
+	 * @param[in] size Bytes to allocate, rounded up to the alignment.
+	 * @param[out] offset Offset of the allocation from the start of the memory.
+	 * @return The allocation, or nullptr if it does not fit or outside Begin() and End().
+	*/
+	void* Allocate(size_t size, uint32_t& offset) noexcept;
+
+	/**
+	 * @brief Allocate aligned memory for a constant buffer structure.
+	*/
+	template<class T>
+	T* Allocate(uint32_t& offset) noexcept { return (T*)Allocate(sizeof(T), offset); }
+
+	/**
+	 * @brief Stop allocating, making the counts of the frame available from GetStats().
+	*/
+	void End() noexcept;
+
+	/**
+	 * @brief Get the bytes allocated since Begin(), including alignment padding.
+	*/
+	size_t GetUsedBytes() const noexcept { return m_used; }
+
+	/**
+	 * @brief Get the counts of the last frame ended with End().
+	*/
+	const ConstantAllocatorStats& GetStats() const noexcept { return m_last_frame; }
+
+private:
+	char* m_data = nullptr;
+	size_t m_capacity = 0;
+	size_t m_used = 0;
+	ConstantAllocatorStats m_frame;
+	ConstantAllocatorStats m_last_frame;
+};
+
+#endif
@@ -0,0 +1,91 @@
+//
+// Constant allocator self test
+//
+// Runs on static system memory in place of a mapped constant buffer.
+//
+
+#include "constantallocatortest.h"
+#include "benchmark.h"
+#include "constantallocator.h"
+
+namespace
+{
+	// The size of a TransformationBuffer, three matrices
+	struct DrawConstants
+	{
+		float Matrices[3][16];
+	};
+
+	bool CheckPacking(std::string& failure)
+	{
+		alignas(16) static char memory[4 * CONSTANTALLOCATOR_ALIGNMENT];
+		ConstantAllocator allocator;
+		allocator.Begin(memory, sizeof(memory));
+
+		// The constants of a draw take one aligned block, a 300 byte structure two
+		uint32_t offsets[3] = {};
+		char* first = (char*)allocator.Allocate<DrawConstants>(offsets[0]);
+		char* second = (char*)allocator.Allocate(300, offsets[1]);
+		char* third = (char*)allocator.Allocate(1, offsets[2]);
+		if (first != memory || second != memory + offsets[1] || third != memory + offsets[2])
+			return FailCheck(failure, "packing: pointers do not match their offsets");
+		if (offsets[0] != 0 || offsets[1] != CONSTANTALLOCATOR_ALIGNMENT || offsets[2] != 3 * CONSTANTALLOCATOR_ALIGNMENT)
+			return FailCheck(failure, "packing: allocations are not aligned and adjacent");
+
+		uint32_t firstConstant, constantCount;
+		ConstantAllocator::GetConstantRange(offsets[1], 300, firstConstant, constantCount);
+		if (firstConstant != 16 || constantCount != 32)
+			return FailCheck(failure, "packing: wrong constant range");
+
+		// The memory is full, and zero sizes are rejected
+		uint32_t offset = 12345;
+		if (allocator.Allocate(1, offset) || allocator.Allocate(0, offset) || offset != 12345)
+			return FailCheck(failure, "overflow: allocated past the end of the memory");
+		if (allocator.GetUsedBytes() != sizeof(memory))
+			return FailCheck(failure, "overflow: used bytes changed by a failed allocation");
+
+		allocator.End();
+		const ConstantAllocatorStats& stats = allocator.GetStats();
+		if (stats.Allocations != 3 || stats.Failures != 2 || stats.UsedBytes != sizeof(memory) || stats.CapacityBytes != sizeof(memory))
+			return FailCheck(failure, "stats: wrong counts for the frame");
+		return true;
+	}
+
+	bool CheckFrames(std::string& failure)
+	{
+		alignas(16) static char memory[2 * CONSTANTALLOCATOR_ALIGNMENT];
+		ConstantAllocator allocator;
+
+		// Outside of a frame nothing is allocated
+		uint32_t offset = 0;
+		if (allocator.Allocate(16, offset))
+			return FailCheck(failure, "frames: allocated before Begin()");
+
+		for (int frame = 0; frame < 3; frame++)
+		{
+			allocator.Begin(memory, sizeof(memory));
+			if (!allocator.Allocate(16, offset) || offset != 0)
+				return FailCheck(failure, "frames: a new frame does not start at offset 0");
+			allocator.End();
+			if (allocator.Allocate(16, offset))
+				return FailCheck(failure, "frames: allocated after End()");
+		}
+		if (allocator.GetStats().Allocations != 1 || allocator.GetStats().Failures != 0)
+			return FailCheck(failure, "frames: counts not reset by Begin()");
+
+		// Memory that is not mapped holds nothing
+		allocator.Begin(nullptr, sizeof(memory));
+		if (allocator.Allocate(16, offset))
+			return FailCheck(failure, "frames: allocated from no memory");
+		allocator.End();
+		return true;
+	}
+}
+
+bool RunConstantAllocatorTest(std::string& failure)
+{
+	if (ConstantAllocator::AlignSize(1) != CONSTANTALLOCATOR_ALIGNMENT || ConstantAllocator::AlignSize(CONSTANTALLOCATOR_ALIGNMENT) != CONSTANTALLOCATOR_ALIGNMENT ||
+		ConstantAllocator::AlignSize(CONSTANTALLOCATOR_ALIGNMENT + 1) != 2 * CONSTANTALLOCATOR_ALIGNMENT)
+		return FailCheck(failure, "alignment: sizes are not rounded up to the alignment");
+	return CheckPacking(failure) && CheckFrames(failure);
+}
@@ -0,0 +1,19 @@
+/**
+ * @file constantallocatortest.h
+ * @brief Self test of the constant allocator
+ * @details Checks the alignment, packing, overflow and frame counts of ConstantAllocator on system memory,
+ * without a device. Run by -constantbenchmark before the benchmark of constantringbenchmark.h.
+*/
+
+#pragma once
+#ifndef CONSTANTALLOCATORTEST_H
+#define CONSTANTALLOCATORTEST_H
+
+#include <string>
+
+/**
+ * @brief Run the self test of ConstantAllocator.
+*/
+bool RunConstantAllocatorTest(std::string& failure);
+
+#endif
@@ -0,0 +1,80 @@
+//
+// Constant ring
+//
+// The allocator writes straight to the mapped buffer, which may be
+// write-combined memory: constants are written once, in order, and never
+// read back.
+//
+
+#include "constantring.h"
+#include "devicestate.h"
+
+bool ConstantRing::IsSupported(ID3D11Device* device)
+{
+	// Fails on the Direct3D 11.0 runtime, which does not know the structure
+	D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+	return SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) &&
+		options.ConstantBufferOffsetting;
+}
+
+ConstantRing::ConstantRing(ID3D11Device* device, size_t capacity)
+	: m_device(device)
+{
+	Create(capacity);
+}
+
+ConstantRing::~ConstantRing()
+{
+	SAFE_RELEASE(m_buffer);
+}
+
+void ConstantRing::Create(size_t capacity)
+{
+	SAFE_RELEASE(m_buffer);
+	m_capacity = 0;
+
+	D3D11_BUFFER_DESC bufferDesc = { 0 };
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = (UINT)ConstantAllocator::AlignSize(capacity);
+	if (SUCCEEDED(m_device->CreateBuffer(&bufferDesc, nullptr, &m_buffer)))
+	{
+		SETNAME(m_buffer, "ConstantRing");
+		m_capacity = bufferDesc.ByteWidth;
+	}
+}
+
+bool ConstantRing::Begin(ID3D11DeviceContext* context, size_t required)
+{
+	if (required > m_capacity)
+	{
+		size_t capacity = m_capacity ? m_capacity : CONSTANTRING_DEFAULT_CAPACITY;
+		while (capacity < required)
+			capacity *= 2;
+		Create(capacity);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE resource;
+	if (!m_buffer || FAILED(context->Map(m_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &resource)))
+	{
+		m_allocator.Begin(nullptr, 0);
+		m_allocator.End();
+		return false;
+	}
+	m_allocator.Begin(resource.pData, m_capacity);
+	return true;
+}
+
+void ConstantRing::End(ID3D11DeviceContext* context)
+{
+	m_allocator.End();
+	context->Unmap(m_buffer, 0);
+}
+
+void ConstantRing::BindVS(DeviceState& state, UINT slot, uint32_t offset, size_t size) const
+{
+	uint32_t firstConstant, constantCount;
+	ConstantAllocator::GetConstantRange(offset, size, firstConstant, constantCount);
+	state.SetVSConstantBufferRange(slot, m_buffer, firstConstant, constantCount);
+}
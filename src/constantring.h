@@ -0,0 +1,94 @@
+/**
+ * @file constantring.h
+ * @brief One constant buffer for the per-draw constants of a frame
+ * @details The buffer is mapped with WRITE_DISCARD once per frame, filled through a ConstantAllocator,
+ * and each draw binds its range with DeviceState::SetVSConstantBufferRange(). Discarding hands the
+ * driver a fresh copy of the buffer while the GPU still reads the last frames, so the copies form a
+ * ring without the buffer being written twice in a frame. The buffer grows to the largest frame seen.
+ *
+ * Binding ranges needs Direct3D 11.1 with constant buffer offsetting, see IsSupported().
+*/
+
+#pragma once
+#ifndef CONSTANTRING_H
+#define CONSTANTRING_H
+
+#include "stdafx.h"
+#include "constantallocator.h"
+
+//! Bytes of the buffer when created, 256 allocations
+#define CONSTANTRING_DEFAULT_CAPACITY (64 * 1024)
+
+class DeviceState;
+
+/**
+ * @brief Constant buffer that is filled once per frame and bound by ranges.
+*/
+class ConstantRing
+{
+public:
+	/**
+	 * @brief Check if a device can bind ranges of constant buffers.
+	*/
+	static bool IsSupported(ID3D11Device* device);
+
+	/**
+	 * @brief Create the buffer.
+	 * @param[in] device Device to create the buffer on.
+	 * @param[in] capacity Bytes to make room for.
+	*/
+	explicit ConstantRing(ID3D11Device* device, size_t capacity = CONSTANTRING_DEFAULT_CAPACITY);
+
+	/**
+	 * @brief Releases the buffer.
+	*/
+	~ConstantRing();
+
+	ConstantRing(const ConstantRing&) = delete;
+	ConstantRing& operator=(const ConstantRing&) = delete;
+
+	/**
+	 * @brief Map the buffer for the constants of a frame, growing it first if needed.
+	 * @param[in] context Context to map the buffer with.
+	 * @param[in] required Bytes the frame allocates, including alignment, see ConstantAllocator::AlignSize().
+	 * @return False if the buffer could not be created or mapped.
+	*/
+	bool Begin(ID3D11DeviceContext* context, size_t required);
+
+	/**
+	 * @brief Allocate a constant buffer structure between Begin() and End().
+	 * @param[out] offset Offset to bind the structure with.
+	 * @return Memory to write the structure to, nullptr if it did not fit.
+	*/
+	template<class T>
+	T* Allocate(uint32_t& offset) noexcept { return m_allocator.Allocate<T>(offset); }
+
+	/**
+	 * @brief Unmap the buffer, the allocations can be bound after this.
+	*/
+	void End(ID3D11DeviceContext* context);
+
+	/**
+	 * @brief Bind an allocation to a slot of the vertex shader.
+	 * @param[in,out] state State filter to bind through, must support constant buffer ranges.
+	 * @param[in] slot Constant buffer slot.
+	 * @param[in] offset Offset returned by Allocate().
+	 * @param[in] size Size of the allocated structure.
+	*/
+	void BindVS(DeviceState& state, UINT slot, uint32_t offset, size_t size) const;
+
+	/**
+	 * @brief Get the allocations of the last frame.
+	*/
+	const ConstantAllocatorStats& GetStats() const noexcept { return m_allocator.GetStats(); }
+
+private:
+	ID3D11Device* m_device;
+	ID3D11Buffer* m_buffer = nullptr;
+	size_t m_capacity = 0;
+	ConstantAllocator m_allocator;
+
+	void Create(size_t capacity);
+};
+
+#endif
@@ -0,0 +1,196 @@
+//
+// Constant ring benchmark
+//
+// The draws of the benchmark have no input layout, pixel shader or render
+// target: a vertex shader that reads the transformation buffer is all the
+// constants need to be consumed. Every frame is flushed and waited for
+// outside of the timed part, so neither path runs ahead of the GPU.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "constantringbenchmark.h"
+#include "constantallocatortest.h"
+#include "benchmark.h"
+#include "constantring.h"
+#include "devicestate.h"
+#include "buffers.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+namespace
+{
+	const char* const VertexShaderSource =
+		"cbuffer TransformationBuffer : register(b0) { matrix ModelToWorld; matrix WorldToView; matrix Projection; };\n"
+		"float4 main(uint id : SV_VertexID) : SV_Position\n"
+		"{\n"
+		"	return mul(Projection, mul(WorldToView, mul(ModelToWorld, float4(id & 1, id >> 1, 0, 1))));\n"
+		"}\n";
+
+	// Objects of the benchmark device, released when it ends
+	struct BenchmarkDevice
+	{
+		ID3D11Device* Device = nullptr;
+		ID3D11DeviceContext* Context = nullptr;
+		ID3DBlob* Bytecode = nullptr;
+		ID3D11VertexShader* VertexShader = nullptr;
+		ID3D11Buffer* Constants = nullptr;
+		ID3D11Query* Fence = nullptr;
+
+		~BenchmarkDevice()
+		{
+			SAFE_RELEASE(Fence);
+			SAFE_RELEASE(Constants);
+			SAFE_RELEASE(VertexShader);
+			SAFE_RELEASE(Bytecode);
+			SAFE_RELEASE(Context);
+			SAFE_RELEASE(Device);
+		}
+	};
+
+	// One frame of draws; the fence is waited for outside of the timing
+	template<class Submit>
+	double TimeFrame(ID3D11DeviceContext* context, ID3D11Query* fence, Submit submit)
+	{
+		const int64_t start = Profiler::Now();
+		submit();
+		context->End(fence);
+		context->Flush();
+		const double milliseconds = MillisecondsSince(start);
+		while (context->GetData(fence, nullptr, 0, 0) == S_FALSE)
+			;
+		return milliseconds;
+	}
+}
+
+bool RunConstantRingTimings(unsigned objects, unsigned frames, ConstantRingTiming& timing, std::string& failure)
+{
+	timing = ConstantRingTiming();
+	timing.Objects = objects;
+	timing.Frames = frames;
+
+	BenchmarkDevice d3d;
+	const D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_0;
+	if (FAILED(D3D11CreateDevice(nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr, 0, &featureLevel, 1, D3D11_SDK_VERSION, &d3d.Device, nullptr, &d3d.Context)))
+		return FailCheck(failure, "could not create a device");
+	ID3D11DeviceContext* context = d3d.Context;
+
+	DeviceState state(context);
+	if (!ConstantRing::IsSupported(d3d.Device) || !state.SupportsConstantBufferRanges())
+		return FailCheck(failure, "the device can not bind ranges of constant buffers");
+	if (FAILED(D3DCompile(VertexShaderSource, strlen(VertexShaderSource), "constantringbenchmark", nullptr, nullptr, "main", "vs_5_0", 0, 0, &d3d.Bytecode, nullptr)) ||
+		FAILED(d3d.Device->CreateVertexShader(d3d.Bytecode->GetBufferPointer(), d3d.Bytecode->GetBufferSize(), nullptr, &d3d.VertexShader)))
+		return FailCheck(failure, "could not create the vertex shader");
+
+	D3D11_BUFFER_DESC bufferDesc = { 0 };
+	bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = sizeof(TransformationBuffer);
+	const D3D11_QUERY_DESC queryDesc = { D3D11_QUERY_EVENT, 0 };
+	if (FAILED(d3d.Device->CreateBuffer(&bufferDesc, nullptr, &d3d.Constants)) || FAILED(d3d.Device->CreateQuery(&queryDesc, &d3d.Fence)))
+		return FailCheck(failure, "could not create the constant buffer");
+
+	std::vector<linalg::mat4f> transforms(objects);
+	for (unsigned i = 0; i < objects; i++)
+		transforms[i] = linalg::mat4f::translation((float)(i % 100), (float)(i / 100), 0.0f);
+	const linalg::mat4f view = linalg::mat4f::translation(0.0f, 0.0f, -10.0f);
+	const linalg::mat4f projection = linalg::mat4f::projection(1.0f, 1.0f, 1.0f, 100.0f);
+
+	state.SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	state.SetInputLayout(nullptr);
+	state.SetVertexShader(d3d.VertexShader);
+	state.SetPixelShader(nullptr);
+
+	ConstantRing ring(d3d.Device);
+	std::vector<uint32_t> offsets(objects);
+
+	const auto perDrawMap = [&]()
+	{
+		state.SetVSConstantBuffer(0, d3d.Constants);
+		for (unsigned i = 0; i < objects; i++)
+		{
+			D3D11_MAPPED_SUBRESOURCE resource;
+			context->Map(d3d.Constants, 0, D3D11_MAP_WRITE_DISCARD, 0, &resource);
+			TransformationBuffer* matrixBuffer = (TransformationBuffer*)resource.pData;
+			matrixBuffer->ModelToWorldMatrix = transforms[i];
+			matrixBuffer->WorldToViewMatrix = view;
+			matrixBuffer->ProjectionMatrix = projection;
+			context->Unmap(d3d.Constants, 0);
+			context->Draw(3, 0);
+		}
+	};
+	const auto ringMap = [&]()
+	{
+		if (!ring.Begin(context, objects * ConstantAllocator::AlignSize(sizeof(TransformationBuffer))))
+			return;
+		for (unsigned i = 0; i < objects; i++)
+		{
+			TransformationBuffer* matrixBuffer = ring.Allocate<TransformationBuffer>(offsets[i]);
+			matrixBuffer->ModelToWorldMatrix = transforms[i];
+			matrixBuffer->WorldToViewMatrix = view;
+			matrixBuffer->ProjectionMatrix = projection;
+		}
+		ring.End(context);
+		for (unsigned i = 0; i < objects; i++)
+		{
+			ring.BindVS(state, 0, offsets[i], sizeof(TransformationBuffer));
+			context->Draw(3, 0);
+		}
+	};
+
+	// Warm up both paths, then alternate them frame by frame
+	TimeFrame(context, d3d.Fence, perDrawMap);
+	TimeFrame(context, d3d.Fence, ringMap);
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		timing.PerDrawMapMilliseconds += TimeFrame(context, d3d.Fence, perDrawMap);
+		timing.RingMilliseconds += TimeFrame(context, d3d.Fence, ringMap);
+	}
+	if (frames)
+	{
+		timing.PerDrawMapMilliseconds /= frames;
+		timing.RingMilliseconds /= frames;
+	}
+	context->ClearState();
+
+	if (ring.GetStats().Allocations != objects || ring.GetStats().Failures != 0)
+		return FailCheck(failure, "the constant ring could not be mapped");
+	return true;
+}
+
+bool RunConstantRingBenchmark(unsigned objects, unsigned frames, const std::string& report_filename)
+{
+	std::string testFailure;
+	const bool passed = RunConstantAllocatorTest(testFailure);
+	printf("Constant allocator self test: %s\n", passed ? "passed" : testFailure.c_str());
+
+	ConstantRingTiming timing;
+	std::string benchmarkFailure;
+	const bool ran = RunConstantRingTimings(objects, frames, timing, benchmarkFailure);
+	if (ran)
+	{
+		printf("\t%u draws, %u frames\n", timing.Objects, timing.Frames);
+		printf("\tMap per draw: %.3f ms per frame, %.0f ns per draw\n", timing.PerDrawMapMilliseconds,
+			objects ? timing.PerDrawMapMilliseconds * 1e6 / objects : 0.0);
+		printf("\tOne map, range per draw: %.3f ms per frame, %.0f ns per draw\n", timing.RingMilliseconds,
+			objects ? timing.RingMilliseconds * 1e6 / objects : 0.0);
+	}
+	else
+		printf("Constant ring benchmark skipped: %s\n", benchmarkFailure.c_str());
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(testFailure);
+		json.Key("benchmark_ran").Value(ran);
+		json.Key("benchmark_failure").Value(benchmarkFailure);
+		json.Key("objects").Value(timing.Objects);
+		json.Key("frames").Value(timing.Frames);
+		json.Key("map_per_draw_ms").Value(timing.PerDrawMapMilliseconds);
+		json.Key("ring_ms").Value(timing.RingMilliseconds);
+		json.Key("speedup").Value(timing.RingMilliseconds > 0.0 ? timing.PerDrawMapMilliseconds / timing.RingMilliseconds : 0.0);
+	});
+	return passed && ran && written;
+}
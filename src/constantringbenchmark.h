@@ -0,0 +1,49 @@
+/**
+ * @file constantringbenchmark.h
+ * @brief Submit cost of per-draw constants
+ * @details Runs after the self test of constantallocatortest.h. The benchmark creates its own device and
+ * submits a frame of draws that each read a TransformationBuffer, once mapping a small constant buffer per
+ * draw and once writing all of them to a ConstantRing with one map and binding a range per draw, and times
+ * the CPU side of both.
+*/
+
+#pragma once
+#ifndef CONSTANTRINGBENCHMARK_H
+#define CONSTANTRINGBENCHMARK_H
+
+#include <string>
+
+//! Draws per frame of -constantbenchmark
+#define CONSTANTRINGBENCHMARK_DEFAULT_OBJECTS 2000
+
+//! Frames per path of -constantbenchmark
+#define CONSTANTRINGBENCHMARK_DEFAULT_FRAMES 200
+
+/**
+ * @brief Submit times of one run.
+*/
+struct ConstantRingTiming
+{
+	unsigned Objects = 0; //!< Draws per frame
+	unsigned Frames = 0; //!< Frames per path
+	double PerDrawMapMilliseconds = 0.0; //!< Average frame with a map per draw
+	double RingMilliseconds = 0.0; //!< Average frame with one map and a bound range per draw
+};
+
+/**
+ * @brief Time both paths on a new hardware device.
+ * @param[in] objects Draws per frame.
+ * @param[in] frames Frames per path.
+ * @param[out] timing Times of the run.
+ * @param[out] failure Why the device could not run the benchmark, if it returns false.
+ * @return False if no device with constant buffer ranges could be created.
+*/
+bool RunConstantRingTimings(unsigned objects, unsigned frames, ConstantRingTiming& timing, std::string& failure);
+
+/**
+ * @brief Run the self test and time both paths.
+ * @return True if the test passed, the benchmark ran and the report was written.
+*/
+bool RunConstantRingBenchmark(unsigned objects, unsigned frames, const std::string& report_filename);
+
+#endif
@@ -0,0 +1,104 @@
+//
+// CPU visibility culling of drawcall bounds
+//
+
+#include <algorithm>
+#include <chrono>
+#include "culling.h"
+
+using namespace linalg;
+
+size_t CullBounds(
+	const frustum& frustum,
+	const aabb* bounds,
+	size_t count,
+	uint8_t* visibility,
+	CullStats* stats)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	const size_t visible = frustum_cull(frustum, bounds, count, visibility);
+
+	if (stats)
+	{
+		const auto end = std::chrono::high_resolution_clock::now();
+		stats->Tested += (unsigned)count;
+		stats->Visible += (unsigned)visible;
+		stats->Milliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+	return visible;
+}
+
+size_t CullBVH(
+	const frustum& frustum,
+	const BVH& bvh,
+	std::vector<uint32_t>& visible,
+	CullStats* stats)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	visible.clear();
+	const size_t visited = bvh.QueryFrustum(frustum, visible);
+
+	// Keep the original (e.g. material sorted) order
+	std::sort(visible.begin(), visible.end());
+
+	if (stats)
+	{
+		const auto end = std::chrono::high_resolution_clock::now();
+		stats->Tested += (unsigned)visited;
+		stats->Visible += (unsigned)visible.size();
+		stats->Milliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+	return visible.size();
+}
+
+size_t CullOcclusion(
+	OcclusionCuller& occlusion,
+	const mat4f& model_to_clip,
+	const aabb* bounds,
+	size_t count,
+	uint8_t* visibility,
+	CullStats* stats)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	size_t visible = 0, occluded = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!visibility[i])
+			continue;
+		if (occlusion.IsVisible(bounds[i], model_to_clip))
+			visible++;
+		else
+		{
+			visibility[i] = 0;
+			occluded++;
+		}
+	}
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	const double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+	occlusion.AddTestTime(milliseconds);
+	if (stats)
+	{
+		stats->Occluded += (unsigned)occluded;
+		stats->OcclusionMilliseconds += milliseconds;
+	}
+	return visible;
+}
+
+aabb ComputeIndexedBounds(
+	const vec3f* positions,
+	size_t stride,
+	const unsigned* indices,
+	size_t index_count)
+{
+	const char* base = (const char*)positions;
+
+	aabb bounds;
+	for (size_t i = 0; i < index_count; i++)
+		bounds.merge(*(const vec3f*)(base + indices[i] * stride));
+
+	return bounds;
+}
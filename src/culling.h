@@ -0,0 +1,106 @@
+/**
+ * @file culling.h
+ * @brief CPU visibility culling of drawcall bounds
+*/
+
+#pragma once
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "vec/bounds.h"
+#include "bvh.h"
+#include "occlusion.h"
+
+/**
+ * @brief Statistics gathered by the culling functions.
+ * @details Accumulates over all calls until Reset() is called, usually once per frame.
+*/
+struct CullStats
+{
+	unsigned Tested = 0; //!< Number of bounds tested
+	unsigned Visible = 0; //!< Number of bounds that passed the test
+	double Milliseconds = 0.0; //!< Time spent testing
+	unsigned Occluded = 0; //!< Number of visible bounds that were rejected by occlusion culling
+	unsigned OccluderTriangles = 0; //!< Number of occluder triangles rasterized
+	double OcclusionMilliseconds = 0.0; //!< Time spent rasterizing occluders and testing bounds against them
+
+	/**
+	 * @brief Zero all counters.
+	*/
+	void Reset() noexcept { *this = CullStats(); }
+
+	/**
+	 * @brief Number of bounds that were culled.
+	*/
+	unsigned Culled() const noexcept { return Tested - Visible; }
+};
+
+/**
+ * @brief What a model needs to cull itself against the current view.
+*/
+struct CullView
+{
+	linalg::frustum Frustum; //!< View frustum in the object space of the model
+	linalg::mat4f ModelToClip; //!< Object space to clip space matrix
+	OcclusionCuller* Occlusion; //!< Occluder depth buffer to test against, may be nullptr
+	CullStats* Stats; //!< Statistics to accumulate into, may be nullptr
+
+	/**
+	 * @brief Create a view from the combined Model->View->Projection matrix.
+	 * @param[in] model_to_clip ProjectionMatrix * WorldToViewMatrix * ModelToWorldMatrix.
+	 * @param[in,out] stats Statistics to accumulate into, may be nullptr.
+	 * @param[in] occlusion Occluder depth buffer, rasterized for the same view, may be nullptr.
+	*/
+	CullView(const linalg::mat4f& model_to_clip, CullStats* stats = nullptr, OcclusionCuller* occlusion = nullptr)
+		: Frustum(linalg::frustum::from_matrix(model_to_clip)), ModelToClip(model_to_clip), Occlusion(occlusion), Stats(stats) { }
+};
+
+/**
+ * @brief Test an array of bounds against a frustum.
+ * @param[in] frustum Frustum, in the same space as the bounds.
+ * @param[in] bounds Array of bounds to test.
+ * @param[in] count Number of bounds.
+ * @param[out] visibility Receives 1 for each visible bound and 0 for culled bounds.
+ * @param[in,out] stats Statistics to accumulate into, may be nullptr.
+ * @return Number of visible bounds.
+*/
+size_t CullBounds(const linalg::frustum& frustum, const linalg::aabb* bounds, size_t count, uint8_t* visibility, CullStats* stats);
+
+/**
+ * @brief Test the primitives of a BVH against a frustum.
+ * @details Scales with the number of visible primitives rather than the total number,
+ * for use when there are many bounds. CullStats::Tested counts visited nodes.
+ * @param[in] frustum Frustum, in the same space as the BVH.
+ * @param[in] bvh Hierarchy to query.
+ * @param[out] visible Receives the indices of the visible primitives in ascending order.
+ * @param[in,out] stats Statistics to accumulate into, may be nullptr.
+ * @return Number of visible primitives.
+*/
+size_t CullBVH(const linalg::frustum& frustum, const BVH& bvh, std::vector<uint32_t>& visible, CullStats* stats);
+
+/**
+ * @brief Test bounds that passed the frustum test against an occluder depth buffer.
+ * @param[in,out] occlusion Depth buffer with the occluders rasterized.
+ * @param[in] model_to_clip Object space to clip space matrix of the bounds.
+ * @param[in] bounds Array of bounds to test.
+ * @param[in] count Number of bounds.
+ * @param[in,out] visibility Only bounds with a 1 are tested, and set to 0 if occluded.
+ * @param[in,out] stats Statistics to accumulate into, may be nullptr.
+ * @return Number of bounds still visible.
+*/
+size_t CullOcclusion(OcclusionCuller& occlusion, const linalg::mat4f& model_to_clip, const linalg::aabb* bounds, size_t count, uint8_t* visibility, CullStats* stats);
+
+/**
+ * @brief Compute the bounding box of the vertices referenced by a range of indices.
+ * @param[in] positions Pointer to the position of the first vertex.
+ * @param[in] stride Byte distance between consecutive vertex positions.
+ * @param[in] indices Pointer to the first index of the range.
+ * @param[in] index_count Number of indices in the range.
+ * @return Bounding box, empty if index_count is zero.
+*/
+linalg::aabb ComputeIndexedBounds(const linalg::vec3f* positions, size_t stride, const unsigned* indices, size_t index_count);
+
+#endif
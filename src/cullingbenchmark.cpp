@@ -0,0 +1,422 @@
+//
+// Culling self test and benchmark
+//
+// The test view is a camera at the origin looking down -z with a vertical
+// field of view of 90 degrees, an aspect ratio of 1 and planes at 1 and 100,
+// so at z = -10 the frustum spans x and y from -10 to 10.
+//
+// The BVH queries are checked against brute-force loops over the same boxes.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include "cullingbenchmark.h"
+#include "bvh.h"
+#include "culling.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+#include "vertex.h"
+
+using namespace linalg;
+
+namespace
+{
+	mat4f ViewToClip()
+	{
+		return mat4f::projection(fPI / 2.0f, 1.0f, 1.0f, 100.0f);
+	}
+
+	aabb Box(float x, float y, float z, float extent)
+	{
+		return aabb::from_center_extents(vec3f(x, y, z), vec3f(extent, extent, extent));
+	}
+
+	bool SameBounds(const aabb& a, const aabb& b)
+	{
+		return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z &&
+			a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+	}
+
+	bool CheckCullBounds(std::string& failure)
+	{
+		// Seven boxes, so that both the four-wide and the remaining tests run
+		const frustum f = frustum::from_matrix(ViewToClip());
+		const aabb boxes[] =
+		{
+			Box(0.0f, 0.0f, -10.0f, 1.0f), // inside
+			Box(0.0f, 0.0f, 10.0f, 1.0f), // behind the camera
+			Box(0.0f, 0.0f, -200.0f, 1.0f), // beyond the far plane
+			Box(-50.0f, 0.0f, -10.0f, 1.0f), // left of the left plane
+			Box(-10.0f, 0.0f, -10.0f, 1.0f), // straddling the left plane
+			Box(0.0f, 0.5f, -1.0f, 1.0f), // straddling the near and top planes
+			Box(0.0f, 0.0f, 0.0f, 500.0f), // containing the frustum
+		};
+		const uint8_t expected[] = { 1, 0, 0, 0, 1, 1, 1 };
+		const size_t count = sizeof(boxes) / sizeof(boxes[0]);
+
+		CullStats stats;
+		uint8_t visibility[count] = {};
+		if (CullBounds(f, boxes, count, visibility, &stats) != 4)
+			return FailCheck(failure, "cull_bounds: wrong visible count");
+		for (size_t i = 0; i < count; i++)
+		{
+			if (visibility[i] != expected[i])
+				return FailCheck(failure, "cull_bounds: wrong visibility of box " + std::to_string(i));
+		}
+		if (stats.Tested != 7 || stats.Visible != 4 || stats.Culled() != 3)
+			return FailCheck(failure, "cull_bounds: wrong counts");
+
+		// Counts accumulate over calls until Reset(), and no statistics may be given
+		if (CullBounds(f, boxes + 1, 3, visibility, &stats) != 0 || CullBounds(f, boxes, 0, visibility, &stats) != 0 ||
+			CullBounds(f, boxes, count, visibility, nullptr) != 4)
+			return FailCheck(failure, "cull_bounds: wrong visible count of outside boxes");
+		if (stats.Tested != 10 || stats.Visible != 4 || stats.Culled() != 6 || stats.Milliseconds < 0.0)
+			return FailCheck(failure, "cull_bounds: counts did not accumulate");
+		stats.Reset();
+		if (stats.Tested || stats.Visible || stats.Occluded || stats.OccluderTriangles || stats.Milliseconds != 0.0)
+			return FailCheck(failure, "cull_bounds: counts were not reset");
+		return true;
+	}
+
+	bool CheckOcclusion(std::string& failure)
+	{
+		// A wall at z = -5 covering the view
+		const vec3f wall[] = { { -20.0f, -20.0f, -5.0f }, { 20.0f, -20.0f, -5.0f }, { 20.0f, 20.0f, -5.0f }, { -20.0f, 20.0f, -5.0f } };
+		const unsigned wallIndices[] = { 0, 1, 2, 0, 2, 3 };
+		const mat4f viewToClip = ViewToClip();
+		OcclusionCuller occlusion(64, 64);
+		occlusion.BeginFrame();
+		occlusion.AddOccluder(viewToClip, wall, sizeof(vec3f), wallIndices, 6);
+		occlusion.EndFrame();
+
+		const aabb boxes[] =
+		{
+			Box(0.0f, 0.0f, -20.0f, 1.0f), // behind the wall
+			Box(0.0f, 0.0f, -3.0f, 1.0f), // in front of the wall
+			Box(0.0f, 0.0f, -5.0f, 1.0f), // through the wall
+			Box(3.0f, 0.0f, -30.0f, 1.0f), // behind the wall, but already culled
+		};
+		uint8_t visibility[] = { 1, 1, 1, 0 };
+		CullStats stats;
+		if (CullOcclusion(occlusion, viewToClip, boxes, 4, visibility, &stats) != 2)
+			return FailCheck(failure, "cull_occlusion: wrong visible count");
+		if (visibility[0] || !visibility[1] || !visibility[2] || visibility[3])
+			return FailCheck(failure, "cull_occlusion: wrong visibility");
+		if (stats.Occluded != 1 || stats.Tested || stats.OcclusionMilliseconds < 0.0)
+			return FailCheck(failure, "cull_occlusion: wrong counts");
+		return true;
+	}
+
+	bool CheckIndexedBounds(std::string& failure)
+	{
+		// The vertices left out of the ranges are the outermost ones
+		Vertex vertices[6] = {};
+		const vec3f positions[] = { { 1.0f, 2.0f, 3.0f }, { -100.0f, 0.0f, 0.0f }, { -1.0f, 5.0f, 0.0f },
+			{ 0.0f, 100.0f, -100.0f }, { 2.0f, -2.0f, 4.0f }, { 100.0f, 0.0f, 0.0f } };
+		for (int i = 0; i < 6; i++)
+			vertices[i].Position = positions[i];
+		const unsigned indices[] = { 0, 2, 2, 4, 0 };
+
+		const aabb all = ComputeIndexedBounds(&vertices[0].Position, sizeof(Vertex), indices, 5);
+		if (!SameBounds(all, aabb(vec3f(-1.0f, -2.0f, 0.0f), vec3f(2.0f, 5.0f, 4.0f))))
+			return FailCheck(failure, "indexed_bounds: wrong bounds of a range");
+		if (!SameBounds(ComputeIndexedBounds(&vertices[0].Position, sizeof(Vertex), indices + 3, 1), aabb(positions[4], positions[4])))
+			return FailCheck(failure, "indexed_bounds: wrong bounds of a single index");
+		if (!ComputeIndexedBounds(&vertices[0].Position, sizeof(Vertex), indices, 0).empty())
+			return FailCheck(failure, "indexed_bounds: an empty range was not empty");
+		if (!SameBounds(ComputeIndexedBounds(positions, sizeof(vec3f), indices, 5), all))
+			return FailCheck(failure, "indexed_bounds: packed positions gave other bounds");
+		return true;
+	}
+
+	std::vector<aabb> RandomBoxes(unsigned count, std::mt19937& random)
+	{
+		// Boxes in front of and around the camera, a fraction of them in view
+		std::uniform_real_distribution<float> position(-100.0f, 100.0f), extent(0.1f, 2.0f);
+		std::vector<aabb> boxes(count);
+		for (aabb& box : boxes)
+		{
+			const vec3f center(position(random), position(random), position(random));
+			box = aabb::from_center_extents(center, vec3f(extent(random), extent(random), extent(random)));
+		}
+		return boxes;
+	}
+
+	// Every primitive in exactly one leaf, and every node containing what is below it
+	bool CheckHierarchy(const BVH& bvh, const std::vector<aabb>& boxes, std::string& failure)
+	{
+		const std::vector<BVHNode>& nodes = bvh.GetNodes();
+		std::vector<unsigned> references(boxes.size());
+		for (const BVHNode& node : nodes)
+		{
+			if (node.IsLeaf())
+			{
+				for (uint32_t i = node.Index; i < node.Index + node.Count; i++)
+				{
+					const uint32_t primitive = bvh.GetPrimitiveIndices()[i];
+					references[primitive]++;
+					if (!node.Bounds.contains(boxes[primitive].min) || !node.Bounds.contains(boxes[primitive].max))
+						return FailCheck(failure, "bvh: a leaf does not contain its primitive");
+				}
+			}
+			else
+			{
+				for (uint32_t child = node.Index; child < node.Index + 2; child++)
+				{
+					if (!node.Bounds.contains(nodes[child].Bounds.min) || !node.Bounds.contains(nodes[child].Bounds.max))
+						return FailCheck(failure, "bvh: a node does not contain its child");
+				}
+			}
+		}
+		for (unsigned count : references)
+		{
+			if (count != 1)
+				return FailCheck(failure, "bvh: a primitive is not in exactly one leaf");
+		}
+		const BVHBuildStats& stats = bvh.GetBuildStats();
+		if (stats.Nodes != nodes.size() || !stats.Leaves || stats.MaxDepth > BVH_MAX_DEPTH)
+			return FailCheck(failure, "bvh: wrong build statistics");
+		return true;
+	}
+
+	// The queries of a BVH against loops over all boxes
+	bool CheckQueries(const BVH& bvh, const std::vector<aabb>& boxes, std::mt19937& random, std::string& failure)
+	{
+		const frustum f = frustum::from_matrix(ViewToClip());
+		std::vector<uint8_t> visibility(boxes.size());
+		CullBounds(f, boxes.data(), boxes.size(), visibility.data(), nullptr);
+		std::vector<uint32_t> expected, result;
+		for (uint32_t i = 0; i < boxes.size(); i++)
+		{
+			if (visibility[i])
+				expected.push_back(i);
+		}
+		CullStats stats;
+		if (CullBVH(f, bvh, result, &stats) != expected.size() || result != expected)
+			return FailCheck(failure, "bvh: frustum query differs from cull_bounds");
+		if (stats.Visible != expected.size() || !stats.Tested || stats.Tested > bvh.GetNodes().size())
+			return FailCheck(failure, "bvh: wrong frustum query counts");
+
+		std::uniform_real_distribution<float> position(-100.0f, 100.0f), extent(1.0f, 20.0f);
+		for (int query = 0; query < 32; query++)
+		{
+			const aabb box = aabb::from_center_extents(vec3f(position(random), position(random), position(random)),
+				vec3f(extent(random), extent(random), extent(random)));
+			expected.clear();
+			result.clear();
+			for (uint32_t i = 0; i < boxes.size(); i++)
+			{
+				if (box.overlaps(boxes[i]))
+					expected.push_back(i);
+			}
+			bvh.QueryOverlap(box, result);
+			std::sort(result.begin(), result.end());
+			if (result != expected)
+				return FailCheck(failure, "bvh: overlap query differs from the loop");
+
+			// Closest hit of a ray from the box center towards a random point
+			const vec3f origin = box.center();
+			const ray r(origin, vec3f(position(random), position(random), position(random)) - origin);
+			float closest = (float)fINF;
+			for (const aabb& b : boxes)
+			{
+				float t;
+				if (intersect(r, b, closest, t) && t < closest)
+					closest = t;
+			}
+			const BVHRayHit hit = bvh.Raycast(r, (float)fINF);
+			float t;
+			if (closest == (float)fINF ? hit.Primitive != UINT32_MAX :
+				hit.Primitive >= boxes.size() || hit.Distance != closest || !intersect(r, boxes[hit.Primitive], (float)fINF, t) || t != closest)
+				return FailCheck(failure, "bvh: raycast differs from the loop");
+		}
+		return true;
+	}
+
+	bool CheckBVH(std::string& failure)
+	{
+		std::mt19937 random(2);
+		std::vector<aabb> boxes = RandomBoxes(1000, random);
+		BVH bvh;
+		bvh.Build(boxes.data(), boxes.size());
+		if (!CheckHierarchy(bvh, boxes, failure) || !CheckQueries(bvh, boxes, random, failure))
+			return false;
+
+		// Moved primitives, refitted and rebuilt
+		std::uniform_real_distribution<float> offset(-5.0f, 5.0f);
+		for (aabb& box : boxes)
+		{
+			const vec3f move(offset(random), offset(random), offset(random));
+			box = aabb(box.min + move, box.max + move);
+		}
+		bvh.Refit(boxes.data());
+		if (!CheckHierarchy(bvh, boxes, failure) || !CheckQueries(bvh, boxes, random, failure))
+			return FailCheck(failure, "refit " + failure);
+		bvh.Build(boxes.data(), boxes.size(), 1);
+		if (!CheckHierarchy(bvh, boxes, failure) || !CheckQueries(bvh, boxes, random, failure))
+			return FailCheck(failure, "single primitive leaves " + failure);
+
+		// Nothing to find in an empty tree
+		std::vector<uint32_t> result;
+		bvh.Build(boxes.data(), 0);
+		if (bvh.QueryFrustum(frustum::from_matrix(ViewToClip()), result) || bvh.QueryOverlap(Box(0.0f, 0.0f, 0.0f, 1000.0f), result) ||
+			!result.empty() || bvh.Raycast(ray(vec3f(0.0f, 0.0f, 0.0f), vec3f(0.0f, 0.0f, -1.0f)), (float)fINF).Primitive != UINT32_MAX)
+			return FailCheck(failure, "bvh: an empty tree found something");
+		return true;
+	}
+}
+
+bool RunCullingTest(std::string& failure)
+{
+	return CheckCullBounds(failure) && CheckOcclusion(failure) && CheckIndexedBounds(failure) && CheckBVH(failure);
+}
+
+std::vector<CullingTiming> RunCullingTimings(unsigned bounds, unsigned frames)
+{
+	std::mt19937 random(1);
+	const std::vector<aabb> boxes = RandomBoxes(bounds, random);
+	const frustum f = frustum::from_matrix(ViewToClip());
+	std::vector<uint8_t> visibility(bounds);
+	std::vector<CullingTiming> timings;
+
+	CullingTiming cull;
+	cull.Name = "cull_bounds";
+	cull.Count = bounds;
+	std::vector<double> times;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const int64_t start = Profiler::Now();
+		cull.Visible = (unsigned)CullBounds(f, boxes.data(), bounds, visibility.data(), nullptr);
+		times.push_back(MillisecondsSince(start));
+	}
+	cull.Milliseconds = BenchmarkSummary::Compute(times);
+	timings.push_back(cull);
+
+	// A vertex and three indices per bound, indexing the vertices in random order
+	std::vector<Vertex> vertices(bounds);
+	std::vector<unsigned> indices(bounds * 3);
+	for (unsigned i = 0; i < bounds; i++)
+		vertices[i].Position = boxes[i].center();
+	std::uniform_int_distribution<unsigned> vertex(0, bounds ? bounds - 1 : 0);
+	for (unsigned& index : indices)
+		index = vertex(random);
+
+	CullingTiming indexed;
+	indexed.Name = "indexed_bounds";
+	indexed.Count = (unsigned)indices.size();
+	times.clear();
+	aabb result;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const int64_t start = Profiler::Now();
+		result = ComputeIndexedBounds(&vertices[0].Position, sizeof(Vertex), indices.data(), indices.size());
+		times.push_back(MillisecondsSince(start));
+	}
+	indexed.Milliseconds = bounds && result.empty() ? BenchmarkSummary() : BenchmarkSummary::Compute(times);
+	timings.push_back(indexed);
+
+	CullingTiming build;
+	build.Name = "bvh_build";
+	build.Count = bounds;
+	times.clear();
+	BVH bvh;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const int64_t start = Profiler::Now();
+		bvh.Build(boxes.data(), boxes.size());
+		times.push_back(MillisecondsSince(start));
+	}
+	build.Milliseconds = BenchmarkSummary::Compute(times);
+	timings.push_back(build);
+
+	CullingTiming refit;
+	refit.Name = "bvh_refit";
+	refit.Count = bounds;
+	times.clear();
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const int64_t start = Profiler::Now();
+		bvh.Refit(boxes.data());
+		times.push_back(MillisecondsSince(start));
+	}
+	refit.Milliseconds = BenchmarkSummary::Compute(times);
+	timings.push_back(refit);
+
+	// The same frustum as cull_bounds, through the hierarchy
+	CullingTiming query;
+	query.Name = "bvh_frustum";
+	query.Count = bounds;
+	times.clear();
+	std::vector<uint32_t> visible;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const int64_t start = Profiler::Now();
+		query.Visible = (unsigned)CullBVH(f, bvh, visible, nullptr);
+		times.push_back(MillisecondsSince(start));
+	}
+	query.Milliseconds = BenchmarkSummary::Compute(times);
+	timings.push_back(query);
+
+	// Rays from the camera through the view, counting the ones that hit
+	const unsigned rayCount = 1000;
+	std::vector<ray> rays(rayCount);
+	std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+	for (ray& r : rays)
+		r = ray(vec3f(0.0f, 0.0f, 0.0f), vec3f(direction(random), direction(random), -1.0f));
+
+	CullingTiming raycast;
+	raycast.Name = "bvh_raycast";
+	raycast.Count = rayCount;
+	times.clear();
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const int64_t start = Profiler::Now();
+		unsigned hits = 0;
+		for (const ray& r : rays)
+			hits += bvh.Raycast(r, (float)fINF).Primitive != UINT32_MAX;
+		times.push_back(MillisecondsSince(start));
+		raycast.Visible = hits;
+	}
+	raycast.Milliseconds = BenchmarkSummary::Compute(times);
+	timings.push_back(raycast);
+	return timings;
+}
+
+bool RunCullingBenchmark(unsigned bounds, unsigned frames, const std::string& report_filename)
+{
+	std::string testFailure;
+	const bool passed = RunCullingTest(testFailure);
+	printf("Culling self test: %s\n", passed ? "passed" : testFailure.c_str());
+
+	printf("Culling, %u bounds, %u frames...\n", bounds, frames);
+	printf("\t%16s %10s %10s %10s %14s\n", "Function", "Count", "Visible", "p50 ms", "Mper second");
+	const std::vector<CullingTiming> timings = RunCullingTimings(bounds, frames);
+	for (const CullingTiming& timing : timings)
+	{
+		const double milliseconds = timing.Milliseconds.P50;
+		printf("\t%16s %10u %10u %10.3f %14.1f\n", timing.Name, timing.Count, timing.Visible, milliseconds,
+			milliseconds > 0.0 ? timing.Count / milliseconds * 1e-3 : 0.0);
+	}
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(testFailure);
+		json.Key("bounds").Value(bounds);
+		json.Key("frames").Value(frames);
+		json.Key("functions").BeginArray();
+		for (const CullingTiming& timing : timings)
+		{
+			json.BeginObject();
+			json.Key("name").Value(timing.Name);
+			json.Key("count").Value(timing.Count);
+			json.Key("visible").Value(timing.Visible);
+			json.Key("p50_ms").Value(timing.Milliseconds.P50);
+			json.Key("p95_ms").Value(timing.Milliseconds.P95);
+			json.EndObject();
+		}
+		json.EndArray();
+	});
+	return passed && written;
+}
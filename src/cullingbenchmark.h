@@ -0,0 +1,53 @@
+/**
+ * @file cullingbenchmark.h
+ * @brief Self test of the culling functions and their cost for many bounds
+ * @details The test culls boxes inside, outside and straddling the planes of a frustum, boxes in front
+ * of, behind and across an occluder, and checks the visibility, the returned counts and the counts
+ * accumulated in CullStats, as well as the bounds ComputeIndexedBounds() finds for ranges of a vertex
+ * array. The BVH is checked for containment, and its frustum, overlap and ray queries against loops over
+ * all boxes, after a build, a refit and a build with single primitive leaves. The benchmark times
+ * CullBounds() and ComputeIndexedBounds() over many boxes and indices, and building, refitting and
+ * querying a BVH over the same boxes.
+*/
+
+#pragma once
+#ifndef CULLINGBENCHMARK_H
+#define CULLINGBENCHMARK_H
+
+#include <string>
+#include <vector>
+#include "benchmark.h"
+
+//! Bounds culled per frame of -cullbenchmark
+#define CULLINGBENCHMARK_DEFAULT_BOUNDS 100000
+
+//! Frames per function of -cullbenchmark
+#define CULLINGBENCHMARK_DEFAULT_FRAMES 100
+
+/**
+ * @brief Cost of one culling function.
+*/
+struct CullingTiming
+{
+	const char* Name = ""; //!< "cull_bounds", "indexed_bounds", "bvh_build", "bvh_refit", "bvh_frustum" or "bvh_raycast"
+	unsigned Count = 0; //!< Bounds, indices or rays per frame
+	unsigned Visible = 0; //!< Visible bounds or rays that hit per frame, 0 for the others
+	BenchmarkSummary Milliseconds; //!< Time per frame
+};
+
+/**
+ * @brief Run the self test of CullBounds(), CullOcclusion(), CullStats, ComputeIndexedBounds() and the BVH.
+*/
+bool RunCullingTest(std::string& failure);
+
+/**
+ * @brief Time every culling function over a field of bounds.
+*/
+std::vector<CullingTiming> RunCullingTimings(unsigned bounds, unsigned frames);
+
+/**
+ * @brief Run the self test and time every culling function.
+*/
+bool RunCullingBenchmark(unsigned bounds, unsigned frames, const std::string& report_filename);
+
+#endif
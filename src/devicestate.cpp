@@ -0,0 +1,99 @@
+//
+// Redundant state change filter
+//
+// Each call asks the cache if it changes the bound state, and only then
+// reaches the context. See devicestatecache.h for how state is compared.
+//
+
+#include "devicestate.h"
+
+DeviceState::DeviceState(ID3D11DeviceContext* context) noexcept
+	: m_context(context)
+{
+	// Missing on Windows 7 without the platform update, and from contexts that are not the runtime's
+	if (FAILED(m_context->QueryInterface(__uuidof(ID3D11DeviceContext1), (void**)&m_context1)))
+		m_context1 = nullptr;
+}
+
+DeviceState::~DeviceState()
+{
+	SAFE_RELEASE(m_context1);
+}
+
+void DeviceState::SetInputLayout(ID3D11InputLayout* layout)
+{
+	if (m_cache.ChangedInputLayout(layout))
+		m_context->IASetInputLayout(layout);
+}
+
+void DeviceState::SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology)
+{
+	if (m_cache.ChangedTopology((uint32_t)topology))
+		m_context->IASetPrimitiveTopology(topology);
+}
+
+void DeviceState::SetVertexBuffer(UINT slot, ID3D11Buffer* buffer, UINT stride, UINT offset)
+{
+	if (m_cache.ChangedVertexBuffer(slot, buffer, stride, offset))
+		m_context->IASetVertexBuffers(slot, 1, &buffer, &stride, &offset);
+}
+
+void DeviceState::SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset)
+{
+	if (m_cache.ChangedIndexBuffer(buffer, (uint32_t)format, offset))
+		m_context->IASetIndexBuffer(buffer, format, offset);
+}
+
+void DeviceState::SetVertexShader(ID3D11VertexShader* shader)
+{
+	if (m_cache.ChangedShader(DeviceStateStage::Vertex, shader))
+		m_context->VSSetShader(shader, nullptr, 0);
+}
+
+void DeviceState::SetHullShader(ID3D11HullShader* shader)
+{
+	if (m_cache.ChangedShader(DeviceStateStage::Hull, shader))
+		m_context->HSSetShader(shader, nullptr, 0);
+}
+
+void DeviceState::SetDomainShader(ID3D11DomainShader* shader)
+{
+	if (m_cache.ChangedShader(DeviceStateStage::Domain, shader))
+		m_context->DSSetShader(shader, nullptr, 0);
+}
+
+void DeviceState::SetGeometryShader(ID3D11GeometryShader* shader)
+{
+	if (m_cache.ChangedShader(DeviceStateStage::Geometry, shader))
+		m_context->GSSetShader(shader, nullptr, 0);
+}
+
+void DeviceState::SetPixelShader(ID3D11PixelShader* shader)
+{
+	if (m_cache.ChangedShader(DeviceStateStage::Pixel, shader))
+		m_context->PSSetShader(shader, nullptr, 0);
+}
+
+void DeviceState::SetVSConstantBuffer(UINT slot, ID3D11Buffer* buffer)
+{
+	if (m_cache.ChangedVSConstantBuffer(slot, buffer, 0, 0))
+		m_context->VSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void DeviceState::SetVSConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT first_constant, UINT constant_count)
+{
+	if (m_cache.ChangedVSConstantBuffer(slot, buffer, first_constant, constant_count))
+		m_context1->VSSetConstantBuffers1(slot, 1, &buffer, &first_constant, &constant_count);
+}
+
+void DeviceState::SetPSConstantBuffer(UINT slot, ID3D11Buffer* buffer)
+{
+	if (m_cache.ChangedPSConstantBuffer(slot, buffer))
+		m_context->PSSetConstantBuffers(slot, 1, &buffer);
+}
+
+void DeviceState::SetPSShaderResource(UINT slot, ID3D11ShaderResourceView* view)
+{
+	if (m_cache.ChangedPSShaderResource(slot, view))
+		m_context->PSSetShaderResources(slot, 1, &view);
+}
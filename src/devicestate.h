@@ -0,0 +1,97 @@
+/**
+ * @file devicestate.h
+ * @brief Redundant state change filter in front of the device context
+ * @details Keeps the shaders, input layout, topology, vertex and index buffers, constant buffers and shader
+ * resource views last bound through it, and drops calls that would bind what is already bound. Every call
+ * is counted as issued or filtered.
+ *
+ * A bound object is referenced by the context, so its address cannot be reused by a new object while it is
+ * cached. Code that binds state on the context directly must call Invalidate() afterwards. What is cached,
+ * and whether a call changes it, is kept by DeviceStateCache, which does not depend on Direct3D.
+ *
+ * Ranges of a constant buffer are bound with ID3D11DeviceContext1, when the context has it. A range and
+ * the whole buffer are different bindings, and code that restores constant buffers without their ranges,
+ * e.g. the ImGui backend, must call InvalidateConstantBuffers() afterwards.
+*/
+
+#pragma once
+#ifndef DEVICESTATE_H
+#define DEVICESTATE_H
+
+#include "stdafx.h"
+#include <d3d11_1.h>
+#include "devicestatecache.h"
+
+/**
+ * @brief Filters redundant state changes on a device context.
+*/
+class DeviceState
+{
+public:
+	/**
+	 * @brief Create a filter with nothing known to be bound.
+	 * @param[in] context Context to forward calls to, must outlive the filter.
+	*/
+	explicit DeviceState(ID3D11DeviceContext* context) noexcept;
+
+	/**
+	 * @brief Releases the ID3D11DeviceContext1 of the context.
+	*/
+	~DeviceState();
+
+	DeviceState(const DeviceState&) = delete;
+	DeviceState& operator=(const DeviceState&) = delete;
+
+	void SetInputLayout(ID3D11InputLayout* layout); //!< IASetInputLayout()
+	void SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY topology); //!< IASetPrimitiveTopology()
+	void SetVertexBuffer(UINT slot, ID3D11Buffer* buffer, UINT stride, UINT offset); //!< IASetVertexBuffers() of one slot
+	void SetIndexBuffer(ID3D11Buffer* buffer, DXGI_FORMAT format, UINT offset); //!< IASetIndexBuffer()
+
+	void SetVertexShader(ID3D11VertexShader* shader); //!< VSSetShader() without class instances
+	void SetHullShader(ID3D11HullShader* shader); //!< HSSetShader() without class instances
+	void SetDomainShader(ID3D11DomainShader* shader); //!< DSSetShader() without class instances
+	void SetGeometryShader(ID3D11GeometryShader* shader); //!< GSSetShader() without class instances
+	void SetPixelShader(ID3D11PixelShader* shader); //!< PSSetShader() without class instances
+
+	void SetVSConstantBuffer(UINT slot, ID3D11Buffer* buffer); //!< VSSetConstantBuffers() of one slot
+	void SetVSConstantBufferRange(UINT slot, ID3D11Buffer* buffer, UINT first_constant, UINT constant_count); //!< VSSetConstantBuffers1() of one slot, see SupportsConstantBufferRanges()
+	void SetPSConstantBuffer(UINT slot, ID3D11Buffer* buffer); //!< PSSetConstantBuffers() of one slot
+	void SetPSShaderResource(UINT slot, ID3D11ShaderResourceView* view); //!< PSSetShaderResources() of one slot
+
+	/**
+	 * @brief Forget all cached state, so that the next call of each kind is issued.
+	*/
+	void Invalidate() noexcept { m_cache.Invalidate(); }
+
+	/**
+	 * @brief Forget the cached constant buffers, so that the next call of each slot is issued.
+	*/
+	void InvalidateConstantBuffers() noexcept { m_cache.InvalidateConstantBuffers(); }
+
+	/**
+	 * @brief Check if SetVSConstantBufferRange() can be called, i.e. the context is an ID3D11DeviceContext1.
+	*/
+	bool SupportsConstantBufferRanges() const noexcept { return m_context1 != nullptr; }
+
+	/**
+	 * @brief Make the counts of the frame available from GetStats() and start counting a new frame.
+	*/
+	void EndFrame() noexcept { m_cache.EndFrame(); }
+
+	/**
+	 * @brief Get the counts of the last frame ended with EndFrame().
+	*/
+	const DeviceStateStats& GetStats() const noexcept { return m_cache.GetStats(); }
+
+	/**
+	 * @brief Get the context calls are forwarded to.
+	*/
+	ID3D11DeviceContext* GetContext() const noexcept { return m_context; }
+
+private:
+	ID3D11DeviceContext* m_context;
+	ID3D11DeviceContext1* m_context1 = nullptr;
+	DeviceStateCache m_cache;
+};
+
+#endif
@@ -0,0 +1,262 @@
+//
+// Redundant state filter self test and benchmark
+//
+// A mock context keeps what is bound per kind of state and slot, together
+// with the range or stride and offset of the binding, and counts the calls
+// it receives. Filtering is correct when the mock behind the cache always
+// has the same state as the mock that receives every call.
+//
+
+#include <cstdio>
+#include <map>
+#include <random>
+#include <tuple>
+#include <vector>
+#include "devicestatebenchmark.h"
+#include "devicestatecache.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+namespace
+{
+	enum class BindingKind
+	{
+		InputLayout,
+		Topology,
+		VertexBuffer,
+		IndexBuffer,
+		Shader,
+		VSConstantBuffer,
+		PSConstantBuffer,
+		PSShaderResource,
+		Count
+	};
+
+	// One call of a DeviceState, Slot is the stage for shaders and 0 for unslotted state
+	struct Binding
+	{
+		BindingKind Kind;
+		uint32_t Slot;
+		const void* Object;
+		uint32_t First; // Topology, stride, format or first constant
+		uint32_t Second; // Offset or constant count
+	};
+
+	class MockContext
+	{
+	public:
+		void Bind(const Binding& binding)
+		{
+			m_state[std::make_pair((int)binding.Kind, binding.Slot)] = std::make_tuple(binding.Object, binding.First, binding.Second);
+			m_calls++;
+		}
+
+		bool SameState(const MockContext& other) const { return m_state == other.m_state; }
+		unsigned GetCalls() const noexcept { return m_calls; }
+
+	private:
+		std::map<std::pair<int, uint32_t>, std::tuple<const void*, uint32_t, uint32_t>> m_state;
+		unsigned m_calls = 0;
+	};
+
+	// What DeviceState asks the cache before forwarding a call
+	bool Changed(DeviceStateCache& cache, const Binding& binding)
+	{
+		switch (binding.Kind)
+		{
+		case BindingKind::InputLayout: return cache.ChangedInputLayout(binding.Object);
+		case BindingKind::Topology: return cache.ChangedTopology(binding.First);
+		case BindingKind::VertexBuffer: return cache.ChangedVertexBuffer(binding.Slot, binding.Object, binding.First, binding.Second);
+		case BindingKind::IndexBuffer: return cache.ChangedIndexBuffer(binding.Object, binding.First, binding.Second);
+		case BindingKind::Shader: return cache.ChangedShader((DeviceStateStage)binding.Slot, binding.Object);
+		case BindingKind::VSConstantBuffer: return cache.ChangedVSConstantBuffer(binding.Slot, binding.Object, binding.First, binding.Second);
+		case BindingKind::PSConstantBuffer: return cache.ChangedPSConstantBuffer(binding.Slot, binding.Object);
+		case BindingKind::PSShaderResource: return cache.ChangedPSShaderResource(binding.Slot, binding.Object);
+		default: return true;
+		}
+	}
+
+	// Objects to bind, nullptr is one of them
+	const char objects[4] = {};
+
+	Binding RandomBinding(std::mt19937& random)
+	{
+		std::uniform_int_distribution<int> kind(0, (int)BindingKind::Count - 1), object(0, 4), value(0, 2), slot(0, 19);
+		Binding binding;
+		binding.Kind = (BindingKind)kind(random);
+		const int objectIndex = object(random);
+		binding.Object = objectIndex < 4 ? &objects[objectIndex] : nullptr;
+		binding.First = value(random) * 16;
+		binding.Second = value(random) * 16;
+
+		// Mostly cached slots, sometimes one past the cached ones
+		const int slotIndex = slot(random);
+		binding.Slot = slotIndex < 16 ? slotIndex % 3 : DEVICESTATE_MAX_SLOTS + slotIndex % 2;
+		if (binding.Kind == BindingKind::InputLayout || binding.Kind == BindingKind::Topology || binding.Kind == BindingKind::IndexBuffer)
+			binding.Slot = 0;
+		else if (binding.Kind == BindingKind::Shader)
+			binding.Slot = slotIndex % (int)DeviceStateStage::Count;
+
+		// Only the values each kind is bound with
+		if (binding.Kind == BindingKind::Topology)
+			binding.Object = nullptr;
+		if (binding.Kind == BindingKind::Topology || binding.Kind == BindingKind::InputLayout || binding.Kind == BindingKind::Shader ||
+			binding.Kind == BindingKind::PSConstantBuffer || binding.Kind == BindingKind::PSShaderResource)
+			binding.Second = 0;
+		if (binding.Kind == BindingKind::InputLayout || binding.Kind == BindingKind::Shader ||
+			binding.Kind == BindingKind::PSConstantBuffer || binding.Kind == BindingKind::PSShaderResource)
+			binding.First = 0;
+		return binding;
+	}
+
+	bool CheckCases(std::string& failure)
+	{
+		DeviceStateCache cache;
+		const void* buffer = &objects[0];
+
+		if (!cache.ChangedPSConstantBuffer(0, nullptr) || cache.ChangedPSConstantBuffer(0, nullptr))
+			return FailCheck(failure, "nullptr was not bound once");
+		if (!cache.ChangedVSConstantBuffer(1, buffer, 0, 0) || !cache.ChangedVSConstantBuffer(1, buffer, 0, 16) ||
+			cache.ChangedVSConstantBuffer(1, buffer, 0, 16) || !cache.ChangedVSConstantBuffer(1, buffer, 16, 16))
+			return FailCheck(failure, "a range and the whole constant buffer were not told apart");
+		if (!cache.ChangedVertexBuffer(DEVICESTATE_MAX_SLOTS, buffer, 16, 0) || !cache.ChangedVertexBuffer(DEVICESTATE_MAX_SLOTS, buffer, 16, 0))
+			return FailCheck(failure, "an uncached slot was filtered");
+		if (!cache.ChangedTopology(4) || cache.ChangedTopology(4))
+			return FailCheck(failure, "the topology was not bound once");
+		if (!cache.ChangedShader(DeviceStateStage::Pixel, buffer) || cache.ChangedShader(DeviceStateStage::Pixel, buffer) ||
+			!cache.ChangedShader(DeviceStateStage::Vertex, buffer))
+			return FailCheck(failure, "shader stages were not told apart");
+
+		// Invalidating the constant buffers keeps the rest
+		cache.InvalidateConstantBuffers();
+		if (!cache.ChangedVSConstantBuffer(1, buffer, 16, 16) || !cache.ChangedPSConstantBuffer(0, nullptr) || cache.ChangedTopology(4))
+			return FailCheck(failure, "constant buffers were not invalidated alone");
+		cache.Invalidate();
+		if (!cache.ChangedTopology(4) || !cache.ChangedShader(DeviceStateStage::Pixel, buffer))
+			return FailCheck(failure, "state was not invalidated");
+
+		cache.EndFrame();
+		const DeviceStateStats& stats = cache.GetStats();
+		if (stats.Issued != 13 || stats.Filtered != 5)
+			return FailCheck(failure, "wrong counts of issued and filtered calls");
+		cache.EndFrame();
+		if (cache.GetStats().Issued || cache.GetStats().Filtered)
+			return FailCheck(failure, "counts were not restarted with the frame");
+		return true;
+	}
+
+	bool CheckRandom(std::string& failure)
+	{
+		DeviceStateCache cache;
+		MockContext filtered, unfiltered;
+		std::mt19937 random(1);
+		std::uniform_int_distribution<int> bypass(0, 19);
+		unsigned cached = 0, direct = 0, issued = 0, dropped = 0;
+
+		for (int call = 0; call < 100000; call++)
+		{
+			const Binding binding = RandomBinding(random);
+			if (bypass(random) == 0)
+			{
+				// Bound on the context directly, then the cache is told so
+				filtered.Bind(binding);
+				unfiltered.Bind(binding);
+				direct++;
+				if (binding.Kind == BindingKind::VSConstantBuffer || binding.Kind == BindingKind::PSConstantBuffer)
+					cache.InvalidateConstantBuffers();
+				else
+					cache.Invalidate();
+			}
+			else
+			{
+				if (Changed(cache, binding))
+					filtered.Bind(binding);
+				unfiltered.Bind(binding);
+				cached++;
+			}
+			if (!filtered.SameState(unfiltered))
+				return FailCheck(failure, "the filtered context differs after call " + std::to_string(call));
+
+			if (call % 100 == 99)
+			{
+				cache.EndFrame();
+				issued += cache.GetStats().Issued;
+				dropped += cache.GetStats().Filtered;
+			}
+		}
+		if (issued + dropped != cached || issued != filtered.GetCalls() - direct)
+			return FailCheck(failure, "counts differ from the calls the context received");
+		if (!dropped)
+			return FailCheck(failure, "nothing was filtered");
+		return true;
+	}
+
+	// Draws of objects that share vertex buffers, materials and textures in runs, as a sorted queue gives them
+	std::vector<Binding> DrawStream(unsigned calls)
+	{
+		static const char vertexBuffers[64] = {}, indexBuffers[64] = {}, shaders[8] = {}, textures[32] = {}, ring = 0;
+		std::vector<Binding> stream;
+		stream.reserve(calls);
+		for (unsigned draw = 0; stream.size() < calls; draw++)
+		{
+			const Binding draws[] =
+			{
+				{ BindingKind::Shader, (uint32_t)DeviceStateStage::Pixel, &shaders[draw / 512 % 8], 0, 0 },
+				{ BindingKind::PSShaderResource, 0, &textures[draw / 64 % 32], 0, 0 },
+				{ BindingKind::VertexBuffer, 0, &vertexBuffers[draw / 8 % 64], 64, 0 },
+				{ BindingKind::IndexBuffer, 0, &indexBuffers[draw / 8 % 64], 42, 0 },
+				{ BindingKind::VSConstantBuffer, 0, &ring, draw % 4096 * 16, 16 },
+			};
+			for (const Binding& binding : draws)
+			{
+				if (stream.size() < calls)
+					stream.push_back(binding);
+			}
+		}
+		return stream;
+	}
+}
+
+bool RunDeviceStateTest(std::string& failure)
+{
+	return CheckCases(failure) && CheckRandom(failure);
+}
+
+bool RunDeviceStateBenchmark(unsigned calls, unsigned frames, const std::string& report_filename)
+{
+	std::string testFailure;
+	const bool passed = RunDeviceStateTest(testFailure);
+	printf("Device state self test: %s\n", passed ? "passed" : testFailure.c_str());
+
+	const std::vector<Binding> stream = DrawStream(calls);
+	DeviceStateCache cache;
+	std::vector<double> times;
+	unsigned issued = 0;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const int64_t start = Profiler::Now();
+		for (const Binding& binding : stream)
+			Changed(cache, binding);
+		times.push_back(MillisecondsSince(start));
+		cache.EndFrame();
+		issued = cache.GetStats().Issued;
+	}
+	const BenchmarkSummary milliseconds = BenchmarkSummary::Compute(times);
+	const double nanosecondsPerCall = calls ? milliseconds.P50 * 1e6 / calls : 0.0;
+	printf("Device state filter, %u calls, %u frames: %u issued, %.3f ms, %.2f ns per call\n", calls, frames, issued, milliseconds.P50,
+		nanosecondsPerCall);
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(testFailure);
+		json.Key("calls").Value(calls);
+		json.Key("frames").Value(frames);
+		json.Key("issued").Value(issued);
+		json.Key("filtered").Value(calls - issued);
+		json.Key("p50_ms").Value(milliseconds.P50);
+		json.Key("p95_ms").Value(milliseconds.P95);
+		json.Key("ns_per_call").Value(nanosecondsPerCall);
+	});
+	return passed && written;
+}
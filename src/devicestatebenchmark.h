@@ -0,0 +1,36 @@
+/**
+ * @file devicestatebenchmark.h
+ * @brief Self test of the redundant state filter against a mock context, and its cost per call
+ * @details The test sends random bindings of every kind, with repeated objects, nullptr, ranges of constant
+ * buffers and slots beyond DEVICESTATE_MAX_SLOTS, through a DeviceStateCache to a mock context that only
+ * receives the calls the cache reports as changes, and unfiltered to a second mock context. After every call
+ * both contexts must have the same state bound. Some calls bypass the cache, as the ImGui backend does, and
+ * are followed by the invalidation that code has to make. The counts of issued and filtered calls are checked
+ * against the calls the mock received. The benchmark times the cache over a stream of draws that rebind
+ * mostly the same state.
+*/
+
+#pragma once
+#ifndef DEVICESTATEBENCHMARK_H
+#define DEVICESTATEBENCHMARK_H
+
+#include <string>
+#include "benchmark.h"
+
+//! Bindings per frame of -statebenchmark
+#define DEVICESTATEBENCHMARK_DEFAULT_CALLS 100000
+
+//! Frames of -statebenchmark
+#define DEVICESTATEBENCHMARK_DEFAULT_FRAMES 100
+
+/**
+ * @brief Run the self test of DeviceStateCache against mock contexts.
+*/
+bool RunDeviceStateTest(std::string& failure);
+
+/**
+ * @brief Run the self test and time the cache over a stream of draws.
+*/
+bool RunDeviceStateBenchmark(unsigned calls, unsigned frames, const std::string& report_filename);
+
+#endif
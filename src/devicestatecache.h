@@ -0,0 +1,214 @@
+/**
+ * @file devicestatecache.h
+ * @brief Bookkeeping of the state DeviceState has bound
+ * @details Remembers the objects and values last bound per kind of state and slot, and tells for each new
+ * binding whether it changes anything, counting it as issued or filtered. Objects are compared by address
+ * only, and unknown state is marked with the address of a private byte, which no object or nullptr can
+ * equal, so the first binding of each kind after Invalidate() always counts as a change.
+ *
+ * DeviceState forwards to the context whatever this reports as changed. Kept apart from it, and header
+ * only, so that the filtering can be tested with a mock context.
+*/
+
+#pragma once
+#ifndef DEVICESTATECACHE_H
+#define DEVICESTATECACHE_H
+
+#include <cstdint>
+
+//! Constant buffer and shader resource slots that are cached per stage, higher slots are always bound
+#define DEVICESTATE_MAX_SLOTS 16
+
+/**
+ * @brief Calls to a DeviceState in one frame.
+*/
+struct DeviceStateStats
+{
+	unsigned Issued = 0; //!< Calls passed on to the context
+	unsigned Filtered = 0; //!< Calls dropped because the state was already bound
+};
+
+/**
+ * @brief Shader stages whose shader is cached.
+*/
+enum class DeviceStateStage
+{
+	Vertex,
+	Hull,
+	Domain,
+	Geometry,
+	Pixel,
+	Count //!< Number of stages
+};
+
+/**
+ * @brief Last bound state of a device context, and the counts of the current and last frame.
+*/
+class DeviceStateCache
+{
+public:
+	/**
+	 * @brief Create a cache with nothing known to be bound.
+	*/
+	DeviceStateCache() noexcept { Invalidate(); }
+
+	/**
+	 * @brief Check if an input layout changes the bound one, and remember it.
+	*/
+	bool ChangedInputLayout(const void* layout) noexcept { return Changed(m_input_layout, layout); }
+
+	/**
+	 * @brief Check if a primitive topology changes the bound one, and remember it.
+	*/
+	bool ChangedTopology(uint32_t topology) noexcept { return Changed(m_topology, topology); }
+
+	/**
+	 * @brief Check if a vertex buffer changes the binding of a slot, and remember it.
+	 * @details Slots from DEVICESTATE_MAX_SLOTS up are not cached and always changed.
+	*/
+	bool ChangedVertexBuffer(uint32_t slot, const void* buffer, uint32_t stride, uint32_t offset) noexcept
+	{
+		return ChangedSlot(m_vertex_buffers, slot, Binding{ buffer, stride, offset });
+	}
+
+	/**
+	 * @brief Check if an index buffer changes the bound one, and remember it.
+	*/
+	bool ChangedIndexBuffer(const void* buffer, uint32_t format, uint32_t offset) noexcept
+	{
+		return Changed(m_index_buffer, Binding{ buffer, format, offset });
+	}
+
+	/**
+	 * @brief Check if a shader changes the one bound to its stage, and remember it.
+	*/
+	bool ChangedShader(DeviceStateStage stage, const void* shader) noexcept { return Changed(m_shaders[(int)stage], shader); }
+
+	/**
+	 * @brief Check if a range of a constant buffer changes the vertex shader binding of a slot, and remember it.
+	 * @param[in] slot Constant buffer slot, slots from DEVICESTATE_MAX_SLOTS up are always changed.
+	 * @param[in] buffer The constant buffer.
+	 * @param[in] first First constant of the range.
+	 * @param[in] count Number of constants in the range, 0 with first 0 for the whole buffer.
+	*/
+	bool ChangedVSConstantBuffer(uint32_t slot, const void* buffer, uint32_t first, uint32_t count) noexcept
+	{
+		return ChangedSlot(m_vs_constant_buffers, slot, Binding{ buffer, first, count });
+	}
+
+	/**
+	 * @brief Check if a constant buffer changes the pixel shader binding of a slot, and remember it.
+	*/
+	bool ChangedPSConstantBuffer(uint32_t slot, const void* buffer) noexcept { return ChangedSlot(m_ps_constant_buffers, slot, buffer); }
+
+	/**
+	 * @brief Check if a shader resource view changes the pixel shader binding of a slot, and remember it.
+	*/
+	bool ChangedPSShaderResource(uint32_t slot, const void* view) noexcept { return ChangedSlot(m_ps_shader_resources, slot, view); }
+
+	/**
+	 * @brief Forget all state, so that the next binding of each kind is a change.
+	*/
+	void Invalidate() noexcept
+	{
+		m_input_layout = Unknown();
+		m_topology = UnknownValue;
+		m_index_buffer = UnknownBinding();
+		for (int slot = 0; slot < DEVICESTATE_MAX_SLOTS; slot++)
+		{
+			m_vertex_buffers[slot] = UnknownBinding();
+			m_ps_shader_resources[slot] = Unknown();
+		}
+		for (const void*& shader : m_shaders)
+			shader = Unknown();
+		InvalidateConstantBuffers();
+	}
+
+	/**
+	 * @brief Forget the constant buffers, so that the next binding of each slot is a change.
+	*/
+	void InvalidateConstantBuffers() noexcept
+	{
+		for (int slot = 0; slot < DEVICESTATE_MAX_SLOTS; slot++)
+		{
+			m_vs_constant_buffers[slot] = UnknownBinding();
+			m_ps_constant_buffers[slot] = Unknown();
+		}
+	}
+
+	/**
+	 * @brief Make the counts of the frame available from GetStats() and start counting a new frame.
+	*/
+	void EndFrame() noexcept
+	{
+		m_last_frame = m_frame;
+		m_frame = DeviceStateStats();
+	}
+
+	/**
+	 * @brief Get the counts of the last frame ended with EndFrame().
+	*/
+	const DeviceStateStats& GetStats() const noexcept { return m_last_frame; }
+
+private:
+	// An object with two values, e.g. a buffer with its stride and offset
+	struct Binding
+	{
+		const void* Object;
+		uint32_t First;
+		uint32_t Second;
+
+		bool operator==(const Binding& other) const noexcept
+		{
+			return Object == other.Object && First == other.First && Second == other.Second;
+		}
+	};
+
+	static const uint32_t UnknownValue = ~0u;
+
+	static const void* Unknown() noexcept
+	{
+		static const char unknownObject = 0;
+		return &unknownObject;
+	}
+
+	static Binding UnknownBinding() noexcept { return { Unknown(), UnknownValue, UnknownValue }; }
+
+	template<class T>
+	bool Changed(T& cached, const T& value) noexcept
+	{
+		if (cached == value)
+		{
+			m_frame.Filtered++;
+			return false;
+		}
+		cached = value;
+		m_frame.Issued++;
+		return true;
+	}
+
+	template<class T>
+	bool ChangedSlot(T* cached, uint32_t slot, const T& value) noexcept
+	{
+		if (slot >= DEVICESTATE_MAX_SLOTS)
+		{
+			m_frame.Issued++;
+			return true;
+		}
+		return Changed(cached[slot], value);
+	}
+
+	const void* m_input_layout;
+	uint32_t m_topology;
+	Binding m_vertex_buffers[DEVICESTATE_MAX_SLOTS];
+	Binding m_index_buffer;
+	const void* m_shaders[(int)DeviceStateStage::Count];
+	Binding m_vs_constant_buffers[DEVICESTATE_MAX_SLOTS];
+	const void* m_ps_constant_buffers[DEVICESTATE_MAX_SLOTS];
+	const void* m_ps_shader_resources[DEVICESTATE_MAX_SLOTS];
+
+	DeviceStateStats m_frame;
+	DeviceStateStats m_last_frame;
+};
+
+#endif
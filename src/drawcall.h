@@ -15,21 +15,10 @@
 #include "vec/vec.h"
 
 #include "Texture.h"
+#include "vertex.h"
 
 using namespace linalg;
 
-/**
- * @brief Structure defining a vertex
-*/
-struct Vertex
-{
-	vec3f Position; //!< 3D coordinate of the vertex
-	vec3f Normal; //!< Normal of the vertex
-	vec3f Tangent; //!< Tangent of the vertex
-	vec3f Binormal; //!< Binormal of the vertex
-	vec2f TexCoord; //!< 2D texture coordiante of the vertex
-};
-
 /**
  * @brief Phong-esque material
 */
@@ -50,7 +39,11 @@ struct Material
 
 	// Device textures
 	Texture DiffuseTexture; //!< Diffuse Texture
+	Texture NormalTexture; //!< Tangent space normal map
+	Texture SpecularTexture; //!< Specular map
 	// + other texture types
+
+	uint32_t ShaderFeatures = 0; //!< ShaderFeature bits of the loaded textures, selects the shader variant
 };
 
 /**
@@ -98,4 +91,23 @@ struct Drawcall
     }
 };
 
+/**
+ * @brief A drawcall as a range of an index array shared by all drawcalls
+*/
+struct DrawcallRange
+{
+    std::string GroupName; //!< Name of the drawcall group
+    int MaterialIndex = -1; //!< Index of the material used in the drawcall
+    unsigned IndexStart = 0; //!< First index of the drawcall's triangles
+    unsigned IndexCount = 0; //!< Number of indices, three per triangle
+
+    /**
+     * @brief Used for sorting ranges based on material
+    */
+    bool operator < (const DrawcallRange& other) const
+    {
+        return MaterialIndex < other.MaterialIndex;
+    }
+};
+
 #endif
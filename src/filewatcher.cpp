@@ -0,0 +1,326 @@
+//
+// Background file watcher
+//
+// The platform part opens the notifications, blocks on them together with a
+// stop signal and hands each changed file name to Post(). Windows reads every
+// directory with its own overlapped ReadDirectoryChangesW() and waits on their
+// events; Linux adds every directory to one inotify instance and polls it with
+// the read end of a pipe that Stop() writes to.
+//
+
+#include <algorithm>
+#include "filewatcher.h"
+#include "profiler.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+namespace
+{
+	std::wstring Widen(const std::string& text)
+	{
+		const int length = MultiByteToWideChar(CP_UTF8, 0, text.c_str(), (int)text.size(), nullptr, 0);
+		std::wstring result(length, L'\0');
+		MultiByteToWideChar(CP_UTF8, 0, text.c_str(), (int)text.size(), &result[0], length);
+		return result;
+	}
+
+	std::string Narrow(const WCHAR* text, int length)
+	{
+		const int size = WideCharToMultiByte(CP_UTF8, 0, text, length, nullptr, 0, nullptr, nullptr);
+		std::string result(size, '\0');
+		WideCharToMultiByte(CP_UTF8, 0, text, length, &result[0], size, nullptr, nullptr);
+		return result;
+	}
+}
+
+struct FileWatcher::Platform
+{
+	struct Directory
+	{
+		HANDLE Handle = INVALID_HANDLE_VALUE;
+		OVERLAPPED Overlapped = {};
+		bool Pending = false;
+		DWORD Buffer[4096]; // ReadDirectoryChangesW() needs DWORD alignment
+	};
+
+	HANDLE StopEvent = nullptr;
+	std::vector<std::unique_ptr<Directory>> Directories;
+
+	~Platform()
+	{
+		for (const std::unique_ptr<Directory>& directory : Directories)
+		{
+			// The buffer must outlive a pending read
+			if (directory->Pending)
+			{
+				DWORD bytes = 0;
+				CancelIoEx(directory->Handle, &directory->Overlapped);
+				GetOverlappedResult(directory->Handle, &directory->Overlapped, &bytes, TRUE);
+			}
+			if (directory->Handle != INVALID_HANDLE_VALUE)
+				CloseHandle(directory->Handle);
+			if (directory->Overlapped.hEvent)
+				CloseHandle(directory->Overlapped.hEvent);
+		}
+		if (StopEvent)
+			CloseHandle(StopEvent);
+	}
+
+	static bool Read(Directory& directory)
+	{
+		ResetEvent(directory.Overlapped.hEvent);
+		directory.Pending = ReadDirectoryChangesW(directory.Handle, directory.Buffer, sizeof(directory.Buffer), FALSE,
+			FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &directory.Overlapped, nullptr) != FALSE;
+		return directory.Pending;
+	}
+
+	bool Open(const std::vector<std::string>& directories)
+	{
+		// One wait handle is the stop event
+		if (directories.size() >= MAXIMUM_WAIT_OBJECTS)
+			return false;
+		StopEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+		if (!StopEvent)
+			return false;
+
+		for (const std::string& name : directories)
+		{
+			Directories.push_back(std::make_unique<Directory>());
+			Directory& directory = *Directories.back();
+			directory.Handle = CreateFileW(Widen(name).c_str(), FILE_LIST_DIRECTORY,
+				FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+				FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+			directory.Overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+			if (directory.Handle == INVALID_HANDLE_VALUE || !directory.Overlapped.hEvent || !Read(directory))
+				return false;
+		}
+		return true;
+	}
+
+	void Wake()
+	{
+		SetEvent(StopEvent);
+	}
+
+	void Run(FileWatcher& watcher)
+	{
+		std::vector<HANDLE> events;
+		for (const std::unique_ptr<Directory>& directory : Directories)
+			events.push_back(directory->Overlapped.hEvent);
+		events.push_back(StopEvent);
+
+		for (;;)
+		{
+			const DWORD signaled = WaitForMultipleObjects((DWORD)events.size(), events.data(), FALSE, INFINITE) - WAIT_OBJECT_0;
+			if (signaled >= Directories.size())
+				break;
+
+			Directory& directory = *Directories[signaled];
+			DWORD bytes = 0;
+			const BOOL completed = GetOverlappedResult(directory.Handle, &directory.Overlapped, &bytes, FALSE);
+			directory.Pending = false;
+
+			// Zero bytes means the changes did not fit in the buffer
+			if (!completed || bytes == 0)
+				watcher.PostOverflow();
+			else
+			{
+				const BYTE* entry = (const BYTE*)directory.Buffer;
+				for (;;)
+				{
+					const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)entry;
+					if (info->Action == FILE_ACTION_ADDED || info->Action == FILE_ACTION_MODIFIED || info->Action == FILE_ACTION_RENAMED_NEW_NAME)
+						watcher.Post(watcher.m_directories[signaled], Narrow(info->FileName, (int)(info->FileNameLength / sizeof(WCHAR))));
+					if (info->NextEntryOffset == 0)
+						break;
+					entry += info->NextEntryOffset;
+				}
+			}
+
+			if (!Read(directory))
+			{
+				watcher.PostOverflow();
+				break;
+			}
+		}
+	}
+};
+
+#elif defined(__linux__)
+
+struct FileWatcher::Platform
+{
+	int Notify = -1;
+	int WakePipe[2] = { -1, -1 };
+	std::vector<int> Watches; // Watch descriptor of each directory
+
+	~Platform()
+	{
+		for (int descriptor : { Notify, WakePipe[0], WakePipe[1] })
+			if (descriptor >= 0)
+				close(descriptor);
+	}
+
+	bool Open(const std::vector<std::string>& directories)
+	{
+		Notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (Notify < 0 || pipe2(WakePipe, O_NONBLOCK | O_CLOEXEC) != 0)
+			return false;
+
+		// Editors either write the file in place or write a new one and rename it over the old
+		for (const std::string& directory : directories)
+		{
+			const int watch = inotify_add_watch(Notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (watch < 0)
+				return false;
+			Watches.push_back(watch);
+		}
+		return true;
+	}
+
+	void Wake()
+	{
+		const char byte = 0;
+		(void)!write(WakePipe[1], &byte, 1);
+	}
+
+	void Run(FileWatcher& watcher)
+	{
+		alignas(inotify_event) char buffer[4096];
+		for (;;)
+		{
+			pollfd descriptors[2] = { { Notify, POLLIN, 0 }, { WakePipe[0], POLLIN, 0 } };
+			if (poll(descriptors, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			if (descriptors[1].revents)
+				break;
+
+			const ssize_t size = read(Notify, buffer, sizeof(buffer));
+			for (ssize_t offset = 0; offset < size; )
+			{
+				const inotify_event* event = (const inotify_event*)(buffer + offset);
+				offset += sizeof(inotify_event) + event->len;
+
+				if (event->mask & IN_Q_OVERFLOW)
+				{
+					watcher.PostOverflow();
+					continue;
+				}
+				const auto watch = std::find(Watches.begin(), Watches.end(), event->wd);
+				if (event->len > 0 && watch != Watches.end())
+					watcher.Post(watcher.m_directories[watch - Watches.begin()], event->name);
+			}
+		}
+	}
+};
+
+#else
+
+// No notifications, Start() fails
+struct FileWatcher::Platform
+{
+	bool Open(const std::vector<std::string>&) { return false; }
+	void Wake() { }
+	void Run(FileWatcher&) { }
+};
+
+#endif
+
+FileWatcher::FileWatcher()
+	: m_queue(FILEWATCHER_QUEUE_CAPACITY)
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+	Stop();
+}
+
+bool FileWatcher::Start(const std::vector<std::string>& directories)
+{
+	Stop();
+
+	m_directories.clear();
+	for (std::string directory : directories)
+	{
+		while (directory.size() > 1 && (directory.back() == '/' || directory.back() == '\\'))
+			directory.pop_back();
+		m_directories.push_back(directory);
+	}
+
+	m_platform = std::make_unique<Platform>();
+	if (!m_platform->Open(m_directories))
+	{
+		m_platform.reset();
+		return false;
+	}
+	m_thread = std::thread(&FileWatcher::Run, this);
+	return true;
+}
+
+void FileWatcher::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+	m_platform->Wake();
+	m_thread.join();
+	m_platform.reset();
+}
+
+bool FileWatcher::Poll(FileChange& change)
+{
+	if (m_overflow.load(std::memory_order_relaxed) && m_overflow.exchange(false, std::memory_order_acquire))
+	{
+		change.Path.clear();
+		change.Overflow = true;
+		return true;
+	}
+	return m_queue.TryPop(change);
+}
+
+FileWatcherStats FileWatcher::GetStats() const noexcept
+{
+	FileWatcherStats stats;
+	stats.Changes = m_changes.load(std::memory_order_relaxed);
+	stats.Overflows = m_overflows.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void FileWatcher::Run()
+{
+	Profiler::SetThreadName("File watcher");
+	m_platform->Run(*this);
+}
+
+void FileWatcher::Post(const std::string& directory, const std::string& name)
+{
+	FileChange change;
+	change.Path = directory + '/' + name;
+	std::replace(change.Path.begin(), change.Path.end(), '\\', '/');
+	if (m_queue.TryPush(change))
+		m_changes.fetch_add(1, std::memory_order_relaxed);
+	else
+		PostOverflow();
+}
+
+void FileWatcher::PostOverflow() noexcept
+{
+	m_overflows.fetch_add(1, std::memory_order_relaxed);
+	m_overflow.store(true, std::memory_order_release);
+}
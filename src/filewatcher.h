@@ -0,0 +1,105 @@
+/**
+ * @file filewatcher.h
+ * @brief Background watcher of file changes in directories
+ * @details A thread blocks on the operating system's change notifications, ReadDirectoryChangesW() on
+ * Windows and inotify on Linux, and posts the paths of written, created and renamed files to a lock-free
+ * queue. The thread that owns the watcher drains the queue with Poll(), which costs three atomic loads
+ * when nothing changed, instead of opening every watched file once per frame.
+ *
+ * Notifications are not recursive, only files directly in a watched directory are reported. One save
+ * can be reported more than once. If the queue or the operating system's buffer overflows, changes are
+ * lost and Poll() reports an overflow, after which anything watched may have changed.
+*/
+
+#pragma once
+#ifndef FILEWATCHER_H
+#define FILEWATCHER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spscqueue.h"
+
+//! Number of changes that can be queued between two polls
+#define FILEWATCHER_QUEUE_CAPACITY 256
+
+/**
+ * @brief A changed file, or lost changes.
+*/
+struct FileChange
+{
+	std::string Path; //!< Watched directory and file name joined with '/', empty on overflow
+	bool Overflow = false; //!< Changes were lost, any watched file may have changed
+};
+
+/**
+ * @brief Notifications received by a FileWatcher.
+*/
+struct FileWatcherStats
+{
+	uint64_t Changes = 0; //!< Changes posted to the queue
+	uint64_t Overflows = 0; //!< Times changes were lost
+};
+
+/**
+ * @brief Watches directories on a background thread.
+*/
+class FileWatcher
+{
+public:
+	FileWatcher();
+	~FileWatcher();
+
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	/**
+	 * @brief Start watching, restarting if already running.
+	 * @param[in] directories Directories to watch, relative to the working directory or absolute.
+	 * @return False if a directory could not be watched or notifications are not supported, nothing is watched then.
+	*/
+	bool Start(const std::vector<std::string>& directories);
+
+	/**
+	 * @brief Stop watching and join the thread. Queued changes are kept.
+	*/
+	void Stop();
+
+	/**
+	 * @brief True between a successful Start() and Stop().
+	*/
+	bool IsRunning() const noexcept { return m_thread.joinable(); }
+
+	/**
+	 * @brief Take the oldest change, from one thread only.
+	 * @param[out] change The change, or an overflow which is reported before the changes queued after it.
+	 * @return False if there are no changes.
+	*/
+	bool Poll(FileChange& change);
+
+	/**
+	 * @brief Get the number of changes and overflows since construction.
+	*/
+	FileWatcherStats GetStats() const noexcept;
+
+private:
+	struct Platform;
+
+	void Run();
+	void Post(const std::string& directory, const std::string& name);
+	void PostOverflow() noexcept;
+
+	std::unique_ptr<Platform> m_platform;
+	std::vector<std::string> m_directories;
+	std::thread m_thread;
+
+	SpscQueue<FileChange> m_queue;
+	std::atomic<bool> m_overflow{ false };
+	std::atomic<uint64_t> m_changes{ 0 };
+	std::atomic<uint64_t> m_overflows{ 0 };
+};
+
+#endif
@@ -0,0 +1,150 @@
+//
+// File watcher benchmark
+//
+// Nothing is written while the idle frames are polled, so every change
+// reported then is counted against the watcher. Writes are spaced apart so
+// the operating system does not merge their notifications.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <sys/stat.h>
+#include "filewatcherbenchmark.h"
+#include "filewatcher.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+namespace
+{
+	const char* const TemporaryFile = "file_watcher_benchmark.tmp";
+
+	bool EndsWith(const std::string& text, const std::string& suffix)
+	{
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+
+	bool WriteFile(const std::string& path, unsigned value)
+	{
+		std::ofstream out(path, std::ios::trunc);
+		out << value << "\n";
+		return (bool)out;
+	}
+
+	// Drain the changes reported in a short while, counting those of the file
+	unsigned DrainChanges(FileWatcher& watcher, const std::string& file)
+	{
+		unsigned changes = 0;
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		FileChange change;
+		while (watcher.Poll(change))
+			if (change.Overflow || EndsWith(change.Path, file))
+				changes++;
+		return changes;
+	}
+}
+
+FileWatcherBenchmarkResult RunFileWatcherFrames(const std::string& directory, unsigned frames)
+{
+	FileWatcherBenchmarkResult result;
+	result.Frames = frames;
+
+	const std::string path = directory + "/" + TemporaryFile;
+	if (!WriteFile(path, 0))
+		return result;
+
+	FileWatcher watcher;
+	result.Started = watcher.Start({ directory });
+	if (!result.Started)
+	{
+		std::remove(path.c_str());
+		return result;
+	}
+
+	// Idle frames: the cost of asking for changes when there are none
+	FileChange change;
+	int64_t start = Profiler::Now();
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		while (watcher.Poll(change))
+			result.IdleChanges++;
+	}
+	result.PollNanoseconds = frames ? (double)(Profiler::Now() - start) / frames : 0.0;
+
+	// What hot reload cost per frame without the watcher, for comparison
+	const unsigned queries = frames < 10000 ? frames : 10000;
+	uint64_t checksum = 0;
+	start = Profiler::Now();
+	for (unsigned frame = 0; frame < queries; frame++)
+	{
+		std::ifstream file(path);
+		struct stat status;
+		if (file && stat(path.c_str(), &status) == 0)
+			checksum += (uint64_t)status.st_mtime;
+	}
+	result.FileQueryNanoseconds = queries && checksum ? (double)(Profiler::Now() - start) / queries : 0.0;
+
+	// Latency from starting a write until it is seen
+	std::vector<double> latencies;
+	for (unsigned write = 0; write < FILEWATCHERBENCHMARK_WRITES; write++)
+	{
+		result.Writes++;
+		start = Profiler::Now();
+		WriteFile(path, write + 1);
+
+		bool seen = false;
+		while (!seen && Profiler::Now() - start < 1000000000)
+		{
+			if (!watcher.Poll(change))
+				std::this_thread::yield();
+			else
+				seen = change.Overflow || EndsWith(change.Path, TemporaryFile);
+		}
+		if (seen)
+			latencies.push_back(MillisecondsSince(start));
+		else
+			result.Missed++;
+		result.Duplicates += DrainChanges(watcher, TemporaryFile);
+	}
+	result.LatencyMilliseconds = BenchmarkSummary::Compute(latencies);
+
+	watcher.Stop();
+	std::remove(path.c_str());
+	return result;
+}
+
+bool RunFileWatcherBenchmark(unsigned frames, const std::string& report_filename)
+{
+	printf("File watcher, %u idle frames, %u writes...\n", frames, FILEWATCHERBENCHMARK_WRITES);
+	const FileWatcherBenchmarkResult result = RunFileWatcherFrames(".", frames);
+	if (!result.Started)
+	{
+		printf("\tCould not watch the working directory\n");
+		return false;
+	}
+
+	printf("\tPoll per idle frame: %.1f ns, %u changes reported\n", result.PollNanoseconds, result.IdleChanges);
+	printf("\tFile open and write time per frame: %.1f ns\n", result.FileQueryNanoseconds);
+	printf("\tLatency p50 %.3f ms, max %.3f ms, %u missed, %u duplicates\n", result.LatencyMilliseconds.P50,
+		result.LatencyMilliseconds.Max, result.Missed, result.Duplicates);
+
+	const bool passed = result.IdleChanges == 0 && result.Missed == 0;
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("frames").Value(result.Frames);
+		json.Key("idle_changes").Value(result.IdleChanges);
+		json.Key("poll_ns_per_frame").Value(result.PollNanoseconds);
+		json.Key("file_query_ns_per_frame").Value(result.FileQueryNanoseconds);
+		json.Key("writes").Value(result.Writes);
+		json.Key("missed").Value(result.Missed);
+		json.Key("duplicates").Value(result.Duplicates);
+		json.Key("latency").BeginObject();
+		json.Key("p50_ms").Value(result.LatencyMilliseconds.P50);
+		json.Key("p95_ms").Value(result.LatencyMilliseconds.P95);
+		json.Key("max_ms").Value(result.LatencyMilliseconds.Max);
+		json.EndObject();
+		json.Key("passed").Value(passed);
+	});
+	return passed && written;
+}
@@ -0,0 +1,49 @@
+/**
+ * @file filewatcherbenchmark.h
+ * @brief Per-frame cost and latency of the file watcher
+ * @details Measures what watching costs a frame when no file changes, compared with opening a file and
+ * reading its write time every frame as shader hot reload used to, and how long a write takes to show up
+ * in FileWatcher::Poll().
+*/
+
+#pragma once
+#ifndef FILEWATCHERBENCHMARK_H
+#define FILEWATCHERBENCHMARK_H
+
+#include <string>
+#include "benchmark.h"
+
+//! Number of frames polled without changes
+#define FILEWATCHERBENCHMARK_DEFAULT_FRAMES 100000
+
+//! Number of writes timed for latency
+#define FILEWATCHERBENCHMARK_WRITES 20
+
+/**
+ * @brief Per-frame costs and latencies of a file watcher benchmark.
+*/
+struct FileWatcherBenchmarkResult
+{
+	bool Started = false; //!< The watcher could watch the directory
+	unsigned Frames = 0; //!< Frames polled without changes
+	unsigned IdleChanges = 0; //!< Changes reported while nothing was written, expected to be zero
+	double PollNanoseconds = 0.0; //!< Draining the watcher per frame with no changes
+	double FileQueryNanoseconds = 0.0; //!< Opening a file and reading its write time per frame
+	unsigned Writes = 0; //!< Files written to time latency
+	unsigned Missed = 0; //!< Writes that were not reported within a second
+	unsigned Duplicates = 0; //!< Extra reports of the same write
+	BenchmarkSummary LatencyMilliseconds; //!< From starting a write until Poll() reported it
+};
+
+/**
+ * @brief Watch a directory and run the measurements, writing a temporary file in it.
+*/
+FileWatcherBenchmarkResult RunFileWatcherFrames(const std::string& directory, unsigned frames);
+
+/**
+ * @brief Run the benchmark in the working directory.
+ * @return True if the watcher started, reported no change while idle, missed no write, and the report was written.
+*/
+bool RunFileWatcherBenchmark(unsigned frames, const std::string& report_filename);
+
+#endif
@@ -0,0 +1,43 @@
+//
+// Fixed-timestep accumulator
+//
+// The accumulator is kept in double precision: summing float frame times
+// loses whole steps after a few hours of running.
+//
+
+#include "fixedtimestep.h"
+
+FixedTimestep::FixedTimestep(double step_seconds, unsigned max_steps) noexcept
+	: m_step(step_seconds > 0.0 ? step_seconds : FIXEDTIMESTEP_DEFAULT_STEP)
+	, m_max_steps(max_steps ? max_steps : 1)
+{
+}
+
+unsigned FixedTimestep::Advance(double elapsed_seconds) noexcept
+{
+	if (elapsed_seconds > 0.0)
+		m_accumulator += elapsed_seconds;
+
+	unsigned steps = (unsigned)(m_accumulator / m_step);
+	if (steps > m_max_steps)
+	{
+		// Running every step would make the next frame longer still
+		m_stats.DroppedSeconds += (steps - m_max_steps) * m_step;
+		m_accumulator -= (steps - m_max_steps) * m_step;
+		steps = m_max_steps;
+	}
+	m_accumulator -= steps * m_step;
+	if (m_accumulator < 0.0)
+		m_accumulator = 0.0;
+
+	m_stats.FrameSteps = steps;
+	m_stats.Steps += steps;
+	m_stats.Frames++;
+	return steps;
+}
+
+void FixedTimestep::Reset() noexcept
+{
+	m_accumulator = 0.0;
+	m_stats = FixedTimestepStats();
+}
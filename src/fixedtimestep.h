@@ -0,0 +1,78 @@
+/**
+ * @file fixedtimestep.h
+ * @brief Fixed-timestep accumulator decoupling simulation from rendering
+ * @details Frame times are added to an accumulator that is consumed in steps of a fixed length, so the
+ * simulation advances the same way at any frame rate. The remainder, as a fraction of a step, is the
+ * interpolation factor between the last two simulation states to render with.
+*/
+
+#pragma once
+#ifndef FIXEDTIMESTEP_H
+#define FIXEDTIMESTEP_H
+
+//! Length of a simulation step, in seconds
+#define FIXEDTIMESTEP_DEFAULT_STEP (1.0 / 60.0)
+
+//! Most steps run for one frame, the rest of a long frame is dropped to let the simulation catch up
+#define FIXEDTIMESTEP_MAX_STEPS 8
+
+/**
+ * @brief Counters of a FixedTimestep since it was created or reset.
+*/
+struct FixedTimestepStats
+{
+	unsigned FrameSteps = 0; //!< Steps of the last frame
+	unsigned long long Steps = 0; //!< Steps of all frames
+	unsigned long long Frames = 0; //!< Calls to Advance()
+	double DroppedSeconds = 0.0; //!< Time discarded after frames longer than the step limit
+};
+
+/**
+ * @brief Accumulates frame times into fixed simulation steps.
+*/
+class FixedTimestep
+{
+public:
+	/**
+	 * @brief Create an empty accumulator.
+	 * @param[in] step_seconds Length of a step.
+	 * @param[in] max_steps Most steps per frame, at least 1.
+	*/
+	explicit FixedTimestep(double step_seconds = FIXEDTIMESTEP_DEFAULT_STEP, unsigned max_steps = FIXEDTIMESTEP_MAX_STEPS) noexcept;
+
+	/**
+	 * @brief Add the time of a frame.
+	 * @param[in] elapsed_seconds Time since the last call, negative times are ignored.
+	 * @return Number of steps to run this frame.
+	*/
+	unsigned Advance(double elapsed_seconds) noexcept;
+
+	/**
+	 * @brief Get the time left over after the steps, as a fraction of a step in [0,1).
+	 * @details 0 renders the state of the last step, values towards 1 approach the next one.
+	*/
+	float GetAlpha() const noexcept { return (float)(m_accumulator / m_step); }
+
+	/**
+	 * @brief Get the length of a step, in seconds.
+	*/
+	float GetStep() const noexcept { return (float)m_step; }
+
+	/**
+	 * @brief Empty the accumulator and zero the counters, e.g. after a pause.
+	*/
+	void Reset() noexcept;
+
+	/**
+	 * @brief Get the counters.
+	*/
+	const FixedTimestepStats& GetStats() const noexcept { return m_stats; }
+
+private:
+	double m_step;
+	unsigned m_max_steps;
+	double m_accumulator = 0.0;
+	FixedTimestepStats m_stats;
+};
+
+#endif
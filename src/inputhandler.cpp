@@ -9,6 +9,7 @@ InputHandler& InputHandler::operator=(InputHandler&& other) noexcept
 {
 	if (this == &other) return *this;
 
+	std::swap(m_window, other.m_window);
 	std::swap(m_direct_input, other.m_direct_input);
 	std::swap(m_keyboard, other.m_keyboard);
 	std::swap(m_mouse, other.m_mouse);
@@ -19,12 +20,14 @@ InputHandler& InputHandler::operator=(InputHandler&& other) noexcept
 	std::swap(m_screen_width, other.m_screen_width);
 	std::swap(m_screen_height, other.m_screen_height);
 	std::swap(m_mouse_x, other.m_mouse_x);
+	std::swap(m_mouse_y, other.m_mouse_y);
 
 	return *this;
 }
 
 bool InputHandler::Initialize(HINSTANCE hInstance, HWND hWnd, int screenWidth, int screenHeight) noexcept
 {
+	m_window = hWnd;
 	m_screen_height = screenHeight;
 	m_screen_width = screenWidth;
 	m_mouse_x = 0;
@@ -132,6 +135,11 @@ bool InputHandler::IsKeyPressed(Keys key) const noexcept
 	return m_keyboard_state[(int)key] & 0x80;
 }
 
+bool InputHandler::IsMouseButtonPressed(MouseButtons button) const noexcept
+{
+	return m_mouse_state.rgbButtons[(int)button] & 0x80;
+}
+
 LONG InputHandler::GetMouseDeltaX() const noexcept
 {
 	return m_mouse_state.lX;
@@ -184,6 +192,16 @@ bool InputHandler::ReadMouse() noexcept
 
 void InputHandler::ProcessInput() noexcept
 {
-	m_mouse_x += m_mouse_state.lX;
-	m_mouse_y += m_mouse_state.lY;
+	// DirectInput only reports relative motion, so the cursor location is taken from the OS
+	POINT cursor;
+	if (GetCursorPos(&cursor) && ScreenToClient(m_window, &cursor))
+	{
+		m_mouse_x = cursor.x;
+		m_mouse_y = cursor.y;
+	}
+	else
+	{
+		m_mouse_x += m_mouse_state.lX;
+		m_mouse_y += m_mouse_state.lY;
+	}
 }
\ No newline at end of file
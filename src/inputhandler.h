@@ -27,6 +27,16 @@ enum class Keys
 	Esc = DIK_ESCAPE,
 };
 
+/**
+ * @brief Mouse buttons
+*/
+enum class MouseButtons
+{
+	Left = 0,
+	Right = 1,
+	Middle = 2,
+};
+
 /**
  * @brief Class that handles mouse and keyboard input.
  * @details Uses DirectInput internally.
@@ -39,7 +49,7 @@ public:
 	 * @see Initialize(HINSTANCE, HWND, int, int)
 	*/
 	constexpr InputHandler() noexcept 
-		: m_direct_input(nullptr), m_keyboard(nullptr), m_mouse(nullptr), m_keyboard_state(), m_mouse_state(), m_previous_mouse_state(), m_screen_width(0), m_screen_height(0), m_mouse_x(0), m_mouse_y(0) {}
+		: m_window(nullptr), m_direct_input(nullptr), m_keyboard(nullptr), m_mouse(nullptr), m_keyboard_state(), m_mouse_state(), m_previous_mouse_state(), m_screen_width(0), m_screen_height(0), m_mouse_x(0), m_mouse_y(0) {}
 
 	/**
 	 * @brief Destructor, does nothing, see Shutdown()
@@ -89,6 +99,7 @@ public:
 
 	/**
 	 * @brief Gets the current X and Y location of the mouse cursor.
+	 * @details Coordinates are in pixels relative to the upper-left corner of the window client area.
 	 * @param[out] mouse_x Will be set to the X coordinate of the mouse. 
 	 * @param[out] mouse_y Will be set to the Y coordinate of the mouse. 
 	*/
@@ -101,6 +112,13 @@ public:
 	*/
 	bool IsKeyPressed(Keys key) const noexcept;
 
+	/**
+	 * @brief Check if the given mouse button is currently pressed.
+	 * @param[in] button Button to check @see MouseButtons
+	 * @return True if the button is currently held down.
+	*/
+	bool IsMouseButtonPressed(MouseButtons button) const noexcept;
+
 	/**
 	 * @brief Gets the mouse X delta since last Update()
 	 * @return Pixels moved in X since last Update()
@@ -114,6 +132,7 @@ public:
 	LONG GetMouseDeltaY() const noexcept;
 
 private:
+	HWND m_window;
 	IDirectInput8* m_direct_input;
 	IDirectInputDevice8* m_keyboard;
 	IDirectInputDevice8* m_mouse;
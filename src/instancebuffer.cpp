@@ -0,0 +1,77 @@
+//
+// Instance buffer
+//
+// Instances are packed into system memory first: packing writes a slot for
+// every instance and only keeps the visible ones, which is fine for cached
+// memory but not for the write-combined memory a mapped buffer may be.
+//
+
+#include "instancebuffer.h"
+#include "devicestate.h"
+
+const D3D11_INPUT_ELEMENT_DESC InstanceBuffer::Layout[INSTANCEBUFFER_LAYOUT_COUNT] = {
+	{ "INSTANCE_TRANSFORM", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, INSTANCEBUFFER_SLOT, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_TRANSFORM", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, INSTANCEBUFFER_SLOT, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_TRANSFORM", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, INSTANCEBUFFER_SLOT, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_TRANSFORM", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, INSTANCEBUFFER_SLOT, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "INSTANCE_DATA", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, INSTANCEBUFFER_SLOT, 64, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+};
+
+InstanceBuffer::InstanceBuffer(ID3D11Device* device, UINT capacity)
+	: m_device(device)
+{
+	Create(capacity);
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	SAFE_RELEASE(m_buffer);
+}
+
+void InstanceBuffer::Create(UINT capacity)
+{
+	SAFE_RELEASE(m_buffer);
+	m_capacity = 0;
+
+	D3D11_BUFFER_DESC bufferDesc = { 0 };
+	bufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.ByteWidth = (UINT)(capacity * sizeof(InstanceData));
+	if (SUCCEEDED(m_device->CreateBuffer(&bufferDesc, nullptr, &m_buffer)))
+	{
+		SETNAME(m_buffer, "InstanceBuffer");
+		m_capacity = capacity;
+	}
+}
+
+UINT InstanceBuffer::Update(ID3D11DeviceContext* context, const linalg::frustum& world_frustum, const linalg::aabb& bounds,
+	const InstanceData* instances, size_t count, CullStats* stats)
+{
+	if (m_packed.size() < count)
+		m_packed.resize(count);
+	m_count = (UINT)PackInstances(world_frustum, bounds, instances, count, m_packed.data(), stats);
+
+	if (m_count > m_capacity)
+	{
+		UINT capacity = m_capacity ? m_capacity : INSTANCEBUFFER_DEFAULT_CAPACITY;
+		while (capacity < m_count)
+			capacity *= 2;
+		Create(capacity);
+	}
+
+	D3D11_MAPPED_SUBRESOURCE resource;
+	if (!m_buffer || !m_count || FAILED(context->Map(m_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &resource)))
+	{
+		m_count = 0;
+		return 0;
+	}
+	memcpy(resource.pData, m_packed.data(), m_count * sizeof(InstanceData));
+	context->Unmap(m_buffer, 0);
+	return m_count;
+}
+
+void InstanceBuffer::Bind(DeviceState& state) const
+{
+	state.SetVertexBuffer(INSTANCEBUFFER_SLOT, m_buffer, sizeof(InstanceData), 0);
+}
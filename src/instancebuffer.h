@@ -0,0 +1,88 @@
+/**
+ * @file instancebuffer.h
+ * @brief Dynamic vertex buffer of the visible instances of a model
+ * @details Filled every frame by PackInstances() into a CPU array and copied to the buffer with one
+ * WRITE_DISCARD map, then bound to INSTANCEBUFFER_SLOT next to the vertex buffer of the model for
+ * Model::RenderInstanced(). The buffer grows to the largest number of visible instances seen.
+*/
+
+#pragma once
+#ifndef INSTANCEBUFFER_H
+#define INSTANCEBUFFER_H
+
+#include <vector>
+#include "stdafx.h"
+#include "instancing.h"
+
+//! Input slot the instance buffer is bound to, slot 0 holds the vertices
+#define INSTANCEBUFFER_SLOT 1
+
+//! Number of instances the buffer has room for when created
+#define INSTANCEBUFFER_DEFAULT_CAPACITY 1024
+
+//! Number of elements of InstanceBuffer::Layout
+#define INSTANCEBUFFER_LAYOUT_COUNT 5
+
+class DeviceState;
+
+/**
+ * @brief GPU copy of the visible instances of a frame.
+*/
+class InstanceBuffer
+{
+public:
+	/**
+	 * @brief Input elements of InstanceData, to append to the vertex elements of an instanced vertex shader.
+	 * @details INSTANCE_TRANSFORM 0-3 are the columns of the model-to-world matrix, INSTANCE_DATA is InstanceData::Data.
+	*/
+	static const D3D11_INPUT_ELEMENT_DESC Layout[INSTANCEBUFFER_LAYOUT_COUNT];
+
+	/**
+	 * @brief Create an empty buffer.
+	 * @param[in] device Device to create the buffer on.
+	 * @param[in] capacity Number of instances to make room for.
+	*/
+	explicit InstanceBuffer(ID3D11Device* device, UINT capacity = INSTANCEBUFFER_DEFAULT_CAPACITY);
+
+	/**
+	 * @brief Releases the buffer.
+	*/
+	~InstanceBuffer();
+
+	InstanceBuffer(const InstanceBuffer&) = delete;
+	InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+	/**
+	 * @brief Cull instances and copy the visible ones to the buffer.
+	 * @param[in] context Context to map the buffer with.
+	 * @param[in] world_frustum View frustum in world space.
+	 * @param[in] bounds Object space bounds of the instanced model.
+	 * @param[in] instances Instances of the model.
+	 * @param[in] count Number of instances.
+	 * @param[in,out] stats Statistics to accumulate into, may be nullptr.
+	 * @return Number of visible instances, the instance count to draw.
+	*/
+	UINT Update(ID3D11DeviceContext* context, const linalg::frustum& world_frustum, const linalg::aabb& bounds,
+		const InstanceData* instances, size_t count, CullStats* stats);
+
+	/**
+	 * @brief Bind the buffer to INSTANCEBUFFER_SLOT.
+	*/
+	void Bind(DeviceState& state) const;
+
+	/**
+	 * @brief Get the number of instances written by the last Update().
+	*/
+	UINT GetCount() const noexcept { return m_count; }
+
+private:
+	ID3D11Device* m_device;
+	ID3D11Buffer* m_buffer = nullptr;
+	UINT m_capacity = 0;
+	UINT m_count = 0;
+	std::vector<InstanceData> m_packed;
+
+	void Create(UINT capacity);
+};
+
+#endif
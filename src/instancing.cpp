@@ -0,0 +1,141 @@
+//
+// Instance culling and packing
+//
+// With SSE2 an instance is one pass over its five registers: the columns of
+// its matrix give the world center and extents of the bounds with a few
+// multiply-adds, and the six frustum planes are tested in two groups of four
+// laid out by component. Every instance is stored to the next free slot and
+// the slot only advances if it was visible, so packing does not branch.
+//
+
+#include <chrono>
+#include <cstring>
+#include "instancing.h"
+
+#ifdef LINALG_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace linalg;
+
+namespace
+{
+#ifdef LINALG_SSE2
+	// Four planes by component, padded with planes every point is inside
+	struct PlaneGroup
+	{
+		__m128 Nx, Ny, Nz, D;
+		__m128 AbsNx, AbsNy, AbsNz;
+	};
+
+	void LoadPlanes(const frustum& f, PlaneGroup groups[2])
+	{
+		for (int group = 0; group < 2; group++)
+		{
+			float nx[4], ny[4], nz[4], d[4];
+			for (int i = 0; i < 4; i++)
+			{
+				const int index = group * 4 + i;
+				const plane p = index < 6 ? f.planes[index] : plane(vec3f(0.0f, 0.0f, 0.0f), 1.0f);
+				nx[i] = p.n.x;
+				ny[i] = p.n.y;
+				nz[i] = p.n.z;
+				d[i] = p.d;
+			}
+			PlaneGroup& g = groups[group];
+			g.Nx = _mm_loadu_ps(nx);
+			g.Ny = _mm_loadu_ps(ny);
+			g.Nz = _mm_loadu_ps(nz);
+			g.D = _mm_loadu_ps(d);
+
+			const __m128 sign = _mm_set1_ps(-0.0f);
+			g.AbsNx = _mm_andnot_ps(sign, g.Nx);
+			g.AbsNy = _mm_andnot_ps(sign, g.Ny);
+			g.AbsNz = _mm_andnot_ps(sign, g.Nz);
+		}
+	}
+
+	__m128 Splat(__m128 v, int lane)
+	{
+		switch (lane)
+		{
+		case 0: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0));
+		case 1: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1));
+		default: return _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2));
+		}
+	}
+#endif
+}
+
+size_t PackInstances(const frustum& world_frustum, const aabb& bounds, const InstanceData* instances, size_t count,
+	InstanceData* packed, CullStats* stats)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	size_t visible = 0;
+
+	if (bounds.empty())
+	{
+		memcpy(packed, instances, count * sizeof(InstanceData));
+		visible = count;
+	}
+	else
+	{
+		const vec3f center = bounds.center(), extents = bounds.extents();
+#ifdef LINALG_SSE2
+		PlaneGroup groups[2];
+		LoadPlanes(world_frustum, groups);
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 zero = _mm_setzero_ps();
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const float* m = &instances[i].ModelToWorld.col[0].x;
+			const __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8), c3 = _mm_loadu_ps(m + 12);
+			const __m128 data = _mm_loadu_ps(&instances[i].Data.x);
+
+			// World space center and extents, in the same order as transform(const mat4f&, const aabb&)
+			const __m128 worldCenter = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(c0, _mm_set1_ps(center.x)), _mm_mul_ps(c1, _mm_set1_ps(center.y))),
+				_mm_mul_ps(c2, _mm_set1_ps(center.z))), c3);
+			const __m128 worldExtents = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(_mm_andnot_ps(sign, c0), _mm_set1_ps(extents.x)), _mm_mul_ps(_mm_andnot_ps(sign, c1), _mm_set1_ps(extents.y))),
+				_mm_mul_ps(_mm_andnot_ps(sign, c2), _mm_set1_ps(extents.z)));
+
+			const __m128 cx = Splat(worldCenter, 0), cy = Splat(worldCenter, 1), cz = Splat(worldCenter, 2);
+			const __m128 ex = Splat(worldExtents, 0), ey = Splat(worldExtents, 1), ez = Splat(worldExtents, 2);
+
+			// Outside if the signed distance of the center plus the projected radius is negative for any plane
+			__m128 outside = zero;
+			for (const PlaneGroup& g : groups)
+			{
+				const __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(g.Nx, cx), _mm_mul_ps(g.Ny, cy)), _mm_mul_ps(g.Nz, cz)), g.D);
+				const __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, g.AbsNx), _mm_mul_ps(ey, g.AbsNy)), _mm_mul_ps(ez, g.AbsNz));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+			}
+
+			float* out = &packed[visible].ModelToWorld.col[0].x;
+			_mm_storeu_ps(out, c0);
+			_mm_storeu_ps(out + 4, c1);
+			_mm_storeu_ps(out + 8, c2);
+			_mm_storeu_ps(out + 12, c3);
+			_mm_storeu_ps(&packed[visible].Data.x, data);
+			visible += _mm_movemask_ps(outside) == 0;
+		}
+#else
+		for (size_t i = 0; i < count; i++)
+		{
+			if (world_frustum.intersects(transform(instances[i].ModelToWorld, bounds)))
+				packed[visible++] = instances[i];
+		}
+#endif
+	}
+
+	if (stats)
+	{
+		const auto end = std::chrono::high_resolution_clock::now();
+		stats->Tested += (unsigned)count;
+		stats->Visible += (unsigned)visible;
+		stats->Milliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+	}
+	return visible;
+}
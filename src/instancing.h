@@ -0,0 +1,44 @@
+/**
+ * @file instancing.h
+ * @brief Per-instance culling and packing for instanced draws
+ * @details Copies of one model are drawn with one instanced draw per index range, reading the model-to-world
+ * matrix of each copy from an instance buffer instead of a constant buffer updated per copy. PackInstances()
+ * culls the copies against the view frustum and packs the visible ones for the instance buffer in one pass,
+ * four frustum planes at a time with SSE2.
+*/
+
+#pragma once
+#ifndef INSTANCING_H
+#define INSTANCING_H
+
+#include <cstddef>
+#include "vec/bounds.h"
+#include "vec/mat.h"
+#include "culling.h"
+
+/**
+ * @brief One copy of a model, as it is laid out in the instance buffer.
+*/
+struct InstanceData
+{
+	linalg::mat4f ModelToWorld = linalg::mat4f_identity; //!< Model-to-world matrix, by columns as in TransformationBuffer
+	linalg::vec4f Data = { 1.0f, 1.0f, 1.0f, 1.0f }; //!< Per-instance shader data, e.g. a colour
+};
+
+/**
+ * @brief Copy the instances whose bounds intersect a frustum to a packed array.
+ * @details The bounds of each instance are transformed to world space as linalg::transform() does, and
+ * tested as linalg::frustum::intersects() does, so the result is that of culling every copy on its own,
+ * up to rounding of bounds that touch a plane.
+ * @param[in] world_frustum Frustum in world space.
+ * @param[in] bounds Object space bounds of the model, an empty box passes every instance.
+ * @param[in] instances Instances to cull.
+ * @param[in] count Number of instances.
+ * @param[out] packed Receives the visible instances in their original order, room for count instances.
+ * @param[in,out] stats Statistics to accumulate into, may be nullptr.
+ * @return Number of visible instances.
+*/
+size_t PackInstances(const linalg::frustum& world_frustum, const linalg::aabb& bounds, const InstanceData* instances, size_t count,
+	InstanceData* packed, CullStats* stats);
+
+#endif
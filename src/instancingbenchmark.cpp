@@ -0,0 +1,131 @@
+//
+// Instancing benchmark
+//
+// The per-copy path writes the three matrices of a draw to one constant
+// buffer sized block, as UpdateTransformationBuffer() does through Map(), so
+// the comparison covers the CPU work of both paths but not the driver calls
+// the per-copy path also makes for every copy.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "instancingbenchmark.h"
+#include "buffers.h"
+#include "instancing.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	const unsigned Counts[] = { 10000, 30000, 100000 };
+
+	void WriteSummary(JsonWriter& json, const char* name, const BenchmarkSummary& summary, unsigned instances)
+	{
+		json.Key(name).BeginObject();
+		json.Key("p50_ms").Value(summary.P50);
+		json.Key("p95_ms").Value(summary.P95);
+		json.Key("ns_per_instance").Value(instances ? summary.P50 * 1e6 / instances : 0.0);
+		json.EndObject();
+	}
+}
+
+InstancingBenchmarkResult RunInstancingFrames(unsigned instances, unsigned frames)
+{
+	InstancingBenchmarkResult result;
+	result.Instances = instances;
+	result.Frames = frames;
+
+	// Unit cubes scattered around a camera at the origin looking down -z
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> height(-20.0f, 20.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 2.0f * fPI);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+	std::vector<InstanceData> field(instances);
+	for (InstanceData& instance : field)
+	{
+		instance.ModelToWorld = mat4f::translation(position(random), height(random), position(random)) *
+			mat4f::rotation(angle(random), 0.0f, 1.0f, 0.0f) * mat4f::scaling(scale(random));
+	}
+	const aabb bounds(vec3f(-0.5f, -0.5f, -0.5f), vec3f(0.5f, 0.5f, 0.5f));
+
+	TransformationBuffer transforms;
+	transforms.WorldToViewMatrix = mat4f_identity;
+	transforms.ProjectionMatrix = mat4f::projection(45.0f * fTO_RAD, 16.0f / 9.0f, 1.0f, 500.0f);
+	const frustum viewFrustum = frustum::from_matrix(transforms.ProjectionMatrix * transforms.WorldToViewMatrix);
+
+	std::vector<InstanceData> packed(instances);
+	std::vector<TransformationBuffer> constantBuffer(1);
+	std::vector<uint32_t> perCopyVisible;
+	perCopyVisible.reserve(instances);
+	std::vector<double> pack, perCopy;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		int64_t start = Profiler::Now();
+		const size_t visible = PackInstances(viewFrustum, bounds, field.data(), field.size(), packed.data(), nullptr);
+		pack.push_back(MillisecondsSince(start));
+
+		start = Profiler::Now();
+		perCopyVisible.clear();
+		for (uint32_t i = 0; i < instances; i++)
+		{
+			if (!viewFrustum.intersects(transform(field[i].ModelToWorld, bounds)))
+				continue;
+			transforms.ModelToWorldMatrix = field[i].ModelToWorld;
+			memcpy(constantBuffer.data(), &transforms, sizeof(transforms));
+			perCopyVisible.push_back(i);
+		}
+		perCopy.push_back(MillisecondsSince(start));
+
+		bool match = visible == perCopyVisible.size();
+		for (size_t i = 0; i < visible && match; i++)
+			match = memcmp(&packed[i], &field[perCopyVisible[i]], sizeof(InstanceData)) == 0;
+		if (!match)
+			result.Mismatches++;
+		result.Visible = (unsigned)visible;
+	}
+
+	result.PackMilliseconds = BenchmarkSummary::Compute(pack);
+	result.PerCopyMilliseconds = BenchmarkSummary::Compute(perCopy);
+	return result;
+}
+
+bool RunInstancingBenchmark(unsigned frames, const std::string& report_filename)
+{
+	std::vector<InstancingBenchmarkResult> results;
+	printf("Instancing, %u frames...\n", frames);
+	printf("\t%10s %10s %14s %14s %10s\n", "Instances", "Visible", "Pack ns/inst", "Copy ns/inst", "Speedup");
+	for (unsigned count : Counts)
+	{
+		results.push_back(RunInstancingFrames(count, frames));
+		const InstancingBenchmarkResult& result = results.back();
+		const double pack = result.PackMilliseconds.P50 * 1e6 / count;
+		const double perCopy = result.PerCopyMilliseconds.P50 * 1e6 / count;
+		printf("\t%10u %10u %14.2f %14.2f %9.1fx%s\n", count, result.Visible, pack, perCopy, pack > 0.0 ? perCopy / pack : 0.0,
+			result.Mismatches ? "  MISMATCH" : "");
+	}
+
+	bool passed = true;
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("frames").Value(frames);
+		json.Key("counts").BeginArray();
+		for (const InstancingBenchmarkResult& result : results)
+		{
+			json.BeginObject();
+			json.Key("instances").Value(result.Instances);
+			json.Key("visible").Value(result.Visible);
+			json.Key("mismatches").Value(result.Mismatches);
+			WriteSummary(json, "pack", result.PackMilliseconds, result.Instances);
+			WriteSummary(json, "per_copy", result.PerCopyMilliseconds, result.Instances);
+			json.EndObject();
+			passed = passed && result.Mismatches == 0;
+		}
+		json.EndArray();
+		json.Key("passed").Value(passed);
+	});
+	return passed && written;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file instancingbenchmark.h
+ * @brief CPU cost of instanced drawing against drawing every copy on its own
+ * @details Culls and packs a field of random instances with PackInstances() every frame, and compares it
+ * with what drawing each copy costs the CPU before the driver: culling its bounds, then writing a
+ * TransformationBuffer for it. Both must find the same visible instances.
+*/
+
+#pragma once
+#ifndef INSTANCINGBENCHMARK_H
+#define INSTANCINGBENCHMARK_H
+
+#include <string>
+#include "benchmark.h"
+
+//! Number of frames per instance count
+#define INSTANCINGBENCHMARK_DEFAULT_FRAMES 100
+
+/**
+ * @brief Times and results of one instance count.
+*/
+struct InstancingBenchmarkResult
+{
+	unsigned Instances = 0; //!< Instances in the field
+	unsigned Frames = 0; //!< Frames run
+	unsigned Visible = 0; //!< Instances inside the view frustum
+	unsigned Mismatches = 0; //!< Frames where packing and per-copy culling disagreed
+	BenchmarkSummary PackMilliseconds; //!< PackInstances() of all instances
+	BenchmarkSummary PerCopyMilliseconds; //!< Culling each copy and writing its constant buffer
+};
+
+/**
+ * @brief Cull a field of random instances, seen by a fixed camera, for a number of frames.
+*/
+InstancingBenchmarkResult RunInstancingFrames(unsigned instances, unsigned frames);
+
+/**
+ * @brief Run 10k, 30k and 100k instances.
+ * @return True if packing matched per-copy culling for every count and the report was written.
+*/
+bool RunInstancingBenchmark(unsigned frames, const std::string& report_filename);
+
+#endif
@@ -0,0 +1,269 @@
+//
+// Job system stress test and scaling benchmark
+//
+// Every check counts what actually ran and compares it with what was
+// started, so lost, duplicated or reordered jobs show up as a failure
+// rather than a hang or a crash far from the cause.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include "jobbenchmark.h"
+#include "benchmark.h"
+#include "jobsystem.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+namespace
+{
+	// Several threads start many small jobs at once, contending for the shared deque
+	bool CheckFanOut(std::string& failure)
+	{
+		const unsigned Threads = 4;
+		const int JobsPerThread = 2000;
+		std::atomic<int> total(0);
+		std::atomic<int> perThread[Threads + 1];
+		for (auto& count : perThread)
+			count = 0;
+
+		auto submit = [&](unsigned thread)
+		{
+			JobCounter counter;
+			for (int i = 0; i < JobsPerThread; i++)
+				JobSystem::Run([&, thread]() { perThread[thread]++; total++; }, &counter);
+			JobSystem::Wait(counter);
+		};
+
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < Threads; t++)
+			threads.emplace_back(submit, t);
+		submit(Threads);
+		for (std::thread& thread : threads)
+			thread.join();
+
+		for (unsigned t = 0; t <= Threads; t++)
+			if (perThread[t] != JobsPerThread)
+				return FailCheck(failure, "fan-out: a thread's jobs ran " + std::to_string(perThread[t].load()) + " times instead of " + std::to_string(JobsPerThread));
+		if (total != (int)(Threads + 1) * JobsPerThread)
+			return FailCheck(failure, "fan-out: wrong total");
+		return true;
+	}
+
+	// Jobs start children on the counter they run under, waiting on it waits for the whole tree
+	bool CheckJobTree(std::string& failure)
+	{
+		const int Branching = 4;
+		const int Depth = 6;
+		std::atomic<int> nodes(0);
+		JobCounter counter;
+
+		struct Tree
+		{
+			static void Spawn(int depth, std::atomic<int>& nodes, JobCounter& counter)
+			{
+				nodes++;
+				if (depth == 0)
+					return;
+				for (int i = 0; i < Branching; i++)
+					JobSystem::Run([depth, &nodes, &counter]() { Spawn(depth - 1, nodes, counter); }, &counter);
+			}
+		};
+		JobSystem::Run([&]() { Tree::Spawn(Depth, nodes, counter); }, &counter);
+		JobSystem::Wait(counter);
+
+		int expected = 0;
+		for (int level = 0, width = 1; level <= Depth; level++, width *= Branching)
+			expected += width;
+		if (nodes != expected)
+			return FailCheck(failure, "job tree: " + std::to_string(nodes.load()) + " nodes ran instead of " + std::to_string(expected));
+		return true;
+	}
+
+	// Stages chained with RunAfter() must see all jobs of the previous stage finished
+	bool CheckDependencies(std::string& failure)
+	{
+		const int Stages = 16;
+		const int JobsPerStage = 32;
+		std::unique_ptr<JobCounter[]> stages(new JobCounter[Stages]);
+		std::unique_ptr<std::atomic<int>[]> finished(new std::atomic<int>[Stages]);
+		std::atomic<int> violations(0);
+		for (int s = 0; s < Stages; s++)
+			finished[s] = 0;
+
+		for (int s = 0; s < Stages; s++)
+		{
+			for (int j = 0; j < JobsPerStage; j++)
+			{
+				auto job = [&, s]()
+				{
+					if (s > 0 && finished[s - 1] != JobsPerStage)
+						violations++;
+					finished[s]++;
+				};
+				if (s == 0)
+					JobSystem::Run(job, &stages[s]);
+				else
+					JobSystem::RunAfter(stages[s - 1], job, &stages[s]);
+			}
+		}
+		for (int s = 0; s < Stages; s++)
+			JobSystem::Wait(stages[s]);
+
+		if (violations)
+			return FailCheck(failure, "dependencies: " + std::to_string(violations.load()) + " jobs ran before their dependency finished");
+		for (int s = 0; s < Stages; s++)
+			if (finished[s] != JobsPerStage)
+				return FailCheck(failure, "dependencies: stage " + std::to_string(s) + " ran " + std::to_string(finished[s].load()) + " jobs");
+		return true;
+	}
+
+	// Parallel loops inside jobs of a parallel loop, every element visited exactly once
+	bool CheckNestedLoops(std::string& failure, unsigned round)
+	{
+		const size_t Outer = 64;
+		const size_t Inner = 1000 + round * 37;
+		std::vector<int> visits(Outer * Inner, 0);
+
+		JobSystem::ParallelFor(0, Outer, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t o = begin; o < end; o++)
+			{
+				JobSystem::ParallelFor(0, Inner, 1 + round % 7 * 13, [&, o](size_t innerBegin, size_t innerEnd)
+				{
+					for (size_t i = innerBegin; i < innerEnd; i++)
+						visits[o * Inner + i]++;
+				});
+			}
+		});
+
+		for (size_t i = 0; i < visits.size(); i++)
+			if (visits[i] != 1)
+				return FailCheck(failure, "nested loops: element " + std::to_string(i) + " visited " + std::to_string(visits[i]) + " times");
+		return true;
+	}
+
+	// Compute bound loop body, about the same cost for every element
+	void Work(size_t begin, size_t end, std::vector<float>& out)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			float x = (float)i;
+			for (int k = 0; k < 64; k++)
+				x = std::sqrt(x + 1.0f);
+			out[i] = x;
+		}
+	}
+}
+
+bool RunJobStressTest(unsigned rounds, std::string& failure)
+{
+	for (unsigned round = 0; round < rounds; round++)
+	{
+		if (!CheckFanOut(failure) || !CheckJobTree(failure) || !CheckDependencies(failure) || !CheckNestedLoops(failure, round))
+		{
+			failure = "round " + std::to_string(round) + ", " + failure;
+			return false;
+		}
+	}
+	return true;
+}
+
+std::vector<JobScalingResult> RunJobScaling(unsigned max_workers)
+{
+	const size_t Elements = 1 << 20;
+	const unsigned EmptyJobs = 100000;
+	std::vector<float> out(Elements);
+
+	std::vector<unsigned> workerCounts = { 0 };
+	for (unsigned workers = 1; workers < max_workers; workers *= 2)
+		workerCounts.push_back(workers);
+	if (max_workers)
+		workerCounts.push_back(max_workers);
+
+	std::vector<JobScalingResult> results;
+	for (unsigned workers : workerCounts)
+	{
+		JobSystem::Shutdown();
+		if (workers)
+			JobSystem::Initialize(workers);
+
+		JobScalingResult result;
+		result.Workers = workers;
+
+		// Best of three, the first run also warms up the workers
+		result.LoopMilliseconds = 1e30;
+		for (int run = 0; run < 3; run++)
+		{
+			const int64_t start = Profiler::Now();
+			JobSystem::ParallelFor(0, Elements, 0, [&](size_t begin, size_t end) { Work(begin, end, out); });
+			const double milliseconds = MillisecondsSince(start);
+			if (milliseconds < result.LoopMilliseconds)
+				result.LoopMilliseconds = milliseconds;
+		}
+		result.Speedup = results.empty() ? 1.0 : results[0].LoopMilliseconds / result.LoopMilliseconds;
+
+		JobCounter counter;
+		const int64_t start = Profiler::Now();
+		for (unsigned i = 0; i < EmptyJobs; i++)
+			JobSystem::Run([]() {}, &counter);
+		JobSystem::Wait(counter);
+		result.JobNanoseconds = (double)(Profiler::Now() - start) / EmptyJobs;
+
+		results.push_back(result);
+	}
+	JobSystem::Shutdown();
+	return results;
+}
+
+bool RunJobBenchmark(const std::string& report_filename)
+{
+	const unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned maxWorkers = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+
+	// Stress with few workers, one per core, and more workers than cores
+	const unsigned stressWorkers[] = { 1, maxWorkers, 2 * hardwareThreads };
+	const unsigned StressRounds = 20;
+	bool passed = true;
+	std::string failure;
+	for (unsigned workers : stressWorkers)
+	{
+		JobSystem::Initialize(workers);
+		const int64_t start = Profiler::Now();
+		passed = RunJobStressTest(StressRounds, failure);
+		const JobSystemStats stats = JobSystem::GetStats();
+		JobSystem::Shutdown();
+		printf("Job stress test, %u workers: %s in %.0f ms, %llu jobs, %llu steals\n", workers,
+			passed ? "passed" : failure.c_str(), MillisecondsSince(start),
+			(unsigned long long)stats.Jobs, (unsigned long long)stats.Steals);
+		if (!passed)
+			break;
+	}
+
+	const std::vector<JobScalingResult> scaling = RunJobScaling(maxWorkers);
+	printf("\t%8s %10s %8s %10s\n", "Workers", "Loop ms", "Speedup", "ns/job");
+	for (const JobScalingResult& result : scaling)
+		printf("\t%8u %10.2f %8.2f %10.1f\n", result.Workers, result.LoopMilliseconds, result.Speedup, result.JobNanoseconds);
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("hardware_threads").Value(hardwareThreads);
+		json.Key("stress_passed").Value(passed);
+		json.Key("stress_failure").Value(failure);
+		json.Key("scaling").BeginArray();
+		for (const JobScalingResult& result : scaling)
+		{
+			json.BeginObject();
+			json.Key("workers").Value(result.Workers);
+			json.Key("loop_ms").Value(result.LoopMilliseconds);
+			json.Key("speedup").Value(result.Speedup);
+			json.Key("ns_per_job").Value(result.JobNanoseconds);
+			json.EndObject();
+		}
+		json.EndArray();
+	});
+	return passed && written;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file jobbenchmark.h
+ * @brief Stress test and scaling benchmark of the job system
+ * @details The stress test hammers the scheduler from several threads at once with fan-out, nested job
+ * trees, dependency chains and nested parallel loops, and checks that every job ran exactly once and
+ * in dependency order. The scaling benchmark times a parallel loop and a burst of small jobs at
+ * increasing worker counts.
+*/
+
+#pragma once
+#ifndef JOBBENCHMARK_H
+#define JOBBENCHMARK_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief Times at one worker count.
+*/
+struct JobScalingResult
+{
+	unsigned Workers = 0; //!< Worker threads, the calling thread helps as well
+	double LoopMilliseconds = 0.0; //!< Parallel loop over a compute bound workload
+	double Speedup = 0.0; //!< Loop time without workers divided by LoopMilliseconds
+	double JobNanoseconds = 0.0; //!< Cost per empty job of a burst started from one thread
+};
+
+/**
+ * @brief Run the stress test with the current workers.
+ * @param[in] rounds Number of times to repeat every check.
+*/
+bool RunJobStressTest(unsigned rounds, std::string& failure);
+
+/**
+ * @brief Time the workloads at 0, 1, 2, 4, ... workers, up to max_workers.
+ * @details Restarts the job system for every count and leaves it stopped.
+*/
+std::vector<JobScalingResult> RunJobScaling(unsigned max_workers);
+
+/**
+ * @brief Run the stress test at several worker counts and the scaling benchmark.
+ * @details Leaves the job system stopped.
+*/
+bool RunJobBenchmark(const std::string& report_filename);
+
+#endif
@@ -0,0 +1,317 @@
+//
+// Work-stealing job scheduler
+//
+// Deque 0 is shared by all threads that are not workers; worker i owns deque
+// i. A thread pops its own deque at the back and steals at the front of the
+// others. Each deque has its own mutex, which is rarely contended by more
+// than one thief at a time.
+//
+// Idle workers sleep on a condition variable. The number of queued jobs and
+// the number of sleepers are both sequentially consistent atomics: a pusher
+// increments the queue count and then checks for sleepers, a worker increments
+// the sleepers and then checks the queue count, so one of the two always sees
+// the other and no wakeup is lost.
+//
+// A counter is decremented to zero under its mutex, which Wait() also takes
+// before it returns, so a counter is never touched after its waiter has moved
+// on and possibly destroyed it.
+//
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include "jobsystem.h"
+#include "profiler.h"
+
+namespace
+{
+	struct QueuedJob
+	{
+		Job Function;
+		JobCounter* Counter;
+	};
+
+	struct JobQueue
+	{
+		std::mutex Mutex;
+		std::deque<QueuedJob> Jobs;
+	};
+
+	struct Scheduler
+	{
+		std::vector<std::unique_ptr<JobQueue>> Queues; // deque 0 is shared by non-worker threads
+		std::vector<std::thread> Workers;
+		std::atomic<int> Queued{ 0 };
+		std::atomic<int> Sleeping{ 0 };
+		std::atomic<bool> Stop{ false };
+		std::atomic<bool> Running{ false };
+		std::mutex SleepMutex;
+		std::condition_variable Wake;
+
+		std::atomic<uint64_t> Jobs{ 0 };
+		std::atomic<uint64_t> Steals{ 0 };
+		std::atomic<uint64_t> Sleeps{ 0 };
+
+		// Workers still running at exit must not outlive the queues they use
+		~Scheduler() { StopWorkers(); }
+
+		void StopWorkers()
+		{
+			{
+				std::lock_guard<std::mutex> lock(SleepMutex);
+				Stop = true;
+				Wake.notify_all();
+			}
+			for (std::thread& worker : Workers)
+				worker.join();
+			Workers.clear();
+			Running = false;
+		}
+	};
+
+	Scheduler& GetScheduler()
+	{
+		static Scheduler scheduler;
+		return scheduler;
+	}
+
+	// Deque of the calling thread, 0 for threads that are not workers
+	thread_local unsigned t_queue = 0;
+
+	bool FindJob(QueuedJob& job)
+	{
+		Scheduler& scheduler = GetScheduler();
+		if (scheduler.Queued.load() <= 0)
+			return false;
+
+		// Own deque first, newest job
+		{
+			JobQueue& queue = *scheduler.Queues[t_queue];
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			if (!queue.Jobs.empty())
+			{
+				job = std::move(queue.Jobs.back());
+				queue.Jobs.pop_back();
+				scheduler.Queued.fetch_sub(1);
+				return true;
+			}
+		}
+
+		// Then the oldest job of another deque
+		const size_t queueCount = scheduler.Queues.size();
+		for (size_t i = 1; i < queueCount; i++)
+		{
+			JobQueue& queue = *scheduler.Queues[(t_queue + i) % queueCount];
+			std::lock_guard<std::mutex> lock(queue.Mutex);
+			if (!queue.Jobs.empty())
+			{
+				job = std::move(queue.Jobs.front());
+				queue.Jobs.pop_front();
+				scheduler.Queued.fetch_sub(1);
+				scheduler.Steals.fetch_add(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+void JobSystem::Initialize(unsigned worker_count)
+{
+	Scheduler& scheduler = GetScheduler();
+	if (scheduler.Running)
+		Shutdown();
+
+	if (!worker_count)
+	{
+		const unsigned hardwareThreads = std::thread::hardware_concurrency();
+		worker_count = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+	if (worker_count > JOBSYSTEM_MAX_WORKERS)
+		worker_count = JOBSYSTEM_MAX_WORKERS;
+
+	scheduler.Queues.clear();
+	for (unsigned i = 0; i <= worker_count; i++)
+		scheduler.Queues.push_back(std::make_unique<JobQueue>());
+	scheduler.Queued = 0;
+	scheduler.Stop = false;
+	scheduler.Jobs = 0;
+	scheduler.Steals = 0;
+	scheduler.Sleeps = 0;
+
+	for (unsigned i = 1; i <= worker_count; i++)
+	{
+		scheduler.Workers.emplace_back([i]()
+		{
+			Scheduler& scheduler = GetScheduler();
+			t_queue = i;
+			Profiler::SetThreadName(("Worker " + std::to_string(i)).c_str());
+
+			while (true)
+			{
+				QueuedJob job;
+				if (FindJob(job))
+				{
+					Execute(job.Function, job.Counter);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(scheduler.SleepMutex);
+				if (scheduler.Stop)
+					break;
+				scheduler.Sleeping.fetch_add(1);
+				if (scheduler.Queued.load() <= 0 && !scheduler.Stop)
+				{
+					scheduler.Sleeps.fetch_add(1, std::memory_order_relaxed);
+					scheduler.Wake.wait(lock);
+				}
+				scheduler.Sleeping.fetch_sub(1);
+			}
+		});
+	}
+	scheduler.Running = true;
+}
+
+void JobSystem::Shutdown()
+{
+	Scheduler& scheduler = GetScheduler();
+	if (!scheduler.Running)
+		return;
+
+	scheduler.StopWorkers();
+
+	// Jobs started during shutdown run on the calling thread
+	QueuedJob job;
+	while (FindJob(job))
+		Execute(job.Function, job.Counter);
+}
+
+unsigned JobSystem::GetWorkerCount() noexcept
+{
+	const Scheduler& scheduler = GetScheduler();
+	return scheduler.Running ? (unsigned)scheduler.Workers.size() : 0;
+}
+
+JobSystemStats JobSystem::GetStats() noexcept
+{
+	const Scheduler& scheduler = GetScheduler();
+	JobSystemStats stats;
+	stats.Jobs = scheduler.Jobs.load(std::memory_order_relaxed);
+	stats.Steals = scheduler.Steals.load(std::memory_order_relaxed);
+	stats.Sleeps = scheduler.Sleeps.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void JobSystem::Run(Job job, JobCounter* counter)
+{
+	if (counter)
+		counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+	Start(std::move(job), counter);
+}
+
+void JobSystem::RunAfter(JobCounter& dependency, Job job, JobCounter* counter)
+{
+	if (counter)
+		counter->m_pending.fetch_add(1, std::memory_order_relaxed);
+	{
+		std::lock_guard<std::mutex> lock(dependency.m_mutex);
+		if (dependency.m_pending.load(std::memory_order_acquire) > 0)
+		{
+			dependency.m_continuations.push_back({ std::move(job), counter });
+			return;
+		}
+	}
+	Start(std::move(job), counter);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+	while (counter.m_pending.load(std::memory_order_acquire) > 0)
+	{
+		QueuedJob job;
+		if (GetScheduler().Running && FindJob(job))
+			Execute(job.Function, job.Counter);
+		else
+			std::this_thread::yield();
+	}
+
+	// The last job may still hold the counter's mutex
+	std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::ParallelFor(size_t begin, size_t end, size_t grain, const JobRangeFunction& function)
+{
+	if (begin >= end)
+		return;
+	if (!grain)
+	{
+		const size_t parts = 4 * ((size_t)GetWorkerCount() + 1);
+		grain = (end - begin + parts - 1) / parts;
+	}
+
+	// Split off the upper half as a job until the rest is small enough
+	JobCounter counter;
+	struct Splitter
+	{
+		static void Split(size_t begin, size_t end, size_t grain, const JobRangeFunction& function, JobCounter& counter)
+		{
+			while (end - begin > grain)
+			{
+				const size_t middle = begin + (end - begin) / 2;
+				Run([middle, end, grain, &function, &counter]() { Split(middle, end, grain, function, counter); }, &counter);
+				end = middle;
+			}
+			function(begin, end);
+		}
+	};
+	Splitter::Split(begin, end, grain, function, counter);
+	Wait(counter);
+}
+
+void JobSystem::Start(Job&& job, JobCounter* counter)
+{
+	Scheduler& scheduler = GetScheduler();
+	if (!scheduler.Running)
+	{
+		Execute(job, counter);
+		return;
+	}
+
+	JobQueue& queue = *scheduler.Queues[t_queue];
+	{
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		queue.Jobs.push_back({ std::move(job), counter });
+	}
+
+	scheduler.Queued.fetch_add(1);
+	if (scheduler.Sleeping.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(scheduler.SleepMutex);
+		scheduler.Wake.notify_one();
+	}
+}
+
+void JobSystem::Execute(Job& job, JobCounter* counter)
+{
+	job();
+	job = nullptr; // release the captures before the counter signals completion
+	GetScheduler().Jobs.fetch_add(1, std::memory_order_relaxed);
+	if (counter)
+		Finish(*counter);
+}
+
+void JobSystem::Finish(JobCounter& counter)
+{
+	std::vector<JobCounter::Continuation> ready;
+	{
+		std::lock_guard<std::mutex> lock(counter.m_mutex);
+		if (counter.m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			ready.swap(counter.m_continuations);
+	}
+
+	// Their counters were incremented by RunAfter()
+	for (JobCounter::Continuation& continuation : ready)
+		Start(std::move(continuation.Function), continuation.Counter);
+}
@@ -0,0 +1,141 @@
+/**
+ * @file jobsystem.h
+ * @brief Work-stealing job scheduler
+ * @details A fixed set of worker threads runs jobs, small functions without a return value. Every worker
+ * owns a deque: it pushes and pops its own jobs at the back, so nested work stays hot in its cache,
+ * and idle workers steal from the front of the other deques. Threads that are not workers, such as
+ * the main thread, share one more deque.
+ *
+ * Completion is tracked with JobCounter: every job started with a counter increments it and decrements
+ * it when done. A job may start child jobs on the counter it runs under, so waiting on the counter waits
+ * for the whole tree. JobSystem::Wait() runs other jobs while it waits, so jobs can wait on their children
+ * without blocking a worker. RunAfter() starts a job once a counter reaches zero, to chain dependent work.
+ *
+ * Without Initialize(), jobs run immediately on the calling thread, so code using the job system works
+ * the same in tools and tests that never start workers. Jobs must not throw. Uses only the
+ * standard library.
+*/
+
+#pragma once
+#ifndef JOBSYSTEM_H
+#define JOBSYSTEM_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+//! Maximum number of worker threads
+#define JOBSYSTEM_MAX_WORKERS 64
+
+//! A unit of work
+typedef std::function<void()> Job;
+
+//! Body of a parallel loop, called with a range [begin, end) of the loop
+typedef std::function<void(size_t begin, size_t end)> JobRangeFunction;
+
+/**
+ * @brief Number of unfinished jobs started with it, and jobs waiting for it to reach zero.
+ * @details Must not be destroyed before JobSystem::Wait() on it has returned.
+*/
+class JobCounter
+{
+public:
+	JobCounter() noexcept = default;
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	/**
+	 * @brief True if all jobs started with the counter have finished.
+	*/
+	bool IsDone() const noexcept { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	struct Continuation
+	{
+		Job Function;
+		JobCounter* Counter;
+	};
+
+	std::atomic<int> m_pending{ 0 };
+	std::mutex m_mutex; // guards m_continuations and the decrement to zero
+	std::vector<Continuation> m_continuations;
+};
+
+/**
+ * @brief Counters of the scheduler since Initialize().
+*/
+struct JobSystemStats
+{
+	uint64_t Jobs = 0; //!< Jobs run by workers and waiting threads
+	uint64_t Steals = 0; //!< Jobs taken from another thread's deque
+	uint64_t Sleeps = 0; //!< Times a worker went to sleep for lack of work
+};
+
+/**
+ * @brief The job scheduler.
+ * @details Initialize() and Shutdown() must be called from one thread while no jobs are running.
+ * All other functions may be called from any thread, including from jobs.
+*/
+class JobSystem
+{
+public:
+	/**
+	 * @brief Start the worker threads.
+	 * @param[in] worker_count Number of workers, 0 for one less than the number of hardware threads.
+	*/
+	static void Initialize(unsigned worker_count = 0);
+
+	/**
+	 * @brief Stop and join the worker threads. Jobs run on the calling thread afterwards.
+	*/
+	static void Shutdown();
+
+	/**
+	 * @brief Get the number of worker threads, 0 when not initialized.
+	*/
+	static unsigned GetWorkerCount() noexcept;
+
+	/**
+	 * @brief Get the counters of the scheduler.
+	*/
+	static JobSystemStats GetStats() noexcept;
+
+	/**
+	 * @brief Start a job.
+	 * @param[in] job Function to run.
+	 * @param[in,out] counter Incremented now and decremented when the job has finished, or nullptr.
+	*/
+	static void Run(Job job, JobCounter* counter = nullptr);
+
+	/**
+	 * @brief Start a job when a counter reaches zero, or now if it is zero.
+	 * @param[in,out] dependency Counter to wait for.
+	 * @param[in] job Function to run.
+	 * @param[in,out] counter Incremented now and decremented when the job has finished, or nullptr.
+	*/
+	static void RunAfter(JobCounter& dependency, Job job, JobCounter* counter = nullptr);
+
+	/**
+	 * @brief Run jobs on the calling thread until a counter reaches zero.
+	*/
+	static void Wait(JobCounter& counter);
+
+	/**
+	 * @brief Call a function over the range [begin, end) split in parts of at most grain elements, in parallel.
+	 * @details The range is split in halves recursively, one half started as a job and the other continued
+	 * on the same thread, so idle workers steal large parts first. Returns when all parts are done.
+	 * @param[in] grain Largest part, 0 to split in about four parts per thread.
+	*/
+	static void ParallelFor(size_t begin, size_t end, size_t grain, const JobRangeFunction& function);
+
+private:
+	static void Start(Job&& job, JobCounter* counter);
+	static void Execute(Job& job, JobCounter* counter);
+	static void Finish(JobCounter& counter);
+};
+
+#endif
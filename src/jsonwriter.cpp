@@ -0,0 +1,146 @@
+//
+// Minimal streaming JSON writer
+//
+
+#include <cmath>
+#include <cstdio>
+#include "jsonwriter.h"
+
+JsonWriter& JsonWriter::BeginObject()
+{
+	Begin('{');
+	return *this;
+}
+
+JsonWriter& JsonWriter::EndObject()
+{
+	End('}');
+	return *this;
+}
+
+JsonWriter& JsonWriter::BeginArray()
+{
+	Begin('[');
+	return *this;
+}
+
+JsonWriter& JsonWriter::EndArray()
+{
+	End(']');
+	return *this;
+}
+
+JsonWriter& JsonWriter::Key(const char* key)
+{
+	BeforeValue();
+	WriteString(key);
+	m_out << (m_scopes.empty() || m_scopes.back().Indented ? ": " : ":");
+	m_after_key = true;
+	return *this;
+}
+
+JsonWriter& JsonWriter::Value(double value)
+{
+	BeforeValue();
+	if (std::isfinite(value))
+	{
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.9g", value);
+		m_out << buffer;
+	}
+	else
+		m_out << "null";
+	return *this;
+}
+
+JsonWriter& JsonWriter::Value(int64_t value)
+{
+	BeforeValue();
+	m_out << value;
+	return *this;
+}
+
+JsonWriter& JsonWriter::Value(uint64_t value)
+{
+	BeforeValue();
+	m_out << value;
+	return *this;
+}
+
+JsonWriter& JsonWriter::Value(bool value)
+{
+	BeforeValue();
+	m_out << (value ? "true" : "false");
+	return *this;
+}
+
+JsonWriter& JsonWriter::Value(const char* value)
+{
+	BeforeValue();
+	WriteString(value);
+	return *this;
+}
+
+void JsonWriter::BeforeValue()
+{
+	// A value following a key is already placed
+	if (m_after_key)
+	{
+		m_after_key = false;
+		return;
+	}
+	if (m_scopes.empty())
+		return;
+
+	Scope& scope = m_scopes.back();
+	if (!scope.Empty)
+		m_out << ',';
+	if (scope.Indented)
+		m_out << '\n' << std::string(m_scopes.size(), '\t');
+	scope.Empty = false;
+}
+
+void JsonWriter::Begin(char bracket)
+{
+	BeforeValue();
+	m_out << bracket;
+	const bool parentIndented = m_scopes.empty() || m_scopes.back().Indented;
+	m_scopes.push_back({ true, parentIndented && m_scopes.size() < m_max_indent_depth });
+}
+
+void JsonWriter::End(char bracket)
+{
+	const Scope scope = m_scopes.back();
+	m_scopes.pop_back();
+	if (scope.Indented && !scope.Empty)
+		m_out << '\n' << std::string(m_scopes.size(), '\t');
+	m_out << bracket;
+	if (m_scopes.empty())
+		m_out << '\n';
+}
+
+void JsonWriter::WriteString(const char* value)
+{
+	m_out << '"';
+	for (const char* c = value; *c; c++)
+	{
+		switch (*c)
+		{
+		case '"': m_out << "\\\""; break;
+		case '\\': m_out << "\\\\"; break;
+		case '\n': m_out << "\\n"; break;
+		case '\r': m_out << "\\r"; break;
+		case '\t': m_out << "\\t"; break;
+		default:
+			if ((unsigned char)*c < 0x20)
+			{
+				char buffer[8];
+				snprintf(buffer, sizeof(buffer), "\\u%04x", (unsigned)(unsigned char)*c);
+				m_out << buffer;
+			}
+			else
+				m_out << *c;
+		}
+	}
+	m_out << '"';
+}
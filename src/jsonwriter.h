@@ -0,0 +1,73 @@
+/**
+ * @file jsonwriter.h
+ * @brief Minimal streaming JSON writer
+ * @details Used for machine readable reports, e.g. benchmark results.
+*/
+
+#pragma once
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Writes JSON to a stream, one value at a time.
+ * @details Inside objects every value must be preceded by Key(). Commas and indentation are handled by the writer.
+ * @code
+ * JsonWriter json(stream);
+ * json.BeginObject();
+ * json.Key("frames").Value(100);
+ * json.EndObject();
+ * @endcode
+*/
+class JsonWriter
+{
+public:
+	/**
+	 * @brief Create a writer.
+	 * @param[in,out] out Stream to write to.
+	 * @param[in] max_indent_depth Containers nested deeper than this are written on a single line.
+	*/
+	JsonWriter(std::ostream& out, unsigned max_indent_depth = 8) : m_out(out), m_max_indent_depth(max_indent_depth) { }
+
+	JsonWriter& BeginObject(); //!< Start an object, {
+	JsonWriter& EndObject(); //!< End the current object, }
+	JsonWriter& BeginArray(); //!< Start an array, [
+	JsonWriter& EndArray(); //!< End the current array, ]
+
+	/**
+	 * @brief Write the key of the next object member.
+	*/
+	JsonWriter& Key(const char* key);
+
+	JsonWriter& Value(double value); //!< Write a number, non-finite numbers are written as null
+	JsonWriter& Value(int64_t value); //!< Write an integer
+	JsonWriter& Value(uint64_t value); //!< Write an unsigned integer
+	JsonWriter& Value(int value) { return Value((int64_t)value); } //!< Write an integer
+	JsonWriter& Value(unsigned value) { return Value((uint64_t)value); } //!< Write an unsigned integer
+	JsonWriter& Value(bool value); //!< Write true or false
+	JsonWriter& Value(const char* value); //!< Write an escaped string
+	JsonWriter& Value(const std::string& value) { return Value(value.c_str()); } //!< Write an escaped string
+
+private:
+	struct Scope
+	{
+		bool Empty;
+		bool Indented;
+	};
+
+	void BeforeValue();
+	void Begin(char bracket);
+	void End(char bracket);
+	void WriteString(const char* value);
+
+	std::ostream& m_out;
+	unsigned m_max_indent_depth;
+	std::vector<Scope> m_scopes;
+	bool m_after_key = false;
+};
+
+#endif
@@ -0,0 +1,110 @@
+//
+// Batch load benchmark
+//
+// One untimed load first brings the files into the OS cache. The heap run
+// goes before the arena run; both start from a warm cache.
+//
+
+#include <cstdio>
+#include "loadbenchmark.h"
+#include "jsonwriter.h"
+#include "memoryarena.h"
+#include "memorytracker.h"
+#include "objloader.h"
+#include "profiler.h"
+
+double BatchLoadResult::GetTotalMilliseconds() const noexcept
+{
+	double total = 0.0;
+	for (double milliseconds : LoadMilliseconds)
+		total += milliseconds;
+	return total;
+}
+
+BatchLoadResult RunBatchLoad(const std::vector<std::string>& files, unsigned repeat, MemoryArena* arena)
+{
+	BatchLoadResult result;
+	result.LoadMilliseconds.reserve(files.size() * repeat);
+	const AllocationCount start = GetThreadAllocationCount();
+
+	for (unsigned i = 0; i < repeat; i++)
+	{
+		for (const std::string& file : files)
+		{
+			const int64_t loadStart = Profiler::Now();
+			{
+				OBJLoader loader;
+				loader.Load(file, true, true, arena);
+			}
+			result.LoadMilliseconds.push_back(MillisecondsSince(loadStart));
+			if (arena && arena->GetPeakBytes() > result.ArenaPeakBytes)
+				result.ArenaPeakBytes = arena->GetPeakBytes();
+		}
+	}
+
+	// Allocations of the reserved result vector are made before the start count
+	const AllocationCount end = GetThreadAllocationCount();
+	result.Allocations = end.Allocations - start.Allocations;
+	result.AllocatedBytes = end.Bytes - start.Bytes;
+	result.ArenaCapacity = arena ? arena->GetCapacity() : 0;
+	return result;
+}
+
+namespace
+{
+	void WriteResult(JsonWriter& json, const BatchLoadResult& result)
+	{
+		const BenchmarkSummary summary = BenchmarkSummary::Compute(result.LoadMilliseconds);
+		const double loads = result.LoadMilliseconds.empty() ? 1.0 : (double)result.LoadMilliseconds.size();
+		json.BeginObject();
+		json.Key("loads").Value((uint64_t)result.LoadMilliseconds.size());
+		json.Key("total_ms").Value(result.GetTotalMilliseconds());
+		json.Key("mean_ms").Value(summary.Mean);
+		json.Key("p50_ms").Value(summary.P50);
+		json.Key("p95_ms").Value(summary.P95);
+		json.Key("max_ms").Value(summary.Max);
+		json.Key("allocations").Value(result.Allocations);
+		json.Key("allocations_per_load").Value(result.Allocations / loads);
+		json.Key("allocated_bytes").Value(result.AllocatedBytes);
+		json.Key("arena_capacity").Value((uint64_t)result.ArenaCapacity);
+		json.Key("arena_peak_bytes").Value((uint64_t)result.ArenaPeakBytes);
+		json.EndObject();
+	}
+
+	void PrintResult(const char* name, const BatchLoadResult& result)
+	{
+		const BenchmarkSummary summary = BenchmarkSummary::Compute(result.LoadMilliseconds);
+		const double loads = result.LoadMilliseconds.empty() ? 1.0 : (double)result.LoadMilliseconds.size();
+		printf("\t%-6s %10.1f %10.2f %10.2f %14.0f %14.1f\n", name, result.GetTotalMilliseconds(), summary.Mean, summary.P95,
+			result.Allocations / loads, result.AllocatedBytes / loads / 1024.0);
+	}
+}
+
+bool RunLoadBenchmark(const std::vector<std::string>& files, unsigned repeat, const std::string& report_filename)
+{
+	printf("Batch loading %u files %u times...\n", (unsigned)files.size(), repeat);
+	RunBatchLoad(files, 1, nullptr);
+
+	const BatchLoadResult heap = RunBatchLoad(files, repeat, nullptr);
+	MemoryArena arena;
+	const BatchLoadResult arenaResult = RunBatchLoad(files, repeat, &arena);
+
+	printf("\t%-6s %10s %10s %10s %14s %14s\n", "", "Total ms", "Mean ms", "p95 ms", "Allocs/load", "KiB/load");
+	PrintResult("Heap", heap);
+	PrintResult("Arena", arenaResult);
+	printf("\tArena: %.1f MiB in %u blocks, %.1f MiB peak per load\n", arena.GetCapacity() / (1024.0 * 1024.0),
+		(unsigned)arena.GetBlockCount(), arenaResult.ArenaPeakBytes / (1024.0 * 1024.0));
+
+	return WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("files").BeginArray();
+		for (const std::string& file : files)
+			json.Value(file);
+		json.EndArray();
+		json.Key("repeat").Value(repeat);
+		json.Key("heap");
+		WriteResult(json, heap);
+		json.Key("arena");
+		WriteResult(json, arenaResult);
+	});
+}
@@ -0,0 +1,54 @@
+/**
+ * @file loadbenchmark.h
+ * @brief Batch load benchmark of the OBJ loader
+ * @details Loads a list of models many times over, once with the loader's temporary data on the heap
+ * and once in a MemoryArena reused by all loads, to measure what the arena saves in allocations and time.
+*/
+
+#pragma once
+#ifndef LOADBENCHMARK_H
+#define LOADBENCHMARK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "benchmark.h"
+
+class MemoryArena;
+
+//! Number of times the files are loaded in a batch load benchmark
+#define LOADBENCHMARK_DEFAULT_REPEATS 20
+
+/**
+ * @brief Results of a batch of loads.
+*/
+struct BatchLoadResult
+{
+	std::vector<double> LoadMilliseconds; //!< Time of each load
+	uint64_t Allocations = 0; //!< Heap allocations of all loads
+	uint64_t AllocatedBytes = 0; //!< Bytes allocated from the heap by all loads
+	size_t ArenaCapacity = 0; //!< Size of the arena after the batch
+	size_t ArenaPeakBytes = 0; //!< Most arena memory used by one load
+
+	/**
+	 * @brief Sum of all load times.
+	*/
+	double GetTotalMilliseconds() const noexcept;
+};
+
+/**
+ * @brief Load every file repeat times with a new OBJLoader.
+ * @param[in] files OBJ files to load.
+ * @param[in] repeat Number of times to load the list.
+ * @param[in,out] arena Arena for the temporary data of the loads, or nullptr to use the heap.
+ * @throw std::runtime_error if a file fails to load.
+*/
+BatchLoadResult RunBatchLoad(const std::vector<std::string>& files, unsigned repeat, MemoryArena* arena);
+
+/**
+ * @brief Load the files with and without an arena, print the comparison and write it as JSON.
+ * @return True if the report was written.
+*/
+bool RunLoadBenchmark(const std::vector<std::string>& files, unsigned repeat, const std::string& report_filename);
+
+#endif
@@ -0,0 +1,158 @@
+//
+// Stage timings and sizes of model loads
+//
+
+#include <cstdio>
+#include <fstream>
+#include "loadreport.h"
+
+void LoadReport::AddStage(const char* name, double milliseconds, const AllocationCount& allocations)
+{
+	LoadStageStats* stage = nullptr;
+	for (LoadStageStats& existing : Stages)
+		if (existing.Name == name)
+			stage = &existing;
+	if (!stage)
+	{
+		Stages.push_back(LoadStageStats());
+		stage = &Stages.back();
+		stage->Name = name;
+	}
+
+	stage->Calls++;
+	stage->Milliseconds += milliseconds;
+	stage->Allocations += allocations.Allocations;
+	stage->AllocatedBytes += allocations.Bytes;
+}
+
+double LoadReport::GetTotalMilliseconds() const noexcept
+{
+	double total = 0.0;
+	for (const LoadStageStats& stage : Stages)
+		total += stage.Milliseconds;
+	return total;
+}
+
+void LoadReport::Print() const
+{
+	printf("Loaded %s in %.1f ms\n", Filename.c_str(), GetTotalMilliseconds());
+	printf("\t%-20s %6s %10s %12s %12s\n", "Stage", "Calls", "ms", "Allocations", "KiB");
+	for (const LoadStageStats& stage : Stages)
+		printf("\t%-20s %6u %10.2f %12llu %12.1f\n", stage.Name.c_str(), stage.Calls, stage.Milliseconds,
+			(unsigned long long)stage.Allocations, stage.AllocatedBytes / 1024.0);
+	printf("\tInput: %.1f KiB, %.1f KiB materials, %u positions, %u normals, %u texcoords, %u triangles, %u quads, %u drawcalls\n",
+		FileBytes / 1024.0, MaterialFileBytes / 1024.0, FileVertices, FileNormals, FileTexcoords, FileTriangles, FileQuads, FileDrawcalls);
+	printf("\tOutput: %u vertices (%u generated normals), %u triangles, %u quads, %u drawcalls, %u materials\n",
+		Vertices, GeneratedNormals, Triangles, Quads, Drawcalls, Materials);
+	printf("\tBuffers: %.1f KiB vertices, %.1f KiB indices, %u textures with %.1f MiB of texels\n",
+		VertexBufferBytes / 1024.0, IndexBufferBytes / 1024.0, Textures, TextureBytes / (1024.0 * 1024.0));
+	printf("\tCulling: triangle BVH with %u nodes, %u leaves, depth %u, %u occluder drawcalls with %u triangles\n",
+		BVHNodes, BVHLeaves, BVHDepth, OccluderRanges, OccluderTriangles);
+	printf("\tLevels of detail:");
+	for (unsigned triangles : LodTriangles)
+		printf(" %u", triangles);
+	printf(" triangles\n");
+}
+
+void LoadReport::WriteJSON(JsonWriter& json) const
+{
+	json.BeginObject();
+	json.Key("file").Value(Filename);
+	json.Key("total_ms").Value(GetTotalMilliseconds());
+
+	json.Key("stages").BeginArray();
+	for (const LoadStageStats& stage : Stages)
+	{
+		json.BeginObject();
+		json.Key("name").Value(stage.Name);
+		json.Key("calls").Value(stage.Calls);
+		json.Key("ms").Value(stage.Milliseconds);
+		json.Key("allocations").Value(stage.Allocations);
+		json.Key("allocated_bytes").Value(stage.AllocatedBytes);
+		json.EndObject();
+	}
+	json.EndArray();
+
+	json.Key("input").BeginObject();
+	json.Key("file_bytes").Value(FileBytes);
+	json.Key("material_file_bytes").Value(MaterialFileBytes);
+	json.Key("positions").Value(FileVertices);
+	json.Key("normals").Value(FileNormals);
+	json.Key("texcoords").Value(FileTexcoords);
+	json.Key("triangles").Value(FileTriangles);
+	json.Key("quads").Value(FileQuads);
+	json.Key("drawcalls").Value(FileDrawcalls);
+	json.EndObject();
+
+	json.Key("output").BeginObject();
+	json.Key("vertices").Value(Vertices);
+	json.Key("generated_normals").Value(GeneratedNormals);
+	json.Key("triangles").Value(Triangles);
+	json.Key("quads").Value(Quads);
+	json.Key("drawcalls").Value(Drawcalls);
+	json.Key("materials").Value(Materials);
+	json.Key("textures").Value(Textures);
+	json.Key("texture_bytes").Value(TextureBytes);
+	json.Key("vertex_buffer_bytes").Value(VertexBufferBytes);
+	json.Key("index_buffer_bytes").Value(IndexBufferBytes);
+	json.Key("bvh_nodes").Value(BVHNodes);
+	json.Key("bvh_leaves").Value(BVHLeaves);
+	json.Key("bvh_depth").Value(BVHDepth);
+	json.Key("occluder_ranges").Value(OccluderRanges);
+	json.Key("occluder_triangles").Value(OccluderTriangles);
+	json.Key("lod_triangles").BeginArray();
+	for (unsigned triangles : LodTriangles)
+		json.Value(triangles);
+	json.EndArray();
+	json.EndObject();
+
+	json.EndObject();
+}
+
+bool LoadReport::WriteJSON(const std::string& filename) const
+{
+	std::ofstream out(filename);
+	if (!out)
+		return false;
+	JsonWriter json(out, 3);
+	WriteJSON(json);
+	return (bool)out;
+}
+
+LoadStage::LoadStage(LoadReport* report, const char* name)
+	: m_zone(name), m_report(report), m_name(name), m_parent(report ? report->m_open_stage : nullptr)
+{
+	if (m_report)
+		m_report->m_open_stage = this;
+	m_start_allocations = GetThreadAllocationCount();
+	m_start = Profiler::Now();
+}
+
+LoadStage::~LoadStage()
+{
+	const int64_t end = Profiler::Now();
+	const AllocationCount endAllocations = GetThreadAllocationCount();
+	if (!m_report)
+		return;
+
+	const int64_t time = end - m_start;
+	AllocationCount allocations;
+	allocations.Allocations = endAllocations.Allocations - m_start_allocations.Allocations;
+	allocations.Bytes = endAllocations.Bytes - m_start_allocations.Bytes;
+
+	// Charge only what happened outside nested stages
+	AllocationCount exclusive;
+	exclusive.Allocations = allocations.Allocations - m_nested_allocations.Allocations;
+	exclusive.Bytes = allocations.Bytes - m_nested_allocations.Bytes;
+	m_report->AddStage(m_name, (time - m_nested_time) * 1e-6, exclusive);
+
+	// The allocations of the report itself are not charged to the parent either
+	if (m_parent)
+	{
+		const AllocationCount reported = GetThreadAllocationCount();
+		m_parent->m_nested_time += Profiler::Now() - m_start;
+		m_parent->m_nested_allocations.Allocations += reported.Allocations - m_start_allocations.Allocations;
+		m_parent->m_nested_allocations.Bytes += reported.Bytes - m_start_allocations.Bytes;
+	}
+	m_report->m_open_stage = m_parent;
+}
@@ -0,0 +1,131 @@
+/**
+ * @file loadreport.h
+ * @brief Stage timings and sizes of model loads
+ * @details A load is split in named stages, timed with LoadStage scopes. Each stage gets its wall time
+ * and the allocations made on the loading thread, both excluding nested stages. Together with the
+ * input and output sizes, the report can be printed or written as JSON to track load times of assets
+ * across builds.
+*/
+
+#pragma once
+#ifndef LOADREPORT_H
+#define LOADREPORT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "jsonwriter.h"
+#include "memorytracker.h"
+#include "profiler.h"
+
+/**
+ * @brief Totals of one stage of a load.
+*/
+struct LoadStageStats
+{
+	std::string Name; //!< Stage name
+	unsigned Calls = 0; //!< Number of times the stage ran, e.g. once per texture
+	double Milliseconds = 0.0; //!< Wall time, excluding nested stages
+	uint64_t Allocations = 0; //!< Heap allocations, excluding nested stages
+	uint64_t AllocatedBytes = 0; //!< Bytes allocated, excluding nested stages
+};
+
+class LoadStage;
+
+/**
+ * @brief Stages and sizes of a model load.
+*/
+struct LoadReport
+{
+	std::string Filename; //!< Loaded file
+	std::vector<LoadStageStats> Stages; //!< Stages in the order they first ran
+
+	uint64_t FileBytes = 0; //!< Size of the model file
+	uint64_t MaterialFileBytes = 0; //!< Size of the material files
+	unsigned FileVertices = 0; //!< Positions in the file
+	unsigned FileNormals = 0; //!< Normals in the file
+	unsigned FileTexcoords = 0; //!< Texture coordinates in the file
+	unsigned FileTriangles = 0; //!< Triangles in the file, after triangulation
+	unsigned FileQuads = 0; //!< Quads in the file, when not triangulated
+	unsigned FileDrawcalls = 0; //!< Material groups in the file
+
+	unsigned Vertices = 0; //!< Welded vertices
+	unsigned GeneratedNormals = 0; //!< Normals generated for a file without normals
+	unsigned Triangles = 0; //!< Output triangles
+	unsigned Quads = 0; //!< Output quads
+	unsigned Drawcalls = 0; //!< Output drawcalls
+	unsigned Materials = 0; //!< Materials used by the drawcalls
+	unsigned Textures = 0; //!< Textures decoded
+	uint64_t TextureBytes = 0; //!< Decoded texture data, excluding mipmaps
+	uint64_t VertexBufferBytes = 0; //!< Size of the vertex buffer
+	uint64_t IndexBufferBytes = 0; //!< Size of the index buffer
+
+	unsigned BVHNodes = 0; //!< Nodes of the triangle BVH
+	unsigned BVHLeaves = 0; //!< Leaves of the triangle BVH
+	unsigned BVHDepth = 0; //!< Depth of the deepest leaf of the triangle BVH
+	unsigned OccluderRanges = 0; //!< Drawcalls selected as occluders
+	unsigned OccluderTriangles = 0; //!< Triangles of the occluders
+	std::vector<unsigned> LodTriangles; //!< Triangles of each level of detail, full detail first
+
+	/**
+	 * @brief Add to the totals of a stage, creating it if it has not run before.
+	*/
+	void AddStage(const char* name, double milliseconds, const AllocationCount& allocations);
+
+	/**
+	 * @brief Sum of the times of all stages.
+	*/
+	double GetTotalMilliseconds() const noexcept;
+
+	/**
+	 * @brief Print a table of the stages and the sizes.
+	*/
+	void Print() const;
+
+	/**
+	 * @brief Write the report as a JSON object.
+	*/
+	void WriteJSON(JsonWriter& json) const;
+
+	/**
+	 * @brief Write the report to a JSON file.
+	 * @return True on success.
+	*/
+	bool WriteJSON(const std::string& filename) const;
+
+private:
+	friend class LoadStage;
+	LoadStage* m_open_stage = nullptr;
+};
+
+/**
+ * @brief Times a stage of a load from construction to destruction, and records it as a profiler zone.
+ * @details Stages may nest; the time and allocations of a nested stage are only charged to the nested stage.
+*/
+class LoadStage
+{
+public:
+	/**
+	 * @brief Start a stage.
+	 * @param[in,out] report Report to add the stage to, or nullptr to only record the profiler zone.
+	 * @param[in] name Stage name, must outlive the profiler, e.g. a string literal.
+	*/
+	LoadStage(LoadReport* report, const char* name);
+
+	~LoadStage();
+
+	LoadStage(const LoadStage&) = delete;
+	LoadStage& operator=(const LoadStage&) = delete;
+
+private:
+	ProfileZone m_zone;
+	LoadReport* m_report;
+	const char* m_name;
+	LoadStage* m_parent;
+	int64_t m_start;
+	AllocationCount m_start_allocations;
+	int64_t m_nested_time = 0;
+	AllocationCount m_nested_allocations;
+};
+
+#endif
@@ -0,0 +1,207 @@
+//
+// Level of detail selection
+//
+// An error e at distance d covers e * m22 * h / 2 / d pixels, m22 being the
+// y scale of the projection and h the viewport height. The distance is to
+// the closest point of the world bounds, which never underestimates the
+// error of any part of the object. Per object, the pixels per unit of error
+// are computed once, so finding the levels for another pixel budget is a
+// multiply and compare per level.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <unordered_map>
+#include "lod.h"
+#include "jobsystem.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	// Coarsest level whose projected error is within a pixel budget, full detail always is
+	uint32_t CoarsestWithin(const LodChain& chain, float projected_scale, float pixel_error) noexcept
+	{
+		const uint32_t count = std::min(chain.Count, (uint32_t)LOD_MAX_LEVELS);
+		uint32_t level = 0;
+		while (level + 1 < count && chain.Levels[level + 1].Error * projected_scale <= pixel_error)
+			level++;
+		return level;
+	}
+
+	// Go finer as soon as the error exceeds the budget, coarser only once the error is well within it
+	uint32_t SelectLevel(const LodChain& chain, float projected_scale, uint32_t previous, float pixel_error, float hysteresis) noexcept
+	{
+		const uint32_t level = CoarsestWithin(chain, projected_scale, pixel_error);
+		if (level <= previous)
+			return level;
+		return std::max(previous, CoarsestWithin(chain, projected_scale, pixel_error * (1.0f - hysteresis)));
+	}
+
+	float DistanceToBounds(const vec3f& p, const aabb& bounds) noexcept
+	{
+		const float dx = std::max(std::max(bounds.min.x - p.x, p.x - bounds.max.x), 0.0f);
+		const float dy = std::max(std::max(bounds.min.y - p.y, p.y - bounds.max.y), 0.0f);
+		const float dz = std::max(std::max(bounds.min.z - p.z, p.z - bounds.max.z), 0.0f);
+		return std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+
+	float MaxScale(const mat4f& m) noexcept
+	{
+		const float x = m.col[0].x * m.col[0].x + m.col[0].y * m.col[0].y + m.col[0].z * m.col[0].z;
+		const float y = m.col[1].x * m.col[1].x + m.col[1].y * m.col[1].y + m.col[1].z * m.col[1].z;
+		const float z = m.col[2].x * m.col[2].x + m.col[2].y * m.col[2].y + m.col[2].z * m.col[2].z;
+		return std::sqrt(std::max(x, std::max(y, z)));
+	}
+}
+
+void LodSelector::SetView(const vec3f& eye, const mat4f& projection, float viewport_height) noexcept
+{
+	m_eye = eye;
+	m_pixels_per_unit = projection.m22 * viewport_height * 0.5f;
+}
+
+void LodSelector::Select(uint32_t count, const aabb* world_bounds, const mat4f* world_matrices, const LodChain* chains,
+	const uint8_t* visibility, uint8_t* levels)
+{
+	PROFILE_FUNCTION();
+	const int64_t start = Profiler::Now();
+	m_projected_scales.resize(count);
+	m_chains = chains;
+	m_count = count;
+	m_stats = LodStats();
+
+	// Pixels per unit of error of each object, and the full detail triangles
+	std::atomic<uint32_t> objects{ 0 }, fullTriangles{ 0 };
+	JobSystem::ParallelFor(0, count, LOD_SELECT_GRAIN, [&](size_t begin, size_t end)
+	{
+		uint32_t chunkObjects = 0, chunkTriangles = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			if (!chains[i].Count || (visibility && !visibility[i]))
+			{
+				m_projected_scales[i] = 0.0f;
+				continue;
+			}
+			const float distance = world_bounds[i].empty() ? 0.0f : DistanceToBounds(m_eye, world_bounds[i]);
+			m_projected_scales[i] = distance > 0.0f ? MaxScale(world_matrices[i]) * m_pixels_per_unit / distance : (float)fINF;
+			chunkObjects++;
+			chunkTriangles += chains[i].Levels[0].Triangles;
+		}
+		objects += chunkObjects;
+		fullTriangles += chunkTriangles;
+	});
+
+	// Raise the pixel budget until the levels fit the triangle budget, starting from last frame's factor.
+	// The triangles only go down as the budget goes up, hysteresis included, so bisection finds it
+	float pixelError = m_pixel_error;
+	if (m_triangle_budget && CountTriangles(pixelError, levels) > m_triangle_budget)
+	{
+		float low = 1.0f, high = std::max(m_budget_scale, 2.0f);
+		while (high < 1e6f && CountTriangles(m_pixel_error * high, levels) > m_triangle_budget)
+		{
+			low = high;
+			high *= 2.0f;
+		}
+		for (int step = 0; step < LOD_BUDGET_STEPS; step++)
+		{
+			const float middle = 0.5f * (low + high);
+			if (CountTriangles(m_pixel_error * middle, levels) > m_triangle_budget)
+				low = middle;
+			else
+				high = middle;
+		}
+		m_budget_scale = high;
+		pixelError = m_pixel_error * high;
+	}
+	else
+	{
+		m_budget_scale = 1.0f;
+	}
+
+	std::atomic<uint32_t> triangles{ 0 }, changes{ 0 };
+	JobSystem::ParallelFor(0, count, LOD_SELECT_GRAIN, [&](size_t begin, size_t end)
+	{
+		uint32_t chunkTriangles = 0, chunkChanges = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			const float scale = m_projected_scales[i];
+			if (scale == 0.0f)
+				continue;
+			const uint32_t previous = levels[i];
+			const uint32_t level = SelectLevel(chains[i], scale, previous, pixelError, m_hysteresis);
+			levels[i] = (uint8_t)level;
+			chunkTriangles += chains[i].Levels[level].Triangles;
+			chunkChanges += level != previous ? 1 : 0;
+		}
+		triangles += chunkTriangles;
+		changes += chunkChanges;
+	});
+
+	m_stats.Objects = objects;
+	m_stats.Triangles = triangles;
+	m_stats.FullTriangles = fullTriangles;
+	m_stats.Changes = changes;
+	m_stats.PixelError = pixelError;
+	m_stats.Milliseconds = (Profiler::Now() - start) * 1e-6;
+}
+
+uint32_t LodSelector::CountTriangles(float pixel_error, const uint8_t* levels) const
+{
+	std::atomic<uint32_t> triangles{ 0 };
+	JobSystem::ParallelFor(0, m_count, LOD_SELECT_GRAIN, [&](size_t begin, size_t end)
+	{
+		uint32_t chunkTriangles = 0;
+		for (size_t i = begin; i < end; i++)
+		{
+			if (m_projected_scales[i] != 0.0f)
+				chunkTriangles += m_chains[i].Levels[SelectLevel(m_chains[i], m_projected_scales[i], levels[i], pixel_error, m_hysteresis)].Triangles;
+		}
+		triangles += chunkTriangles;
+	});
+	return triangles;
+}
+
+float ClusterIndices(const vec3f* positions, size_t stride, const unsigned* indices, size_t index_count,
+	const vec3f& origin, float cell_size, std::vector<unsigned>& out)
+{
+	out.clear();
+	const float inverseSize = 1.0f / cell_size;
+	auto position = [positions, stride](unsigned index) -> const vec3f&
+	{
+		return *reinterpret_cast<const vec3f*>(reinterpret_cast<const uint8_t*>(positions) + index * stride);
+	};
+
+	// First vertex met in each cube, keyed by 21 bits of each cube coordinate
+	unsigned maxIndex = 0;
+	for (size_t i = 0; i < index_count; i++)
+		maxIndex = std::max(maxIndex, indices[i]);
+	std::vector<unsigned> representatives(index_count ? maxIndex + 1 : 0, UINT32_MAX);
+	std::unordered_map<uint64_t, unsigned> cells;
+	cells.reserve(index_count / 3);
+	for (size_t i = 0; i < index_count; i++)
+	{
+		const unsigned index = indices[i];
+		if (representatives[index] != UINT32_MAX)
+			continue;
+		const vec3f cell = (position(index) - origin) * inverseSize;
+		const uint64_t key =
+			((uint64_t)((uint32_t)std::max(cell.x, 0.0f) & 0x1fffff)) |
+			((uint64_t)((uint32_t)std::max(cell.y, 0.0f) & 0x1fffff) << 21) |
+			((uint64_t)((uint32_t)std::max(cell.z, 0.0f) & 0x1fffff) << 42);
+		representatives[index] = cells.emplace(key, index).first->second;
+	}
+
+	for (size_t i = 0; i + 2 < index_count; i += 3)
+	{
+		const unsigned a = representatives[indices[i]], b = representatives[indices[i + 1]], c = representatives[indices[i + 2]];
+		if (a == b || b == c || c == a)
+			continue;
+		out.push_back(a);
+		out.push_back(b);
+		out.push_back(c);
+	}
+	return cell_size * std::sqrt(3.0f);
+}
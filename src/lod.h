@@ -0,0 +1,157 @@
+/**
+ * @file lod.h
+ * @brief Level of detail selection by projected geometric error
+ * @details A model has a chain of levels, from full detail to the coarsest, each with its triangle count and
+ * its geometric error: how far, in object space, its surface may be from the full detail one. Projected at
+ * the distance of an object, the error becomes a number of pixels, and LodSelector picks for each object the
+ * coarsest level whose error stays within a pixel budget.
+ *
+ * An object switches to a coarser level only once that level's error is below a fraction of the budget, so
+ * one that hovers around the threshold does not pop back and forth every frame. With a triangle budget, the
+ * pixel budget is raised for the frame until the selected levels fit it.
+ *
+ * ClusterIndices() builds coarser levels of an indexed mesh by vertex clustering.
+*/
+
+#pragma once
+#ifndef LOD_H
+#define LOD_H
+
+#include <cstdint>
+#include <vector>
+#include "vec/bounds.h"
+#include "vec/mat.h"
+
+//! Objects per job of LodSelector::Select()
+#define LOD_SELECT_GRAIN 4096
+
+//! Maximum number of levels of a chain, levels after this are never selected
+#define LOD_MAX_LEVELS 8
+
+//! Bisection steps of the pixel budget when the triangle budget is exceeded
+#define LOD_BUDGET_STEPS 10
+
+/**
+ * @brief One level of detail of a model.
+*/
+struct LodLevel
+{
+	float Error = 0.0f; //!< Geometric error in object space units, 0 for full detail
+	uint32_t Triangles = 0; //!< Triangles drawn at this level
+};
+
+/**
+ * @brief Levels of detail of a model, full detail first and the error growing with every level.
+ * @details A chain without levels draws the model as it is, and is not counted in LodStats.
+*/
+struct LodChain
+{
+	const LodLevel* Levels = nullptr; //!< Levels, owned by the model
+	uint32_t Count = 0; //!< Number of levels
+};
+
+/**
+ * @brief Counts of the last LodSelector::Select().
+*/
+struct LodStats
+{
+	unsigned Objects = 0; //!< Visible objects with a level chain
+	unsigned Triangles = 0; //!< Triangles of the selected levels
+	unsigned FullTriangles = 0; //!< Triangles of the same objects at full detail
+	unsigned Changes = 0; //!< Objects whose level changed
+	float PixelError = 0.0f; //!< Pixel budget used, raised above the set one to meet the triangle budget
+	double Milliseconds = 0.0; //!< Time spent selecting
+
+	/**
+	 * @brief Triangles not drawn thanks to the selected levels.
+	*/
+	unsigned TrianglesSaved() const noexcept { return FullTriangles - Triangles; }
+};
+
+/**
+ * @brief Selects a level of detail per object from its screen-space error.
+ * @details Not thread safe, apart from the jobs Select() starts itself.
+*/
+class LodSelector
+{
+public:
+	/**
+	 * @brief Set the projected error allowed, in pixels.
+	*/
+	void SetPixelError(float pixels) noexcept { m_pixel_error = pixels; }
+
+	/**
+	 * @brief Set how far below the pixel budget a coarser level's error has to be before switching to it.
+	 * @param[in] fraction Fraction of the budget, in [0, 1), 0 to switch as soon as the level is within the budget.
+	*/
+	void SetHysteresis(float fraction) noexcept { m_hysteresis = fraction; }
+
+	/**
+	 * @brief Set the number of triangles the selected levels may add up to.
+	 * @param[in] triangles The budget, or 0 for no limit.
+	*/
+	void SetTriangleBudget(uint32_t triangles) noexcept { m_triangle_budget = triangles; }
+
+	/**
+	 * @brief Set the view to project errors in.
+	 * @param[in] eye Position of the camera in world space.
+	 * @param[in] projection Perspective projection matrix of the camera.
+	 * @param[in] viewport_height Height of the viewport in pixels.
+	*/
+	void SetView(const linalg::vec3f& eye, const linalg::mat4f& projection, float viewport_height) noexcept;
+
+	/**
+	 * @brief Select the level of every object, in parallel.
+	 * @details An object inside its bounds, or with empty bounds, gets full detail.
+	 * @param[in] count Number of objects.
+	 * @param[in] world_bounds World space bounds of each object.
+	 * @param[in] world_matrices Model-to-world matrix of each object, whose largest scale scales the errors.
+	 * @param[in] chains Level chain of each object.
+	 * @param[in] visibility Nonzero for each object to select for, the others keep their level. May be nullptr for all.
+	 * @param[in,out] levels In: level of each object in the previous frame, 0 for new objects. Out: the selected level.
+	*/
+	void Select(uint32_t count, const linalg::aabb* world_bounds, const linalg::mat4f* world_matrices, const LodChain* chains,
+		const uint8_t* visibility, uint8_t* levels);
+
+	/**
+	 * @brief Get the counts of the last Select().
+	*/
+	const LodStats& GetStats() const noexcept { return m_stats; }
+
+private:
+	// Triangles of the levels a pixel budget would select
+	uint32_t CountTriangles(float pixel_error, const uint8_t* levels) const;
+
+	float m_pixel_error = 1.0f;
+	float m_hysteresis = 0.25f;
+	uint32_t m_triangle_budget = 0;
+	float m_budget_scale = 1.0f; // Factor the pixel budget was raised by in the last frame over the triangle budget
+
+	linalg::vec3f m_eye = { 0.0f, 0.0f, 0.0f };
+	float m_pixels_per_unit = 1.0f; // Pixels covered by one unit at distance one
+
+	// Per object of the current Select(), pixels per object space unit of error, 0 when not selected for
+	std::vector<float> m_projected_scales;
+	const LodChain* m_chains = nullptr;
+	uint32_t m_count = 0;
+	LodStats m_stats;
+};
+
+/**
+ * @brief Simplify indexed triangles by vertex clustering.
+ * @details Space is divided into cubes of a size, and every vertex is replaced by the first vertex of the
+ * triangles that lies in the same cube. Triangles that lose an edge are dropped. No vertices are added, so
+ * the result indexes the same vertex array and its bounds are within those of the input.
+ * @param[in] positions Position of the first vertex.
+ * @param[in] stride Bytes between vertex positions.
+ * @param[in] indices Triangle list.
+ * @param[in] index_count Number of indices, a multiple of 3.
+ * @param[in] origin Corner of the grid of cubes, e.g. the minimum of the bounds of the model.
+ * @param[in] cell_size Edge length of the cubes.
+ * @param[out] out Receives the indices of the remaining triangles.
+ * @return Geometric error of the result, the diagonal of a cube.
+*/
+float ClusterIndices(const linalg::vec3f* positions, size_t stride, const unsigned* indices, size_t index_count,
+	const linalg::vec3f& origin, float cell_size, std::vector<unsigned>& out);
+
+#endif
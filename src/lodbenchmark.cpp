@@ -0,0 +1,326 @@
+//
+// Level of detail self test and selection benchmark
+//
+// The field is a square of unit objects sharing one chain of levels, with
+// a camera flying across it. The projection has a vertical field of view of
+// 90 degrees and the viewport is 1000 pixels high, so an error e at
+// distance d covers 500 e / d pixels, which the checks below rely on.
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include "lodbenchmark.h"
+#include "lod.h"
+#include "jobsystem.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	const float ViewportHeight = 1000.0f;
+	const float FieldSize = 1000.0f;
+	const LodLevel Levels[] = { { 0.0f, 2000 }, { 0.01f, 600 }, { 0.1f, 150 }, { 1.0f, 40 } };
+	const LodChain Chain = { Levels, 4 };
+
+	mat4f Projection()
+	{
+		return mat4f::projection(fPI / 2.0f, 1.0f, 0.1f, 2000.0f);
+	}
+
+	// Unit object at a distance straight ahead of a camera at the origin
+	struct TestObject
+	{
+		aabb Bounds;
+		mat4f World = mat4f_identity;
+
+		void MoveTo(float distance)
+		{
+			World = mat4f::translation(0.0f, 0.0f, -distance - 0.5f);
+			Bounds = aabb(vec3f(-0.5f, -0.5f, -distance - 1.0f), vec3f(0.5f, 0.5f, -distance));
+		}
+	};
+
+	uint8_t SelectOne(LodSelector& selector, float distance, uint8_t level)
+	{
+		TestObject object;
+		object.MoveTo(distance);
+		selector.Select(1, &object.Bounds, &object.World, &Chain, nullptr, &level);
+		return level;
+	}
+
+	bool CheckClustering(std::string& failure)
+	{
+		// A bumpy grid of 64 x 64 quads
+		const int Size = 65;
+		std::vector<vec3f> positions;
+		for (int z = 0; z < Size; z++)
+			for (int x = 0; x < Size; x++)
+				positions.push_back(vec3f((float)x, 0.1f * std::sin(x * 0.7f) * std::cos(z * 0.5f), (float)z));
+		std::vector<unsigned> indices;
+		for (int z = 0; z + 1 < Size; z++)
+		{
+			for (int x = 0; x + 1 < Size; x++)
+			{
+				const unsigned i = z * Size + x;
+				indices.insert(indices.end(), { i, i + Size, i + 1, i + 1, i + Size, i + Size + 1 });
+			}
+		}
+
+		std::vector<unsigned> out;
+		const vec3f origin(-0.5f, -1.0f, -0.5f);
+		ClusterIndices(positions.data(), sizeof(vec3f), indices.data(), indices.size(), origin, 0.5f, out);
+		if (out != indices)
+			return FailCheck(failure, "clustering: cubes smaller than the triangles changed the mesh");
+
+		size_t previous = indices.size();
+		for (float cell = 2.0f; cell <= 32.0f; cell *= 2.0f)
+		{
+			const float error = ClusterIndices(positions.data(), sizeof(vec3f), indices.data(), indices.size(), origin, cell, out);
+			if (out.size() % 3 || out.size() >= previous || std::fabs(error - cell * std::sqrt(3.0f)) > 1e-4f)
+				return FailCheck(failure, "clustering: larger cubes did not remove triangles");
+			for (unsigned index : out)
+			{
+				if (std::find(indices.begin(), indices.end(), index) == indices.end())
+					return FailCheck(failure, "clustering: a vertex not in the input was used");
+			}
+			for (size_t i = 0; i < out.size(); i += 3)
+			{
+				if (out[i] == out[i + 1] || out[i + 1] == out[i + 2] || out[i + 2] == out[i])
+					return FailCheck(failure, "clustering: a degenerate triangle was kept");
+			}
+			previous = out.size();
+		}
+		return true;
+	}
+
+	bool CheckSelection(std::string& failure)
+	{
+		// Level 2 (error 0.1) covers one pixel at 50 units, level 3 (error 1) at 500
+		LodSelector selector;
+		selector.SetHysteresis(0.0f);
+		selector.SetView(vec3f(0.0f, 0.0f, 0.0f), Projection(), ViewportHeight);
+		if (SelectOne(selector, 1.0f, 0) != 0 || SelectOne(selector, 10.0f, 0) != 1 || SelectOne(selector, 100.0f, 0) != 2 ||
+			SelectOne(selector, 1000.0f, 0) != 3)
+			return FailCheck(failure, "selection: not the coarsest level within the pixel budget");
+		if (SelectOne(selector, 100.0f, 3) != 2)
+			return FailCheck(failure, "selection: a level over the pixel budget was kept");
+		if (selector.GetStats().Objects != 1 || selector.GetStats().Triangles != 150 || selector.GetStats().TrianglesSaved() != 1850 ||
+			selector.GetStats().Changes != 1)
+			return FailCheck(failure, "selection: wrong counts");
+		selector.SetPixelError(4.0f);
+		if (SelectOne(selector, 20.0f, 0) != 2)
+			return FailCheck(failure, "selection: a larger pixel budget did not allow a coarser level");
+
+		// Inside its bounds an object has full detail, and hidden objects keep their level
+		TestObject object;
+		object.MoveTo(-0.5f);
+		uint8_t level = 2;
+		selector.Select(1, &object.Bounds, &object.World, &Chain, nullptr, &level);
+		if (level != 0)
+			return FailCheck(failure, "selection: an object around the camera was not at full detail");
+		const uint8_t hidden = 0;
+		level = 2;
+		selector.Select(1, &object.Bounds, &object.World, &Chain, &hidden, &level);
+		if (level != 2 || selector.GetStats().Objects != 0)
+			return FailCheck(failure, "selection: a hidden object changed level or was counted");
+
+		// Twice the scale, twice the error: level 2 covers 0.8 pixels at 60 units, scaled 1.7
+		object.MoveTo(60.0f);
+		object.World = object.World * mat4f::scaling(2.0f);
+		level = 0;
+		selector.SetPixelError(1.0f);
+		selector.Select(1, &object.Bounds, &object.World, &Chain, nullptr, &level);
+		if (level != 1 || SelectOne(selector, 60.0f, 0) != 2)
+			return FailCheck(failure, "selection: the scale of the object did not scale its error");
+		return true;
+	}
+
+	bool CheckHysteresis(std::string& failure)
+	{
+		// Hover around 50 units, where level 2 comes within the budget
+		unsigned changes[2] = {};
+		for (int run = 0; run < 2; run++)
+		{
+			LodSelector selector;
+			selector.SetHysteresis(run ? 0.25f : 0.0f);
+			selector.SetView(vec3f(0.0f, 0.0f, 0.0f), Projection(), ViewportHeight);
+			uint8_t level = 1;
+			for (int frame = 0; frame < 20; frame++)
+			{
+				const uint8_t next = SelectOne(selector, frame % 2 ? 49.0f : 51.0f, level);
+				changes[run] += next != level ? 1 : 0;
+				level = next;
+			}
+		}
+		if (changes[0] != 20 || changes[1] != 0)
+			return FailCheck(failure, "hysteresis: an object at the switch distance popped every frame");
+
+		// Far enough beyond the switch distance the coarser level is taken
+		LodSelector selector;
+		selector.SetHysteresis(0.25f);
+		selector.SetView(vec3f(0.0f, 0.0f, 0.0f), Projection(), ViewportHeight);
+		if (SelectOne(selector, 60.0f, 1) != 1 || SelectOne(selector, 70.0f, 1) != 2)
+			return FailCheck(failure, "hysteresis: wrong distance to switch to a coarser level");
+		return true;
+	}
+
+	bool CheckBudget(std::string& failure)
+	{
+		// A row of objects, 2000 triangles each at full detail
+		const unsigned Count = 100;
+		std::vector<TestObject> objects(Count);
+		std::vector<aabb> bounds(Count);
+		std::vector<mat4f> world(Count);
+		std::vector<LodChain> chains(Count, Chain);
+		for (unsigned i = 0; i < Count; i++)
+		{
+			objects[i].MoveTo(1.0f + i);
+			bounds[i] = objects[i].Bounds;
+			world[i] = objects[i].World;
+		}
+
+		LodSelector selector;
+		selector.SetView(vec3f(0.0f, 0.0f, 0.0f), Projection(), ViewportHeight);
+		std::vector<uint8_t> levels(Count, 0);
+		selector.Select(Count, bounds.data(), world.data(), chains.data(), nullptr, levels.data());
+		const unsigned unlimited = selector.GetStats().Triangles;
+
+		// Objects held at finer levels by the hysteresis count too
+		const unsigned budget = unlimited / 3;
+		selector.SetTriangleBudget(budget);
+		std::fill(levels.begin(), levels.end(), (uint8_t)0);
+		for (int frame = 0; frame < 3; frame++)
+		{
+			selector.Select(Count, bounds.data(), world.data(), chains.data(), nullptr, levels.data());
+			if (selector.GetStats().Triangles > budget || selector.GetStats().PixelError <= 1.0f)
+				return FailCheck(failure, "budget: the triangle budget was exceeded");
+		}
+		if (selector.GetStats().Triangles < budget / 2)
+			return FailCheck(failure, "budget: detail was lowered far more than the triangle budget needs");
+
+		selector.SetTriangleBudget(0);
+		selector.Select(Count, bounds.data(), world.data(), chains.data(), nullptr, levels.data());
+		if (selector.GetStats().PixelError != 1.0f)
+			return FailCheck(failure, "budget: the pixel budget stayed raised without a triangle budget");
+		return true;
+	}
+}
+
+bool RunLodTest(std::string& failure)
+{
+	return CheckClustering(failure) && CheckSelection(failure) && CheckHysteresis(failure) && CheckBudget(failure);
+}
+
+LodTiming RunLodTimings(const char* name, unsigned objects, unsigned frames, float hysteresis, unsigned triangle_budget)
+{
+	LodTiming timing;
+	timing.Name = name;
+	timing.Hysteresis = hysteresis;
+	timing.TriangleBudget = triangle_budget;
+
+	// Unit objects at random in a square around the origin, some of them larger
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> coordinate(-0.5f * FieldSize, 0.5f * FieldSize);
+	std::uniform_real_distribution<float> scale(1.0f, 4.0f);
+	std::vector<mat4f> world(objects);
+	std::vector<aabb> bounds(objects);
+	const aabb unit(vec3f(-0.5f), vec3f(0.5f));
+	for (unsigned i = 0; i < objects; i++)
+	{
+		world[i] = mat4f::translation(coordinate(random), 0.0f, coordinate(random)) * mat4f::scaling(scale(random));
+		bounds[i] = transform(world[i], unit);
+	}
+	std::vector<LodChain> chains(objects, Chain);
+	std::vector<uint8_t> levels(objects, 0);
+
+	LodSelector selector;
+	selector.SetHysteresis(hysteresis);
+	selector.SetTriangleBudget(triangle_budget);
+
+	// Fly across the field at head height
+	std::vector<double> times;
+	double triangles = 0.0, saved = 0.0, changes = 0.0, pixelError = 0.0;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const float z = FieldSize * ((frame + 0.5f) / frames - 0.5f);
+		selector.SetView(vec3f(0.0f, 2.0f, z), Projection(), ViewportHeight);
+		selector.Select(objects, bounds.data(), world.data(), chains.data(), nullptr, levels.data());
+
+		const LodStats& stats = selector.GetStats();
+		times.push_back(stats.Milliseconds);
+		triangles += stats.Triangles;
+		saved += stats.TrianglesSaved();
+		changes += stats.Changes;
+		pixelError += stats.PixelError;
+		timing.MaxTriangles = std::max(timing.MaxTriangles, stats.Triangles);
+	}
+
+	if (frames)
+	{
+		timing.Triangles = triangles / frames;
+		timing.TrianglesSaved = saved / frames;
+		timing.Changes = changes / frames;
+		timing.PixelError = pixelError / frames;
+	}
+	timing.Milliseconds = BenchmarkSummary::Compute(times);
+	return timing;
+}
+
+bool RunLodBenchmark(unsigned objects, unsigned frames, const std::string& report_filename)
+{
+	std::string testFailure;
+	const bool passed = RunLodTest(testFailure);
+	printf("LOD self test: %s\n", passed ? "passed" : testFailure.c_str());
+
+	JobSystem::Initialize();
+	const unsigned workers = JobSystem::GetWorkerCount();
+	printf("LOD selection, %u objects, %u frames, %u workers...\n", objects, frames, workers);
+	std::vector<LodTiming> timings;
+	timings.push_back(RunLodTimings("no hysteresis", objects, frames, 0.0f, 0));
+	timings.push_back(RunLodTimings("hysteresis", objects, frames, 0.25f, 0));
+	const unsigned budget = (unsigned)(timings.back().Triangles / 2);
+	timings.push_back(RunLodTimings("budget", objects, frames, 0.25f, budget));
+	JobSystem::Shutdown();
+
+	const bool budgetMet = timings.back().MaxTriangles <= budget;
+	printf("\t%14s %10s %12s %12s %10s %8s\n", "Run", "Select ms", "Triangles", "Saved", "Changes", "Pixels");
+	for (const LodTiming& timing : timings)
+	{
+		printf("\t%14s %10.3f %12.0f %12.0f %10.1f %8.2f\n", timing.Name, timing.Milliseconds.P50, timing.Triangles, timing.TrianglesSaved,
+			timing.Changes, timing.PixelError);
+	}
+	printf("\tTriangle budget %u %s, at most %u triangles\n", budget, budgetMet ? "met" : "EXCEEDED", timings.back().MaxTriangles);
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(testFailure);
+		json.Key("objects").Value(objects);
+		json.Key("frames").Value(frames);
+		json.Key("workers").Value(workers);
+		json.Key("triangle_budget").Value(budget);
+		json.Key("budget_met").Value(budgetMet);
+		json.Key("runs").BeginArray();
+		for (const LodTiming& timing : timings)
+		{
+			json.BeginObject();
+			json.Key("name").Value(timing.Name);
+			json.Key("hysteresis").Value(timing.Hysteresis);
+			json.Key("triangle_budget").Value(timing.TriangleBudget);
+			json.Key("select_p50_ms").Value(timing.Milliseconds.P50);
+			json.Key("select_p95_ms").Value(timing.Milliseconds.P95);
+			json.Key("triangles").Value(timing.Triangles);
+			json.Key("triangles_saved").Value(timing.TrianglesSaved);
+			json.Key("max_triangles").Value(timing.MaxTriangles);
+			json.Key("changes").Value(timing.Changes);
+			json.Key("pixel_error").Value(timing.PixelError);
+			json.EndObject();
+		}
+		json.EndArray();
+	});
+	return passed && budgetMet && written;
+}
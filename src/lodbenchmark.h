@@ -0,0 +1,60 @@
+/**
+ * @file lodbenchmark.h
+ * @brief Self test of the level of detail selection and its cost for many objects
+ * @details The test checks that vertex clustering only removes triangles, that the selector picks the
+ * coarsest level within the pixel budget, that hysteresis keeps an object hovering at a switch distance from
+ * changing level every frame, and that a triangle budget is met. The benchmark moves a camera through a field
+ * of objects and times the selection without hysteresis, with it, and with it under a triangle budget.
+*/
+
+#pragma once
+#ifndef LODBENCHMARK_H
+#define LODBENCHMARK_H
+
+#include <string>
+#include "benchmark.h"
+
+//! Objects in the field of -lodbenchmark
+#define LODBENCHMARK_DEFAULT_OBJECTS 10000
+
+//! Frames per run of -lodbenchmark
+#define LODBENCHMARK_DEFAULT_FRAMES 200
+
+/**
+ * @brief Selection cost and result of one run through the field.
+*/
+struct LodTiming
+{
+	const char* Name = ""; //!< "no hysteresis", "hysteresis" or "budget"
+	float Hysteresis = 0.0f; //!< Fraction set with LodSelector::SetHysteresis()
+	unsigned TriangleBudget = 0; //!< Triangle budget, 0 for none
+	double Triangles = 0.0; //!< Average triangles of the selected levels per frame
+	double TrianglesSaved = 0.0; //!< Average triangles saved per frame
+	double Changes = 0.0; //!< Average level changes per frame
+	double PixelError = 0.0; //!< Average pixel budget used
+	unsigned MaxTriangles = 0; //!< Most triangles of any frame
+	BenchmarkSummary Milliseconds; //!< LodSelector::Select() per frame
+};
+
+/**
+ * @brief Run the self test of LodSelector and ClusterIndices().
+*/
+bool RunLodTest(std::string& failure);
+
+/**
+ * @brief Move a camera through a field of objects and select their levels every frame.
+ * @details Expects the job system to be started, or selects on the calling thread.
+ * @param[in] hysteresis Fraction set with LodSelector::SetHysteresis().
+ * @param[in] triangle_budget Triangle budget, 0 for none.
+*/
+LodTiming RunLodTimings(const char* name, unsigned objects, unsigned frames, float hysteresis, unsigned triangle_budget);
+
+/**
+ * @brief Run the self test, and runs through the field without and with hysteresis and with a triangle budget.
+ * @details Starts the job system for the runs and leaves it stopped. The triangle budget is half the average
+ * triangles of the run with hysteresis.
+ * @return True if the test passed, the budget was met and the report was written.
+*/
+bool RunLodBenchmark(unsigned objects, unsigned frames, const std::string& report_filename);
+
+#endif
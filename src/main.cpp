@@ -27,9 +27,35 @@
 #include "Camera.h"
 #include "Model.h"
 #include "Scene.h"
+#include "benchmark.h"
+#include "blobcachebenchmark.h"
+#include "boundsbenchmark.h"
+#include "devicestate.h"
+#include "filewatcher.h"
+#include "filewatcherbenchmark.h"
+#include "fixedtimestep.h"
+#include "loadbenchmark.h"
+#include "jobbenchmark.h"
+#include "jobsystem.h"
+#include "renderqueuebenchmark.h"
+#include "shadercache.h"
+#include "shaderpermutations.h"
+#include "instancebuffer.h"
+#include "instancingbenchmark.h"
+#include "constantringbenchmark.h"
+#include "cullingbenchmark.h"
+#include "devicestatebenchmark.h"
+#include "transformbenchmark.h"
+#include "scenestorebenchmark.h"
+#include "scenegraphbenchmark.h"
+#include "lodbenchmark.h"
+#include "softrasterbenchmark.h"
+#include "profiler.h"
 #include "imgui.h"
 #include "imgui_impl_win32.h"
 #include "imgui_impl_dx11.h"
+#include <algorithm>
+#include <chrono>
 
 #ifdef FORCE_DGPU
 #include "dgpuforcer.h"
@@ -46,9 +72,15 @@ static ID3D11DepthStencilView*	depthStencilView	= nullptr;
 static ID3D11Device*			device				= nullptr;
 static ID3D11DeviceContext*		deviceContext		= nullptr;
 static ID3D11RasterizerState*	rasterState			= nullptr;
+static ID3D11SamplerState*		samplerState		= nullptr;
+static std::unique_ptr<DeviceState>	deviceState;		// Redundant state filter of deviceContext
 
-static shader_data*				vertexShader		= nullptr;
-static shader_data*				pixelShader			= nullptr;
+static std::unique_ptr<ShaderPermutations>	vertexShaders;	// Vertex shader, without features
+static std::unique_ptr<ShaderPermutations>	pixelShaders;	// Pixel shader variants of the materials' features
+static std::unique_ptr<ShaderPermutations>	instancedVertexShaders; // Vertex shader of instanced draws
+static std::unique_ptr<ShaderCache>	shaderCache;		// Compiled shader bytecode, kept between runs
+static FileWatcher				shaderWatcher;		// Reports changed shader files for hot reload
+static int						shaderReloadFrames[3] = {}; // Frames left to retry reloading the vertex, pixel and instanced vertex shader
 
 #ifdef _DEBUG
 static ID3D11Debug*				debugController		= nullptr;
@@ -63,6 +95,13 @@ static std::unique_ptr<Scene>	scene;
 
 static bool						showImgui			= true; // Disable to hide metrics
 
+static std::unique_ptr<Benchmark>	benchmark;			// Set when running in benchmark mode
+static CameraPath				recordedPath;		// Camera path being recorded from user input
+static bool						recordingPath		= false;
+static float					recordingTime		= 0.0f;
+static double					sceneRenderMilliseconds = 0.0; // CPU time of the last scene->Render()
+static FixedTimestep			timestep;			// Simulation steps of the frames
+
 //--------------------------------------------------------------------------------------
 // Forward declarations
 //--------------------------------------------------------------------------------------
@@ -70,18 +109,121 @@ HRESULT				Render(float deltaTime);
 HRESULT				Update(float deltaTime);
 HRESULT				InitDirect3DAndSwapChain(int width, int height);
 void				InitRasterizerState();
+void				InitSamplerState();
 HRESULT				CreateRenderTargetView();
 HRESULT				CreateDepthStencilView(int width, int height);
 void				SetViewport(int width, int height);
 void				Release();
 void				WinResize();
 void				ShowMetrics(bool* p_open);
+void				ShowProfiler();
+void				ShowMemory();
+void				StartBenchmark();
+void				ReloadChangedShaders();
+bool				StepBenchmark();
+void				RecordCameraPath(float deltaTime);
+
+//--------------------------------------------------------------------------------------
+// Self tests and benchmarks that run instead of the application, each writing a JSON
+// report: eduRend.exe <switch> [arguments]
+//--------------------------------------------------------------------------------------
+static const BenchmarkMode benchmarkModes[] =
+{
+	// -loadbenchmark [obj file] [repeat count]: OBJ loading with temporary data on the heap and in an arena
+	{ L"-loadbenchmark", "load_benchmark.json", "Load benchmark failed or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunLoadBenchmark({ arguments.GetString(0, "assets/crytek-sponza/sponza.obj") },
+				arguments.GetUnsigned(1, LOADBENCHMARK_DEFAULT_REPEATS), report); } },
+
+	// -boundsbenchmark [volume count] [frame count]: batched bounding volume tests against the scalar ones
+	{ L"-boundsbenchmark", "bounds_benchmark.json", "Self test failed, the batched and scalar tests differed or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunBoundsBenchmark(arguments.GetUnsigned(0, BOUNDSBENCHMARK_DEFAULT_VOLUMES),
+				arguments.GetUnsigned(1, BOUNDSBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -jobbenchmark: job system stress test and scaling
+	{ L"-jobbenchmark", "job_benchmark.json", "Stress test failed or results could not be saved",
+		[](const BenchmarkArguments&, const std::string& report) { return RunJobBenchmark(report); } },
+
+	// -queuebenchmark [packet count] [frame count]: render queue build, sort and submit throughput
+	{ L"-queuebenchmark", "render_queue_benchmark.json", "Sort order was wrong or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunRenderQueueBenchmark(arguments.GetUnsigned(0, RENDERQUEUEBENCHMARK_DEFAULT_PACKETS),
+				arguments.GetUnsigned(1, RENDERQUEUEBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -watchbenchmark [frame count]: file watcher cost per frame and change latency
+	{ L"-watchbenchmark", "file_watcher_benchmark.json", "Changes were missed or misreported, or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunFileWatcherBenchmark(arguments.GetUnsigned(0, FILEWATCHERBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -cachebenchmark: blob cache self test, hashing, hit and store times
+	{ L"-cachebenchmark", "blob_cache_benchmark.json", "Self test failed or results could not be saved",
+		[](const BenchmarkArguments&, const std::string& report) { return RunBlobCacheBenchmark(report); } },
+
+	// -cullbenchmark [bound count] [frame count]: culling self test and cost of culling many bounds
+	{ L"-cullbenchmark", "culling_benchmark.json", "Self test failed or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunCullingBenchmark(arguments.GetUnsigned(0, CULLINGBENCHMARK_DEFAULT_BOUNDS),
+				arguments.GetUnsigned(1, CULLINGBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -statebenchmark [call count] [frame count]: redundant state filter self test against a mock context, and its cost per call
+	{ L"-statebenchmark", "device_state_benchmark.json", "Self test failed or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunDeviceStateBenchmark(arguments.GetUnsigned(0, DEVICESTATEBENCHMARK_DEFAULT_CALLS),
+				arguments.GetUnsigned(1, DEVICESTATEBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -instancebenchmark [frame count]: instanced culling and packing against a draw per copy
+	{ L"-instancebenchmark", "instancing_benchmark.json", "Packed instances differed or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunInstancingBenchmark(arguments.GetUnsigned(0, INSTANCINGBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -constantbenchmark [draw count] [frame count]: constant allocator self test and per-draw constants
+	{ L"-constantbenchmark", "constant_ring_benchmark.json", "Self test failed, the benchmark could not run or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunConstantRingBenchmark(arguments.GetUnsigned(0, CONSTANTRINGBENCHMARK_DEFAULT_OBJECTS),
+				arguments.GetUnsigned(1, CONSTANTRINGBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -transformbenchmark [object count] [frame count]: batched model-view-projection and normal matrices
+	{ L"-transformbenchmark", "transform_benchmark.json", "Matrices differed or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunTransformBenchmark(arguments.GetUnsigned(0, TRANSFORMBENCHMARK_DEFAULT_OBJECTS),
+				arguments.GetUnsigned(1, TRANSFORMBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -scenebenchmark [object count] [frame count]: scene store self test and parallel object update
+	{ L"-scenebenchmark", "scene_store_benchmark.json", "Self test failed, the runs differed or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunSceneStoreBenchmark(arguments.GetUnsigned(0, SCENESTOREBENCHMARK_DEFAULT_OBJECTS),
+				arguments.GetUnsigned(1, SCENESTOREBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -graphbenchmark [node count] [frame count]: scene graph self test and hierarchy updates
+	{ L"-graphbenchmark", "scene_graph_benchmark.json", "Self test failed, the updates differed or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunSceneGraphBenchmark(arguments.GetUnsigned(0, SCENEGRAPHBENCHMARK_DEFAULT_NODES),
+				arguments.GetUnsigned(1, SCENEGRAPHBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -lodbenchmark [object count] [frame count]: level of detail self test and selection
+	{ L"-lodbenchmark", "lod_benchmark.json", "Self test failed, the triangle budget was exceeded or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunLodBenchmark(arguments.GetUnsigned(0, LODBENCHMARK_DEFAULT_OBJECTS),
+				arguments.GetUnsigned(1, LODBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -rastertest [golden directory] [frame count]: CPU rasterizer images against their references, and frame times
+	{ L"-rastertest", "software_rasterizer_benchmark.json", "Images differed from their references or results could not be saved",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return RunSoftwareRasterizerBenchmark(arguments.GetString(0, SOFTRASTERBENCHMARK_DEFAULT_GOLDEN_DIRECTORY),
+				arguments.GetUnsigned(1, SOFTRASTERBENCHMARK_DEFAULT_FRAMES), report); } },
+
+	// -rastergolden [golden directory]: write the CPU rasterizer images as the new references
+	{ L"-rastergolden", "software_rasterizer_golden.json", "Reference images could not be written",
+		[](const BenchmarkArguments& arguments, const std::string& report) {
+			return WriteSoftwareRasterizerGoldenImages(arguments.GetString(0, SOFTRASTERBENCHMARK_DEFAULT_GOLDEN_DIRECTORY), report); } },
+};
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
 // loop. Idle time is used to render the scene.
 //--------------------------------------------------------------------------------------
-int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE, _In_ LPWSTR, _In_ int)
+int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE, _In_ LPWSTR command_line, _In_ int)
 {
 	// Load console and redirect some I/O to it
 	// Note: this has to be done before the win32 window is initialized, otherwise DirectInput dies
@@ -97,6 +239,17 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE, _In_ LPWSTR, _I
 	}
 #endif
 	
+	Profiler::SetThreadName("Main");
+	// Debug builds record the stack of every allocation for the leak report with: eduRend.exe -memstacks
+	myInitMemoryCheck(BenchmarkArguments(__argc, __wargv, L"-memstacks").IsPresent());
+
+	// Self tests and benchmarks without rendering, see benchmarkModes
+	int exitCode = 0;
+	if (RunBenchmarkMode(benchmarkModes, ARRAYSIZE(benchmarkModes), __argc, __wargv, exitCode))
+		return exitCode;
+
+	JobSystem::Initialize();
+
 	// Init the win32 window
 	window.Init(initialWinWidth, initialWinHeight);
 
@@ -104,6 +257,9 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE, _In_ LPWSTR, _I
 
 	// Setup Dear ImGui context
 	IMGUI_CHECKVERSION();
+	ImGui::SetAllocatorFunctions(
+		[](size_t size, void*) { return TrackedMalloc(size, MemoryTag::ImGui); },
+		[](void* pointer, void*) { TrackedFree(pointer); });
 	ImGui::CreateContext();
 	ImGuiIO& io = ImGui::GetIO(); (void) io;
 	io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;     // Enable Keyboard Controls
@@ -122,7 +278,9 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE, _In_ LPWSTR, _I
 
 	if(SUCCEEDED(hr = InitDirect3DAndSwapChain(initialWinWidth, initialWinHeight)))
 	{
+		deviceState = std::make_unique<DeviceState>(deviceContext);
 		InitRasterizerState();
+		InitSamplerState();
 
 		if (SUCCEEDED(hr = CreateRenderTargetView()) &&
 			SUCCEEDED(hr = CreateDepthStencilView(initialWinWidth, initialWinHeight)))
@@ -139,36 +297,74 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE, _In_ LPWSTR, _I
 					{ "TEX", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 48, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 			};
 
-			if(FAILED(create_shader(device, "shaders/vertex_shader.hlsl", "VS_main", SHADER_VERTEX, &inputDesc[0], 5, &vertexShader)))
+			// Skip compiling shaders that are unchanged since the last run
+			shaderCache = std::make_unique<ShaderCache>("shader_cache");
+			set_shader_cache(shaderCache->GetCallbacks());
+
+			// The variants without features now, the pixel shader variants of the materials once the scene is loaded
+			vertexShaders = std::make_unique<ShaderPermutations>(device, "shaders/vertex_shader.hlsl", "VS_main", SHADER_VERTEX, 0, &inputDesc[0], 5);
+			pixelShaders = std::make_unique<ShaderPermutations>(device, "shaders/pixel_shader.hlsl", "PS_main", SHADER_PIXEL, SHADERPERMUTATIONS_ALL_FEATURES);
+
+			// Instanced draws read the instance buffer after the vertices
+			D3D11_INPUT_ELEMENT_DESC instancedInputDesc[5 + INSTANCEBUFFER_LAYOUT_COUNT];
+			std::copy(inputDesc, inputDesc + 5, instancedInputDesc);
+			std::copy(InstanceBuffer::Layout, InstanceBuffer::Layout + INSTANCEBUFFER_LAYOUT_COUNT, instancedInputDesc + 5);
+			instancedVertexShaders = std::make_unique<ShaderPermutations>(device, "shaders/vertex_shader.hlsl", "VS_instanced", SHADER_VERTEX, 0,
+				instancedInputDesc, 5 + INSTANCEBUFFER_LAYOUT_COUNT);
+
+			if (!vertexShaders->Compile({}) || !pixelShaders->Compile({}) || !instancedVertexShaders->Compile({}))
 			{
 				// Can't continue the program if the shader fails to load.
-				return -1;
+				printf("Shaders did not compile\n");
+				hr = E_FAIL;
 			}
-			if(FAILED(create_shader(device, "shaders/pixel_shader.hlsl", "PS_main", SHADER_PIXEL, nullptr, 0, &pixelShader)))
+			else
 			{
-				// Can't continue the program if the shader fails to load.
-				return -1;
+				if (!shaderWatcher.Start({ "shaders" }))
+					printf("Could not watch the shaders directory, shader hot reload is disabled\n");
+
+				MemoryTagScope sceneMemory(MemoryTag::Scene);
+				scene = std::make_unique<OurTestScene>(
+					device,
+					deviceContext,
+					deviceState.get(),
+					initialWinWidth,
+					initialWinHeight);
+
+				int64_t cps = 0;
+				QueryPerformanceFrequency((LARGE_INTEGER*)&cps);
+				double ss = 1.0f / (float)cps;
+
+				int64_t start = 0;
+				QueryPerformanceCounter((LARGE_INTEGER*)&start);
+
+				{
+					PROFILE_ZONE("Scene init");
+					scene->Init();
+				}
+
+				// Compile the pixel shader variants the materials use, in parallel
+				std::vector<uint32_t> shaderFeatures;
+				scene->GetShaderFeatures(shaderFeatures);
+				if (!pixelShaders->Compile(shaderFeatures))
+					printf("Some pixel shader variants did not compile, their materials use fewer features\n");
+				scene->SetPixelShaders(pixelShaders.get());
+				scene->SetInstancedVertexShaders(instancedVertexShaders.get());
+
+				const ShaderPermutationStats& shaderStats = pixelShaders->GetStats();
+				const BlobCacheStats cacheStats = shaderCache->GetStats();
+				printf("Pixel shader variants: %u in %.1f ms\n", shaderStats.Variants, shaderStats.CompileMilliseconds);
+				printf("Shader cache: %u hits, %u misses, %.1f ms saved\n", cacheStats.Hits, cacheStats.Misses, cacheStats.SavedMilliseconds);
+
+				int64_t end = 0;
+				QueryPerformanceCounter((LARGE_INTEGER*)&end);
+				double dt = ((double)end - start) * ss;
+				printf("Scene loading took %lfs\n", dt);
+
+				// Benchmark mode: eduRend.exe -benchmark [camera path file] [frame count]
+				if (BenchmarkArguments(__argc, __wargv, L"-benchmark").IsPresent())
+					StartBenchmark();
 			}
-
-			scene = std::make_unique<OurTestScene>(
-				device,
-				deviceContext,
-				initialWinWidth,
-				initialWinHeight);
-
-			int64_t cps = 0;
-			QueryPerformanceFrequency((LARGE_INTEGER*)&cps);
-			double ss = 1.0f / (float)cps;
-
-			int64_t start = 0;
-			QueryPerformanceCounter((LARGE_INTEGER*)&start);
-
-			scene->Init();
-
-			int64_t end = 0;
-			QueryPerformanceCounter((LARGE_INTEGER*)&end);
-			double dt = ((double)end - start) * ss;
-			printf("Scene loading took %lfs\n", dt);
 		}
 	}
 
@@ -178,15 +374,27 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE, _In_ LPWSTR, _I
 
 	int64_t prevTimeStamp = 0;
 	QueryPerformanceCounter((LARGE_INTEGER*)&prevTimeStamp);
+	float fpsCooldown = 0.0f;
 
 	// after successful setup, initialize imgui
-	ImGui_ImplWin32_Init(window.GetHandle());
-	ImGui_ImplDX11_Init(device, deviceContext);
+	if (SUCCEEDED(hr))
+	{
+		ImGui_ImplWin32_Init(window.GetHandle());
+		ImGui_ImplDX11_Init(device, deviceContext);
+		printf("Entering main loop...\n");
+	}
+	else
+		printf("Initialization failed, exiting\n");
 
-	printf("Entering main loop...\n");
-	
-	while (window.Update())
+	// Nothing to render without the device, the state filter and the scene, but everything created is released below
+	while (SUCCEEDED(hr) && window.Update())
 	{
+		// Collect the zones and allocation counts of the previous frame
+		Profiler::EndFrame();
+		MemoryTracker::EndFrame();
+		deviceState->EndFrame();
+		PROFILE_ZONE("Frame");
+
 		if (window.SizeChanged())
 		{
 			WinResize();
@@ -196,18 +404,41 @@ int WINAPI wWinMain(_In_ HINSTANCE instance, _In_opt_ HINSTANCE, _In_ LPWSTR, _I
 		QueryPerformanceCounter((LARGE_INTEGER*)&currTimeStamp);
 		const float deltaTime = (currTimeStamp - prevTimeStamp) * secsPerCnt;
 		inputHandler.Update();
-		
-		Update(deltaTime);
-		Render(deltaTime);
+
+		if (benchmark)
+		{
+			if (!StepBenchmark())
+				break;
+		}
+		else
+		{
+			// Simulate in fixed steps, render interpolated between the last two
+			scene->HandleInput(inputHandler);
+			const unsigned steps = timestep.Advance(deltaTime);
+			for (unsigned step = 0; step < steps; step++)
+				Update(timestep.GetStep());
+			scene->SetInterpolation(timestep.GetAlpha());
+			RecordCameraPath(deltaTime);
+			Render(deltaTime);
+
+			// Print fps
+			fpsCooldown -= deltaTime;
+			if (fpsCooldown < 0.0f)
+			{
+				std::cout << "fps " << (int)(1.0f / deltaTime) << std::endl;
+				fpsCooldown = 2.0f;
+			}
+		}
 
 		prevTimeStamp = currTimeStamp;
 	}
 
 	Release();
+	myDumpMemoryLeaks();
 #ifdef USECONSOLE
 	FreeConsole();
 #endif
-	return 0;
+	return SUCCEEDED(hr) ? 0 : -1;
 }
 
 // Resize render targets and swap chains.
@@ -356,6 +587,22 @@ void InitRasterizerState()
 	deviceContext->RSSetState(rasterState);
 }
 
+void InitSamplerState()
+{
+	D3D11_SAMPLER_DESC samplerDesc{};
+	samplerDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+	samplerDesc.AddressU = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressV = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.AddressW = D3D11_TEXTURE_ADDRESS_WRAP;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+	samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+
+	// Shared by the textures of every pixel shader variant, slot s0
+	device->CreateSamplerState(&samplerDesc, &samplerState);
+	SETNAME(samplerState, "SamplerState");
+	deviceContext->PSSetSamplers(0, 1, &samplerState);
+}
+
 HRESULT CreateRenderTargetView()
 {
 	HRESULT hr = S_OK;
@@ -417,6 +664,9 @@ void SetViewport(int width, int height)
 
 HRESULT Update(float deltaTime)
 {
+	PROFILE_FUNCTION();
+	MemoryTagScope memoryTag(MemoryTag::Scene);
+
 	scene->Update(deltaTime, inputHandler);
 
 	return S_OK;
@@ -424,15 +674,20 @@ HRESULT Update(float deltaTime)
 
 HRESULT Render(float deltaTime)
 {
+	PROFILE_FUNCTION();
+
 	// Start the Dear ImGui frame
-	ImGui_ImplDX11_NewFrame();
-	ImGui_ImplWin32_NewFrame();
-	ImGui::NewFrame();
+	{
+		PROFILE_ZONE("ImGui");
+		ImGui_ImplDX11_NewFrame();
+		ImGui_ImplWin32_NewFrame();
+		ImGui::NewFrame();
 
-	if (showImgui)
-		ShowMetrics(&showImgui);
-	
-	ImGui::Render();
+		if (showImgui)
+			ShowMetrics(&showImgui);
+
+		ImGui::Render();
+	}
 
 	// Get rid of unreferenced warning
 	deltaTime = deltaTime;
@@ -447,26 +702,41 @@ HRESULT Render(float deltaTime)
 	deviceContext->ClearDepthStencilView( depthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0 );
 	
 	// Set topology
-	deviceContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	deviceState->SetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 		
-	// Bind shaders
-	bind_shader(device, deviceContext, vertexShader);
-	bind_shader(device, deviceContext, pixelShader);
+	// Reload the shaders if their files changed, then bind the vertex shader;
+	// the scene binds the pixel shader variant of each material
+	ReloadChangedShaders();
+	deviceState->SetInputLayout(get_input_layout(vertexShaders->Get(0)));
+	deviceState->SetVertexShader(get_vertex_shader(vertexShaders->Get(0)));
 
 	// These shader types are not used
-	deviceContext->HSSetShader(nullptr, nullptr, 0);
-	deviceContext->DSSetShader(nullptr, nullptr, 0);
-	deviceContext->GSSetShader(nullptr, nullptr, 0);
+	deviceState->SetHullShader(nullptr);
+	deviceState->SetDomainShader(nullptr);
+	deviceState->SetGeometryShader(nullptr);
 	
 	// Time for the current scene to render
-	scene->Render();
+	{
+		PROFILE_ZONE("Scene render");
+		MemoryTagScope memoryTag(MemoryTag::Scene);
+		const auto sceneStart = std::chrono::high_resolution_clock::now();
+		scene->Render();
+		const auto sceneEnd = std::chrono::high_resolution_clock::now();
+		sceneRenderMilliseconds = std::chrono::duration<double, std::milli>(sceneEnd - sceneStart).count();
+	}
 
-	ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+	{
+		// Restores the state it binds, but constant buffers without their ranges
+		PROFILE_ZONE("ImGui draw");
+		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
+		deviceState->InvalidateConstantBuffers();
+	}
 
 	// Swap front and back buffer
+	PROFILE_ZONE("Present");
 #ifdef VSYNC
-	// Swapping synchronized with monitor
-	return swapChain->Present(1, 0);
+	// Swapping synchronized with monitor, except when benchmarking
+	return swapChain->Present(benchmark ? 0 : 1, 0);
 #else
 	// Swapping not synchronized with monitor
 	return swapChain->Present(0, 0);
@@ -517,33 +787,370 @@ void ShowMetrics(bool* p_open) {
 
 		// show fps
 		ImGui::Text("FPS: %.1f", ImGui::GetIO().Framerate);
+
+		// show simulation steps
+		const FixedTimestepStats& stepStats = timestep.GetStats();
+		ImGui::Text("Simulation: %.0f Hz, %u steps, alpha %.2f", 1.0f / timestep.GetStep(), stepStats.FrameSteps, timestep.GetAlpha());
+		if (stepStats.DroppedSeconds > 0.0)
+			ImGui::Text("Simulation time dropped: %.2f s", stepStats.DroppedSeconds);
+
+		// show view frustum culling stats
+		if (scene)
+		{
+			const CullStats& cullStats = scene->GetCullStats();
+			ImGui::Separator();
+			ImGui::Text("Culling: %u/%u visible", cullStats.Visible, cullStats.Tested);
+			ImGui::Text("Culling time: %.3f ms", cullStats.Milliseconds);
+			ImGui::Text("Occluded: %u/%u, %u occluder triangles", cullStats.Occluded, cullStats.Visible, cullStats.OccluderTriangles);
+			ImGui::Text("Occlusion time: %.3f ms", cullStats.OcclusionMilliseconds);
+
+			// show state changes of the render queue
+			const RenderQueueStats& queueStats = scene->GetRenderQueueStats();
+			ImGui::Text("Draws: %u, changes: %u geometry, %u material, %u transform", queueStats.Packets,
+				queueStats.GeometryChanges, queueStats.MaterialChanges, queueStats.TransformChanges);
+			const DeviceStateStats& stateStats = deviceState->GetStats();
+			ImGui::Text("State calls: %u issued, %u filtered", stateStats.Issued, stateStats.Filtered);
+			if (const ConstantAllocatorStats* constantStats = scene->GetConstantStats())
+				ImGui::Text("Constants: %u draws, %.1f KB in one map", constantStats->Allocations, constantStats->UsedBytes / 1024.0);
+			else
+				ImGui::Text("Constants: one map per draw");
+			if (const LodStats* lodStats = scene->GetLodStats())
+				ImGui::Text("LOD: %u triangles, %u saved, %u changes, %.1f px, %.3f ms", lodStats->Triangles, lodStats->TrianglesSaved(),
+					lodStats->Changes, lodStats->PixelError, lodStats->Milliseconds);
+			const BlobCacheStats cacheStats = shaderCache->GetStats();
+			ImGui::Text("Shader cache: %u hits, %u misses, %.1f ms saved", cacheStats.Hits, cacheStats.Misses, cacheStats.SavedMilliseconds);
+			const ShaderPermutationStats& shaderStats = pixelShaders->GetStats();
+			ImGui::Text("Pixel shader variants: %u, compiled in %.1f ms", shaderStats.Variants, shaderStats.CompileMilliseconds);
+
+			// Record a camera path to use for benchmarks
+			if (ImGui::Button(recordingPath ? "Stop recording camera path" : "Record camera path"))
+			{
+				if (recordingPath)
+				{
+					const bool saved = recordedPath.Save("camera_path.txt");
+					printf("Camera path with %u keys %s\n", (unsigned)recordedPath.GetKeys().size(),
+						saved ? "saved to camera_path.txt" : "could not be saved");
+				}
+				recordedPath.Clear();
+				recordingTime = 0.0f;
+				recordingPath = !recordingPath;
+			}
+
+			// Render the current frame on the CPU and save it
+			if (ImGui::Button("Save software frame"))
+			{
+				const linalg::vec2i size = window.GetSize();
+				SoftwareRasterizer rasterizer(size.x, size.y);
+				scene->RenderSoftware(rasterizer);
+				const SoftwareRasterizerStats& stats = rasterizer.GetStats();
+				const bool saved = rasterizer.GetImage().WriteTGA("software_frame.tga");
+				printf("Software frame %s: %u/%u triangles, %u pixels, setup %.1f ms, raster %.1f ms\n",
+					saved ? "saved to software_frame.tga" : "could not be saved",
+					stats.TrianglesSetup, stats.Triangles, stats.PixelsShaded, stats.SetupMilliseconds, stats.RasterMilliseconds);
+			}
+		}
+
+		ShowProfiler();
+		ShowMemory();
 		
 		ImGui::End();
 	}
 }
 
+//
+// Timeline of the zones of the last frame, one row per zone depth of each thread.
+// Hover a zone to see its time.
+//
+void ShowProfiler()
+{
+	ImGui::Separator();
+	if (!ImGui::CollapsingHeader("Profiler"))
+		return;
+
+	// Trace captures, written as Chrome trace JSON
+	if (ImGui::Button(Profiler::IsCapturing() ? "Stop trace" : "Start trace"))
+	{
+		if (Profiler::IsCapturing())
+		{
+			Profiler::StopCapture();
+			const bool saved = Profiler::WriteChromeTrace("profile_trace.json");
+			printf("Trace with %u zones %s\n", (unsigned)Profiler::GetCaptureSize(),
+				saved ? "saved to profile_trace.json" : "could not be saved");
+		}
+		else
+			Profiler::StartCapture();
+	}
+
+	static double zoneOverhead = 0.0;
+	ImGui::SameLine();
+	if (ImGui::Button("Measure zone overhead"))
+		zoneOverhead = Profiler::MeasureZoneOverhead();
+	if (zoneOverhead > 0.0)
+	{
+		ImGui::SameLine();
+		ImGui::Text("%.1f ns/zone", zoneOverhead);
+	}
+
+	const std::vector<ProfileZoneEvent>& zones = Profiler::GetFrameZones();
+	const int64_t frameStart = Profiler::GetFrameStart();
+	const double frameLength = (double)(Profiler::GetFrameEnd() - frameStart);
+	ImGui::Text("Frame: %.3f ms, %u zones, %u dropped", frameLength * 1e-6, (unsigned)zones.size(), (unsigned)Profiler::GetDroppedZones());
+	if (zones.empty() || frameLength <= 0.0)
+		return;
+
+	// Rows of each thread, for its deepest zone
+	const std::vector<std::string> threadNames = Profiler::GetThreadNames();
+	std::vector<unsigned> threadRows(threadNames.size(), 0);
+	for (const ProfileZoneEvent& zone : zones)
+		if (zone.Depth + 1 > threadRows[zone.Thread])
+			threadRows[zone.Thread] = zone.Depth + 1;
+
+	const float Width = 480.0f;
+	const float RowHeight = ImGui::GetTextLineHeight() + 2.0f;
+	std::vector<float> threadY(threadNames.size(), 0.0f);
+	float height = 0.0f;
+	for (size_t i = 0; i < threadNames.size(); i++)
+	{
+		threadY[i] = height;
+		height += threadRows[i] * RowHeight;
+	}
+
+	ImDrawList* drawList = ImGui::GetWindowDrawList();
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	ImGui::Dummy(ImVec2(Width, height));
+	drawList->PushClipRect(origin, ImVec2(origin.x + Width, origin.y + height), true);
+
+	for (const ProfileZoneEvent& zone : zones)
+	{
+		const float x0 = origin.x + (float)((zone.Start - frameStart) / frameLength) * Width;
+		float x1 = origin.x + (float)((zone.End - frameStart) / frameLength) * Width;
+		if (x1 < x0 + 1.0f)
+			x1 = x0 + 1.0f;
+		const float y0 = origin.y + threadY[zone.Thread] + zone.Depth * RowHeight;
+		const float y1 = y0 + RowHeight - 1.0f;
+
+		// Colour by name, so a zone keeps its colour from frame to frame
+		unsigned hash = 2166136261u;
+		for (const char* c = zone.Name; *c; c++)
+			hash = (hash ^ (unsigned char)*c) * 16777619u;
+		drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), ImColor::HSV((hash % 360) / 360.0f, 0.5f, 0.7f));
+
+		if (x1 - x0 > ImGui::CalcTextSize(zone.Name).x + 4.0f)
+			drawList->AddText(ImVec2(x0 + 2.0f, y0 + 1.0f), IM_COL32(255, 255, 255, 255), zone.Name);
+		if (ImGui::IsMouseHoveringRect(ImVec2(x0, y0), ImVec2(x1, y1)))
+			ImGui::SetTooltip("%s\n%s: %.3f ms", threadNames[zone.Thread].c_str(), zone.Name, (zone.End - zone.Start) * 1e-6);
+	}
+
+	drawList->PopClipRect();
+}
+
+//
+// Heap memory per tag, see memorytracker.h. Allocations per frame that stay
+// above zero in a static view are churn in the frame loop.
+//
+void ShowMemory()
+{
+	ImGui::Separator();
+	if (!ImGui::CollapsingHeader("Memory"))
+		return;
+
+	if (ImGui::BeginTable("Memory tags", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit))
+	{
+		ImGui::TableSetupColumn("Tag");
+		ImGui::TableSetupColumn("Live KiB");
+		ImGui::TableSetupColumn("Peak KiB");
+		ImGui::TableSetupColumn("Allocs/frame");
+		ImGui::TableSetupColumn("KiB/frame");
+		ImGui::TableHeadersRow();
+		for (int i = 0; i < (int)MemoryTag::Count; i++)
+		{
+			const MemoryTagStats stats = MemoryTracker::GetStats((MemoryTag)i);
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(MemoryTracker::GetTagName((MemoryTag)i));
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", stats.LiveBytes / 1024.0);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", stats.PeakBytes / 1024.0);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)stats.FrameAllocations);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", stats.FrameBytes / 1024.0);
+		}
+		ImGui::EndTable();
+	}
+
+	// Stacks are only recorded for allocations made while capture is on
+	bool captureStacks = MemoryTracker::IsStackCaptureEnabled();
+	if (ImGui::Checkbox("Record allocation stacks", &captureStacks))
+		MemoryTracker::SetStackCapture(captureStacks);
+	ImGui::SameLine();
+	if (ImGui::Button("Write leak report"))
+	{
+		const bool saved = MemoryTracker::WriteLeakReport("memory_leaks.txt");
+		printf("Leak report %s\n", saved ? "saved to memory_leaks.txt" : "could not be saved");
+	}
+}
+
+//
+// Benchmark mode
+//
+// The camera follows a path instead of user input, and the scene is updated
+// with a fixed timestep for a fixed number of frames, so every run renders the
+// same frames. Per-frame CPU times are written to benchmark.json.
+//
+void StartBenchmark()
+{
+	// Optional arguments after -benchmark: camera path file and frame count
+	const BenchmarkArguments arguments(__argc, __wargv, L"-benchmark");
+	const std::string pathFile = arguments.GetString(0, "");
+	const unsigned frameCount = arguments.GetUnsigned(1, BENCHMARK_DEFAULT_FRAMES);
+
+	CameraPath path;
+	if (pathFile.empty() || !path.Load(pathFile))
+	{
+		if (!pathFile.empty())
+			printf("Could not load camera path %s, using the default path\n", pathFile.c_str());
+
+		// Through the Sponza atrium and back, looking around on the way
+		path.AddKey(0.0f, { 0.0f, 0.0f, 5.0f }, 0.0f, 0.0f);
+		path.AddKey(4.0f, { 0.0f, 1.0f, -25.0f }, 0.0f, 0.1f);
+		path.AddKey(8.0f, { 6.0f, 6.0f, -45.0f }, 0.8f, 0.2f);
+		path.AddKey(12.0f, { -6.0f, 12.0f, -20.0f }, 2.5f, -0.3f);
+		path.AddKey(16.0f, { 0.0f, 4.0f, 30.0f }, 3.1f, -0.1f);
+		path.AddKey(20.0f, { 0.0f, 0.0f, 5.0f }, 0.0f, 0.0f);
+	}
+
+	benchmark = std::make_unique<Benchmark>(path, frameCount);
+#ifdef _DEBUG
+	benchmark->SetMetadata("configuration", "debug");
+#else
+	benchmark->SetMetadata("configuration", "release");
+#endif
+	benchmark->SetMetadata("build", __DATE__ " " __TIME__);
+	benchmark->SetMetadata("camera_path", pathFile.empty() ? "default" : pathFile);
+	benchmark->SetMetadata("profiler_zone_ns", std::to_string(Profiler::MeasureZoneOverhead()));
+	printf("Running benchmark, %u frames...\n", frameCount);
+}
+
+//
+// Recompile the shaders whose files the watcher reported as changed. An
+// editor may still hold a file it just saved, so a reload that cannot read
+// the file is retried for a few frames.
+//
+void ReloadChangedShaders()
+{
+	const int RetryFrames = 30;
+	ShaderPermutations* const shaders[3] = { vertexShaders.get(), pixelShaders.get(), instancedVertexShaders.get() };
+
+	FileChange change;
+	while (shaderWatcher.Poll(change))
+	{
+		for (int i = 0; i < 3; i++)
+			if (change.Overflow || change.Path == shaders[i]->GetPath())
+				shaderReloadFrames[i] = RetryFrames;
+	}
+
+	for (int i = 0; i < 3; i++)
+	{
+		if (shaderReloadFrames[i] == 0)
+			continue;
+		if (shaders[i]->Reload() < 0)
+			shaderReloadFrames[i]--;
+		else
+			shaderReloadFrames[i] = 0;
+	}
+}
+
+bool StepBenchmark()
+{
+	if (benchmark->IsFinished())
+	{
+		const BenchmarkSummary frame = benchmark->Summarize(&BenchmarkFrame::FrameMilliseconds);
+		const bool saved = benchmark->WriteJSON("benchmark.json");
+		printf("Benchmark done, frame time p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+			frame.P50, frame.P95, frame.P99, frame.Max);
+		printf("%s\n", saved ? "Results saved to benchmark.json" : "Results could not be saved");
+		return false;
+	}
+
+	const auto frameStart = std::chrono::high_resolution_clock::now();
+
+	if (Camera* camera = scene->GetCamera())
+	{
+		const CameraPath::Key key = benchmark->GetCameraKey();
+		camera->MoveTo(key.Position);
+		camera->SetOrientation(key.Yaw, key.Pitch);
+	}
+
+	// No keys or buttons are pressed in a default constructed handler
+	static const InputHandler noInput;
+	{
+		MemoryTagScope memoryTag(MemoryTag::Scene);
+		scene->Update(benchmark->GetTimestep(), noInput);
+	}
+	scene->SetInterpolation(1.0f);
+	const auto updateEnd = std::chrono::high_resolution_clock::now();
+
+	Render(benchmark->GetTimestep());
+	const auto frameEnd = std::chrono::high_resolution_clock::now();
+
+	const CullStats& cullStats = scene->GetCullStats();
+	BenchmarkFrame frame;
+	frame.UpdateMilliseconds = std::chrono::duration<double, std::milli>(updateEnd - frameStart).count();
+	frame.CullMilliseconds = cullStats.Milliseconds + cullStats.OcclusionMilliseconds;
+	frame.SubmitMilliseconds = sceneRenderMilliseconds - frame.CullMilliseconds;
+	frame.FrameMilliseconds = std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+	benchmark->AddFrame(frame);
+	return true;
+}
+
+void RecordCameraPath(float deltaTime)
+{
+	const float KeyInterval = 0.1f; // seconds between recorded keys
+
+	Camera* camera = scene ? scene->GetCamera() : nullptr;
+	if (!recordingPath || !camera)
+		return;
+
+	if (recordedPath.GetKeys().empty() || recordingTime - recordedPath.GetDuration() >= KeyInterval)
+		recordedPath.AddKey(recordingTime, camera->GetPosition(), camera->GetYaw(), camera->GetPitch());
+	recordingTime += deltaTime;
+}
+
 void Release()
 {
-	ImGui_ImplDX11_Shutdown();
-	ImGui_ImplWin32_Shutdown();
+	// The backends are only initialized when everything else was
+	if (ImGui::GetIO().BackendRendererUserData)
+		ImGui_ImplDX11_Shutdown();
+	if (ImGui::GetIO().BackendPlatformUserData)
+		ImGui_ImplWin32_Shutdown();
 	ImGui::DestroyContext();
 
 	SAFE_RELEASE(scene);
+	JobSystem::Shutdown();
 
-	delete_shader(vertexShader);
-	delete_shader(pixelShader);
+	shaderWatcher.Stop();
+	vertexShaders.reset();
+	pixelShaders.reset();
+	instancedVertexShaders.reset();
+	set_shader_cache(nullptr);
+	shaderCache.reset();
 
 	SAFE_RELEASE(swapChain);
 	SAFE_RELEASE(renderTargetView);
 	SAFE_RELEASE(depthStencil);
 	SAFE_RELEASE(depthStencilView);
 	SAFE_RELEASE(rasterState);
+	SAFE_RELEASE(samplerState);
+	deviceState.reset();
 	SAFE_RELEASE(deviceContext);
 #ifdef _DEBUG
 	/*
 	* Note the Device is still alive at this point
 	*/
-	debugController->ReportLiveDeviceObjects(D3D11_RLDO_DETAIL | D3D11_RLDO_IGNORE_INTERNAL);
+	if (debugController)
+		debugController->ReportLiveDeviceObjects(D3D11_RLDO_DETAIL | D3D11_RLDO_IGNORE_INTERNAL);
 	SAFE_RELEASE(debugController);
 #endif
 	SAFE_RELEASE(device);
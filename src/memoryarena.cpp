@@ -0,0 +1,105 @@
+//
+// Monotonic memory arena
+//
+// Blocks are only freed by Release() and the destructor. Reset() starts over
+// from the first block, merging the blocks first so that a workload that
+// needed several blocks once fits in one the next time.
+//
+
+#include <cstdint>
+#include "memoryarena.h"
+
+MemoryArena::MemoryArena(size_t block_size) noexcept
+	: m_block_size(block_size ? block_size : MEMORYARENA_DEFAULT_BLOCK_SIZE)
+{
+}
+
+MemoryArena::~MemoryArena()
+{
+	Release();
+}
+
+void* MemoryArena::Allocate(size_t size, size_t alignment)
+{
+	uintptr_t aligned = ((uintptr_t)m_top + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	if (!m_top || aligned + size > (uintptr_t)m_end)
+	{
+		// Continue in the next block that is large enough, or a new one
+		do
+		{
+			if (m_top)
+				m_used_before_current += m_top - m_blocks[m_current].Data;
+			if (m_top && m_current + 1 < m_blocks.size())
+				m_current++;
+			else
+				AddBlock(size + alignment);
+			m_top = m_blocks[m_current].Data;
+			m_end = m_top + m_blocks[m_current].Size;
+			aligned = ((uintptr_t)m_top + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		} while (aligned + size > (uintptr_t)m_end);
+	}
+
+	m_top = (char*)(aligned + size);
+	const size_t used = GetUsedBytes();
+	if (used > m_peak)
+		m_peak = used;
+	return (void*)aligned;
+}
+
+void MemoryArena::Reset()
+{
+	if (m_blocks.size() > 1)
+	{
+		const size_t capacity = GetCapacity();
+		Release();
+		AddBlock(capacity);
+	}
+
+	m_current = 0;
+	m_used_before_current = 0;
+	m_top = m_blocks.empty() ? nullptr : m_blocks[0].Data;
+	m_end = m_blocks.empty() ? nullptr : m_top + m_blocks[0].Size;
+}
+
+void MemoryArena::Release() noexcept
+{
+	for (Block& block : m_blocks)
+		::operator delete(block.Data);
+	m_blocks.clear();
+	m_current = 0;
+	m_used_before_current = 0;
+	m_top = nullptr;
+	m_end = nullptr;
+}
+
+size_t MemoryArena::GetUsedBytes() const noexcept
+{
+	return m_top ? m_used_before_current + (m_top - m_blocks[m_current].Data) : 0;
+}
+
+size_t MemoryArena::GetPeakBytes() const noexcept
+{
+	return m_peak;
+}
+
+size_t MemoryArena::GetCapacity() const noexcept
+{
+	size_t capacity = 0;
+	for (const Block& block : m_blocks)
+		capacity += block.Size;
+	return capacity;
+}
+
+void MemoryArena::AddBlock(size_t min_size)
+{
+	size_t size = m_blocks.empty() ? m_block_size : m_blocks.back().Size * 2;
+	if (size < min_size)
+		size = min_size;
+
+	m_blocks.reserve(m_blocks.size() + 1);
+	Block block;
+	block.Data = (char*)::operator new(size);
+	block.Size = size;
+	m_blocks.push_back(block);
+	m_current = m_blocks.size() - 1;
+}
@@ -0,0 +1,159 @@
+/**
+ * @file memoryarena.h
+ * @brief Monotonic memory arena for short-lived scratch data
+ * @details Allocations bump a pointer through large blocks and are never freed one by one; Reset()
+ * makes all memory of the arena available again at once. Reusing one arena for many operations of
+ * the same kind, e.g. loading a batch of models, replaces their heap allocations with pointer bumps
+ * after the first operation.
+ *
+ * ArenaAllocator adapts an arena to the standard containers, in the manner of a
+ * std::pmr::monotonic_buffer_resource, and falls back to the heap when it has no arena.
+*/
+
+#pragma once
+#ifndef MEMORYARENA_H
+#define MEMORYARENA_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//! Size of the first block of an arena
+#define MEMORYARENA_DEFAULT_BLOCK_SIZE (1 << 20)
+
+/**
+ * @brief Monotonic allocator over a list of blocks.
+ * @details Not thread safe.
+*/
+class MemoryArena
+{
+public:
+	/**
+	 * @brief Create an empty arena; the first block is allocated on first use.
+	 * @param[in] block_size Size of the first block, later blocks double in size.
+	*/
+	explicit MemoryArena(size_t block_size = MEMORYARENA_DEFAULT_BLOCK_SIZE) noexcept;
+
+	~MemoryArena();
+
+	MemoryArena(const MemoryArena&) = delete;
+	MemoryArena& operator=(const MemoryArena&) = delete;
+
+	/**
+	 * @brief Allocate memory that stays valid until the next Reset().
+	 * @param[in] size Bytes to allocate.
+	 * @param[in] alignment Alignment, a power of two.
+	 * @throw std::bad_alloc if a new block can not be allocated.
+	*/
+	void* Allocate(size_t size, size_t alignment);
+
+	/**
+	 * @brief Make all memory available again, invalidating every allocation.
+	 * @details Keeps the memory. When it spans several blocks, they are merged into one
+	 * so that the next use of the same size fits in a single block.
+	*/
+	void Reset();
+
+	/**
+	 * @brief Free all blocks, invalidating every allocation.
+	*/
+	void Release() noexcept;
+
+	/**
+	 * @brief Get the bytes allocated since the last Reset(), including alignment padding.
+	*/
+	size_t GetUsedBytes() const noexcept;
+
+	/**
+	 * @brief Get the highest GetUsedBytes() so far.
+	*/
+	size_t GetPeakBytes() const noexcept;
+
+	/**
+	 * @brief Get the total size of the blocks.
+	*/
+	size_t GetCapacity() const noexcept;
+
+	/**
+	 * @brief Get the number of blocks.
+	*/
+	size_t GetBlockCount() const noexcept { return m_blocks.size(); }
+
+private:
+	struct Block
+	{
+		char* Data;
+		size_t Size;
+	};
+
+	void AddBlock(size_t min_size);
+
+	size_t m_block_size;
+	std::vector<Block> m_blocks;
+	size_t m_current = 0; //!< Block being allocated from
+	size_t m_used_before_current = 0; //!< Bytes used in the blocks before m_current
+	size_t m_peak = 0;
+	char* m_top = nullptr;
+	char* m_end = nullptr;
+};
+
+/**
+ * @brief Standard allocator that allocates from a MemoryArena, or from the heap without one.
+ * @details Deallocation is a no-op with an arena; its memory is reclaimed by MemoryArena::Reset().
+ * Containers using the same arena compare equal and can be moved and swapped freely.
+*/
+template<class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	/**
+	 * @brief Create an allocator.
+	 * @param[in] arena Arena to allocate from, or nullptr to use the heap.
+	*/
+	ArenaAllocator(MemoryArena* arena = nullptr) noexcept : m_arena(arena) { }
+
+	template<class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_arena(other.GetArena()) { }
+
+	T* allocate(size_t count)
+	{
+		if (m_arena)
+			return (T*)m_arena->Allocate(count * sizeof(T), alignof(T));
+		return (T*)::operator new(count * sizeof(T));
+	}
+
+	void deallocate(T* pointer, size_t) noexcept
+	{
+		if (!m_arena)
+			::operator delete(pointer);
+	}
+
+	MemoryArena* GetArena() const noexcept { return m_arena; }
+
+private:
+	MemoryArena* m_arena;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept { return a.GetArena() == b.GetArena(); }
+
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept { return a.GetArena() != b.GetArena(); }
+
+//! Vector allocating from an arena
+template<class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+//! String allocating from an arena
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+//! Hash map allocating from an arena
+template<class Key, class Value, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+using ArenaHashMap = std::unordered_map<Key, Value, Hash, Equal, ArenaAllocator<std::pair<const Key, Value>>>;
+
+#endif
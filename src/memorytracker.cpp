@@ -0,0 +1,523 @@
+//
+// Tracking heap allocator
+//
+// Replacing the global operator new and delete is allowed by the standard and
+// takes effect for the whole program, including the standard containers.
+// Every block gets a 16 byte header with its size and tag, which keeps the
+// alignment of malloc. Tag counters are relaxed atomics; the current tag and
+// the per-thread allocation count are thread local.
+//
+// Stack records live in a table guarded by a mutex. The table allocates
+// itself, so the thread holding the lock is flagged and its allocations are
+// not recorded, which would otherwise re-enter the lock.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+#include "memorytracker.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <dbghelp.h>
+#pragma comment(lib, "dbghelp.lib")
+#else
+#include <execinfo.h>
+#endif
+
+namespace
+{
+	struct Header
+	{
+		uint64_t Size;
+		uint32_t Tag;
+		uint32_t HasStack;
+	};
+	static_assert(sizeof(Header) == 16, "The header must keep the 16 byte alignment of malloc");
+
+	struct TagCounters
+	{
+		std::atomic<int64_t> LiveBytes;
+		std::atomic<int64_t> LiveAllocations;
+		std::atomic<int64_t> PeakBytes;
+		std::atomic<uint64_t> TotalAllocations;
+		std::atomic<uint64_t> TotalBytes;
+
+		// Updated by EndFrame()
+		uint64_t FrameStartAllocations;
+		uint64_t FrameStartBytes;
+		uint64_t FrameAllocations;
+		uint64_t FrameBytes;
+	};
+
+	struct StackRecord
+	{
+		uint64_t Size;
+		MemoryTag Tag;
+		uint32_t Depth;
+		void* Frames[MEMORYTRACKER_STACK_DEPTH];
+	};
+
+	struct StackTable
+	{
+		std::mutex Mutex;
+		std::unordered_map<const void*, StackRecord> Records;
+	};
+
+	// Zero initialized before any dynamic initialization, so allocations from static constructors are counted
+	TagCounters g_counters[(size_t)MemoryTag::Count];
+	std::atomic<bool> g_capture_stacks(false);
+
+	thread_local MemoryTag t_tag = MemoryTag::Untagged;
+	thread_local AllocationCount t_count;
+	thread_local bool t_in_table = false;
+
+	const char* const TagNames[] = { "Untagged", "Loader", "Textures", "Scene", "ImGui" };
+	static_assert(sizeof(TagNames) / sizeof(TagNames[0]) == (size_t)MemoryTag::Count, "Every tag needs a name");
+
+	// Never destroyed, blocks may be freed during static destruction
+	StackTable& GetStackTable()
+	{
+		static StackTable* table = new StackTable();
+		return *table;
+	}
+
+	uint32_t CaptureStack(void** frames)
+	{
+		// Skip the tracker's own frames
+		const int Skip = 3;
+#ifdef _WIN32
+		return CaptureStackBackTrace(Skip, MEMORYTRACKER_STACK_DEPTH, frames, nullptr);
+#else
+		void* buffer[MEMORYTRACKER_STACK_DEPTH + Skip];
+		const int depth = backtrace(buffer, MEMORYTRACKER_STACK_DEPTH + Skip);
+		if (depth <= Skip)
+			return 0;
+		std::copy(buffer + Skip, buffer + depth, frames);
+		return (uint32_t)(depth - Skip);
+#endif
+	}
+
+	void RecordStack(const void* pointer, uint64_t size, MemoryTag tag)
+	{
+		StackRecord record;
+		record.Size = size;
+		record.Tag = tag;
+		record.Depth = CaptureStack(record.Frames);
+
+		StackTable& table = GetStackTable();
+		std::lock_guard<std::mutex> lock(table.Mutex);
+		t_in_table = true;
+		table.Records[pointer] = record;
+		t_in_table = false;
+	}
+
+	void EraseStack(const void* pointer)
+	{
+		StackTable& table = GetStackTable();
+		std::lock_guard<std::mutex> lock(table.Mutex);
+		t_in_table = true;
+		table.Records.erase(pointer);
+		t_in_table = false;
+	}
+
+	void ResizeStack(const void* pointer, uint64_t size)
+	{
+		StackTable& table = GetStackTable();
+		std::lock_guard<std::mutex> lock(table.Mutex);
+		auto record = table.Records.find(pointer);
+		if (record != table.Records.end())
+			record->second.Size = size;
+	}
+
+	void AddAllocation(MemoryTag tag, uint64_t size) noexcept
+	{
+		t_count.Allocations++;
+		t_count.Bytes += size;
+
+		TagCounters& counters = g_counters[(size_t)tag];
+		counters.TotalAllocations.fetch_add(1, std::memory_order_relaxed);
+		counters.TotalBytes.fetch_add(size, std::memory_order_relaxed);
+		counters.LiveAllocations.fetch_add(1, std::memory_order_relaxed);
+		const int64_t live = counters.LiveBytes.fetch_add((int64_t)size, std::memory_order_relaxed) + (int64_t)size;
+		int64_t peak = counters.PeakBytes.load(std::memory_order_relaxed);
+		while (live > peak && !counters.PeakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+			;
+	}
+
+	void RemoveAllocation(MemoryTag tag, uint64_t size) noexcept
+	{
+		TagCounters& counters = g_counters[(size_t)tag];
+		counters.LiveAllocations.fetch_sub(1, std::memory_order_relaxed);
+		counters.LiveBytes.fetch_sub((int64_t)size, std::memory_order_relaxed);
+	}
+
+	bool ShouldRecordStack() noexcept
+	{
+		return g_capture_stacks.load(std::memory_order_relaxed) && !t_in_table;
+	}
+
+	void* Allocate(size_t size, MemoryTag tag) noexcept
+	{
+		Header* header = (Header*)std::malloc(sizeof(Header) + size);
+		if (!header)
+			return nullptr;
+		header->Size = size;
+		header->Tag = (uint32_t)tag;
+		header->HasStack = 0;
+		AddAllocation(tag, size);
+
+		void* pointer = header + 1;
+		if (ShouldRecordStack())
+		{
+			try
+			{
+				RecordStack(pointer, size, tag);
+				header->HasStack = 1;
+			}
+			catch (...)
+			{
+				// Out of memory for the record, the allocation itself succeeded
+			}
+		}
+		return pointer;
+	}
+
+	std::string DescribeAddress(void* address)
+	{
+		std::string description;
+#ifdef _WIN32
+		HANDLE process = GetCurrentProcess();
+		static const bool initialized = (SymSetOptions(SYMOPT_LOAD_LINES | SYMOPT_UNDNAME), SymInitialize(process, nullptr, TRUE) != FALSE);
+		if (initialized)
+		{
+			char buffer[sizeof(SYMBOL_INFO) + 256] = {};
+			SYMBOL_INFO* symbol = (SYMBOL_INFO*)buffer;
+			symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+			symbol->MaxNameLen = 255;
+			DWORD64 displacement = 0;
+			if (SymFromAddr(process, (DWORD64)address, &displacement, symbol))
+				description = symbol->Name;
+
+			IMAGEHLP_LINE64 line = {};
+			line.SizeOfStruct = sizeof(line);
+			DWORD lineDisplacement = 0;
+			if (SymGetLineFromAddr64(process, (DWORD64)address, &lineDisplacement, &line))
+				description += std::string(" (") + line.FileName + ":" + std::to_string(line.LineNumber) + ")";
+		}
+#else
+		if (char** symbols = backtrace_symbols(&address, 1))
+		{
+			description = symbols[0];
+			std::free(symbols);
+		}
+#endif
+		if (description.empty())
+		{
+			char buffer[32];
+			snprintf(buffer, sizeof(buffer), "%p", address);
+			description = buffer;
+		}
+		return description;
+	}
+}
+
+MemoryTagScope::MemoryTagScope(MemoryTag tag) noexcept
+	: m_previous(t_tag)
+{
+	t_tag = tag;
+}
+
+MemoryTagScope::~MemoryTagScope()
+{
+	t_tag = m_previous;
+}
+
+MemoryTagStats MemoryTracker::GetStats(MemoryTag tag) noexcept
+{
+	const TagCounters& counters = g_counters[(size_t)tag];
+	MemoryTagStats stats;
+	stats.LiveBytes = counters.LiveBytes.load(std::memory_order_relaxed);
+	stats.LiveAllocations = counters.LiveAllocations.load(std::memory_order_relaxed);
+	stats.PeakBytes = counters.PeakBytes.load(std::memory_order_relaxed);
+	stats.TotalAllocations = counters.TotalAllocations.load(std::memory_order_relaxed);
+	stats.TotalBytes = counters.TotalBytes.load(std::memory_order_relaxed);
+	stats.FrameAllocations = counters.FrameAllocations;
+	stats.FrameBytes = counters.FrameBytes;
+	return stats;
+}
+
+const char* MemoryTracker::GetTagName(MemoryTag tag) noexcept
+{
+	return tag < MemoryTag::Count ? TagNames[(size_t)tag] : "Invalid";
+}
+
+void MemoryTracker::EndFrame() noexcept
+{
+	for (TagCounters& counters : g_counters)
+	{
+		const uint64_t allocations = counters.TotalAllocations.load(std::memory_order_relaxed);
+		const uint64_t bytes = counters.TotalBytes.load(std::memory_order_relaxed);
+		counters.FrameAllocations = allocations - counters.FrameStartAllocations;
+		counters.FrameBytes = bytes - counters.FrameStartBytes;
+		counters.FrameStartAllocations = allocations;
+		counters.FrameStartBytes = bytes;
+	}
+}
+
+void MemoryTracker::SetStackCapture(bool enabled)
+{
+	// Create the table before any allocation needs it
+	GetStackTable();
+	g_capture_stacks.store(enabled, std::memory_order_relaxed);
+}
+
+bool MemoryTracker::IsStackCaptureEnabled() noexcept
+{
+	return g_capture_stacks.load(std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::WriteLeakReport(std::ostream& out)
+{
+	// Copy the records, so that symbols are looked up without holding the lock
+	std::vector<StackRecord> records;
+	{
+		StackTable& table = GetStackTable();
+		std::lock_guard<std::mutex> lock(table.Mutex);
+		t_in_table = true;
+		records.reserve(table.Records.size());
+		for (const auto& entry : table.Records)
+			records.push_back(entry.second);
+		t_in_table = false;
+	}
+
+	// Group allocations with the same tag and stack
+	auto sameStack = [](const StackRecord& a, const StackRecord& b)
+	{
+		return a.Tag == b.Tag && a.Depth == b.Depth && std::equal(a.Frames, a.Frames + a.Depth, b.Frames);
+	};
+	std::sort(records.begin(), records.end(), [](const StackRecord& a, const StackRecord& b)
+	{
+		if (a.Tag != b.Tag)
+			return a.Tag < b.Tag;
+		if (a.Depth != b.Depth)
+			return a.Depth < b.Depth;
+		return std::lexicographical_compare(a.Frames, a.Frames + a.Depth, b.Frames, b.Frames + b.Depth);
+	});
+
+	struct Group
+	{
+		size_t First;
+		size_t Count;
+		uint64_t Bytes;
+	};
+	std::vector<Group> groups;
+	uint64_t totalBytes = 0;
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		if (groups.empty() || !sameStack(records[groups.back().First], records[i]))
+			groups.push_back({ i, 0, 0 });
+		groups.back().Count++;
+		groups.back().Bytes += records[i].Size;
+		totalBytes += records[i].Size;
+	}
+	std::sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) { return a.Bytes > b.Bytes; });
+
+	out << records.size() << " live allocations with recorded stacks, " << totalBytes << " bytes\n";
+	for (const Group& group : groups)
+	{
+		const StackRecord& record = records[group.First];
+		out << "\n" << group.Bytes << " bytes in " << group.Count << " allocations, " << GetTagName(record.Tag) << "\n";
+		for (uint32_t i = 0; i < record.Depth; i++)
+			out << "\t" << DescribeAddress(record.Frames[i]) << "\n";
+	}
+	return records.size();
+}
+
+bool MemoryTracker::WriteLeakReport(const std::string& filename)
+{
+	std::ofstream out(filename);
+	if (!out)
+		return false;
+	WriteLeakReport(out);
+	return (bool)out;
+}
+
+AllocationCount GetThreadAllocationCount() noexcept
+{
+	return t_count;
+}
+
+void* TrackedMalloc(size_t size) noexcept
+{
+	return Allocate(size, t_tag);
+}
+
+void* TrackedMalloc(size_t size, MemoryTag tag) noexcept
+{
+	return Allocate(size, tag);
+}
+
+void* TrackedCalloc(size_t count, size_t size) noexcept
+{
+	if (size && count > SIZE_MAX / size)
+		return nullptr;
+	void* pointer = Allocate(count * size, t_tag);
+	if (pointer)
+		std::memset(pointer, 0, count * size);
+	return pointer;
+}
+
+void* TrackedRealloc(void* pointer, size_t size) noexcept
+{
+	if (!pointer)
+		return Allocate(size, t_tag);
+	if (!size)
+	{
+		TrackedFree(pointer);
+		return nullptr;
+	}
+
+	Header* header = (Header*)pointer - 1;
+	const MemoryTag tag = (MemoryTag)header->Tag;
+	const uint64_t oldSize = header->Size;
+	const bool hadStack = header->HasStack != 0;
+
+	// On failure the old block is still allocated, and keeps its record
+	Header* resized = (Header*)std::realloc(header, sizeof(Header) + size);
+	if (!resized)
+		return nullptr;
+	if (hadStack)
+	{
+		EraseStack(pointer);
+		resized->HasStack = 0;
+	}
+	RemoveAllocation(tag, oldSize);
+	AddAllocation(tag, size);
+	resized->Size = size;
+
+	void* result = resized + 1;
+	if (ShouldRecordStack())
+	{
+		try
+		{
+			RecordStack(result, size, tag);
+			resized->HasStack = 1;
+		}
+		catch (...)
+		{
+		}
+	}
+	return result;
+}
+
+void* TrackedExpand(void* pointer, size_t size) noexcept
+{
+	if (!pointer)
+		return nullptr;
+	Header* header = (Header*)pointer - 1;
+	if (size > header->Size)
+		return nullptr;
+
+	const MemoryTag tag = (MemoryTag)header->Tag;
+	g_counters[(size_t)tag].LiveBytes.fetch_sub((int64_t)(header->Size - size), std::memory_order_relaxed);
+	header->Size = size;
+	if (header->HasStack)
+	{
+		try
+		{
+			ResizeStack(pointer, size);
+		}
+		catch (...)
+		{
+		}
+	}
+	return pointer;
+}
+
+void TrackedFree(void* pointer) noexcept
+{
+	if (!pointer)
+		return;
+	Header* header = (Header*)pointer - 1;
+	RemoveAllocation((MemoryTag)header->Tag, header->Size);
+	if (header->HasStack)
+	{
+		try
+		{
+			EraseStack(pointer);
+		}
+		catch (...)
+		{
+		}
+	}
+	std::free(header);
+}
+
+size_t TrackedSize(const void* pointer) noexcept
+{
+	return pointer ? (size_t)((const Header*)pointer - 1)->Size : 0;
+}
+
+void* operator new(size_t size)
+{
+	if (void* pointer = Allocate(size, t_tag))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	if (void* pointer = Allocate(size, t_tag))
+		return pointer;
+	throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size, t_tag);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return Allocate(size, t_tag);
+}
+
+void operator delete(void* pointer) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+	TrackedFree(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+	TrackedFree(pointer);
+}
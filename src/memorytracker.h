@@ -0,0 +1,169 @@
+/**
+ * @file memorytracker.h
+ * @brief Tracking heap allocator
+ * @details The global operator new and delete are replaced, and the myMalloc family of macros in
+ * stdafx.h maps to the Tracked functions below, so that every heap allocation of the program is
+ * accounted for. Each allocation is charged to the memory tag that is current on the allocating
+ * thread, see MemoryTagScope, and keeps a small header with its size and tag so that frees are
+ * charged to the same tag.
+ *
+ * Per tag, live and peak bytes and allocation totals are kept in atomic counters. MemoryTracker::EndFrame()
+ * turns the totals into per-frame allocation rates, which is where allocation churn in the frame loop shows up.
+ * Optionally, the call stack of every allocation is recorded for leak reports.
+ *
+ * Allocations are also counted per thread, so that a piece of work can be charged with the allocations
+ * it made, e.g. a stage of a model load. Builds on Windows and Linux.
+*/
+
+#pragma once
+#ifndef MEMORYTRACKER_H
+#define MEMORYTRACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+//! Number of return addresses kept per allocation when stack capture is enabled
+#define MEMORYTRACKER_STACK_DEPTH 16
+
+/**
+ * @brief Subsystems that allocations are charged to.
+*/
+enum class MemoryTag : uint8_t
+{
+	Untagged, //!< Allocations outside any MemoryTagScope
+	Loader, //!< Model loading
+	Textures, //!< Decoded images
+	Scene, //!< Scene objects and per-frame scene work
+	ImGui, //!< Dear ImGui
+	Count
+};
+
+/**
+ * @brief Counters of one tag.
+*/
+struct MemoryTagStats
+{
+	int64_t LiveBytes = 0; //!< Bytes currently allocated
+	int64_t LiveAllocations = 0; //!< Allocations not yet freed
+	int64_t PeakBytes = 0; //!< Highest LiveBytes so far
+	uint64_t TotalAllocations = 0; //!< Allocations since the start
+	uint64_t TotalBytes = 0; //!< Bytes allocated since the start
+	uint64_t FrameAllocations = 0; //!< Allocations during the last frame
+	uint64_t FrameBytes = 0; //!< Bytes allocated during the last frame
+};
+
+/**
+ * @brief Number and total size of allocations.
+*/
+struct AllocationCount
+{
+	uint64_t Allocations = 0; //!< Number of allocations
+	uint64_t Bytes = 0; //!< Bytes requested by the allocations
+};
+
+/**
+ * @brief Charges the allocations of the calling thread to a tag, from construction to destruction.
+*/
+class MemoryTagScope
+{
+public:
+	explicit MemoryTagScope(MemoryTag tag) noexcept;
+	~MemoryTagScope();
+
+	MemoryTagScope(const MemoryTagScope&) = delete;
+	MemoryTagScope& operator=(const MemoryTagScope&) = delete;
+
+private:
+	MemoryTag m_previous;
+};
+
+/**
+ * @brief Counters and leak reports of the tracking allocator.
+*/
+class MemoryTracker
+{
+public:
+	/**
+	 * @brief Get the counters of a tag.
+	*/
+	static MemoryTagStats GetStats(MemoryTag tag) noexcept;
+
+	/**
+	 * @brief Get the display name of a tag.
+	*/
+	static const char* GetTagName(MemoryTag tag) noexcept;
+
+	/**
+	 * @brief Mark the end of a frame, updating the per-frame allocation counts of all tags.
+	*/
+	static void EndFrame() noexcept;
+
+	/**
+	 * @brief Record the call stack of every following allocation, for leak reports.
+	 * @details Costs a stack walk and a locked table insert per allocation; meant for debugging.
+	*/
+	static void SetStackCapture(bool enabled);
+
+	/**
+	 * @brief True if allocation stacks are recorded.
+	*/
+	static bool IsStackCaptureEnabled() noexcept;
+
+	/**
+	 * @brief Write the live allocations that have a recorded stack, grouped by stack and largest first.
+	 * @return Number of live allocations with a recorded stack.
+	*/
+	static size_t WriteLeakReport(std::ostream& out);
+
+	/**
+	 * @brief Write the leak report to a file.
+	 * @return True on success.
+	*/
+	static bool WriteLeakReport(const std::string& filename);
+};
+
+/**
+ * @brief Get the allocations made by the calling thread since it started.
+ * @details Take the difference of two calls to count the allocations made in between.
+*/
+AllocationCount GetThreadAllocationCount() noexcept;
+
+/**
+ * @brief malloc() charged to the current tag of the calling thread.
+*/
+void* TrackedMalloc(size_t size) noexcept;
+
+/**
+ * @brief malloc() charged to a given tag.
+*/
+void* TrackedMalloc(size_t size, MemoryTag tag) noexcept;
+
+/**
+ * @brief calloc() charged to the current tag.
+*/
+void* TrackedCalloc(size_t count, size_t size) noexcept;
+
+/**
+ * @brief realloc() of a tracked allocation, keeping its tag.
+*/
+void* TrackedRealloc(void* pointer, size_t size) noexcept;
+
+/**
+ * @brief Shrink a tracked allocation in place.
+ * @return The pointer if the allocation is at least size bytes, otherwise nullptr and the allocation is unchanged.
+*/
+void* TrackedExpand(void* pointer, size_t size) noexcept;
+
+/**
+ * @brief free() of a tracked allocation.
+*/
+void TrackedFree(void* pointer) noexcept;
+
+/**
+ * @brief Get the requested size of a tracked allocation.
+*/
+size_t TrackedSize(const void* pointer) noexcept;
+
+#endif
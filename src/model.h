@@ -15,11 +15,18 @@
 #include "Drawcall.h"
 #include "OBJLoader.h"
 #include "Texture.h"
+#include "culling.h"
+#include "softrasterizer.h"
+#include "buffers.h"
+#include "renderqueue.h"
+#include "lod.h"
 
 using namespace linalg;
 
+class DeviceState;
+
 /**
- * @brief Abstract class. Defines the Render method and contains mesh data needed for a model.
+ * @brief Abstract class. Defines the Enqueue method and contains mesh data needed for a model.
 */
 class Model
 {
@@ -32,6 +39,9 @@ protected:
 	ID3D11Buffer* m_vertex_buffer = nullptr; //!< Pointer to gpu side vertex buffer
 	ID3D11Buffer* m_index_buffer = nullptr; //!< Pointer to gpu side index buffer
 
+	linalg::aabb m_bounds; //!< Object space bounding box of the whole model
+	const uint32_t m_geometry_id = RenderQueue::AllocateGeometryId(); //!< Geometry field of the sort keys of the model
+
 public:
 
 	/**
@@ -43,9 +53,74 @@ public:
 		:	m_dxdevice(dxdevice), m_dxdevice_context(dxdevice_context) { }
 
 	/**
-	 * @brief Abstract render method: must be implemented by derived classes
+	 * @brief Add a draw packet for each part of the model that may be visible to a render queue.
+	 * @param[in,out] queue Queue to push to.
+	 * @param[in] view View to cull against, in the object space of the model.
+	 * @param[in] transform Index of the model-to-world matrix in the queue, from RenderQueue::AddTransform().
+	 * @param[in] lod Level of detail to draw, an index into GetLodChain(), 0 for full detail.
+	*/
+	virtual void Enqueue(RenderQueue& queue, const CullView& view, uint32_t transform, uint32_t lod) const = 0;
+
+	/**
+	 * @brief Get the levels of detail Enqueue() can draw.
+	 * @details The default implementation returns a chain without levels, the model has full detail only.
+	*/
+	virtual LodChain GetLodChain() const { return LodChain(); }
+
+	/**
+	 * @brief Draw every index range once per instance of the instance buffer, one instanced draw per range.
+	 * @details The caller binds the instanced vertex shader, the pixel shader and the instance buffer to
+	 * INSTANCEBUFFER_SLOT. The default implementation draws nothing.
+	 * @param[in,out] state State filter to bind the geometry and textures through.
+	 * @param[in] instance_count Number of instances in the instance buffer.
+	*/
+	virtual void RenderInstanced(DeviceState& /*state*/, UINT /*instance_count*/) const { }
+
+	/**
+	 * @brief Add the ShaderFeature masks the packets of the model use, to compile their shader variants.
+	 * @details The default implementation adds the mask without features.
+	 * @param[in,out] masks Masks to append to, duplicates are allowed.
+	*/
+	virtual void GetShaderFeatures(std::vector<uint32_t>& masks) const { masks.push_back(0); }
+
+	/**
+	 * @brief Add the parts of the model that are good occluders to an occlusion depth buffer.
+	 * @details The default implementation adds nothing.
+	 * @param[in,out] occlusion Depth buffer, between OcclusionCuller::BeginFrame() and EndFrame().
+	 * @param[in] model_to_clip ProjectionMatrix * WorldToViewMatrix * ModelToWorldMatrix.
+	*/
+	virtual void RasterizeOccluders(OcclusionCuller& /*occlusion*/, const linalg::mat4f& /*model_to_clip*/) const { }
+
+	/**
+	 * @brief Render the model with the CPU rasterizer.
+	 * @details The default implementation draws nothing.
+	 * @param[in,out] rasterizer Rasterizer to draw to.
+	 * @param[in] transforms Matrices, as they would be in the transformation constant buffer.
+	*/
+	virtual void RenderSoftware(SoftwareRasterizer& /*rasterizer*/, const TransformationBuffer& /*transforms*/) const { }
+
+	/**
+	 * @brief Find the closest intersection between a ray and the model.
+	 * @details The default implementation intersects the bounds of the whole model.
+	 * @param[in] object_space_ray Ray in the object space of the model.
+	 * @param[in,out] t_hit In: hits further away than this are ignored. Out: ray parameter of the hit.
+	 * @param[out] part Index of the part (e.g. drawcall) that was hit, -1 if the model has no parts.
+	 * @return True on hit.
+	*/
+	virtual bool Raycast(const linalg::ray& object_space_ray, float& t_hit, int& part) const
+	{
+		part = -1;
+		float t;
+		if (m_bounds.empty() || !linalg::intersect(object_space_ray, m_bounds, t_hit, t))
+			return false;
+		t_hit = t;
+		return true;
+	}
+
+	/**
+	 * @brief Get the object space bounding box of the model.
 	*/
-	virtual void Render() const = 0;
+	const linalg::aabb& GetBounds() const noexcept { return m_bounds; }
 
 	/**
 	 * @brief Destructor.
@@ -8,6 +8,7 @@
 #include <fstream>
 #include <algorithm>
 #include "OBJLoader.h"
+#include "memoryarena.h"
 #include "vec/vec.h"
 #include "parseutil.h"
 
@@ -15,18 +16,46 @@ using namespace linalg;
 
 //
 // Auxiliary structs for raw file data
+// Allocated from the scratch arena of the load, if there is one
 //
 struct unwelded_triangle_t { int vi[9]; };
 struct unwelded_quad_t { int vi[12]; };
 struct unwelded_drawcall_t
 {
-	std::string material_name;
-	std::string group_name;
-	std::vector<unwelded_triangle_t> tris;
-	std::vector<unwelded_quad_t> quads;
+	explicit unwelded_drawcall_t(MemoryArena* arena)
+		: material_name(arena), group_name(arena), tris(arena), quads(arena) { }
+
+	ArenaString material_name;
+	ArenaString group_name;
+	ArenaVector<unwelded_triangle_t> tris;
+	ArenaVector<unwelded_quad_t> quads;
 	int vertex_offset = 0;
 };
 
+//
+// Copies the next line of a file in memory to a buffer, without the line break.
+// Lines longer than the buffer are truncated.
+//
+bool ReadLine(const std::string& data, size_t& position, char* buffer, size_t buffer_size)
+{
+	if (position >= data.size())
+		return false;
+
+	size_t end = data.find('\n', position);
+	if (end == std::string::npos)
+		end = data.size();
+	size_t length = end - position;
+	if (length && data[end - 1] == '\r')
+		length--;
+	if (length > buffer_size - 1)
+		length = buffer_size - 1;
+
+	memcpy(buffer, data.data() + position, length);
+	buffer[length] = 0;
+	position = end + 1;
+	return true;
+}
+
 //
 // Creates normals to a set of Vertices by averaging the 
 // geometric normals of the faces they belong to
@@ -35,11 +64,12 @@ struct unwelded_drawcall_t
 // to create them. Works best for relatively smooth models.
 //
 void GenerateNormals(
-	const std::vector<vec3f>& v, 
-	std::vector<vec3f>& vn, 
-	std::vector<unwelded_drawcall_t>& drawcalls)
+	const ArenaVector<vec3f>& v, 
+	ArenaVector<vec3f>& vn, 
+	ArenaVector<unwelded_drawcall_t>& drawcalls)
 {
-	std::vector<std::vector<vec3f>> v_bin(v.size());
+	const ArenaAllocator<vec3f> allocator = v.get_allocator();
+	ArenaVector<ArenaVector<vec3f>> v_bin(v.size(), ArenaVector<vec3f>(allocator), allocator);
 
 	// bin normals from all faces to vertex bins
 	for (unwelded_drawcall_t& dc : drawcalls)
@@ -77,12 +107,13 @@ void OBJLoader::LoadMaterials(
 	std::string filename, 
 	MaterialHash &mtl_hash)
 {
+    LoadStage stage(&Report, "Material parse");
+
     std::string fullpath = path+filename;
     
     std::ifstream in(fullpath.c_str());
     if (!in)
         throw std::runtime_error(std::string("Failed to open ") + fullpath);
-    std::cout << "Opened " << fullpath << "\n";
     
     std::string line;
 	line.reserve(1024);
@@ -90,6 +121,7 @@ void OBJLoader::LoadMaterials(
     
     while (std::getline(in, line, '\n'))
     {
+        Report.MaterialFileBytes += line.size() + 1;
 		const int MaxChars = 1024;
 		char str0[MaxChars] = { 0 }; // , str1[MaxChars];
         float a,b,c;
@@ -164,191 +196,224 @@ void OBJLoader::LoadMaterials(
 void OBJLoader::Load(
 	const std::string& filename,
 	bool auto_generate_normals,
-	bool triangulate)
+	bool triangulate,
+	MemoryArena* arena)
 {
+	PROFILE_FUNCTION();
+	MemoryTagScope memoryTag(MemoryTag::Loader);
+
+	Report = LoadReport();
+	Report.Filename = filename;
+
+	// The index array holds triangles only
+	if (ContiguousIndices)
+		triangulate = true;
+
+	// Scratch data is freed at once when the load ends, declared first so it is reset last
+	struct ArenaReset
+	{
+		MemoryArena* Arena;
+		~ArenaReset() { if (Arena) Arena->Reset(); }
+	} arenaReset{ arena };
+
 	std::string parentDirectory = get_parentdir(filename);
 
-	std::ifstream in(filename.c_str());
-	if (!in) throw std::runtime_error(std::string("Failed to open ") + filename);
-	std::cout << "Opened " << filename << "\n";
+	// Read the whole file before parsing it
+	std::string fileData;
+	{
+		LoadStage stage(&Report, "Read");
+		std::ifstream in(filename.c_str(), std::ios::binary);
+		if (!in) throw std::runtime_error(std::string("Failed to open ") + filename);
+		in.seekg(0, std::ios::end);
+		fileData.resize((size_t)in.tellg());
+		in.seekg(0, std::ios::beg);
+		in.read(&fileData[0], fileData.size());
+	}
+	Report.FileBytes = fileData.size();
 
 	// raw data from obj
-	std::vector<vec3f> fileVertices, fileNormals;
-	std::vector<vec2f> fileTexcoords;
-	std::vector<unwelded_drawcall_t> fileDrawcalls;
+	ArenaVector<vec3f> fileVertices(arena), fileNormals(arena);
+	ArenaVector<vec2f> fileTexcoords(arena);
+	ArenaVector<unwelded_drawcall_t> fileDrawcalls(arena);
 	MaterialHash fileMaterials;
 
-	std::string currentGroupName;
-	unwelded_drawcall_t defaultDrawcall;
+	ArenaString currentGroupName(arena);
+	unwelded_drawcall_t defaultDrawcall(arena);
 	unwelded_drawcall_t* currentDrawcall = &defaultDrawcall;
 	int lastOffset = 0; bool faceSection = false; // info for skin weight mapping
 
 	char readBuffer[256]{};
 
-	while (in.getline(readBuffer, 256, '\n'))
 	{
-		const int MaxChars = 1024;
-		float x, y, z;
-		int a[3]{}, b[3]{}, c[3]{}, d[3]{};
-		char str[MaxChars];
-
-		if (readBuffer[0] == ' ')
+		LoadStage stage(&Report, "Parse");
+		size_t position = 0;
+		while (ReadLine(fileData, position, readBuffer, sizeof(readBuffer)))
 		{
-			continue;
-		}
+			const int MaxChars = 1024;
+			float x, y, z;
+			int a[3]{}, b[3]{}, c[3]{}, d[3]{};
+			char str[MaxChars];
 
-		// Vertex data
-		//
-		if (readBuffer[0] == 'v')
-		{
-			// normal
-			//
-			if (readBuffer[1] == 'n' && sscanf_s(readBuffer, "vn %f %f %f", &x, &y, &z) == 3)
+			if (readBuffer[0] == ' ')
 			{
-				fileNormals.push_back(vec3f(x, y, z));
+				continue;
 			}
-			else if (readBuffer[1] == 't')
+
+			// Vertex data
+			//
+			if (readBuffer[0] == 'v')
 			{
-				// 3D texel (not supported: ignore last component)
+				// normal
 				//
-				if (sscanf_s(readBuffer, "vt %f %f %f", &x, &y, &z) == 3)
+				if (readBuffer[1] == 'n' && sscanf_s(readBuffer, "vn %f %f %f", &x, &y, &z) == 3)
 				{
-					fileTexcoords.push_back(vec2f(x, y));
+					fileNormals.push_back(vec3f(x, y, z));
 				}
-				// 2D texel
+				else if (readBuffer[1] == 't')
+				{
+					// 3D texel (not supported: ignore last component)
+					//
+					if (sscanf_s(readBuffer, "vt %f %f %f", &x, &y, &z) == 3)
+					{
+						fileTexcoords.push_back(vec2f(x, y));
+					}
+					// 2D texel
+					//
+					else if (sscanf_s(readBuffer, "vt %f %f", &x, &y) == 2)
+					{
+						fileTexcoords.push_back(vec2f(x, y));
+					}
+				}
+				// 3D vertex
 				//
-				else if (sscanf_s(readBuffer, "vt %f %f", &x, &y) == 2)
+				else if (sscanf_s(readBuffer, "v %f %f %f", &x, &y, &z) == 3)
 				{
-					fileTexcoords.push_back(vec2f(x, y));
+					// update vertex offset and mark end to a face section
+					if (faceSection)
+					{
+						lastOffset = (int)fileVertices.size();
+						faceSection = false;
+					}
+
+					fileVertices.push_back(vec3f(x, y, z));
 				}
-			}
-			// 3D vertex
-			//
-			else if (sscanf_s(readBuffer, "v %f %f %f", &x, &y, &z) == 3)
-			{
-				// update vertex offset and mark end to a face section
-				if (faceSection)
+				// 2D vertex
+				//
+				else if (sscanf_s(readBuffer, "v %f %f", &x, &y) == 2)
 				{
-					lastOffset = (int)fileVertices.size();
-					faceSection = false;
+					fileVertices.push_back(vec3f(x, y, 0.0f));
 				}
 
-				fileVertices.push_back(vec3f(x, y, z));
-			}
-			// 2D vertex
-			//
-			else if (sscanf_s(readBuffer, "v %f %f", &x, &y) == 2)
-			{
-				fileVertices.push_back(vec3f(x, y, 0.0f));
+				continue;
 			}
 
-			continue;
-		}
-
-		// face info
-		//
-		if (readBuffer[0] == 'f')
-		{
-			// face: 4x vertex/texel/normal (triangulate)
+			// face info
 			//
-			if (sscanf_s(readBuffer, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d", &a[0], &a[1], &a[2], &b[0], &b[1], &b[2], &c[0], &c[1], &c[2], &d[0], &d[1], &d[2]) == 12)
+			if (readBuffer[0] == 'f')
 			{
-				if (triangulate) 
+				// face: 4x vertex/texel/normal (triangulate)
+				//
+				if (sscanf_s(readBuffer, "f %d/%d/%d %d/%d/%d %d/%d/%d %d/%d/%d", &a[0], &a[1], &a[2], &b[0], &b[1], &b[2], &c[0], &c[1], &c[2], &d[0], &d[1], &d[2]) == 12)
+				{
+					if (triangulate) 
+					{
+						currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, a[2] - 1, b[2] - 1, c[2] - 1, a[1] - 1, b[1] - 1, c[1] - 1 });
+						currentDrawcall->tris.push_back({ a[0] - 1, c[0] - 1, d[0] - 1, a[2] - 1, c[2] - 1, d[2] - 1, a[1] - 1, c[1] - 1, d[1] - 1 });
+					}
+					else
+						currentDrawcall->quads.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, d[0] - 1, a[2] - 1, b[2] - 1, c[2] - 1, d[2] - 1, a[1] - 1, b[1] - 1, c[1] - 1, d[1] - 1 });
+				}
+				// face: 3x vertex/texel/normal
+				//
+				else if (sscanf_s(readBuffer, "f %d/%d/%d %d/%d/%d %d/%d/%d", &a[0], &a[1], &a[2], &b[0], &b[1], &b[2], &c[0], &c[1], &c[2]) == 9)
 				{
 					currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, a[2] - 1, b[2] - 1, c[2] - 1, a[1] - 1, b[1] - 1, c[1] - 1 });
-					currentDrawcall->tris.push_back({ a[0] - 1, c[0] - 1, d[0] - 1, a[2] - 1, c[2] - 1, d[2] - 1, a[1] - 1, c[1] - 1, d[1] - 1 });
 				}
-				else
-					currentDrawcall->quads.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, d[0] - 1, a[2] - 1, b[2] - 1, c[2] - 1, d[2] - 1, a[1] - 1, b[1] - 1, c[1] - 1, d[1] - 1 });
-			}
-			// face: 3x vertex/texel/normal
-			//
-			else if (sscanf_s(readBuffer, "f %d/%d/%d %d/%d/%d %d/%d/%d", &a[0], &a[1], &a[2], &b[0], &b[1], &b[2], &c[0], &c[1], &c[2]) == 9)
-			{
-				currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, a[2] - 1, b[2] - 1, c[2] - 1, a[1] - 1, b[1] - 1, c[1] - 1 });
-			}
-			// face: 4x vertex
-			//
-			else if (sscanf_s(readBuffer, "f %d %d %d %d", &a[0], &b[0], &c[0], &d[0]) == 4)
-			{
-				if (triangulate) 
+				// face: 4x vertex
+				//
+				else if (sscanf_s(readBuffer, "f %d %d %d %d", &a[0], &b[0], &c[0], &d[0]) == 4)
+				{
+					if (triangulate) 
+					{
+						currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, -1, -1, -1, -1, -1, -1 });
+						currentDrawcall->tris.push_back({ a[0] - 1, c[0] - 1, d[0] - 1, -1, -1, -1, -1, -1, -1 });
+					}
+					else
+						currentDrawcall->quads.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, d[0] - 1, -1, -1, -1, -1, -1, -1, -1, -1 });
+				}
+				// face: 3x vertex
+				//
+				else if (sscanf_s(readBuffer, "f %d %d %d", &a[0], &b[0], &c[0]) == 3)
 				{
 					currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, -1, -1, -1, -1, -1, -1 });
-					currentDrawcall->tris.push_back({ a[0] - 1, c[0] - 1, d[0] - 1, -1, -1, -1, -1, -1, -1 });
 				}
-				else
-					currentDrawcall->quads.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, d[0] - 1, -1, -1, -1, -1, -1, -1, -1, -1 });
-			}
-			// face: 3x vertex
-			//
-			else if (sscanf_s(readBuffer, "f %d %d %d", &a[0], &b[0], &c[0]) == 3)
-			{
-				currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, -1, -1, -1, -1, -1, -1 });
-			}
-			// face: 4x vertex/texel (triangulate)
-			//
-			else if (sscanf_s(readBuffer, "f %d/%d %d/%d %d/%d %d/%d", &a[0], &a[1], &b[0], &b[1], &c[0], &c[1], &d[0], &d[1]) == 8)
-			{
-				if (triangulate) 
+				// face: 4x vertex/texel (triangulate)
+				//
+				else if (sscanf_s(readBuffer, "f %d/%d %d/%d %d/%d %d/%d", &a[0], &a[1], &b[0], &b[1], &c[0], &c[1], &d[0], &d[1]) == 8)
+				{
+					if (triangulate) 
+					{
+						currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, -1, -1, -1, a[1] - 1, b[1] - 1, c[1] - 1 });
+						currentDrawcall->tris.push_back({ a[0] - 1, c[0] - 1, d[0] - 1, -1, -1, -1, a[1] - 1, c[1] - 1, d[1] - 1 });
+					}
+					else
+						currentDrawcall->quads.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, d[0] - 1, -1, -1, -1, -1, a[1] - 1, b[1] - 1, c[1] - 1, d[1] - 1 });
+				}
+				// face: 3x vertex/texel
+				//
+				else if (sscanf_s(readBuffer, "f %d/%d %d/%d %d/%d", &a[0], &a[1], &b[0], &b[1], &c[0], &c[1]) == 6)
 				{
 					currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, -1, -1, -1, a[1] - 1, b[1] - 1, c[1] - 1 });
-					currentDrawcall->tris.push_back({ a[0] - 1, c[0] - 1, d[0] - 1, -1, -1, -1, a[1] - 1, c[1] - 1, d[1] - 1 });
 				}
-				else
-					currentDrawcall->quads.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, d[0] - 1, -1, -1, -1, -1, a[1] - 1, b[1] - 1, c[1] - 1, d[1] - 1 });
+				// face: 4x vertex//normal (triangulate)
+				//
+				else if (sscanf_s(readBuffer, "f %d//%d %d//%d %d//%d %d//%d", &a[0], &a[1], &b[0], &b[1], &c[0], &c[1], &d[0], &d[1]) == 8)
+				{
+					if (triangulate) 
+					{
+						currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, a[1] - 1, b[1] - 1, c[1] - 1, -1, -1, -1 });
+						currentDrawcall->tris.push_back({ a[0] - 1, c[0] - 1, d[0] - 1, a[1] - 1, c[1] - 1, d[1] - 1, -1, -1, -1 });
+					}
+					else
+						currentDrawcall->quads.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, d[0] - 1, a[2] - 1, b[2] - 1, c[2] - 1, d[2] - 1, -1, -1, -1, -1 });
+				}
+				// face: 3x vertex//normal
+				//
+				else if (sscanf_s(readBuffer, "f %d//%d %d//%d %d//%d", &a[0], &a[1], &b[0], &b[1], &c[0], &c[1]) == 6)
+				{
+					currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, a[1] - 1, b[1] - 1, c[1] - 1, -1, -1, -1 });
+				}
+				continue;
 			}
-			// face: 3x vertex/texel
+
+			// material file
 			//
-			else if (sscanf_s(readBuffer, "f %d/%d %d/%d %d/%d", &a[0], &a[1], &b[0], &b[1], &c[0], &c[1]) == 6)
+			if (sscanf_s(readBuffer, "mtllib %s", str, MaxChars) == 1)
 			{
-				currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, -1, -1, -1, a[1] - 1, b[1] - 1, c[1] - 1 });
+				LoadMaterials(parentDirectory, str, fileMaterials);
+				continue;
 			}
-			// face: 4x vertex//normal (triangulate)
+			// active material
 			//
-			else if (sscanf_s(readBuffer, "f %d//%d %d//%d %d//%d %d//%d", &a[0], &a[1], &b[0], &b[1], &c[0], &c[1], &d[0], &d[1]) == 8)
+			if (sscanf_s(readBuffer, "usemtl %s", str, MaxChars) == 1)
 			{
-				if (triangulate) 
-				{
-					currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, a[1] - 1, b[1] - 1, c[1] - 1, -1, -1, -1 });
-					currentDrawcall->tris.push_back({ a[0] - 1, c[0] - 1, d[0] - 1, a[1] - 1, c[1] - 1, d[1] - 1, -1, -1, -1 });
-				}
-				else
-					currentDrawcall->quads.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, d[0] - 1, a[2] - 1, b[2] - 1, c[2] - 1, d[2] - 1, -1, -1, -1, -1 });
+				unwelded_drawcall_t udc(arena);
+				udc.material_name = str;
+				udc.group_name = currentGroupName;
+				udc.vertex_offset = lastOffset; faceSection = true; // skinning: set current vertex offset and mark beginning of a face-section
+				fileDrawcalls.push_back(udc);
+				currentDrawcall = &fileDrawcalls.back();
+				continue;
 			}
-			// face: 3x vertex//normal
-			//
-			else if (sscanf_s(readBuffer, "f %d//%d %d//%d %d//%d", &a[0], &a[1], &b[0], &b[1], &c[0], &c[1]) == 6)
+			else if (sscanf_s(readBuffer, "g %s", str, MaxChars) == 1)
 			{
-				currentDrawcall->tris.push_back({ a[0] - 1, b[0] - 1, c[0] - 1, a[1] - 1, b[1] - 1, c[1] - 1, -1, -1, -1 });
+				currentGroupName = str;
 			}
-			continue;
-		}
-
-		// material file
-		//
-		if (sscanf_s(readBuffer, "mtllib %s", str, MaxChars) == 1)
-		{
-			LoadMaterials(parentDirectory, str, fileMaterials);
-			continue;
-		}
-		// active material
-		//
-		if (sscanf_s(readBuffer, "usemtl %s", str, MaxChars) == 1)
-		{
-			unwelded_drawcall_t udc;
-			udc.material_name = str;
-			udc.group_name = currentGroupName;
-			udc.vertex_offset = lastOffset; faceSection = true; // skinning: set current vertex offset and mark beginning of a face-section
-			fileDrawcalls.push_back(udc);
-			currentDrawcall = &fileDrawcalls.back();
-			continue;
-		}
-		else if (sscanf_s(readBuffer, "g %s", str, MaxChars) == 1)
-		{
-			currentGroupName = str;
 		}
 	}
-	in.close();
+
+	// The file text is not needed after parsing, free it before welding allocates the output
+	std::string().swap(fileData);
 
 	// use defualt drawcall if no instance of usemtl
 	if (!fileDrawcalls.size())
@@ -357,22 +422,28 @@ void OBJLoader::Load(
 	HasNormals = (bool)fileNormals.size();
 	HasTexcoords = (bool)fileTexcoords.size();
 
-	printf("Loaded:\n\t%d vertices\n\t%d texels\n\t%d normals\n\t%d drawcalls\n",
-		(int)fileVertices.size(), (int)fileTexcoords.size(), (int)fileNormals.size(), (int)fileDrawcalls.size());
+	Report.FileVertices = (unsigned)fileVertices.size();
+	Report.FileNormals = (unsigned)fileNormals.size();
+	Report.FileTexcoords = (unsigned)fileTexcoords.size();
+	Report.FileDrawcalls = (unsigned)fileDrawcalls.size();
+	for (auto& dc : fileDrawcalls)
+	{
+		Report.FileTriangles += (unsigned)dc.tris.size();
+		Report.FileQuads += (unsigned)dc.quads.size();
+	}
 
 #if 1
 	// auto-generate normals
 	if (!HasNormals && auto_generate_normals)
 	{
+		LoadStage stage(&Report, "Normal generation");
 		GenerateNormals(fileVertices, fileNormals, fileDrawcalls);
 		HasNormals = true;
-		printf("Auto-generated %d normals\n", (int)fileNormals.size());
+		Report.GeneratedNormals = (unsigned)fileNormals.size();
 	}
 #endif
 
 #if 1
-	printf("Welding vertex array...");
-
 	std::unordered_map<std::string, unsigned> materialToIndexHash;
 
 	// hash function for int3
@@ -384,146 +455,155 @@ void OBJLoader::Load(
 		}
 	};
 
-	for (auto &dc : fileDrawcalls)
 	{
-		Drawcall drawcall;
-		drawcall.GroupName = dc.group_name;
-
-		std::unordered_map<int3, unsigned, int3_hashfunction> index3ToIndexHash;
-
-		// material
-		//
-		if (dc.material_name.size())
-		{
-			//
-			// is material added to main vector?
-			auto materialIndex = materialToIndexHash.find(dc.material_name);
-			if (materialIndex == materialToIndexHash.end())
-			{
-				auto material = fileMaterials.find(dc.material_name);
-
-				if (material == fileMaterials.end())
-					throw std::runtime_error(std::string("Error: used material ") + dc.material_name + " not found\n");
-
-				drawcall.MaterialIndex = (unsigned)Materials.size();
-				materialToIndexHash[dc.material_name] = (unsigned)Materials.size();
+		LoadStage stage(&Report, "Welding");
 
-				Materials.push_back(material->second);
-			}
-			else
-				drawcall.MaterialIndex = materialIndex->second;;
-		}
-		else
+		if (ContiguousIndices)
 		{
-			// mtl string is empty, use empty index
-			drawcall.MaterialIndex = -1;
+			size_t indexCount = 0;
+			for (auto& dc : fileDrawcalls)
+				indexCount += dc.tris.size() * 3;
+			Indices.reserve(Indices.size() + indexCount);
+			Ranges.reserve(Ranges.size() + fileDrawcalls.size());
 		}
 
-		// weld Vertices from triangles
-		//
-		for (auto &tri : dc.tris)
+		for (auto &dc : fileDrawcalls)
 		{
-			Triangle wtri{};
+			int materialIndex = -1;
+
+			ArenaHashMap<int3, unsigned, int3_hashfunction> index3ToIndexHash(0, int3_hashfunction(), std::equal_to<int3>(), arena);
 
-			for (int i = 0; i < 3; i++)
+			// material
+			//
+			if (dc.material_name.size())
 			{
-				int3 i3 = { tri.vi[0 + i], tri.vi[3 + i], tri.vi[6 + i] };
+				const std::string materialName(dc.material_name.data(), dc.material_name.size());
 
-				auto s = index3ToIndexHash.find(i3);
-				if (s == index3ToIndexHash.end())
+				//
+				// is material added to main vector?
+				auto materialIndexIt = materialToIndexHash.find(materialName);
+				if (materialIndexIt == materialToIndexHash.end())
 				{
-					// index-combo does not exist, create it
-					Vertex v;
-					v.Position = fileVertices[i3.x];
-					if (i3.y > -1) v.Normal = fileNormals[i3.y];
-					if (i3.z > -1) v.TexCoord = fileTexcoords[i3.z];
+					auto material = fileMaterials.find(materialName);
+
+					if (material == fileMaterials.end())
+						throw std::runtime_error(std::string("Error: used material ") + materialName + " not found\n");
 
-					wtri.VertexIndices[i] = (unsigned)Vertices.size();
-					index3ToIndexHash[i3] = (unsigned)(Vertices.size());
+					materialIndex = (int)Materials.size();
+					materialToIndexHash[materialName] = (unsigned)Materials.size();
 
-					Vertices.push_back(v);
+					Materials.push_back(material->second);
 				}
 				else
+					materialIndex = (int)materialIndexIt->second;
+			}
+
+			// Index of the welded vertex of a position/normal/texcoord combination
+			auto weldVertex = [&](const int3& i3)
+			{
+				auto s = index3ToIndexHash.find(i3);
+				if (s != index3ToIndexHash.end())
 				{
 					// use existing index-combo
-					wtri.VertexIndices[i] = s->second;
+					return s->second;
 				}
-			}
-			drawcall.Triangles.push_back(wtri);
-		}
 
-#if 1
-		// weld Vertices from quads
-		//
-		for (auto &quad : dc.quads)
-		{
-			Quad wquad{};
+				// index-combo does not exist, create it
+				Vertex v;
+				v.Position = fileVertices[i3.x];
+				if (i3.y > -1) v.Normal = fileNormals[i3.y];
+				if (i3.z > -1) v.TexCoord = fileTexcoords[i3.z];
 
-			for (int i = 0; i < 4; i++)
+				const unsigned index = (unsigned)Vertices.size();
+				index3ToIndexHash[i3] = index;
+				Vertices.push_back(v);
+				return index;
+			};
+
+			// Write the triangles straight to the shared index array
+			//
+			if (ContiguousIndices)
 			{
-				int3 i3 = { quad.vi[0 + i], quad.vi[3 + i], quad.vi[6 + i] };
+				DrawcallRange range;
+				range.GroupName.assign(dc.group_name.data(), dc.group_name.size());
+				range.MaterialIndex = materialIndex;
+				range.IndexStart = (unsigned)Indices.size();
+
+				for (auto &tri : dc.tris)
+					for (int i = 0; i < 3; i++)
+						Indices.push_back(weldVertex({ tri.vi[0 + i], tri.vi[3 + i], tri.vi[6 + i] }));
+
+				range.IndexCount = (unsigned)Indices.size() - range.IndexStart;
+				Ranges.push_back(std::move(range));
+				continue;
+			}
 
-				auto s = index3ToIndexHash.find(i3);
-				if (s == index3ToIndexHash.end())
-				{
-					// index-combo does not exist, create it
-					Vertex v;
-					v.Position = fileVertices[i3.x];
-					if (i3.y > -1) v.Normal = fileNormals[i3.y];
-					if (i3.z > -1) v.TexCoord = fileTexcoords[i3.z];
+			Drawcall drawcall;
+			drawcall.GroupName.assign(dc.group_name.data(), dc.group_name.size());
+			drawcall.MaterialIndex = materialIndex;
 
-					wquad.VertexIndices[i] = (unsigned)Vertices.size();
-					index3ToIndexHash[i3] = (unsigned)(Vertices.size());
+			// weld Vertices from triangles
+			//
+			drawcall.Triangles.reserve(dc.tris.size());
+			for (auto &tri : dc.tris)
+			{
+				Triangle wtri{};
+				for (int i = 0; i < 3; i++)
+					wtri.VertexIndices[i] = weldVertex({ tri.vi[0 + i], tri.vi[3 + i], tri.vi[6 + i] });
+				drawcall.Triangles.push_back(wtri);
+			}
 
-					Vertices.push_back(v);
-				}
-				else
-				{
-					// use existing index-combo
-					wquad.VertexIndices[i] = s->second;
-				}
+	#if 1
+			// weld Vertices from quads
+			//
+			drawcall.Quads.reserve(dc.quads.size());
+			for (auto &quad : dc.quads)
+			{
+				Quad wquad{};
+				for (int i = 0; i < 4; i++)
+					wquad.VertexIndices[i] = weldVertex({ quad.vi[0 + i], quad.vi[3 + i], quad.vi[6 + i] });
+				drawcall.Quads.push_back(wquad);
 			}
-			drawcall.Quads.push_back(wquad);
-		}
-#endif
+	#endif
 
-		Drawcalls.push_back(drawcall);
+			Drawcalls.push_back(std::move(drawcall));
+		}
 	}
-	printf("Done\n");
 
-	// Produce and print some stats
+	// Output sizes
 	//
-	int tris = 0, quads = 0;
 	for (auto &dc : Drawcalls)
 	{
-		tris += (int)dc.Triangles.size();
-		quads += (int)dc.Quads.size();
-	}
-	printf("\t%d vertices\n\t%d drawcalls\n\t%d triangles\n\t%d quads\n",
-		(int)Vertices.size(), (int)Drawcalls.size(), tris, quads);
-	printf("Loaded materials:\n");
-
-	for (auto& mtl : Materials)
-	{
-		printf("\t%s\n", mtl.Name.c_str());
+		Report.Triangles += (unsigned)dc.Triangles.size();
+		Report.Quads += (unsigned)dc.Quads.size();
 	}
+	Report.Triangles += (unsigned)(Indices.size() / 3);
+	Report.Vertices = (unsigned)Vertices.size();
+	Report.Drawcalls = (unsigned)(Drawcalls.size() + Ranges.size());
+	Report.Materials = (unsigned)Materials.size();
 
 #ifdef MESH_FORCE_CCW
     // Force counter-clockwise: 
 	// flip triangle if geometric normal points away from vertex normal (at index=0)
-	for (auto& dc : Drawcalls)
 	{
-		for (auto& tri : dc.Triangles)
+		LoadStage stage(&Report, "CCW fix");
+		auto fixWinding = [&](unsigned* tri)
 		{
-			int a = tri.VertexIndices[0], b = tri.VertexIndices[1], c = tri.VertexIndices[2];
+			int a = tri[0], b = tri[1], c = tri[2];
 			vec3f v0 = Vertices[a].Position, v1 = Vertices[b].Position, v2 = Vertices[c].Position;
 
 			vec3f geo_n = linalg::normalize((v1 - v0) % (v2 - v0));
 			vec3f vert_n = Vertices[a].Normal;
 
 			if (linalg::dot(geo_n, vert_n) < 0)
-				std::swap(tri.VertexIndices[0], tri.VertexIndices[1]);
-		}
+				std::swap(tri[0], tri[1]);
+		};
+
+		for (auto& dc : Drawcalls)
+			for (auto& tri : dc.Triangles)
+				fixWinding(tri.VertexIndices);
+		for (size_t i = 0; i + 2 < Indices.size(); i += 3)
+			fixWinding(&Indices[i]);
 	}
 #endif
     
@@ -533,8 +613,12 @@ void OBJLoader::Load(
 	// Drawcalls with the same resources (mainly shader & material) are 
 	// rendered back-to-back to make the number of texture binds (which are slow)
 	// as low as possible
-    std::sort(Drawcalls.begin(), Drawcalls.end());
-	printf("Sorted drawcalls\n");
+	// Ranges are sorted on their own; the indices stay where they are
+	{
+		LoadStage stage(&Report, "Sort");
+		std::sort(Drawcalls.begin(), Drawcalls.end());
+		std::stable_sort(Ranges.begin(), Ranges.end());
+	}
 #endif
     
 #endif
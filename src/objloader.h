@@ -10,6 +10,9 @@
 #include <vector>
 #include <string>
 #include "Drawcall.h"
+#include "loadreport.h"
+
+class MemoryArena;
 
 //! Make sure loaded normals face in the same direction as the triangle's CCW normal
 #define MESH_FORCE_CCW
@@ -27,6 +30,10 @@
 /**
  * @brief OBJ Loader.
  * @details Parses OBJ/MTL-files and organizes the data in arrays with Vertices, Drawcalls and materials.
+ * Load() times its stages (read, parse, material parse, normal generation, welding, CCW fix and sort) in Report.
+ *
+ * With ContiguousIndices set, the triangles of all drawcalls are written to one index array with a range per
+ * drawcall instead, ready to be uploaded as an index buffer without reshaping.
 */
 class OBJLoader
 {
@@ -37,15 +44,22 @@ public:
      * @param filename Path to the file.
      * @param auto_generate_normals Should normals be automatically generated if they are not contained in the file.
      * @param triangulate Should quads be triangulated.
+     * @param arena Arena for the temporary data of the load, or nullptr to use the heap. Reset when the load ends;
+     * reusing one arena for a batch of loads avoids most of their allocations.
     */
-    void Load(const std::string& filename, bool auto_generate_normals = true, bool triangulate = true);
+    void Load(const std::string& filename, bool auto_generate_normals = true, bool triangulate = true, MemoryArena* arena = nullptr);
 
     bool HasNormals = false; //!< Does the model contain normals.
     bool HasTexcoords = false; //!< Does the model contain uv-coordinates
+    bool ContiguousIndices = false; //!< Set before Load() to output Indices and Ranges instead of Drawcalls. Quads are always triangulated.
 
     std::vector<Vertex> Vertices; //!< Vector of Vertex data
     std::vector<Drawcall> Drawcalls; //!< Vector of Drawcall data
     std::vector<Material> Materials; //!< Vector of Material data
+    std::vector<unsigned> Indices; //!< Triangle indices of all drawcalls, with ContiguousIndices
+    std::vector<DrawcallRange> Ranges; //!< Range of Indices per drawcall, sorted like Drawcalls, with ContiguousIndices
+
+    LoadReport Report; //!< Stage times and sizes of the last Load()
 };
 
 #endif
@@ -1,4 +1,8 @@
+#include <algorithm>
 #include "OBJModel.h"
+#include "devicestate.h"
+#include "profiler.h"
+#include "shaderpermutations.h"
 
 OBJModel::OBJModel(
 	const std::string& objfile,
@@ -6,109 +10,370 @@ OBJModel::OBJModel(
 	ID3D11DeviceContext* dxdevice_context)
 	: Model(dxdevice, dxdevice_context)
 {
-	// Load the OBJ
+	PROFILE_FUNCTION();
+
+	// Load the OBJ, with the indices of all drawcalls in one array
 	OBJLoader* mesh = new OBJLoader();
+	mesh->ContiguousIndices = true;
 	mesh->Load(objfile);
+	m_load_report = mesh->Report;
+
+	// Take the geometry from the loader. It is uploaded as it is, and kept on the
+	// CPU side for ray queries (e.g. picking) and software rendering
+	m_vertices = std::move(mesh->Vertices);
+	m_indices = std::move(mesh->Indices);
+
+	// Index ranges per drawcall (material). Ranges without a material get the default one,
+	// added after the materials of the file
+	const int defaultMaterialIndex = (int)mesh->Materials.size();
+	bool usesDefaultMaterial = false;
+	{
+		LoadStage stage(&m_load_report, "Range bounds");
+		m_index_ranges.reserve(mesh->Ranges.size());
+		m_index_range_bounds.reserve(mesh->Ranges.size());
+
+		for (const DrawcallRange& range : mesh->Ranges)
+		{
+			const int materialIndex = range.MaterialIndex >= 0 ? range.MaterialIndex : defaultMaterialIndex;
+			usesDefaultMaterial |= range.MaterialIndex < 0;
+			m_index_ranges.push_back({ range.IndexStart, range.IndexCount, 0, materialIndex });
+
+			// Bounds of the range, used for view frustum culling
+			m_index_range_bounds.push_back(ComputeIndexedBounds(
+				&m_vertices[0].Position,
+				sizeof(Vertex),
+				m_indices.data() + range.IndexStart,
+				range.IndexCount));
+		}
+
+		m_bounds = linalg::merge(m_index_range_bounds.data(), m_index_range_bounds.size());
+		m_index_range_visibility.resize(m_index_ranges.size());
+	}
+
+	{
+		LoadStage stage(&m_load_report, "BVH build");
+		m_index_range_bvh.Build(m_index_range_bounds.data(), m_index_range_bounds.size(), 1);
+
+		std::vector<linalg::aabb> triangleBounds(m_indices.size() / 3);
+		for (size_t i = 0; i < triangleBounds.size(); i++)
+			triangleBounds[i] = ComputeIndexedBounds(&m_vertices[0].Position, sizeof(Vertex), &m_indices[i * 3], 3);
+		m_triangle_bvh.Build(triangleBounds.data(), triangleBounds.size());
+	}
+
+	const BVHBuildStats& bvhStats = m_triangle_bvh.GetBuildStats();
+	m_load_report.BVHNodes = bvhStats.Nodes;
+	m_load_report.BVHLeaves = bvhStats.Leaves;
+	m_load_report.BVHDepth = bvhStats.MaxDepth;
+
+	{
+		LoadStage stage(&m_load_report, "Occluder selection");
+		SelectOccluders();
+	}
+
+	{
+		LoadStage stage(&m_load_report, "LOD build");
+		BuildLods();
+	}
+
+	{
+		LoadStage stage(&m_load_report, "Upload");
+
+		// Vertex array descriptor
+		D3D11_BUFFER_DESC vertexbufferDesc = { 0 };
+		vertexbufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vertexbufferDesc.CPUAccessFlags = 0;
+		vertexbufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		vertexbufferDesc.MiscFlags = 0;
+		vertexbufferDesc.ByteWidth = (UINT)(m_vertices.size() * sizeof(Vertex));
+		// Data resource
+		D3D11_SUBRESOURCE_DATA vertexData = { 0 };
+		vertexData.pSysMem = m_vertices.data();
+		// Create vertex buffer on device using descriptor & data
+		dxdevice->CreateBuffer(&vertexbufferDesc, &vertexData, &m_vertex_buffer);
+		SETNAME(m_vertex_buffer, "VertexBuffer");
 
-	// Load and organize indices in ranges per drawcall (material)
-
-	std::vector<unsigned> indices;
-	unsigned int indexOffset = 0;
-
-	for (auto& dc : mesh->Drawcalls)
-	{
-		// Append the drawcall indices
-		for (auto& tri : dc.Triangles)
-			indices.insert(indices.end(), tri.VertexIndices, tri.VertexIndices + 3);
-
-		// Create a range
-		unsigned int indexSize = (unsigned int)dc.Triangles.size() * 3;
-		int materialIndex = dc.MaterialIndex > -1 ? dc.MaterialIndex : -1;
-		m_index_ranges.push_back({ indexOffset, indexSize, 0, materialIndex });
-
-		indexOffset = (unsigned int)indices.size();
-	}
-
-	// Vertex array descriptor
-	D3D11_BUFFER_DESC vertexbufferDesc = { 0 };
-	vertexbufferDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-	vertexbufferDesc.CPUAccessFlags = 0;
-	vertexbufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	vertexbufferDesc.MiscFlags = 0;
-	vertexbufferDesc.ByteWidth = (UINT)(mesh->Vertices.size() * sizeof(Vertex));
-	// Data resource
-	D3D11_SUBRESOURCE_DATA vertexData = { 0 };
-	vertexData.pSysMem = &(mesh->Vertices)[0];
-	// Create vertex buffer on device using descriptor & data
-	dxdevice->CreateBuffer(&vertexbufferDesc, &vertexData, &m_vertex_buffer);
-	SETNAME(m_vertex_buffer, "VertexBuffer");
-
-	// Index array descriptor
-	D3D11_BUFFER_DESC indexbufferDesc = { 0 };
-	indexbufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-	indexbufferDesc.CPUAccessFlags = 0;
-	indexbufferDesc.Usage = D3D11_USAGE_DEFAULT;
-	indexbufferDesc.MiscFlags = 0;
-	indexbufferDesc.ByteWidth = (UINT)(indices.size() * sizeof(unsigned));
-	// Data resource
-	D3D11_SUBRESOURCE_DATA indexData = { 0 };
-	indexData.pSysMem = &indices[0];
-	// Create index buffer on device using descriptor & data
-	dxdevice->CreateBuffer(&indexbufferDesc, &indexData, &m_index_buffer);
-	SETNAME(m_index_buffer, "IndexBuffer");
+		// Index array descriptor
+		D3D11_BUFFER_DESC indexbufferDesc = { 0 };
+		indexbufferDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		indexbufferDesc.CPUAccessFlags = 0;
+		indexbufferDesc.Usage = D3D11_USAGE_DEFAULT;
+		indexbufferDesc.MiscFlags = 0;
+		indexbufferDesc.ByteWidth = (UINT)(m_indices.size() * sizeof(unsigned));
+		// Data resource
+		D3D11_SUBRESOURCE_DATA indexData = { 0 };
+		indexData.pSysMem = m_indices.data();
+		// Create index buffer on device using descriptor & data
+		dxdevice->CreateBuffer(&indexbufferDesc, &indexData, &m_index_buffer);
+		SETNAME(m_index_buffer, "IndexBuffer");
+
+		m_load_report.VertexBufferBytes = vertexbufferDesc.ByteWidth;
+		m_load_report.IndexBufferBytes = indexbufferDesc.ByteWidth;
+	}
 
 	// Copy materials from mesh
 	append_materials(mesh->Materials);
+	if (usesDefaultMaterial)
+		m_materials.push_back(DefaultMaterial);
 
 	// Go through materials and load textures (if any) to device
-	std::cout << "Loading textures..." << std::endl;
 	for (auto& material : m_materials)
 	{
-		HRESULT hr;
+		const struct
+		{
+			const std::string& Filename;
+			Texture& Target;
+			ShaderFeature Feature;
+		} textures[] =
+		{
+			{ material.DiffuseTextureFilename, material.DiffuseTexture, ShaderFeature::DiffuseTexture },
+			{ material.NormalTextureFilename, material.NormalTexture, ShaderFeature::NormalMap },
+			{ material.SpecularTextureFilename, material.SpecularTexture, ShaderFeature::SpecularMap },
+		};
 
-		// Load Diffuse texture
-		//
-		if (material.DiffuseTextureFilename.size()) {
+		// The material is drawn with the shader variant of the textures that loaded
+		for (auto& texture : textures)
+		{
+			if (texture.Filename.empty())
+				continue;
 
-			hr = LoadTextureFromFile(
+			HRESULT hr = LoadTextureFromFile(
 				dxdevice,
-				material.DiffuseTextureFilename.c_str(),
-				&material.DiffuseTexture);
-			std::cout << "\t" << material.DiffuseTextureFilename
-				<< (SUCCEEDED(hr) ? " - OK" : "- FAILED") << std::endl;
+				nullptr,
+				texture.Filename.c_str(),
+				&texture.Target,
+				&m_load_report);
+			if (FAILED(hr))
+				std::cout << "Failed to load " << texture.Filename << std::endl;
+			else
+				material.ShaderFeatures |= (uint32_t)texture.Feature;
 		}
 
 		// + other texture types here - see Material class
 		// ...
 	}
-	std::cout << "Done." << std::endl;
 
 	SAFE_DELETE(mesh);
+
+	m_load_report.Print();
 }
 
-void OBJModel::Render() const
+size_t OBJModel::CullRanges(const CullView& view) const
 {
-	// Bind vertex buffer
-	const UINT32 stride = sizeof(Vertex);
-	const UINT32 offset = 0;
-	m_dxdevice_context->IASetVertexBuffers(0, 1, &m_vertex_buffer, &stride, &offset);
+	// Early out if the whole model is outside the frustum
+	uint8_t modelVisible = 0;
+	if (!CullBounds(view.Frustum, &m_bounds, 1, &modelVisible, view.Stats))
+		return 0;
 
-	// Bind index buffer
-	m_dxdevice_context->IASetIndexBuffer(m_index_buffer, DXGI_FORMAT_R32_UINT, 0);
+	// Test the index ranges, using the BVH when there are many
+	size_t visibleRanges = 0;
+	if (m_index_ranges.size() >= OBJMODEL_BVH_CULL_MIN_RANGES)
+	{
+		visibleRanges = CullBVH(view.Frustum, m_index_range_bvh, m_visible_index_ranges, view.Stats);
 
-	// Iterate Drawcalls
-	for (auto& indexRange : m_index_ranges)
+		std::fill(m_index_range_visibility.begin(), m_index_range_visibility.end(), (uint8_t)0);
+		for (uint32_t range : m_visible_index_ranges)
+			m_index_range_visibility[range] = 1;
+	}
+	else
+	{
+		visibleRanges = CullBounds(
+			view.Frustum,
+			m_index_range_bounds.data(),
+			m_index_range_bounds.size(),
+			m_index_range_visibility.data(),
+			view.Stats);
+	}
+
+	// Then the ranges inside the frustum against the occluders
+	if (visibleRanges && view.Occlusion)
+	{
+		visibleRanges = CullOcclusion(
+			*view.Occlusion,
+			view.ModelToClip,
+			m_index_range_bounds.data(),
+			m_index_range_bounds.size(),
+			m_index_range_visibility.data(),
+			view.Stats);
+	}
+	return visibleRanges;
+}
+
+void OBJModel::Enqueue(RenderQueue& queue, const CullView& view, uint32_t transform, uint32_t lod) const
+{
+	if (!CullRanges(view))
+		return;
+
+	DrawPacket packet;
+	packet.VertexBuffer = m_vertex_buffer;
+	packet.IndexBuffer = m_index_buffer;
+	packet.VertexStride = sizeof(Vertex);
+	packet.Transform = transform;
+
+	// The ranges of a coarser level are within the bounds of the ranges they were clustered from
+	const IndexRange* ranges = lod && lod < m_lod_levels.size() ? &m_lod_index_ranges[(lod - 1) * m_index_ranges.size()] : m_index_ranges.data();
+	for (size_t i = 0; i < m_index_ranges.size(); i++)
 	{
-		// Fetch material
+		if (!m_index_range_visibility[i])
+			continue;
+
+		const IndexRange& indexRange = ranges[i];
+		if (!indexRange.Size)
+			continue;
 		const Material& material = m_materials[indexRange.MaterialIndex];
+		packet.Material = &material;
+		packet.Shader = material.ShaderFeatures;
+		packet.IndexStart = indexRange.Start;
+		packet.IndexCount = indexRange.Size;
 
-		// Bind diffuse texture to slot t0 of the PS
-		m_dxdevice_context->PSSetShaderResources(0, 1, &material.DiffuseTexture.TextureView);
-		// + bind other textures here, e.g. a normal map, to appropriate slots
+		// Clip w is the distance along the view direction
+		const float depth = (view.ModelToClip * m_index_range_bounds[i].center().xyz1()).w;
+		queue.Push(RenderQueue::MakeKey(RENDERQUEUE_PASS_OPAQUE, packet.Shader, m_geometry_id, indexRange.MaterialIndex, depth), packet);
+	}
+}
 
-		// Make the drawcall
-		m_dxdevice_context->DrawIndexed(indexRange.Size, indexRange.Start, 0);
+void OBJModel::RenderInstanced(DeviceState& state, UINT instance_count) const
+{
+	state.SetVertexBuffer(0, m_vertex_buffer, sizeof(Vertex), 0);
+	state.SetIndexBuffer(m_index_buffer, DXGI_FORMAT_R32_UINT, 0);
+
+	for (const IndexRange& indexRange : m_index_ranges)
+	{
+		const Material& material = m_materials[indexRange.MaterialIndex];
+		state.SetPSShaderResource(0, material.DiffuseTexture.TextureView);
+		state.SetPSShaderResource(1, material.NormalTexture.TextureView);
+		state.SetPSShaderResource(2, material.SpecularTexture.TextureView);
+		state.GetContext()->DrawIndexedInstanced(indexRange.Size, instance_count, indexRange.Start, 0, 0);
+	}
+}
+
+void OBJModel::GetShaderFeatures(std::vector<uint32_t>& masks) const
+{
+	for (const Material& material : m_materials)
+		masks.push_back(material.ShaderFeatures);
+}
+
+void OBJModel::RenderSoftware(SoftwareRasterizer& rasterizer, const TransformationBuffer& transforms) const
+{
+	if (m_software_textures.empty())
+	{
+		m_software_textures.resize(m_materials.size());
+		for (size_t i = 0; i < m_materials.size(); i++)
+		{
+			const std::string& filename = m_materials[i].DiffuseTextureFilename;
+			if (filename.size() && !LoadSoftwareImage(filename.c_str(), m_software_textures[i]))
+				std::cout << "\t" << filename << " - FAILED" << std::endl;
+		}
+	}
+
+	for (auto& indexRange : m_index_ranges)
+	{
+		const SoftwareImage& texture = m_software_textures[indexRange.MaterialIndex];
+		rasterizer.Draw(
+			transforms,
+			m_vertices.data(),
+			m_indices.data() + indexRange.Start,
+			indexRange.Size,
+			texture.Width ? &texture : nullptr);
+	}
+}
+
+void OBJModel::RasterizeOccluders(OcclusionCuller& occlusion, const linalg::mat4f& model_to_clip) const
+{
+	for (unsigned range : m_occluder_ranges)
+	{
+		const IndexRange& indexRange = m_index_ranges[range];
+		occlusion.AddOccluder(
+			model_to_clip,
+			&m_vertices[0].Position,
+			sizeof(Vertex),
+			m_indices.data() + indexRange.Start,
+			indexRange.Size);
+	}
+}
+
+void OBJModel::SelectOccluders()
+{
+	// Prefer ranges that cover a large area with few triangles
+	std::vector<std::pair<float, unsigned>> candidates;
+	for (unsigned i = 0; i < (unsigned)m_index_ranges.size(); i++)
+	{
+		const unsigned triangles = m_index_ranges[i].Size / 3;
+		if (triangles && triangles <= OBJMODEL_MAX_OCCLUDER_TRIANGLES)
+			candidates.push_back({ m_index_range_bounds[i].surface_area() / triangles, i });
+	}
+	std::sort(candidates.begin(), candidates.end(),
+		[](const std::pair<float, unsigned>& a, const std::pair<float, unsigned>& b) { return a.first > b.first; });
+
+	unsigned triangles = 0;
+	m_occluder_ranges.clear();
+	for (auto& candidate : candidates)
+	{
+		const unsigned rangeTriangles = m_index_ranges[candidate.second].Size / 3;
+		if (m_occluder_ranges.size() == OBJMODEL_MAX_OCCLUDER_RANGES || triangles + rangeTriangles > OBJMODEL_MAX_OCCLUDER_TRIANGLES)
+			continue;
+		m_occluder_ranges.push_back(candidate.second);
+		triangles += rangeTriangles;
+	}
+
+	m_load_report.OccluderRanges = (unsigned)m_occluder_ranges.size();
+	m_load_report.OccluderTriangles = triangles;
+}
+
+void OBJModel::BuildLods()
+{
+	m_lod_levels.assign(1, { 0.0f, (uint32_t)(m_indices.size() / 3) });
+	m_lod_index_ranges.clear();
+	if (m_bounds.empty())
+		return;
+
+	const linalg::vec3f size = m_bounds.max - m_bounds.min;
+	const float longest = std::fmax(size.x, std::fmax(size.y, size.z));
+	std::vector<unsigned> clustered;
+	for (unsigned level = 1, cells = OBJMODEL_LOD_CELLS; level < OBJMODEL_LOD_LEVELS && cells; level++, cells /= 2)
+	{
+		LodLevel lod;
+		for (const IndexRange& range : m_index_ranges)
+		{
+			lod.Error = ClusterIndices(&m_vertices[0].Position, sizeof(Vertex), m_indices.data() + range.Start, range.Size,
+				m_bounds.min, longest / cells, clustered);
+			m_lod_index_ranges.push_back({ (unsigned)m_indices.size(), (unsigned)clustered.size(), 0, range.MaterialIndex });
+			m_indices.insert(m_indices.end(), clustered.begin(), clustered.end());
+			lod.Triangles += (uint32_t)clustered.size() / 3;
+		}
+		m_lod_levels.push_back(lod);
 	}
+
+	m_load_report.LodTriangles.clear();
+	for (const LodLevel& lod : m_lod_levels)
+		m_load_report.LodTriangles.push_back(lod.Triangles);
+}
+
+bool OBJModel::Raycast(const linalg::ray& object_space_ray, float& t_hit, int& part) const
+{
+	const BVHRayHit hit = m_triangle_bvh.Raycast(object_space_ray, t_hit,
+		[this](uint32_t triangle, const linalg::ray& ray, float t_max, float& t)
+		{
+			const unsigned* i = &m_indices[triangle * 3];
+			return IntersectTriangle(ray, m_vertices[i[0]].Position, m_vertices[i[1]].Position, m_vertices[i[2]].Position, t_max, t);
+		});
+	if (hit.Primitive == UINT32_MAX)
+		return false;
+
+	// Find the index range containing the triangle. The ranges are sorted by material, not by where
+	// their indices start, so test them all
+	const unsigned index = hit.Primitive * 3;
+	part = -1;
+	for (size_t i = 0; i < m_index_ranges.size(); i++)
+	{
+		if (index >= m_index_ranges[i].Start && index < m_index_ranges[i].Start + m_index_ranges[i].Size)
+		{
+			part = (int)i;
+			break;
+		}
+	}
+
+	t_hit = hit.Distance;
+	return true;
 }
 
 OBJModel::~OBJModel()
@@ -116,6 +381,8 @@ OBJModel::~OBJModel()
 	for (auto& material : m_materials)
 	{
 		SAFE_RELEASE(material.DiffuseTexture.TextureView);
+		SAFE_RELEASE(material.NormalTexture.TextureView);
+		SAFE_RELEASE(material.SpecularTexture.TextureView);
 
 		// Release other used textures ...
 	}
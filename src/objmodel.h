@@ -6,6 +6,23 @@
 
 #pragma once
 #include "Model.h"
+#include "bvh.h"
+#include "loadreport.h"
+
+//! Models with at least this many index ranges are culled using a BVH instead of testing every range
+#define OBJMODEL_BVH_CULL_MIN_RANGES 64
+
+//! Maximum number of index ranges used as occluders
+#define OBJMODEL_MAX_OCCLUDER_RANGES 8
+
+//! Maximum total number of occluder triangles
+#define OBJMODEL_MAX_OCCLUDER_TRIANGLES 8192
+
+//! Levels of detail built at load, full detail included
+#define OBJMODEL_LOD_LEVELS 4
+
+//! Clustering cubes along the longest side of the model at the first coarser level, halved at every further level
+#define OBJMODEL_LOD_CELLS 256
 
 /**
  * @brief Model representing a 3D object.
@@ -23,7 +40,31 @@ class OBJModel : public Model
 	};
 
 	std::vector<IndexRange> m_index_ranges;
+	std::vector<linalg::aabb> m_index_range_bounds; // object space bounds, one per index range
+	mutable std::vector<uint8_t> m_index_range_visibility; // culling results, rewritten every Enqueue
+	mutable std::vector<uint32_t> m_visible_index_ranges; // BVH culling results, rewritten every Enqueue
+	BVH m_index_range_bvh; // hierarchy over the index range bounds
+	std::vector<unsigned> m_occluder_ranges; // index ranges rasterized as occluders
+
+	// Coarser levels of detail, each with an index range per range of m_index_ranges, clustered from it
+	std::vector<LodLevel> m_lod_levels; // full detail first
+	std::vector<IndexRange> m_lod_index_ranges; // level l > 0 at [(l - 1) * range count, l * range count)
+
+	// CPU copies of the geometry for ray queries and software rendering, and a hierarchy over its triangles
+	std::vector<Vertex> m_vertices;
+	std::vector<unsigned> m_indices;
+	BVH m_triangle_bvh;
 	std::vector<Material> m_materials;
+	mutable std::vector<SoftwareImage> m_software_textures; // CPU copies of the diffuse textures, loaded on first use
+	LoadReport m_load_report;
+
+	// Cull the model and then the index ranges into m_index_range_visibility, returns the number of visible ranges
+	size_t CullRanges(const CullView& view) const;
+
+	void SelectOccluders();
+
+	// Append the indices of the coarser levels to m_indices
+	void BuildLods();
 
 	void append_materials(const std::vector<Material>& mtl_vec)
 	{
@@ -42,9 +83,54 @@ public:
 	OBJModel(const std::string& objfile, ID3D11Device* dxdevice, ID3D11DeviceContext* dxdevice_context);
 
 	/**
-	 * @brief Renders the model.
+	 * @brief Add a draw packet for each index range that may be visible to a render queue.
+	 * @details Tests the bounds of the whole model first and then the bounds of each index range, against the
+	 * view frustum and then the occluder depth buffer. Packets are keyed by the shader variant of the material,
+	 * the material and the view depth of the range. Coarser levels draw the clustered indices of the same ranges.
+	*/
+	virtual void Enqueue(RenderQueue& queue, const CullView& view, uint32_t transform, uint32_t lod) const override;
+
+	/**
+	 * @brief Get the levels of detail, built by vertex clustering when the model is loaded.
+	*/
+	virtual LodChain GetLodChain() const override { return { m_lod_levels.data(), (uint32_t)m_lod_levels.size() }; }
+
+	/**
+	 * @brief Draw the index ranges once per instance, with the textures of their materials.
+	*/
+	virtual void RenderInstanced(DeviceState& state, UINT instance_count) const override;
+
+	/**
+	 * @brief Add the shader feature mask of each material.
+	*/
+	virtual void GetShaderFeatures(std::vector<uint32_t>& masks) const override;
+
+	/**
+	 * @brief Add the occluder index ranges to an occlusion depth buffer.
+	 * @details Occluders are the ranges with the largest bounds relative to their triangle count,
+	 * typically walls and floors, selected when the model is loaded.
+	*/
+	virtual void RasterizeOccluders(OcclusionCuller& occlusion, const linalg::mat4f& model_to_clip) const override;
+
+	/**
+	 * @brief Render the model with the CPU rasterizer.
+	 * @details The diffuse textures are loaded to the CPU the first time this is called.
+	*/
+	virtual void RenderSoftware(SoftwareRasterizer& rasterizer, const TransformationBuffer& transforms) const override;
+
+	/**
+	 * @brief Find the closest triangle hit by a ray.
+	 * @param[in] object_space_ray Ray in object space.
+	 * @param[in,out] t_hit In: hits further away than this are ignored. Out: ray parameter of the hit.
+	 * @param[out] part Index of the index range (drawcall) that was hit.
+	 * @return True on hit.
+	*/
+	virtual bool Raycast(const linalg::ray& object_space_ray, float& t_hit, int& part) const override;
+
+	/**
+	 * @brief Get the stage times and sizes of the load, from reading the file to uploading the textures.
 	*/
-	virtual void Render() const;
+	const LoadReport& GetLoadReport() const noexcept { return m_load_report; }
 
 	/**
 	 * @brief Destructor 
@@ -0,0 +1,320 @@
+//
+// Software occlusion culling
+//
+// Occluders are sampled at pixel centers into a depth buffer that keeps the
+// nearest depth. Depth is stored as NDC z remapped to [0,1]; z/w is affine in
+// screen space, so it is interpolated as a plane without perspective correction.
+// Four pixels of a row are processed at a time with SSE2.
+//
+// The buffer is split into horizontal bands of whole tiles, each rasterized by
+// one job. Every pixel is written by exactly one thread and only ever keeps
+// the minimum depth, so the result is independent of threading and triangle order.
+//
+
+#include <algorithm>
+#include <chrono>
+#include "jobsystem.h"
+#include "occlusion.h"
+#include "profiler.h"
+
+#ifdef LINALG_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace linalg;
+
+namespace
+{
+	// Below this many triangles the cost of starting jobs outweighs the gain
+	const size_t ParallelTriangleThreshold = 256;
+
+	int RoundUp(int value, int multiple)
+	{
+		return (value + multiple - 1) / multiple * multiple;
+	}
+}
+
+OcclusionCuller::OcclusionCuller(int width, int height)
+{
+	Resize(width, height);
+}
+
+void OcclusionCuller::Resize(int width, int height)
+{
+	m_width = RoundUp(width > OCCLUSION_TILE_SIZE ? width : OCCLUSION_TILE_SIZE, OCCLUSION_TILE_SIZE);
+	m_height = RoundUp(height > OCCLUSION_TILE_SIZE ? height : OCCLUSION_TILE_SIZE, OCCLUSION_TILE_SIZE);
+	m_tiles_x = m_width / OCCLUSION_TILE_SIZE;
+	m_tiles_y = m_height / OCCLUSION_TILE_SIZE;
+	m_depth.assign((size_t)m_width * m_height, 1.0f);
+	m_tile_max_depth.assign((size_t)m_tiles_x * m_tiles_y, 1.0f);
+}
+
+void OcclusionCuller::BeginFrame()
+{
+	std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+	std::fill(m_tile_max_depth.begin(), m_tile_max_depth.end(), 1.0f);
+	m_triangles.clear();
+	m_stats = OcclusionStats();
+}
+
+void OcclusionCuller::AddOccluder(
+	const mat4f& model_to_clip,
+	const vec3f* positions,
+	size_t stride,
+	const unsigned* indices,
+	size_t index_count)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	const char* base = (const char*)positions;
+	for (size_t i = 0; i + 2 < index_count; i += 3)
+	{
+		vec4f clip[3];
+		for (int k = 0; k < 3; k++)
+			clip[k] = model_to_clip * vec4f(*(const vec3f*)(base + indices[i + k] * stride), 1.0f);
+		AddClippedTriangle(clip);
+	}
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	m_stats.RasterMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void OcclusionCuller::AddClippedTriangle(const vec4f clip[3])
+{
+	// Clip against the near plane (z >= -w), giving up to four vertices
+	vec4f polygon[4];
+	int count = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		const vec4f& a = clip[k];
+		const vec4f& b = clip[(k + 1) % 3];
+		const float da = a.z + a.w;
+		const float db = b.z + b.w;
+		if (da >= 0.0f)
+			polygon[count++] = a;
+		if ((da >= 0.0f) != (db >= 0.0f))
+			polygon[count++] = a + (b - a) * (da / (da - db));
+	}
+	if (count < 3)
+		return;
+
+	// Project to the screen, y pointing down
+	float x[4], y[4], z[4];
+	bool beyondFar = true;
+	for (int k = 0; k < count; k++)
+	{
+		if (polygon[k].w <= 1e-6f)
+			return;
+		const float invW = 1.0f / polygon[k].w;
+		x[k] = (polygon[k].x * invW * 0.5f + 0.5f) * m_width;
+		y[k] = (0.5f - polygon[k].y * invW * 0.5f) * m_height;
+		z[k] = polygon[k].z * invW * 0.5f + 0.5f;
+		beyondFar = beyondFar && z[k] > 1.0f;
+	}
+	if (beyondFar)
+		return;
+
+	// Triangulate as a fan
+	for (int k = 1; k + 1 < count; k++)
+	{
+		const float minX = std::min(x[0], std::min(x[k], x[k + 1]));
+		const float maxX = std::max(x[0], std::max(x[k], x[k + 1]));
+		const float minY = std::min(y[0], std::min(y[k], y[k + 1]));
+		const float maxY = std::max(y[0], std::max(y[k], y[k + 1]));
+		if (maxX < 0.0f || maxY < 0.0f || minX > (float)m_width || minY > (float)m_height)
+			continue;
+
+		ScreenTriangle t;
+		t.X[0] = x[0]; t.X[1] = x[k]; t.X[2] = x[k + 1];
+		t.Y[0] = y[0]; t.Y[1] = y[k]; t.Y[2] = y[k + 1];
+		t.Z[0] = z[0]; t.Z[1] = z[k]; t.Z[2] = z[k + 1];
+		m_triangles.push_back(t);
+	}
+}
+
+void OcclusionCuller::EndFrame()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	int bands = 1;
+	if (m_triangles.size() >= ParallelTriangleThreshold)
+		bands = std::max(1, std::min((int)JobSystem::GetWorkerCount() + 1, m_tiles_y));
+
+	// Band b covers the tile rows [b*m_tiles_y/bands, (b+1)*m_tiles_y/bands)
+	JobSystem::ParallelFor(0, (size_t)bands, 1, [this, bands](size_t begin, size_t end)
+	{
+		for (size_t b = begin; b < end; b++)
+			RasterizeBand((int)b * m_tiles_y / bands * OCCLUSION_TILE_SIZE, ((int)b + 1) * m_tiles_y / bands * OCCLUSION_TILE_SIZE);
+	});
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	m_stats.OccluderTriangles = (unsigned)m_triangles.size();
+	m_stats.RasterMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void OcclusionCuller::RasterizeBand(int y_begin, int y_end)
+{
+	PROFILE_ZONE("Occlusion band");
+
+	for (const ScreenTriangle& t : m_triangles)
+	{
+		const float minY = std::min(t.Y[0], std::min(t.Y[1], t.Y[2]));
+		const float maxY = std::max(t.Y[0], std::max(t.Y[1], t.Y[2]));
+
+		// Rows and columns whose pixel centers may be covered
+		const int py0 = std::max(y_begin, (int)std::ceil(minY - 0.5f));
+		const int py1 = std::min(y_end - 1, (int)std::floor(maxY - 0.5f));
+		if (py0 > py1)
+			continue;
+
+		const float minX = std::min(t.X[0], std::min(t.X[1], t.X[2]));
+		const float maxX = std::max(t.X[0], std::max(t.X[1], t.X[2]));
+		const int px0 = std::max(0, (int)std::ceil(minX - 0.5f)) & ~3;
+		const int px1 = std::min(m_width - 1, (int)std::floor(maxX - 0.5f));
+		if (px0 > px1)
+			continue;
+
+		// Both windings are rasterized, flip to make the signed area positive
+		float x0 = t.X[0], y0 = t.Y[0], z0 = t.Z[0];
+		float x1 = t.X[1], y1 = t.Y[1], z1 = t.Z[1];
+		float x2 = t.X[2], y2 = t.Y[2], z2 = t.Z[2];
+		float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+		if (std::fabs(area) < 1e-8f)
+			continue;
+		if (area < 0.0f)
+		{
+			std::swap(x1, x2); std::swap(y1, y2); std::swap(z1, z2);
+			area = -area;
+		}
+
+		// Edge functions E = A*x + B*y + C, positive inside
+		const float a0 = y1 - y2, b0 = x2 - x1, c0 = -a0 * x1 - b0 * y1;
+		const float a1 = y2 - y0, b1 = x0 - x2, c1 = -a1 * x2 - b1 * y2;
+		const float a2 = y0 - y1, b2 = x1 - x0, c2 = -a2 * x0 - b2 * y0;
+
+		// Depth plane z = dzdx*x + dzdy*y + zc
+		const float invArea = 1.0f / area;
+		const float dzdx = ((z1 - z0) * (y2 - y0) - (z2 - z0) * (y1 - y0)) * invArea;
+		const float dzdy = ((z2 - z0) * (x1 - x0) - (z1 - z0) * (x2 - x0)) * invArea;
+		const float zc = z0 - dzdx * x0 - dzdy * y0;
+
+		for (int py = py0; py <= py1; py++)
+		{
+			const float cy = (float)py + 0.5f;
+			const float e0Row = b0 * cy + c0;
+			const float e1Row = b1 * cy + c1;
+			const float e2Row = b2 * cy + c2;
+			const float zRow = dzdy * cy + zc;
+			float* row = m_depth.data() + (size_t)py * m_width;
+
+#ifdef LINALG_SSE2
+			const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+			const __m128 zero = _mm_setzero_ps();
+			for (int px = px0; px <= px1; px += 4)
+			{
+				const __m128 cx = _mm_add_ps(_mm_set1_ps((float)px), offsets);
+				const __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a0), cx), _mm_set1_ps(e0Row));
+				const __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a1), cx), _mm_set1_ps(e1Row));
+				const __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a2), cx), _mm_set1_ps(e2Row));
+				const __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+				if (!_mm_movemask_ps(inside))
+					continue;
+
+				const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), cx), _mm_set1_ps(zRow));
+				const __m128 old = _mm_loadu_ps(row + px);
+				const __m128 nearest = _mm_min_ps(old, z);
+				_mm_storeu_ps(row + px, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+			}
+#else
+			for (int px = px0; px <= px1; px++)
+			{
+				const float cx = (float)px + 0.5f;
+				if (a0 * cx + e0Row < 0.0f || a1 * cx + e1Row < 0.0f || a2 * cx + e2Row < 0.0f)
+					continue;
+				const float z = dzdx * cx + zRow;
+				if (z < row[px])
+					row[px] = z;
+			}
+#endif
+		}
+	}
+
+	// Farthest depth of each tile in the band
+	for (int ty = y_begin / OCCLUSION_TILE_SIZE; ty < y_end / OCCLUSION_TILE_SIZE; ty++)
+	{
+		for (int tx = 0; tx < m_tiles_x; tx++)
+		{
+			float maxDepth = 0.0f;
+			for (int py = ty * OCCLUSION_TILE_SIZE; py < (ty + 1) * OCCLUSION_TILE_SIZE; py++)
+			{
+				const float* row = m_depth.data() + (size_t)py * m_width + tx * OCCLUSION_TILE_SIZE;
+				for (int px = 0; px < OCCLUSION_TILE_SIZE; px++)
+					maxDepth = std::max(maxDepth, row[px]);
+			}
+			m_tile_max_depth[(size_t)ty * m_tiles_x + tx] = maxDepth;
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const aabb& box, const mat4f& model_to_clip)
+{
+	m_stats.Tested++;
+
+	// Screen rectangle and nearest depth of the projected corners
+	float minX = fINF, maxX = fNINF, minY = fINF, maxY = fNINF, minZ = fINF;
+	for (int k = 0; k < 8; k++)
+	{
+		const vec4f corner(
+			(k & 1) ? box.max.x : box.min.x,
+			(k & 2) ? box.max.y : box.min.y,
+			(k & 4) ? box.max.z : box.min.z,
+			1.0f);
+		const vec4f clip = model_to_clip * corner;
+
+		// Crossing the near plane, too close to say anything
+		if (clip.w <= 1e-6f || clip.z < -clip.w)
+			return true;
+
+		const float invW = 1.0f / clip.w;
+		const float x = (clip.x * invW * 0.5f + 0.5f) * m_width;
+		const float y = (0.5f - clip.y * invW * 0.5f) * m_height;
+		minX = std::min(minX, x); maxX = std::max(maxX, x);
+		minY = std::min(minY, y); maxY = std::max(maxY, y);
+		minZ = std::min(minZ, clip.z * invW * 0.5f + 0.5f);
+	}
+
+	// Every pixel the rectangle touches, not only those whose centers it covers
+	const int px0 = std::max(0, (int)std::floor(minX));
+	const int px1 = std::min(m_width - 1, (int)std::floor(maxX));
+	const int py0 = std::max(0, (int)std::floor(minY));
+	const int py1 = std::min(m_height - 1, (int)std::floor(maxY));
+	if (px0 > px1 || py0 > py1)
+		return true;
+
+	for (int ty = py0 / OCCLUSION_TILE_SIZE; ty <= py1 / OCCLUSION_TILE_SIZE; ty++)
+	{
+		for (int tx = px0 / OCCLUSION_TILE_SIZE; tx <= px1 / OCCLUSION_TILE_SIZE; tx++)
+		{
+			// The whole tile is nearer than the box
+			if (m_tile_max_depth[(size_t)ty * m_tiles_x + tx] < minZ)
+				continue;
+
+			const int y0 = std::max(py0, ty * OCCLUSION_TILE_SIZE);
+			const int y1 = std::min(py1, (ty + 1) * OCCLUSION_TILE_SIZE - 1);
+			const int x0 = std::max(px0, tx * OCCLUSION_TILE_SIZE);
+			const int x1 = std::min(px1, (tx + 1) * OCCLUSION_TILE_SIZE - 1);
+			for (int py = y0; py <= y1; py++)
+			{
+				const float* row = m_depth.data() + (size_t)py * m_width;
+				for (int px = x0; px <= x1; px++)
+				{
+					if (row[px] >= minZ)
+						return true;
+				}
+			}
+		}
+	}
+
+	m_stats.Occluded++;
+	return false;
+}
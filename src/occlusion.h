@@ -0,0 +1,121 @@
+/**
+ * @file occlusion.h
+ * @brief Software occlusion culling against a low resolution CPU depth buffer
+ * @details Occluder triangles are rasterized (conservatively, keeping the nearest depth) into a
+ * small depth buffer, which also keeps the farthest depth of each tile. Bounding boxes are then
+ * tested against it: the farthest tile depth rejects most occluded boxes without touching pixels.
+ * Deterministic, since the result does not depend on the order triangles are rasterized in.
+*/
+
+#pragma once
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <cstdint>
+#include <vector>
+#include "vec/bounds.h"
+
+//! Width and height, in pixels, of the tiles that store the farthest depth
+#define OCCLUSION_TILE_SIZE 8
+
+/**
+ * @brief Statistics of the current frame.
+*/
+struct OcclusionStats
+{
+	unsigned OccluderTriangles = 0; //!< Number of occluder triangles rasterized
+	unsigned Tested = 0; //!< Number of bounds tested
+	unsigned Occluded = 0; //!< Number of bounds found occluded
+	double RasterMilliseconds = 0.0; //!< Time spent setting up and rasterizing occluders
+	double TestMilliseconds = 0.0; //!< Time spent testing bounds
+};
+
+/**
+ * @brief CPU depth buffer for occlusion culling.
+ * @details Usage per frame: BeginFrame(), AddOccluder() for each occluder mesh, EndFrame(), then IsVisible().
+*/
+class OcclusionCuller
+{
+public:
+	/**
+	 * @brief Create a depth buffer.
+	 * @param[in] width Width in pixels, rounded up to a multiple of OCCLUSION_TILE_SIZE.
+	 * @param[in] height Height in pixels, rounded up to a multiple of OCCLUSION_TILE_SIZE.
+	*/
+	OcclusionCuller(int width = 256, int height = 144);
+
+	/**
+	 * @brief Change the resolution of the depth buffer.
+	*/
+	void Resize(int width, int height);
+
+	/**
+	 * @brief Clear the depth buffer and all occluders.
+	*/
+	void BeginFrame();
+
+	/**
+	 * @brief Add the triangles of an occluder mesh.
+	 * @details Triangles are transformed and clipped against the near plane here, and rasterized in EndFrame().
+	 * @param[in] model_to_clip Object space to clip space matrix, i.e. P*V*M.
+	 * @param[in] positions Pointer to the first vertex position.
+	 * @param[in] stride Byte distance between consecutive vertex positions.
+	 * @param[in] indices Triangle list indices.
+	 * @param[in] index_count Number of indices, a multiple of 3.
+	*/
+	void AddOccluder(const linalg::mat4f& model_to_clip, const linalg::vec3f* positions, size_t stride, const unsigned* indices, size_t index_count);
+
+	/**
+	 * @brief Rasterize all occluders added since BeginFrame().
+	 * @details Horizontal bands of the buffer are rasterized as parallel jobs on the JobSystem.
+	*/
+	void EndFrame();
+
+	/**
+	 * @brief Test if a bounding box may be visible.
+	 * @details Conservative: boxes crossing the near plane or outside the screen are reported visible.
+	 * @param[in] box Object space box.
+	 * @param[in] model_to_clip Object space to clip space matrix.
+	 * @return False if the box is certainly hidden behind the occluders.
+	*/
+	bool IsVisible(const linalg::aabb& box, const linalg::mat4f& model_to_clip);
+
+	/**
+	 * @brief Add the time spent in IsVisible() calls to the statistics.
+	*/
+	void AddTestTime(double milliseconds) noexcept { m_stats.TestMilliseconds += milliseconds; }
+
+	/**
+	 * @brief Get the statistics of the current frame.
+	*/
+	const OcclusionStats& GetStats() const noexcept { return m_stats; }
+
+	/**
+	 * @brief Get the depth buffer, row by row from the top, with depth 0 at the near and 1 at the far plane.
+	*/
+	const std::vector<float>& GetDepth() const noexcept { return m_depth; }
+
+	int GetWidth() const noexcept { return m_width; } //!< Width in pixels
+	int GetHeight() const noexcept { return m_height; } //!< Height in pixels
+
+private:
+	// Screen space triangle, x and y in pixels and z in [0,1]
+	struct ScreenTriangle
+	{
+		float X[3], Y[3], Z[3];
+	};
+
+	void AddClippedTriangle(const linalg::vec4f clip[3]);
+	void RasterizeBand(int y_begin, int y_end);
+
+	int m_width = 0;
+	int m_height = 0;
+	int m_tiles_x = 0;
+	int m_tiles_y = 0;
+	std::vector<float> m_depth; // nearest occluder depth per pixel
+	std::vector<float> m_tile_max_depth; // farthest depth in each tile
+	std::vector<ScreenTriangle> m_triangles;
+	OcclusionStats m_stats;
+};
+
+#endif
@@ -0,0 +1,289 @@
+//
+// Hierarchical CPU zone profiler
+//
+// Every thread owns a single-producer single-consumer ring buffer. The owning
+// thread writes completed zones and publishes them by advancing the write
+// index with release semantics; the collecting thread reads up to the write
+// index and hands the slots back by advancing the read index. Buffers are
+// registered under a mutex the first time a thread records a zone and are
+// never freed, so a zone can be collected after its thread has exited.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include "profiler.h"
+#include "jsonwriter.h"
+
+static_assert((PROFILER_RING_SIZE & (PROFILER_RING_SIZE - 1)) == 0, "PROFILER_RING_SIZE must be a power of two");
+
+namespace
+{
+	struct ThreadBuffer
+	{
+		std::vector<ProfileZoneEvent> Events = std::vector<ProfileZoneEvent>(PROFILER_RING_SIZE);
+		std::atomic<uint64_t> Write{ 0 };
+		std::atomic<uint64_t> Read{ 0 };
+		std::atomic<uint64_t> Dropped{ 0 };
+		std::string Name; // guarded by the registry mutex
+		uint32_t Index = 0;
+		uint32_t Depth = 0; // only accessed by the owning thread
+	};
+
+	struct Registry
+	{
+		std::mutex Mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> Threads;
+	};
+
+	// State of the collecting thread
+	struct Collector
+	{
+		std::vector<ProfileZoneEvent> FrameZones;
+		std::vector<ProfileZoneEvent> Capture;
+		int64_t FrameStart = 0;
+		int64_t FrameEnd = 0;
+		int64_t CaptureStart = 0;
+		bool Capturing = false;
+	};
+
+	Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	Collector& GetCollector()
+	{
+		static Collector collector;
+		return collector;
+	}
+
+	thread_local ThreadBuffer* t_buffer = nullptr;
+
+	ThreadBuffer& GetThreadBuffer()
+	{
+		if (!t_buffer)
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.Mutex);
+			registry.Threads.push_back(std::make_unique<ThreadBuffer>());
+			t_buffer = registry.Threads.back().get();
+			t_buffer->Index = (uint32_t)registry.Threads.size() - 1;
+			t_buffer->Name = "Thread " + std::to_string(t_buffer->Index);
+		}
+		return *t_buffer;
+	}
+
+	// Move all published zones of a thread to the end of a vector
+	void Drain(ThreadBuffer& buffer, std::vector<ProfileZoneEvent>& out)
+	{
+		const uint64_t write = buffer.Write.load(std::memory_order_acquire);
+		const uint64_t read = buffer.Read.load(std::memory_order_relaxed);
+		for (uint64_t i = read; i < write; i++)
+			out.push_back(buffer.Events[i & (PROFILER_RING_SIZE - 1)]);
+		buffer.Read.store(write, std::memory_order_release);
+	}
+}
+
+int64_t Profiler::Now() noexcept
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+	std::lock_guard<std::mutex> lock(GetRegistry().Mutex);
+	buffer.Name = name;
+}
+
+uint32_t Profiler::PushZone() noexcept
+{
+	return GetThreadBuffer().Depth++;
+}
+
+void Profiler::PopZone(const char* name, int64_t start, uint32_t depth) noexcept
+{
+	const int64_t end = Now();
+	ThreadBuffer& buffer = *t_buffer; // registered by PushZone()
+	buffer.Depth = depth;
+
+	const uint64_t write = buffer.Write.load(std::memory_order_relaxed);
+	if (write - buffer.Read.load(std::memory_order_acquire) >= PROFILER_RING_SIZE)
+	{
+		buffer.Dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	buffer.Events[write & (PROFILER_RING_SIZE - 1)] = { name, start, end, buffer.Index, depth };
+	buffer.Write.store(write + 1, std::memory_order_release);
+}
+
+void Profiler::EndFrame()
+{
+	Collector& collector = GetCollector();
+	collector.FrameZones.clear();
+	{
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.Mutex);
+		for (auto& buffer : registry.Threads)
+			Drain(*buffer, collector.FrameZones);
+	}
+
+	// Parents end after their children, so order by start time for drawing
+	std::stable_sort(collector.FrameZones.begin(), collector.FrameZones.end(),
+		[](const ProfileZoneEvent& a, const ProfileZoneEvent& b) { return a.Thread != b.Thread ? a.Thread < b.Thread : a.Start < b.Start; });
+
+	if (collector.Capturing)
+		collector.Capture.insert(collector.Capture.end(), collector.FrameZones.begin(), collector.FrameZones.end());
+
+	collector.FrameStart = collector.FrameEnd;
+	collector.FrameEnd = Now();
+	if (!collector.FrameStart)
+		collector.FrameStart = collector.FrameEnd;
+}
+
+const std::vector<ProfileZoneEvent>& Profiler::GetFrameZones() noexcept
+{
+	return GetCollector().FrameZones;
+}
+
+int64_t Profiler::GetFrameStart() noexcept
+{
+	return GetCollector().FrameStart;
+}
+
+int64_t Profiler::GetFrameEnd() noexcept
+{
+	return GetCollector().FrameEnd;
+}
+
+std::vector<std::string> Profiler::GetThreadNames()
+{
+	Registry& registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.Mutex);
+	std::vector<std::string> names;
+	for (auto& buffer : registry.Threads)
+		names.push_back(buffer->Name);
+	return names;
+}
+
+uint64_t Profiler::GetDroppedZones() noexcept
+{
+	Registry& registry = GetRegistry();
+	std::lock_guard<std::mutex> lock(registry.Mutex);
+	uint64_t dropped = 0;
+	for (auto& buffer : registry.Threads)
+		dropped += buffer->Dropped.load(std::memory_order_relaxed);
+	return dropped;
+}
+
+void Profiler::StartCapture()
+{
+	Collector& collector = GetCollector();
+	collector.Capture.clear();
+	collector.CaptureStart = Now();
+	collector.Capturing = true;
+}
+
+void Profiler::StopCapture() noexcept
+{
+	GetCollector().Capturing = false;
+}
+
+bool Profiler::IsCapturing() noexcept
+{
+	return GetCollector().Capturing;
+}
+
+size_t Profiler::GetCaptureSize() noexcept
+{
+	return GetCollector().Capture.size();
+}
+
+void Profiler::WriteChromeTrace(std::ostream& out)
+{
+	const Collector& collector = GetCollector();
+	const std::vector<std::string> threadNames = GetThreadNames();
+
+	// Times are microseconds since the start of the capture
+	auto micros = [&](int64_t time) { return (double)(time - collector.CaptureStart) * 1e-3; };
+
+	JsonWriter json(out, 2);
+	json.BeginObject();
+	json.Key("displayTimeUnit").Value("ms");
+	json.Key("traceEvents").BeginArray();
+
+	for (size_t i = 0; i < threadNames.size(); i++)
+	{
+		json.BeginObject();
+		json.Key("name").Value("thread_name");
+		json.Key("ph").Value("M");
+		json.Key("pid").Value(1);
+		json.Key("tid").Value((unsigned)i);
+		json.Key("args").BeginObject().Key("name").Value(threadNames[i]).EndObject();
+		json.EndObject();
+	}
+
+	for (const ProfileZoneEvent& zone : collector.Capture)
+	{
+		json.BeginObject();
+		json.Key("name").Value(zone.Name);
+		json.Key("ph").Value("X");
+		json.Key("ts").Value(micros(zone.Start));
+		json.Key("dur").Value((double)(zone.End - zone.Start) * 1e-3);
+		json.Key("pid").Value(1);
+		json.Key("tid").Value(zone.Thread);
+		json.EndObject();
+	}
+
+	json.EndArray();
+	json.EndObject();
+}
+
+bool Profiler::WriteChromeTrace(const std::string& filename)
+{
+	std::ofstream out(filename);
+	if (!out)
+		return false;
+	WriteChromeTrace(out);
+	return (bool)out;
+}
+
+double Profiler::MeasureZoneOverhead(unsigned zone_count)
+{
+	ThreadBuffer& buffer = GetThreadBuffer();
+
+	// Keep the zones recorded so far for the next EndFrame()
+	std::vector<ProfileZoneEvent> pending;
+	Drain(buffer, pending);
+
+	// Batches fit in the ring buffer, which is emptied between them, so no zone takes the cheaper dropped path
+	const unsigned BatchSize = PROFILER_RING_SIZE / 2;
+	int64_t total = 0;
+	for (unsigned measured = 0; measured < zone_count; )
+	{
+		const unsigned count = std::min(BatchSize, zone_count - measured);
+		const int64_t start = Now();
+		for (unsigned i = 0; i < count; i++)
+		{
+			ProfileZone zone("Overhead");
+		}
+		total += Now() - start;
+		measured += count;
+		buffer.Read.store(buffer.Write.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	// Hand the earlier zones back to the ring buffer
+	for (const ProfileZoneEvent& zone : pending)
+	{
+		const uint64_t write = buffer.Write.load(std::memory_order_relaxed);
+		buffer.Events[write & (PROFILER_RING_SIZE - 1)] = zone;
+		buffer.Write.store(write + 1, std::memory_order_release);
+	}
+
+	return zone_count ? (double)total / zone_count : 0.0;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file profiler.h
+ * @brief Hierarchical CPU zone profiler
+ * @details Zones are scopes marked with PROFILE_ZONE() or PROFILE_FUNCTION(). When a zone ends,
+ * its name, start and end time are written to a ring buffer owned by the current thread,
+ * without locks. The main thread drains all buffers once per frame in Profiler::EndFrame(),
+ * keeps the zones of the last frame for display and appends them to a capture while one is
+ * running. Captures are written as Chrome trace JSON, viewable in chrome://tracing or Perfetto.
+ *
+ * A zone costs two clock reads and one ring buffer write, so its overhead is dominated by the
+ * clock. Profiler::MeasureZoneOverhead() measures it; the result is shown in the metrics window
+ * and added to benchmark reports. Measured at about 140 ns per zone in a Linux VM where one
+ * steady_clock read takes 50 ns, so zones belong around work of several microseconds or more,
+ * not in inner loops.
+*/
+
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//! Set to 0 to compile out all zones
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+//! Number of zones a thread can hold until they are collected, a power of two. Zones are dropped when the buffer is full.
+#define PROFILER_RING_SIZE 16384
+
+/**
+ * @brief A completed zone.
+*/
+struct ProfileZoneEvent
+{
+	const char* Name; //!< Zone name, a string literal
+	int64_t Start; //!< Start time in nanoseconds, see Profiler::Now()
+	int64_t End; //!< End time in nanoseconds
+	uint32_t Thread; //!< Index of the thread the zone ran on
+	uint32_t Depth; //!< Number of enclosing zones on the same thread
+};
+
+/**
+ * @brief Collects zones from all threads.
+ * @details EndFrame(), the capture functions and the getters must be called from one thread, usually the main thread.
+*/
+class Profiler
+{
+public:
+	/**
+	 * @brief Monotonic time in nanoseconds, from std::chrono::steady_clock.
+	*/
+	static int64_t Now() noexcept;
+
+	/**
+	 * @brief Name the calling thread in the timeline and in traces.
+	 * @param[in] name Thread name, copied.
+	*/
+	static void SetThreadName(const char* name);
+
+	/**
+	 * @brief Mark the end of a frame and collect the zones of all threads.
+	*/
+	static void EndFrame();
+
+	/**
+	 * @brief Get the zones collected by the last EndFrame(), sorted by thread and start time.
+	*/
+	static const std::vector<ProfileZoneEvent>& GetFrameZones() noexcept;
+
+	/**
+	 * @brief Get the start time of the last frame, i.e. the time of the EndFrame() before it.
+	*/
+	static int64_t GetFrameStart() noexcept;
+
+	/**
+	 * @brief Get the end time of the last frame.
+	*/
+	static int64_t GetFrameEnd() noexcept;
+
+	/**
+	 * @brief Get the names of all threads that have recorded zones, indexed by ProfileZoneEvent::Thread.
+	*/
+	static std::vector<std::string> GetThreadNames();
+
+	/**
+	 * @brief Get the number of zones dropped because a ring buffer was full.
+	*/
+	static uint64_t GetDroppedZones() noexcept;
+
+	/**
+	 * @brief Start appending the zones of every frame to a new capture.
+	*/
+	static void StartCapture();
+
+	/**
+	 * @brief Stop appending zones to the capture.
+	*/
+	static void StopCapture() noexcept;
+
+	/**
+	 * @brief True between StartCapture() and StopCapture().
+	*/
+	static bool IsCapturing() noexcept;
+
+	/**
+	 * @brief Get the number of zones in the capture.
+	*/
+	static size_t GetCaptureSize() noexcept;
+
+	/**
+	 * @brief Write the capture as Chrome trace JSON.
+	*/
+	static void WriteChromeTrace(std::ostream& out);
+
+	/**
+	 * @brief Write the capture to a Chrome trace file.
+	 * @return True on success.
+	*/
+	static bool WriteChromeTrace(const std::string& filename);
+
+	/**
+	 * @brief Measure the cost of an empty zone on the calling thread.
+	 * @details Zones of the calling thread are collected before the measurement so none are lost.
+	 * @param[in] zone_count Number of zones to time.
+	 * @return Average nanoseconds per zone.
+	*/
+	static double MeasureZoneOverhead(unsigned zone_count = 100000);
+
+	/**
+	 * @brief Enter a zone on the calling thread, used by ProfileZone.
+	 * @return Depth of the zone.
+	*/
+	static uint32_t PushZone() noexcept;
+
+	/**
+	 * @brief Leave a zone on the calling thread and record it, used by ProfileZone.
+	*/
+	static void PopZone(const char* name, int64_t start, uint32_t depth) noexcept;
+};
+
+/**
+ * @brief Records a zone from construction to destruction.
+*/
+class ProfileZone
+{
+public:
+	/**
+	 * @brief Start the zone.
+	 * @param[in] name Zone name, must outlive the profiler, e.g. a string literal.
+	*/
+	explicit ProfileZone(const char* name) noexcept : m_name(name), m_depth(Profiler::PushZone()), m_start(Profiler::Now()) { }
+
+	~ProfileZone() { Profiler::PopZone(m_name, m_start, m_depth); }
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* m_name;
+	uint32_t m_depth;
+	int64_t m_start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILER_ENABLED
+//! Profile the rest of the current scope
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name) (void)0
+#endif
+
+//! Profile the rest of the current function, named after it
+#define PROFILE_FUNCTION() PROFILE_ZONE(__FUNCTION__)
+
+#endif
@@ -1,4 +1,5 @@
 #include "QuadModel.h"
+#include "devicestate.h"
 
 QuadModel::QuadModel(
 	ID3D11Device* dxdevice,
@@ -6,7 +7,7 @@ QuadModel::QuadModel(
 	: Model(dxdevice, dxdevice_context)
 {
 	// Vertex and index arrays
-	// Once their data is loaded to GPU buffers, they are not needed anymore
+	// Once their data is loaded to GPU buffers, they are only kept for software rendering
 	std::vector<Vertex> vertices;
 	std::vector<unsigned> indices;
 
@@ -68,19 +69,41 @@ QuadModel::QuadModel(
 	SETNAME(m_index_buffer, "IndexBuffer");
 
 	m_number_of_indices = (unsigned int)indices.size();
+
+	m_bounds = linalg::merge(&vertices[0].Position, vertices.size(), sizeof(Vertex));
+
+	m_vertices = vertices;
+	m_indices = indices;
 }
 
 
-void QuadModel::Render() const
+void QuadModel::Enqueue(RenderQueue& queue, const CullView& view, uint32_t transform, uint32_t lod) const
 {
-	// Bind our vertex buffer
-	const UINT32 stride = sizeof(Vertex); //  sizeof(float) * 8;
-	const UINT32 offset = 0;
-	m_dxdevice_context->IASetVertexBuffers(0, 1, &m_vertex_buffer, &stride, &offset);
+	uint8_t visible = 0;
+	if (!CullBounds(view.Frustum, &m_bounds, 1, &visible, view.Stats))
+		return;
+	if (view.Occlusion && !CullOcclusion(*view.Occlusion, view.ModelToClip, &m_bounds, 1, &visible, view.Stats))
+		return;
 
-	// Bind our index buffer
-	m_dxdevice_context->IASetIndexBuffer(m_index_buffer, DXGI_FORMAT_R32_UINT, 0);
+	DrawPacket packet;
+	packet.VertexBuffer = m_vertex_buffer;
+	packet.IndexBuffer = m_index_buffer;
+	packet.VertexStride = sizeof(Vertex);
+	packet.Transform = transform;
+	packet.IndexCount = m_number_of_indices;
 
-	// Make the drawcall
-	m_dxdevice_context->DrawIndexed(m_number_of_indices, 0, 0);
-}
\ No newline at end of file
+	const float depth = (view.ModelToClip * m_bounds.center().xyz1()).w;
+	queue.Push(RenderQueue::MakeKey(RENDERQUEUE_PASS_OPAQUE, 0, m_geometry_id, 0, depth), packet);
+}
+
+void QuadModel::RenderInstanced(DeviceState& state, UINT instance_count) const
+{
+	state.SetVertexBuffer(0, m_vertex_buffer, sizeof(Vertex), 0);
+	state.SetIndexBuffer(m_index_buffer, DXGI_FORMAT_R32_UINT, 0);
+	state.GetContext()->DrawIndexedInstanced(m_number_of_indices, instance_count, 0, 0, 0);
+}
+
+void QuadModel::RenderSoftware(SoftwareRasterizer& rasterizer, const TransformationBuffer& transforms) const
+{
+	rasterizer.Draw(transforms, m_vertices.data(), m_indices.data(), m_indices.size(), nullptr);
+}
@@ -14,6 +14,10 @@ class QuadModel : public Model
 {
 	unsigned m_number_of_indices = 0;
 
+	// CPU copies of the geometry for software rendering
+	std::vector<Vertex> m_vertices;
+	std::vector<unsigned> m_indices;
+
 public:
 	/**
 	 * @brief Create a model of a quad.
@@ -23,9 +27,19 @@ public:
 	QuadModel(ID3D11Device* dxdevice, ID3D11DeviceContext* dxdevice_context);
 
 	/**
-	 * @brief Render the model.
+	 * @brief Add a draw packet of the quad to a render queue, if it may be visible.
+	*/
+	virtual void Enqueue(RenderQueue& queue, const CullView& view, uint32_t transform, uint32_t lod) const override;
+
+	/**
+	 * @brief Draw the quad once per instance.
+	*/
+	virtual void RenderInstanced(DeviceState& state, UINT instance_count) const override;
+
+	/**
+	 * @brief Render the model with the CPU rasterizer.
 	*/
-	virtual void Render() const;
+	virtual void RenderSoftware(SoftwareRasterizer& rasterizer, const TransformationBuffer& transforms) const override;
 
 	/**
 	 *@brief Destructor. 
@@ -0,0 +1,144 @@
+//
+// Sorted queue of draw packets
+//
+// The radix sort counts all eight bytes of the keys in one pass over the
+// entries, then scatters once per byte. A byte that is the same in every key
+// (typically the pass and shader) leaves the order unchanged and is skipped,
+// so a frame with one pass and one shader sorts in six scatters or fewer.
+//
+
+#include <atomic>
+#include <cstring>
+#include <utility>
+#include "renderqueue.h"
+#include "profiler.h"
+
+namespace
+{
+	const int KeyBytes = 8;
+}
+
+uint64_t RenderQueue::MakeKey(uint32_t pass, uint32_t shader, uint32_t geometry, uint32_t material, float view_depth) noexcept
+{
+	// The bits of a non-negative float increase with its value
+	uint32_t depthBits = 0;
+	if (view_depth > 0.0f)
+		memcpy(&depthBits, &view_depth, sizeof(depthBits));
+
+	return (uint64_t)(pass & 0xF) << 60
+		| (uint64_t)(shader & 0xFF) << 52
+		| (uint64_t)(geometry & 0xFFF) << 40
+		| (uint64_t)(material & 0xFFFF) << 24
+		| (uint64_t)(depthBits >> 7);
+}
+
+uint32_t RenderQueue::AllocateGeometryId() noexcept
+{
+	static std::atomic<uint32_t> nextId(0);
+	return nextId++ & 0xFFF;
+}
+
+void RenderQueue::Clear() noexcept
+{
+	m_packets.clear();
+	m_transforms.clear();
+	m_entries.clear();
+}
+
+uint32_t RenderQueue::AddTransform(const linalg::mat4f& model_to_world)
+{
+	m_transforms.push_back(model_to_world);
+	return (uint32_t)m_transforms.size() - 1;
+}
+
+void RenderQueue::Push(uint64_t key, const DrawPacket& packet)
+{
+	m_entries.push_back({ key, (uint32_t)m_packets.size() });
+	m_packets.push_back(packet);
+}
+
+void RenderQueue::Sort()
+{
+	PROFILE_FUNCTION();
+
+	m_stats.SortPasses = 0;
+	const size_t count = m_entries.size();
+	if (count < 2)
+		return;
+
+	uint32_t histograms[KeyBytes][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (const SortEntry& entry : m_entries)
+	{
+		for (int b = 0; b < KeyBytes; b++)
+			histograms[b][(entry.Key >> (b * 8)) & 0xFF]++;
+	}
+
+	m_sort_buffer.resize(count);
+	SortEntry* source = m_entries.data();
+	SortEntry* destination = m_sort_buffer.data();
+	for (int b = 0; b < KeyBytes; b++)
+	{
+		uint32_t* histogram = histograms[b];
+		const int shift = b * 8;
+		if (histogram[(source[0].Key >> shift) & 0xFF] == count)
+			continue;
+
+		// Exclusive prefix sum: first slot of each byte value
+		uint32_t offset = 0;
+		for (int i = 0; i < 256; i++)
+		{
+			const uint32_t bucket = histogram[i];
+			histogram[i] = offset;
+			offset += bucket;
+		}
+
+		for (size_t i = 0; i < count; i++)
+			destination[histogram[(source[i].Key >> shift) & 0xFF]++] = source[i];
+		std::swap(source, destination);
+		m_stats.SortPasses++;
+	}
+
+	// An odd number of passes leaves the result in the buffer
+	if (source != m_entries.data())
+		m_entries.swap(m_sort_buffer);
+}
+
+void RenderQueue::Submit(RenderQueueDispatcher& dispatcher)
+{
+	PROFILE_FUNCTION();
+
+	const unsigned sortPasses = m_stats.SortPasses;
+	m_stats = RenderQueueStats();
+	m_stats.Packets = (unsigned)m_entries.size();
+	m_stats.SortPasses = sortPasses;
+
+	const DrawPacket* previous = nullptr;
+	for (const SortEntry& entry : m_entries)
+	{
+		const DrawPacket& packet = m_packets[entry.Packet];
+		if (!previous || packet.Shader != previous->Shader)
+		{
+			dispatcher.BindShader(packet.Shader);
+			m_stats.ShaderChanges++;
+		}
+		if (!previous || packet.VertexBuffer != previous->VertexBuffer || packet.IndexBuffer != previous->IndexBuffer ||
+			packet.VertexStride != previous->VertexStride)
+		{
+			dispatcher.BindGeometry(packet);
+			m_stats.GeometryChanges++;
+		}
+		if (!previous || packet.Material != previous->Material)
+		{
+			dispatcher.BindMaterial(packet);
+			m_stats.MaterialChanges++;
+		}
+		if (!previous || packet.Transform != previous->Transform)
+		{
+			dispatcher.BindTransform(packet.Transform, m_transforms[packet.Transform]);
+			m_stats.TransformChanges++;
+		}
+		dispatcher.Draw(packet);
+		previous = &packet;
+	}
+}
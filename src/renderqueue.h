@@ -0,0 +1,170 @@
+/**
+ * @file renderqueue.h
+ * @brief Sorted queue of draw packets
+ * @details Models push one packet per draw with a 64-bit sort key. Each frame the keys are radix
+ * sorted and the packets are submitted in key order, binding only the state that differs from the
+ * previous packet. From the most to the least significant bits a key holds:
+ *
+ * | Bits  | Field    | Meaning                                                  |
+ * |-------|----------|----------------------------------------------------------|
+ * | 63-60 | pass     | Passes draw in increasing order                          |
+ * | 59-52 | shader   | Shader combination                                       |
+ * | 51-40 | geometry | Vertex and index buffers, see AllocateGeometryId()       |
+ * | 39-24 | material | Material of the geometry, e.g. its index in the model    |
+ * | 23-0  | depth    | View depth, front to back                                |
+ *
+ * The material field covers all of a material's textures, which are bound together when it changes,
+ * so textures have no field of their own. The payload of a packet refers to API objects through opaque pointers and state is
+ * bound through a RenderQueueDispatcher, so the queue is independent of Direct3D.
+*/
+
+#pragma once
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <cstdint>
+#include <vector>
+#include "vec/mat.h"
+
+//! Pass of opaque geometry
+#define RENDERQUEUE_PASS_OPAQUE 0
+
+/**
+ * @brief State and draw arguments of one draw.
+*/
+struct DrawPacket
+{
+	const void* VertexBuffer = nullptr; //!< Vertex buffer, e.g. an ID3D11Buffer
+	const void* IndexBuffer = nullptr; //!< Index buffer of 32-bit indices
+	const void* Material = nullptr; //!< Material state, e.g. a Material, or nullptr
+	uint32_t VertexStride = 0; //!< Bytes per vertex
+	uint32_t Shader = 0; //!< Shader combination, 0 for the shaders bound by the caller
+	uint32_t Transform = 0; //!< Index returned by RenderQueue::AddTransform()
+	uint32_t IndexStart = 0; //!< First index of the draw
+	uint32_t IndexCount = 0; //!< Number of indices of the draw
+};
+
+/**
+ * @brief Binds state and draws for RenderQueue::Submit().
+ * @details Each Bind function is called only when its state differs from the previous packet,
+ * and all of them are called before the first draw.
+*/
+class RenderQueueDispatcher
+{
+public:
+	virtual ~RenderQueueDispatcher() = default;
+
+	virtual void BindShader(uint32_t shader) = 0; //!< Bind the shaders of DrawPacket::Shader
+	virtual void BindGeometry(const DrawPacket& packet) = 0; //!< Bind the vertex and index buffers of a packet
+	virtual void BindMaterial(const DrawPacket& packet) = 0; //!< Bind the material of a packet
+	virtual void BindTransform(uint32_t transform, const linalg::mat4f& model_to_world) = 0; //!< Bind transform, from AddTransform(), for the next draws
+	virtual void Draw(const DrawPacket& packet) = 0; //!< Draw a packet
+};
+
+/**
+ * @brief Counts of the last Submit().
+*/
+struct RenderQueueStats
+{
+	unsigned Packets = 0; //!< Packets in the queue
+	unsigned ShaderChanges = 0; //!< Calls to BindShader()
+	unsigned GeometryChanges = 0; //!< Calls to BindGeometry()
+	unsigned MaterialChanges = 0; //!< Calls to BindMaterial()
+	unsigned TransformChanges = 0; //!< Calls to BindTransform()
+	unsigned SortPasses = 0; //!< Radix passes of the last Sort(), bytes shared by all keys are skipped
+};
+
+/**
+ * @brief Draw packets of a frame, sorted and submitted with redundant state changes removed.
+*/
+class RenderQueue
+{
+public:
+	/**
+	 * @brief Build a sort key.
+	 * @details Fields are truncated to their bit widths. Negative depths count as 0.
+	 * @param[in] pass Pass, 0-15.
+	 * @param[in] shader Shader combination, 0-255.
+	 * @param[in] geometry Geometry id, 0-4095.
+	 * @param[in] material Material, 0-65535.
+	 * @param[in] view_depth Distance along the view direction, quantized to the 24 high bits of the float.
+	*/
+	static uint64_t MakeKey(uint32_t pass, uint32_t shader, uint32_t geometry, uint32_t material, float view_depth) noexcept;
+
+	/**
+	 * @brief Get a new geometry id for the key, unique modulo 4096.
+	*/
+	static uint32_t AllocateGeometryId() noexcept;
+
+	/**
+	 * @brief Remove all packets and transforms, keeping the memory for the next frame.
+	*/
+	void Clear() noexcept;
+
+	/**
+	 * @brief Add a model-to-world matrix for packets to refer to.
+	 * @return Index for DrawPacket::Transform.
+	*/
+	uint32_t AddTransform(const linalg::mat4f& model_to_world);
+
+	/**
+	 * @brief Get the number of transforms added since Clear().
+	*/
+	uint32_t GetTransformCount() const noexcept { return (uint32_t)m_transforms.size(); }
+
+	/**
+	 * @brief Get a model-to-world matrix by the index AddTransform() returned.
+	*/
+	const linalg::mat4f& GetTransform(uint32_t transform) const noexcept { return m_transforms[transform]; }
+
+	/**
+	 * @brief Get all model-to-world matrices, indexed as by GetTransform().
+	*/
+	const linalg::mat4f* GetTransforms() const noexcept { return m_transforms.data(); }
+
+	/**
+	 * @brief Add a packet.
+	*/
+	void Push(uint64_t key, const DrawPacket& packet);
+
+	/**
+	 * @brief Sort the packets by key with a least significant digit radix sort on bytes.
+	 * @details Stable, so packets with equal keys keep the order they were pushed in.
+	*/
+	void Sort();
+
+	/**
+	 * @brief Submit the packets in the order of the last Sort(), or as pushed if not sorted.
+	*/
+	void Submit(RenderQueueDispatcher& dispatcher);
+
+	/**
+	 * @brief Get the number of packets.
+	*/
+	size_t GetPacketCount() const noexcept { return m_packets.size(); }
+
+	/**
+	 * @brief Get the key of the i:th packet in submission order.
+	*/
+	uint64_t GetSortedKey(size_t i) const noexcept { return m_entries[i].Key; }
+
+	/**
+	 * @brief Get the counts of the last Submit().
+	*/
+	const RenderQueueStats& GetStats() const noexcept { return m_stats; }
+
+private:
+	struct SortEntry
+	{
+		uint64_t Key;
+		uint32_t Packet;
+	};
+
+	std::vector<DrawPacket> m_packets;
+	std::vector<linalg::mat4f> m_transforms;
+	std::vector<SortEntry> m_entries; // in submission order after Sort()
+	std::vector<SortEntry> m_sort_buffer;
+	RenderQueueStats m_stats;
+};
+
+#endif
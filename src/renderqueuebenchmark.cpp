@@ -0,0 +1,183 @@
+//
+// Render queue throughput benchmark
+//
+// The packets of a frame are generated once, in random order, so the timed
+// build only covers what a model does per packet: make a key and push it.
+// API objects are stood in for by addresses into a byte array.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include "renderqueuebenchmark.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+namespace
+{
+	const unsigned Models = 64;
+	const unsigned MaterialsPerModel = 256;
+
+	struct PacketSource
+	{
+		uint32_t Model;
+		uint32_t Material;
+		float Depth;
+	};
+
+	// Counts the draws so that the submission loop cannot be optimized away
+	class CountingDispatcher : public RenderQueueDispatcher
+	{
+	public:
+		void BindShader(uint32_t shader) override { m_checksum += shader; }
+		void BindGeometry(const DrawPacket& packet) override { m_checksum += packet.VertexStride; }
+		void BindMaterial(const DrawPacket& packet) override { m_checksum += (uintptr_t)packet.Material & 0xFF; }
+		void BindTransform(uint32_t, const linalg::mat4f& model_to_world) override { m_checksum += (uint64_t)model_to_world.m14; }
+		void Draw(const DrawPacket& packet) override { m_checksum += packet.IndexCount; }
+
+		uint64_t GetChecksum() const noexcept { return m_checksum; }
+
+	private:
+		uint64_t m_checksum = 0;
+	};
+
+	void Build(RenderQueue& queue, const std::vector<PacketSource>& sources, const std::vector<char>& handles)
+	{
+		queue.Clear();
+		for (unsigned m = 0; m < Models; m++)
+			queue.AddTransform(linalg::mat4f::translation((float)m, 0.0f, 0.0f));
+
+		DrawPacket packet;
+		packet.VertexStride = 32;
+		for (const PacketSource& source : sources)
+		{
+			packet.VertexBuffer = &handles[source.Model];
+			packet.IndexBuffer = &handles[source.Model];
+			packet.Material = &handles[Models + source.Model * MaterialsPerModel + source.Material];
+			packet.Transform = source.Model;
+			packet.IndexStart = source.Material * 300;
+			packet.IndexCount = 300;
+			queue.Push(RenderQueue::MakeKey(RENDERQUEUE_PASS_OPAQUE, 0, source.Model, source.Material, source.Depth), packet);
+		}
+	}
+
+	void WriteStage(JsonWriter& json, const char* name, const BenchmarkSummary& summary, unsigned packets)
+	{
+		json.Key(name).BeginObject();
+		json.Key("p50_ms").Value(summary.P50);
+		json.Key("p95_ms").Value(summary.P95);
+		json.Key("max_ms").Value(summary.Max);
+		json.Key("packets_per_second").Value(summary.P50 > 0.0 ? packets / (summary.P50 * 1e-3) : 0.0);
+		json.EndObject();
+	}
+
+	void WriteStats(JsonWriter& json, const char* name, const RenderQueueStats& stats)
+	{
+		json.Key(name).BeginObject();
+		json.Key("shader_changes").Value(stats.ShaderChanges);
+		json.Key("geometry_changes").Value(stats.GeometryChanges);
+		json.Key("material_changes").Value(stats.MaterialChanges);
+		json.Key("transform_changes").Value(stats.TransformChanges);
+		json.EndObject();
+	}
+}
+
+RenderQueueBenchmarkResult RunRenderQueueFrames(unsigned packets, unsigned frames)
+{
+	RenderQueueBenchmarkResult result;
+	result.Packets = packets;
+	result.Frames = frames;
+
+	std::mt19937 random(1);
+	std::uniform_int_distribution<uint32_t> model(0, Models - 1);
+	std::uniform_int_distribution<uint32_t> material(0, MaterialsPerModel - 1);
+	std::uniform_real_distribution<float> depth(1.0f, 500.0f);
+	std::vector<PacketSource> sources(packets);
+	for (PacketSource& source : sources)
+		source = { model(random), material(random), depth(random) };
+	std::vector<char> handles(Models + Models * MaterialsPerModel);
+
+	RenderQueue queue;
+	CountingDispatcher dispatcher;
+	std::vector<std::pair<uint64_t, uint32_t>> reference(packets);
+	std::vector<double> build, sort, stdSort, submit;
+
+	// Push order first, which also warms up the queue's memory
+	Build(queue, sources, handles);
+	queue.Submit(dispatcher);
+	result.Unsorted = queue.GetStats();
+
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		int64_t start = Profiler::Now();
+		Build(queue, sources, handles);
+		build.push_back(MillisecondsSince(start));
+
+		start = Profiler::Now();
+		queue.Sort();
+		sort.push_back(MillisecondsSince(start));
+
+		start = Profiler::Now();
+		queue.Submit(dispatcher);
+		submit.push_back(MillisecondsSince(start));
+
+		for (uint32_t i = 0; i < packets; i++)
+			reference[i] = { RenderQueue::MakeKey(RENDERQUEUE_PASS_OPAQUE, 0, sources[i].Model, sources[i].Material, sources[i].Depth), i };
+		start = Profiler::Now();
+		std::stable_sort(reference.begin(), reference.end(),
+			[](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) { return a.first < b.first; });
+		stdSort.push_back(MillisecondsSince(start));
+
+		for (uint32_t i = 0; i < packets && result.OrderCorrect; i++)
+			result.OrderCorrect = queue.GetSortedKey(i) == reference[i].first;
+	}
+	result.Sorted = queue.GetStats();
+
+	result.BuildMilliseconds = BenchmarkSummary::Compute(build);
+	result.SortMilliseconds = BenchmarkSummary::Compute(sort);
+	result.StdSortMilliseconds = BenchmarkSummary::Compute(stdSort);
+	result.SubmitMilliseconds = BenchmarkSummary::Compute(submit);
+	if (dispatcher.GetChecksum() == 0)
+		result.OrderCorrect = false;
+	return result;
+}
+
+bool RunRenderQueueBenchmark(unsigned packets, unsigned frames, const std::string& report_filename)
+{
+	printf("Render queue, %u packets, %u frames...\n", packets, frames);
+	const RenderQueueBenchmarkResult result = RunRenderQueueFrames(packets, frames);
+
+	const struct { const char* Name; const BenchmarkSummary& Summary; } stages[] =
+	{
+		{ "Build", result.BuildMilliseconds },
+		{ "Radix sort", result.SortMilliseconds },
+		{ "std::stable_sort", result.StdSortMilliseconds },
+		{ "Submit", result.SubmitMilliseconds },
+	};
+	printf("\t%-18s %10s %10s %14s\n", "", "p50 ms", "p95 ms", "Mpackets/s");
+	for (const auto& stage : stages)
+	{
+		printf("\t%-18s %10.3f %10.3f %14.1f\n", stage.Name, stage.Summary.P50, stage.Summary.P95,
+			stage.Summary.P50 > 0.0 ? packets / (stage.Summary.P50 * 1e3) : 0.0);
+	}
+	printf("\tState changes (geometry/material/transform): sorted %u/%u/%u, unsorted %u/%u/%u\n",
+		result.Sorted.GeometryChanges, result.Sorted.MaterialChanges, result.Sorted.TransformChanges,
+		result.Unsorted.GeometryChanges, result.Unsorted.MaterialChanges, result.Unsorted.TransformChanges);
+	printf("\tSort order %s\n", result.OrderCorrect ? "correct" : "WRONG");
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("packets").Value(packets);
+		json.Key("frames").Value(frames);
+		json.Key("sort_passes").Value(result.Sorted.SortPasses);
+		json.Key("order_correct").Value(result.OrderCorrect);
+		WriteStage(json, "build", result.BuildMilliseconds, packets);
+		WriteStage(json, "radix_sort", result.SortMilliseconds, packets);
+		WriteStage(json, "std_stable_sort", result.StdSortMilliseconds, packets);
+		WriteStage(json, "submit", result.SubmitMilliseconds, packets);
+		WriteStats(json, "sorted", result.Sorted);
+		WriteStats(json, "unsorted", result.Unsorted);
+	});
+	return result.OrderCorrect && written;
+}
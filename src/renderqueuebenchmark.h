@@ -0,0 +1,50 @@
+/**
+ * @file renderqueuebenchmark.h
+ * @brief Throughput benchmark of the render queue
+ * @details Builds, sorts and submits a synthetic frame of draw packets many times over, with a dispatcher
+ * that only counts, to measure the CPU cost per packet of each stage. The radix sort is checked against
+ * and compared with std::stable_sort.
+*/
+
+#pragma once
+#ifndef RENDERQUEUEBENCHMARK_H
+#define RENDERQUEUEBENCHMARK_H
+
+#include <string>
+#include "benchmark.h"
+#include "renderqueue.h"
+
+//! Number of packets of a benchmark frame
+#define RENDERQUEUEBENCHMARK_DEFAULT_PACKETS 100000
+
+//! Number of frames of a render queue benchmark
+#define RENDERQUEUEBENCHMARK_DEFAULT_FRAMES 100
+
+/**
+ * @brief Stage times and state changes of a render queue benchmark.
+*/
+struct RenderQueueBenchmarkResult
+{
+	unsigned Packets = 0; //!< Packets per frame
+	unsigned Frames = 0; //!< Frames run
+	BenchmarkSummary BuildMilliseconds; //!< Clear(), AddTransform() and Push() of every packet
+	BenchmarkSummary SortMilliseconds; //!< RenderQueue::Sort()
+	BenchmarkSummary StdSortMilliseconds; //!< std::stable_sort of the same keys, for comparison
+	BenchmarkSummary SubmitMilliseconds; //!< RenderQueue::Submit() to a counting dispatcher
+	RenderQueueStats Sorted; //!< State changes submitted in key order
+	RenderQueueStats Unsorted; //!< State changes submitted in push order
+	bool OrderCorrect = true; //!< Radix sorted keys matched std::stable_sort in every frame
+};
+
+/**
+ * @brief Build, sort and submit frames of random packets over 64 models with 256 materials each.
+*/
+RenderQueueBenchmarkResult RunRenderQueueFrames(unsigned packets, unsigned frames);
+
+/**
+ * @brief Run the benchmark, print packets per second of each stage and write the results as JSON.
+ * @return True if the sort order was correct and the report was written.
+*/
+bool RunRenderQueueBenchmark(unsigned packets, unsigned frames, const std::string& report_filename);
+
+#endif
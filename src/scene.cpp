@@ -1,19 +1,74 @@
 
+#include <functional>
 #include "Scene.h"
 #include "QuadModel.h"
 #include "OBJModel.h"
+#include "profiler.h"
+#include "shaderpermutations.h"
+#include "imgui.h"
+
+namespace
+{
+	// Binds render queue state through the redundant state filter
+	class DeviceDispatcher : public RenderQueueDispatcher
+	{
+	public:
+		DeviceDispatcher(DeviceState* state, const ShaderPermutations* pixel_shaders, std::function<void(uint32_t, const mat4f&)> bind_transform)
+			: m_state(state), m_pixel_shaders(pixel_shaders), m_bind_transform(std::move(bind_transform)) { }
+
+		// The shader combination is the feature mask of the pixel shader variant,
+		// the vertex shader is bound by the caller
+		void BindShader(uint32_t shader) override
+		{
+			if (m_pixel_shaders)
+				m_state->SetPixelShader(get_pixel_shader(m_pixel_shaders->Get(shader)));
+		}
+
+		void BindGeometry(const DrawPacket& packet) override
+		{
+			m_state->SetVertexBuffer(0, (ID3D11Buffer*)packet.VertexBuffer, packet.VertexStride, 0);
+			m_state->SetIndexBuffer((ID3D11Buffer*)packet.IndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+		}
+
+		void BindMaterial(const DrawPacket& packet) override
+		{
+			// Diffuse, normal and specular textures to slots t0-t2 of the PS
+			const Material* material = (const Material*)packet.Material;
+			m_state->SetPSShaderResource(0, material ? material->DiffuseTexture.TextureView : nullptr);
+			m_state->SetPSShaderResource(1, material ? material->NormalTexture.TextureView : nullptr);
+			m_state->SetPSShaderResource(2, material ? material->SpecularTexture.TextureView : nullptr);
+		}
+
+		void BindTransform(uint32_t transform, const mat4f& model_to_world) override { m_bind_transform(transform, model_to_world); }
+
+		void Draw(const DrawPacket& packet) override { m_state->GetContext()->DrawIndexed(packet.IndexCount, packet.IndexStart, 0); }
+
+	private:
+		DeviceState* m_state;
+		const ShaderPermutations* m_pixel_shaders;
+		std::function<void(uint32_t, const mat4f&)> m_bind_transform;
+	};
+}
 
 Scene::Scene(
 	ID3D11Device* dxdevice,
 	ID3D11DeviceContext* dxdevice_context,
+	DeviceState* device_state,
 	int window_width,
 	int window_height) :
 	m_dxdevice(dxdevice),
 	m_dxdevice_context(dxdevice_context),
+	m_device_state(device_state),
 	m_window_width(window_width),
 	m_window_height(window_height)
 { }
 
+void Scene::RenderSoftware(SoftwareRasterizer& rasterizer)
+{
+	rasterizer.Clear({ 0.0f, 0.0f, 0.0f, 1.0f });
+	rasterizer.Flush();
+}
+
 void Scene::OnWindowResized(
 	int new_width,
 	int new_height)
@@ -25,12 +80,21 @@ void Scene::OnWindowResized(
 OurTestScene::OurTestScene(
 	ID3D11Device* dxdevice,
 	ID3D11DeviceContext* dxdevice_context,
+	DeviceState* device_state,
 	int window_width,
 	int window_height) :
-	Scene(dxdevice, dxdevice_context, window_width, window_height)
+	Scene(dxdevice, dxdevice_context, device_state, window_width, window_height),
+	m_occlusion(256, window_width > 0 ? 256 * window_height / window_width : 144)
 { 
 	InitTransformationBuffer();
 	// + init other CBuffers
+
+	// One map per frame for the matrices of all draws, where the runtime can bind ranges of a buffer
+	if (ConstantRing::IsSupported(m_dxdevice) && m_device_state->SupportsConstantBufferRanges())
+		m_constant_ring = new ConstantRing(m_dxdevice);
+
+	m_lod.SetPixelError(SCENE_LOD_PIXEL_ERROR);
+	m_lod.SetTriangleBudget(SCENE_LOD_TRIANGLE_BUDGET);
 }
 
 //
@@ -46,29 +110,78 @@ void OurTestScene::Init()
 
 	// Move camera to (0,0,5)
 	m_camera->MoveTo({ 0, 0, 5 });
+	m_previous_camera_position = m_camera->GetPosition();
+	m_render_camera = new Camera(*m_camera);
 
 	// Create objects
 	m_quad = new QuadModel(m_dxdevice, m_dxdevice_context);
-	m_sponza = new OBJModel("assets/crytek-sponza/sponza.obj", m_dxdevice, m_dxdevice_context);
+	OBJModel* sponza = new OBJModel("assets/crytek-sponza/sponza.obj", m_dxdevice, m_dxdevice_context);
+	m_sponza = sponza;
+
+	// Object transformations are T*R*S; i.e. scale, then rotate, and then translate.
+	// Each object moves a root node of the graph, and the models hang from the nodes
+	m_models = { { "Quad", m_quad }, { "Sponza", m_sponza } };
+	const NodeHandle quadNode = m_graph.AddNode(NodeHandle(), mat4f_identity, 0, m_quad->GetBounds());
+	const NodeHandle sponzaNode = m_graph.AddNode(NodeHandle(), mat4f_identity, 1, m_sponza->GetBounds());
+	m_object_nodes = { quadNode, sponzaNode };
+
+	ObjectDesc quad;
+	quad.Scale = { 1.5f, 1.5f, 1.5f };						// Scale uniformly to 150%
+	quad.AngularVelocity = -m_angular_velocity;				// Rotate continuously around the y-axis
+	quad.RenderHandle = 0;
+	m_objects.Create(quad);
+
+	ObjectDesc sponzaObject;
+	sponzaObject.Position = { 0.0f, -5.0f, 0.0f };			// Move down 5 units
+	sponzaObject.RotationAngle = fPI / 2;					// Rotate pi/2 radians (90 degrees) around y
+	sponzaObject.Scale = { 0.05f, 0.05f, 0.05f };			// The scene is quite large so scale it down to 5%
+	sponzaObject.RenderHandle = 1;
+	m_objects.Create(sponzaObject);
+
+	// A small quad circling with the spinning one, as its child
+	m_graph.AddNode(quadNode, mat4f::translation(2.0f, 0.0f, 0.0f) * mat4f::scaling(0.3f), 0, m_quad->GetBounds());
+
+	// A grid of small quads lying on the floor, each with its own colour
+	const float spacing = 1.5f;
+	for (int row = 0; row < SCENE_QUAD_INSTANCE_GRID; row++)
+	{
+		for (int column = 0; column < SCENE_QUAD_INSTANCE_GRID; column++)
+		{
+			InstanceData instance;
+			instance.ModelToWorld = mat4f::translation((column - SCENE_QUAD_INSTANCE_GRID / 2) * spacing, -4.5f, (row - SCENE_QUAD_INSTANCE_GRID / 2) * spacing) *
+				mat4f::rotation(-fPI / 2, 1.0f, 0.0f, 0.0f) *	// Face up
+				mat4f::scaling(0.5f);
+			instance.Data = { (float)column / SCENE_QUAD_INSTANCE_GRID, (float)row / SCENE_QUAD_INSTANCE_GRID, 0.5f, 1.0f };
+			m_quad_instances.push_back(instance);
+		}
+	}
+	m_quad_instance_buffer = new InstanceBuffer(m_dxdevice, (UINT)m_quad_instances.size());
+
+	// Machine readable load times, to track load regressions
+	if (!sponza->GetLoadReport().WriteJSON("load_report.json"))
+		printf("Could not write load_report.json\n");
 }
 
 //
-// Called every frame
-// dt (seconds) is time elapsed since the previous frame
+// Called once per simulation step
+// dt (seconds) is the fixed length of a step
 //
 void OurTestScene::Update(
 	float dt,
 	const InputHandler& input_handler)
 {
-	// Basic camera control
+	// Keep the state of the previous step to interpolate from when rendering
+	m_previous_camera_position = m_camera->GetPosition();
+
+	// Basic camera control, forward and sideways relative to where the camera looks
 	if (input_handler.IsKeyPressed(Keys::Up) || input_handler.IsKeyPressed(Keys::W))
-		m_camera->Move({ 0.0f, 0.0f, -m_camera_velocity * dt });
+		m_camera->MoveLocal({ 0.0f, 0.0f, -m_camera_velocity * dt });
 	if (input_handler.IsKeyPressed(Keys::Down) || input_handler.IsKeyPressed(Keys::S))
-		m_camera->Move({ 0.0f, 0.0f, m_camera_velocity * dt });
+		m_camera->MoveLocal({ 0.0f, 0.0f, m_camera_velocity * dt });
 	if (input_handler.IsKeyPressed(Keys::Right) || input_handler.IsKeyPressed(Keys::D))
-		m_camera->Move({ m_camera_velocity * dt, 0.0f, 0.0f });
+		m_camera->MoveLocal({ m_camera_velocity * dt, 0.0f, 0.0f });
 	if (input_handler.IsKeyPressed(Keys::Left) || input_handler.IsKeyPressed(Keys::A))
-		m_camera->Move({ -m_camera_velocity * dt, 0.0f, 0.0f });
+		m_camera->MoveLocal({ -m_camera_velocity * dt, 0.0f, 0.0f });
 	if(input_handler.IsKeyPressed(Keys::Space))
 		m_camera->Move({ 0.0f, m_camera_velocity * dt, 0.0f });
 	if(input_handler.IsKeyPressed(Keys::LCtrl))
@@ -76,61 +189,195 @@ void OurTestScene::Update(
 	if(input_handler.IsKeyPressed(Keys::Esc))
 		PostQuitMessage(0);
 
-	// Now set/update object transformations
-	// This can be done using any sequence of transformation matrices,
-	// but the T*R*S order is most common; i.e. scale, then rotate, and then translate.
-	// If no transformation is desired, an identity matrix can be obtained 
-	// via e.g. Mquad = linalg::mat4f_identity; 
+	// Move and rotate the objects, keeping their previous state to interpolate from
+	m_objects.Simulate(dt);
+
+	// Pick the object under the mouse cursor when the left button is pressed,
+	// unless the click goes to a window of the user interface
+	const bool pickButtonDown = input_handler.IsMouseButtonPressed(MouseButtons::Left);
+	if (pickButtonDown && !m_pick_button_down && !ImGui::GetIO().WantCaptureMouse)
+	{
+		int mouseX, mouseY;
+		input_handler.GetMouseLocation(mouseX, mouseY);
+		Pick(mouseX, mouseY);
+	}
+	m_pick_button_down = pickButtonDown;
+}
+
+//
+// Called once per frame, before the simulation steps of the frame
+//
+void OurTestScene::HandleInput(const InputHandler& input_handler)
+{
+	// The mouse turns the camera at once rather than in simulation steps, which would add a frame of lag
+	if (input_handler.IsMouseButtonPressed(MouseButtons::Right))
+		m_camera->Rotate(-input_handler.GetMouseDeltaX() * m_camera_sensitivity, -input_handler.GetMouseDeltaY() * m_camera_sensitivity);
+}
 
-	// Quad model-to-world transformation
-	m_quad_transform = mat4f::translation(0, 0, 0) *			// No translation
-		mat4f::rotation(-m_angle, 0.0f, 1.0f, 0.0f) *	// Rotate continuously around the y-axis
-		mat4f::scaling(1.5, 1.5, 1.5);				// Scale uniformly to 150%
+//
+// Place the camera and the objects between the last two simulation steps and
+// move their nodes there, which recomputes the subtrees under the nodes that moved
+//
+void OurTestScene::UpdateWorld()
+{
+	m_render_camera->MoveTo(lerp(m_previous_camera_position, m_camera->GetPosition(), m_interpolation));
+	m_render_camera->SetOrientation(m_camera->GetYaw(), m_camera->GetPitch());
 
-	// Sponza model-to-world transformation
-	m_sponza_transform = mat4f::translation(0, -5, 0) *		 // Move down 5 units
-		mat4f::rotation(fPI / 2, 0.0f, 1.0f, 0.0f) * // Rotate pi/2 radians (90 degrees) around y
-		mat4f::scaling(0.05f);						 // The scene is quite large so scale it down to 5%
+	m_objects.UpdateWorld(m_interpolation);
+	const mat4f* worldMatrices = m_objects.GetWorldMatrices();
+	const uint32_t* renderHandles = m_objects.GetRenderHandles();
+	for (uint32_t i = 0; i < m_objects.GetCount(); i++)
+		m_graph.SetLocal(m_object_nodes[renderHandles[i]], worldMatrices[i]);
+	m_graph.Update();
+}
 
-	// Increment the rotation angle.
-	m_angle += m_angular_velocity * dt;
+//
+// Called every frame, after the simulation steps of the frame
+//
+void OurTestScene::Render()
+{
+	// Interpolate the moving parts between the last two simulation steps
+	UpdateWorld();
 
-	// Print fps
-	m_fps_cooldown -= dt;
-	if (m_fps_cooldown < 0.0)
+	// Obtain the matrices needed for rendering from the camera, recomputed only if it moved
+	m_view_matrix = m_render_camera->WorldToViewMatrix();
+	m_projection_matrix = m_render_camera->ProjectionMatrix();
+
+	// View frustum culling is done in the object space of each model,
+	// using the planes of the combined Model->View->Projection matrix
+	const mat4f& view_projection_matrix = m_render_camera->ViewProjectionMatrix();
+	m_cull_stats.Reset();
+
+	// Nodes whose world bounds are outside the frustum are skipped as a whole, drawn nodes without bounds never
+	const uint32_t nodeCount = m_graph.GetCount();
+	const mat4f* worldMatrices = m_graph.GetWorldMatrices();
+	const aabb* worldBounds = m_graph.GetWorldBounds();
+	const uint32_t* renderHandles = m_graph.GetRenderHandles();
+	m_node_visibility.resize(nodeCount);
+	frustum_cull(m_render_camera->Frustum(), worldBounds, nodeCount, m_node_visibility.data());
+	for (uint32_t i = 0; i < nodeCount; i++)
+		m_node_visibility[i] = renderHandles[i] != SCENEGRAPH_NO_RENDER && (m_node_visibility[i] || worldBounds[i].empty());
+
+	// The level of detail of each visible node follows from its error projected to the screen
+	m_node_lod_chains.resize(nodeCount);
+	for (uint32_t i = 0; i < nodeCount; i++)
+		m_node_lod_chains[i] = renderHandles[i] != SCENEGRAPH_NO_RENDER ? m_models[renderHandles[i]].Object->GetLodChain() : LodChain();
+	m_node_lods.resize(nodeCount);
+	m_lod.SetView(m_render_camera->GetPosition(), m_projection_matrix, (float)m_window_height);
+	m_lod.Select(nodeCount, worldBounds, worldMatrices, m_node_lod_chains.data(), m_node_visibility.data(), m_node_lods.data());
+
+	// Rasterize the occluders to a CPU depth buffer for occlusion culling
+	{
+		PROFILE_ZONE("Occluders");
+		m_occlusion.BeginFrame();
+		for (uint32_t i = 0; i < nodeCount; i++)
+			if (m_node_visibility[i])
+				m_models[renderHandles[i]].Object->RasterizeOccluders(m_occlusion, view_projection_matrix * worldMatrices[i]);
+		m_occlusion.EndFrame();
+	}
+	m_cull_stats.OccluderTriangles = m_occlusion.GetStats().OccluderTriangles;
+	m_cull_stats.OcclusionMilliseconds = m_occlusion.GetStats().RasterMilliseconds;
+
+	// Queue the visible parts of the models with their transformations
+	m_render_queue.Clear();
+	for (uint32_t i = 0; i < nodeCount; i++)
+	{
+		if (m_node_visibility[i])
+			m_models[renderHandles[i]].Object->Enqueue(m_render_queue, CullView(view_projection_matrix * worldMatrices[i], &m_cull_stats, &m_occlusion),
+				m_render_queue.AddTransform(worldMatrices[i]), m_node_lods[i]);
+	}
+
+	// Write the matrices of all draws with one map, or else bind transformation_buffer to slot b0 of the VS
+	// and map it for every draw
+	const bool packed = m_constant_ring && WriteTransformConstants();
+	if (!packed)
+		m_device_state->SetVSConstantBuffer(0, m_transformation_buffer);
+
+	// Draw sorted by state, binding the matrices when the model changes
+	m_render_queue.Sort();
+	DeviceDispatcher dispatcher(m_device_state, m_pixel_shaders, [this, packed](uint32_t transform, const mat4f& model_to_world)
+	{
+		if (packed)
+			m_constant_ring->BindVS(*m_device_state, 0, m_transform_offsets[transform], sizeof(TransformationBuffer));
+		else
+			UpdateTransformationBuffer(model_to_world, m_view_matrix, m_projection_matrix);
+	});
+	m_render_queue.Submit(dispatcher);
+
+	// Draw the visible copies of the quad with one instanced draw
+	if (m_instanced_vertex_shaders && m_pixel_shaders)
 	{
-		std::cout << "fps " << (int)(1.0f / dt) << std::endl;
-//		printf("fps %i\n", (int)(1.0f / dt));
-		m_fps_cooldown = 2.0;
+		PROFILE_ZONE("Instances");
+		const UINT instances = m_quad_instance_buffer->Update(m_dxdevice_context, m_render_camera->Frustum(),
+			m_quad->GetBounds(), m_quad_instances.data(), m_quad_instances.size(), &m_cull_stats);
+		if (instances)
+		{
+			// The instanced vertex shader only reads the view and projection matrices
+			if (packed)
+				m_constant_ring->BindVS(*m_device_state, 0, m_transform_offsets.back(), sizeof(TransformationBuffer));
+			else
+				UpdateTransformationBuffer(mat4f_identity, m_view_matrix, m_projection_matrix);
+			shader_data* vertexShader = m_instanced_vertex_shaders->Get(0);
+			m_device_state->SetInputLayout(get_input_layout(vertexShader));
+			m_device_state->SetVertexShader(get_vertex_shader(vertexShader));
+			m_device_state->SetPixelShader(get_pixel_shader(m_pixel_shaders->Get(0)));
+			m_quad_instance_buffer->Bind(*m_device_state);
+			m_quad->RenderInstanced(*m_device_state, instances);
+		}
 	}
 }
 
+void OurTestScene::GetShaderFeatures(std::vector<uint32_t>& masks) const
+{
+	m_quad->GetShaderFeatures(masks);
+	m_sponza->GetShaderFeatures(masks);
+}
+
 //
-// Called every frame, after update
+// Same frame as Render, drawn by the CPU rasterizer without culling
 //
-void OurTestScene::Render()
+void OurTestScene::RenderSoftware(SoftwareRasterizer& rasterizer)
 {
-	// Bind transformation_buffer to slot b0 of the VS
-	m_dxdevice_context->VSSetConstantBuffers(0, 1, &m_transformation_buffer);
+	UpdateWorld();
+
+	TransformationBuffer transforms;
+	transforms.WorldToViewMatrix = m_render_camera->WorldToViewMatrix();
+	transforms.ProjectionMatrix = m_render_camera->ProjectionMatrix();
 
-	// Obtain the matrices needed for rendering from the camera
-	m_view_matrix = m_camera->WorldToViewMatrix();
-	m_projection_matrix = m_camera->ProjectionMatrix();
+	rasterizer.Clear({ 0.0f, 0.0f, 0.0f, 1.0f });
+
+	for (uint32_t i = 0; i < m_graph.GetCount(); i++)
+	{
+		if (m_graph.GetRenderHandles()[i] == SCENEGRAPH_NO_RENDER)
+			continue;
+		transforms.ModelToWorldMatrix = m_graph.GetWorldMatrices()[i];
+		m_models[m_graph.GetRenderHandles()[i]].Object->RenderSoftware(rasterizer, transforms);
+	}
 
-	// Load matrices + the Quad's transformation to the device and render it
-	UpdateTransformationBuffer(m_quad_transform, m_view_matrix, m_projection_matrix);
-	m_quad->Render();
+	for (const InstanceData& instance : m_quad_instances)
+	{
+		transforms.ModelToWorldMatrix = instance.ModelToWorld;
+		m_quad->RenderSoftware(rasterizer, transforms);
+	}
 
-	// Load matrices + Sponza's transformation to the device and render it
-	UpdateTransformationBuffer(m_sponza_transform, m_view_matrix, m_projection_matrix);
-	m_sponza->Render();
+	rasterizer.Flush();
 }
 
 void OurTestScene::Release()
 {
+	m_objects.Clear();
+	m_object_nodes.clear();
+	m_graph.Clear();
+	m_models.clear();
+	m_node_lod_chains.clear();
+	m_node_lods.clear();
 	SAFE_DELETE(m_quad);
 	SAFE_DELETE(m_sponza);
+	SAFE_DELETE(m_quad_instance_buffer);
+	SAFE_DELETE(m_constant_ring);
+	m_quad_instances.clear();
 	SAFE_DELETE(m_camera);
+	SAFE_DELETE(m_render_camera);
 
 	SAFE_RELEASE(m_transformation_buffer);
 	// + release other CBuffers
@@ -142,10 +389,60 @@ void OurTestScene::OnWindowResized(
 {
 	if (m_camera)
 		m_camera->SetAspect(float(new_width) / new_height);
+	if (m_render_camera)
+		m_render_camera->SetAspect(float(new_width) / new_height);
+
+	// Keep the occlusion buffer at a fixed width with the aspect of the window
+	if (new_width > 0)
+		m_occlusion.Resize(256, 256 * new_height / new_width);
 
 	Scene::OnWindowResized(new_width, new_height);
 }
 
+void OurTestScene::Pick(
+	int mouse_x,
+	int mouse_y)
+{
+	// Mouse location in normalized device coordinates
+	const float x = 2.0f * (mouse_x + 0.5f) / m_window_width - 1.0f;
+	const float y = 1.0f - 2.0f * (mouse_y + 0.5f) / m_window_height;
+
+	// Unproject to points on the near and far planes in world space, from the camera the frame
+	// was rendered with, since the simulation step this runs in has already moved m_camera
+	const mat4f& clipToWorld = m_render_camera->InverseViewProjectionMatrix();
+	const vec4f nearPoint = clipToWorld * vec4f(x, y, -1.0f, 1.0f);
+	const vec4f farPoint = clipToWorld * vec4f(x, y, 1.0f, 1.0f);
+	const vec3f origin = nearPoint.xyz() / nearPoint.w;
+	const vec3f direction = farPoint.xyz() / farPoint.w - origin;
+
+	// The ray spans [0,1] from the near to the far plane, and the parameter
+	// is the same in world and object space since the direction is not normalized.
+	// Objects are where they were last rendered, with the same UpdateWorld() as the camera
+	float closest = 1.0f;
+	const char* closestName = nullptr;
+	int closestPart = -1;
+	for (uint32_t i = 0; i < m_graph.GetCount(); i++)
+	{
+		if (m_graph.GetRenderHandles()[i] == SCENEGRAPH_NO_RENDER)
+			continue;
+		const SceneModel& model = m_models[m_graph.GetRenderHandles()[i]];
+		const mat4f worldToObject = m_graph.GetWorldMatrices()[i].inverse();
+		const linalg::ray objectRay((worldToObject * origin.xyz1()).xyz(), (worldToObject * direction.xyz0()).xyz());
+
+		int part;
+		if (model.Object->Raycast(objectRay, closest, part))
+		{
+			closestName = model.Name;
+			closestPart = part;
+		}
+	}
+
+	if (closestName)
+		printf("Picked %s, part %d, at distance %.2f\n", closestName, closestPart, closest * direction.length());
+	else
+		printf("Picked nothing\n");
+}
+
 void OurTestScene::InitTransformationBuffer()
 {
 	HRESULT hr;
@@ -167,9 +464,30 @@ void OurTestScene::UpdateTransformationBuffer(
 	// Map the resource buffer, obtain a pointer and then write our matrices to it
 	D3D11_MAPPED_SUBRESOURCE resource;
 	m_dxdevice_context->Map(m_transformation_buffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &resource);
-	TransformationBuffer* matrixBuffer = (TransformationBuffer*)resource.pData;
-	matrixBuffer->ModelToWorldMatrix = ModelToWorldMatrix;
-	matrixBuffer->WorldToViewMatrix = WorldToViewMatrix;
-	matrixBuffer->ProjectionMatrix = ProjectionMatrix;
+	FillTransformationBuffers(&ModelToWorldMatrix, 1, WorldToViewMatrix, ProjectionMatrix, (TransformationBuffer*)resource.pData);
 	m_dxdevice_context->Unmap(m_transformation_buffer, 0);
-}
\ No newline at end of file
+}
+
+//
+// Write the matrices of each transform of the render queue, and then those of
+// the instanced draws, to the constant ring with one map
+//
+bool OurTestScene::WriteTransformConstants()
+{
+	PROFILE_FUNCTION();
+	const uint32_t count = m_render_queue.GetTransformCount() + 1;
+	const size_t stride = ConstantAllocator::AlignSize(sizeof(TransformationBuffer));
+	if (!m_constant_ring->Begin(m_dxdevice_context, count * stride))
+		return false;
+
+	// The ring hands out consecutive ranges, so the buffers are filled in one batch after allocating them all
+	m_transform_offsets.resize(count);
+	TransformationBuffer* first = m_constant_ring->Allocate<TransformationBuffer>(m_transform_offsets[0]);
+	for (uint32_t i = 1; i < count; i++)
+		m_constant_ring->Allocate<TransformationBuffer>(m_transform_offsets[i]);
+	FillTransformationBuffers(m_render_queue.GetTransforms(), count - 1, m_view_matrix, m_projection_matrix, first, stride);
+	FillTransformationBuffers(&mat4f_identity, 1, m_view_matrix, m_projection_matrix,
+		(TransformationBuffer*)((char*)first + (count - 1) * stride));
+	m_constant_ring->End(m_dxdevice_context);
+	return true;
+}
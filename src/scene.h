@@ -13,6 +13,22 @@
 #include "Model.h"
 #include "Texture.h"
 #include "buffers.h"
+#include "devicestate.h"
+#include "instancebuffer.h"
+#include "constantring.h"
+#include "scenestore.h"
+#include "scenegraph.h"
+
+//! Rows and columns of the grid of instanced quads in the test scene
+#define SCENE_QUAD_INSTANCE_GRID 32
+
+//! Pixels the surface of a level of detail may be off by in the test scene
+#define SCENE_LOD_PIXEL_ERROR 1.0f
+
+//! Triangles the levels of detail of the test scene may add up to before detail is lowered, 0 for no limit
+#define SCENE_LOD_TRIANGLE_BUDGET 0
+
+class ShaderPermutations;
 
 /**
  * @brief Abstract class defining scene rendering and updating.
@@ -25,10 +41,11 @@ public:
 	 * @note These params are saved in the scene so they must be valid for as long as the scene is.
 	 * @param[in] dxdevice ID3D11Device that will be used in the scene.
 	 * @param[in] dxdevice_context ID3D11DeviceContext that will be used in the scene.
+	 * @param[in] device_state Redundant state filter of dxdevice_context, used to bind state when rendering.
 	 * @param[in] window_width Window hight for the scene.
 	 * @param[in] window_height Window width for the scene.
 	*/
-	Scene(ID3D11Device* dxdevice, ID3D11DeviceContext* dxdevice_context, int window_width, int window_height);
+	Scene(ID3D11Device* dxdevice, ID3D11DeviceContext* dxdevice_context, DeviceState* device_state, int window_width, int window_height);
 
 	/**
 	 * @brief Initialize all scene data.
@@ -41,16 +58,38 @@ public:
 	virtual void Release() = 0;
 
 	/**
-	 * @brief Update any relevant scene data.
-	 * @param[in] delta_time Seconds since the last call.
+	 * @brief Advance the simulation of the scene by one step.
+	 * @details Called zero or more times per frame with a fixed step, see FixedTimestep.
+	 * @param[in] delta_time Length of the step in seconds.
 	 * @param[in] input_handler Reference to the current InputHandler.
 	*/
 	virtual void Update(float delta_time, const InputHandler& input_handler) = 0;
+
+	/**
+	 * @brief Apply input that is not simulated, like looking around with the mouse.
+	 * @details Called once per frame before the simulation steps, so mouse movement is applied once
+	 * however many steps the frame has. The default implementation does nothing.
+	 * @param[in] input_handler Reference to the current InputHandler.
+	*/
+	virtual void HandleInput(const InputHandler& /*input_handler*/) { }
 	
 	/**
-	 * @brief Render the scene.
+	 * @brief Render the scene, interpolated between the last two simulation steps.
 	*/
 	virtual void Render() = 0;
+
+	/**
+	 * @brief Set the interpolation factor of the next Render().
+	 * @param[in] alpha 0 renders the state before the last Update(), 1 the state after it.
+	*/
+	void SetInterpolation(float alpha) noexcept { m_interpolation = alpha; }
+
+	/**
+	 * @brief Render the scene with the CPU rasterizer, e.g. for golden-image tests.
+	 * @details The default implementation only clears the image.
+	 * @param[in,out] rasterizer Rasterizer to render to, flushed before returning.
+	*/
+	virtual void RenderSoftware(SoftwareRasterizer& rasterizer);
 	
 
 	/**
@@ -60,11 +99,65 @@ public:
 	*/
 	virtual void OnWindowResized(int window_width,	int window_height);
 
+	/**
+	 * @brief Add the ShaderFeature masks the scene draws with, to compile their pixel shader variants.
+	 * @details Valid after Init(). The default implementation adds nothing.
+	 * @param[in,out] masks Masks to append to, duplicates are allowed.
+	*/
+	virtual void GetShaderFeatures(std::vector<uint32_t>& /*masks*/) const { }
+
+	/**
+	 * @brief Set the pixel shader variants the scene draws with, looked up by the feature mask of each packet.
+	 * @param[in] pixel_shaders Variants, must be valid for as long as the scene renders, or nullptr to draw
+	 * with the pixel shader bound by the caller.
+	*/
+	void SetPixelShaders(const ShaderPermutations* pixel_shaders) noexcept { m_pixel_shaders = pixel_shaders; }
+
+	/**
+	 * @brief Set the vertex shader of instanced draws, which reads the model-to-world matrix from InstanceBuffer::Layout.
+	 * @param[in] vertex_shaders Shader, must be valid for as long as the scene renders, or nullptr to skip instanced draws.
+	*/
+	void SetInstancedVertexShaders(const ShaderPermutations* vertex_shaders) noexcept { m_instanced_vertex_shaders = vertex_shaders; }
+
+	/**
+	 * @brief Get the camera of the scene, e.g. to drive it along a benchmark path.
+	 * @return The camera, or nullptr if the scene has none.
+	*/
+	virtual Camera* GetCamera() noexcept { return nullptr; }
+
+	/**
+	 * @brief Get the view frustum and occlusion culling statistics of the last rendered frame.
+	*/
+	const CullStats& GetCullStats() const noexcept { return m_cull_stats; }
+
+	/**
+	 * @brief Get the packet and state change counts of the last rendered frame.
+	*/
+	const RenderQueueStats& GetRenderQueueStats() const noexcept { return m_render_queue.GetStats(); }
+
+	/**
+	 * @brief Get the per-draw constants written with one map in the last rendered frame.
+	 * @return The counts, or nullptr if the scene maps a constant buffer per draw.
+	*/
+	virtual const ConstantAllocatorStats* GetConstantStats() const noexcept { return nullptr; }
+
+	/**
+	 * @brief Get the levels of detail selected in the last rendered frame.
+	 * @return The counts, or nullptr if the scene draws full detail only.
+	*/
+	virtual const LodStats* GetLodStats() const noexcept { return nullptr; }
+
 protected:
 	ID3D11Device*			m_dxdevice; //!< Graphics device, use for creating resources.
 	ID3D11DeviceContext*	m_dxdevice_context; //!< Graphics context, use for binding resources and draw commands.
+	DeviceState*			m_device_state; //!< Filters redundant state changes on m_dxdevice_context.
+	const ShaderPermutations* m_pixel_shaders = nullptr; //!< Pixel shader variants by feature mask, see SetPixelShaders().
+	const ShaderPermutations* m_instanced_vertex_shaders = nullptr; //!< Vertex shader of instanced draws, see SetInstancedVertexShaders().
 	int						m_window_width; //!< Current width of the window.
 	int						m_window_height; //!< Current height of the window.
+	CullStats				m_cull_stats; //!< Culling statistics, reset at the start of Render().
+	RenderQueue				m_render_queue; //!< Draw packets of the frame, filled and submitted by Render().
+	float					m_interpolation = 1.0f; //!< Interpolation factor between the last two simulation steps, see SetInterpolation().
 };
 
 /**
@@ -78,41 +171,73 @@ class OurTestScene : public Scene
 
 	// CBuffer for transformation matrices
 	ID3D11Buffer* m_transformation_buffer = nullptr;
+	// The transformation matrices of every draw of a frame, when ranges of a CBuffer can be bound
+	ConstantRing* m_constant_ring = nullptr;
+	std::vector<uint32_t> m_transform_offsets; // Offset in m_constant_ring of each transform of the render queue
 	// + other CBuffers
 
 	//
 	// Scene content
 	//
-	Camera* m_camera;
+	Camera* m_camera = nullptr;
+	Camera* m_render_camera = nullptr; // m_camera interpolated between the last two steps, kept so its matrices are reused while it stands still
 
 	Model* m_quad;
 	Model* m_sponza;
 
-	mat4f m_sponza_transform;
-	mat4f m_quad_transform;
+	// Moving objects of the scene, each placing the graph node its render handle indexes in m_object_nodes
+	SceneStore m_objects;
+	std::vector<NodeHandle> m_object_nodes;
+
+	// Transform hierarchy, each node drawn with the model its render handle indexes in m_models
+	struct SceneModel { const char* Name; Model* Object; };
+	SceneGraph m_graph;
+	std::vector<SceneModel> m_models;
+	std::vector<uint8_t> m_node_visibility;
+
+	// Level of detail of each node, kept between frames for the hysteresis
+	LodSelector m_lod;
+	std::vector<LodChain> m_node_lod_chains;
+	std::vector<uint8_t> m_node_lods;
+
+	// Copies of the quad, drawn with one instanced draw
+	std::vector<InstanceData> m_quad_instances;
+	InstanceBuffer* m_quad_instance_buffer = nullptr;
+
+	OcclusionCuller m_occlusion;
 
 	mat4f m_view_matrix;
 	mat4f m_projection_matrix;
 
+	// Simulation state before the last Update(), rendered interpolated with the current state
+	vec3f m_previous_camera_position;
+
 	// Misc
-	float m_angle = 0;			// A per-frame updated rotation angle (radians)...
-	float m_angular_velocity = fPI / 2;	// ...and its velocity (radians/sec)
+	float m_angular_velocity = fPI / 2;	// Rotation velocity of the quad (radians/sec)
 	float m_camera_velocity = 5.0f;	// Camera movement velocity in units/s
-	float m_fps_cooldown = 0;
+	float m_camera_sensitivity = 0.003f;	// Camera rotation in radians per pixel of mouse movement
+	bool m_pick_button_down = false;
 
 	void InitTransformationBuffer();
 
+	void Pick(int mouse_x, int mouse_y);
+
 	void UpdateTransformationBuffer(mat4f model_to_world_matrix, mat4f world_to_view_matrix, mat4f projection_matrix);
 
+	bool WriteTransformConstants();
+
+	void UpdateWorld();
+
 public:
 	/**
 	 * @brief Constructor
 	 * @param dxdevice Valid ID3D11Device.
 	 * @param dxdevice_context Valid ID3D11DeviceContext.
+	 * @param device_state Redundant state filter of dxdevice_context.
 	 * @param window_width Current window width.
 	 * @param window_height Current window height.
 	*/
-	OurTestScene(ID3D11Device* dxdevice, ID3D11DeviceContext* dxdevice_context,	int window_width, int window_height);
+	OurTestScene(ID3D11Device* dxdevice, ID3D11DeviceContext* dxdevice_context, DeviceState* device_state, int window_width, int window_height);
 
 	/**
 	 * @brief Initializes all resources held by the scene.
@@ -120,17 +245,33 @@ public:
 	void Init() override;
 
 	/**
-	 * @brief Updates all ojects in the scene
-	 * @param dt Time in seconds since last iteration
+	 * @brief Updates all ojects in the scene by one simulation step
+	 * @param dt Length of the step in seconds
 	 * @param input_handler Current InputHandler
 	*/
 	void Update(float dt, const InputHandler& input_handler) override;
 
 	/**
-	 * @brief Renders all objects in the scene
+	 * @brief Turns the camera while the right mouse button is held
+	 * @param input_handler Current InputHandler
+	*/
+	void HandleInput(const InputHandler& input_handler) override;
+
+	/**
+	 * @brief Renders all objects in the scene, interpolated between the last two steps
 	*/
 	void Render() override;
 
+	/**
+	 * @brief Renders all objects in the scene with the CPU rasterizer
+	*/
+	void RenderSoftware(SoftwareRasterizer& rasterizer) override;
+
+	/**
+	 * @brief Adds the shader feature masks of the models
+	*/
+	void GetShaderFeatures(std::vector<uint32_t>& masks) const override;
+
 	/**
 	 * @brief Releases all resources created by the scene.
 	*/
@@ -142,6 +283,21 @@ public:
 	 * @param window_height New height
 	*/
 	void OnWindowResized(int window_width, int window_height) override;
+
+	/**
+	 * @brief Get the camera of the scene.
+	*/
+	Camera* GetCamera() noexcept override { return m_camera; }
+
+	/**
+	 * @brief Get the transformation matrices written with one map in the last frame, nullptr without constant buffer ranges.
+	*/
+	const ConstantAllocatorStats* GetConstantStats() const noexcept override { return m_constant_ring ? &m_constant_ring->GetStats() : nullptr; }
+
+	/**
+	 * @brief Get the levels of detail selected for the nodes in the last frame.
+	*/
+	const LodStats* GetLodStats() const noexcept override { return &m_lod.GetStats(); }
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,255 @@
+//
+// Scene graph
+//
+// A node's subtree is the range [index, index + subtree size), so a new
+// child goes right after the last node of its parent's subtree, and removing
+// a subtree erases one range. Both shift the nodes after them and their parent
+// indices, which is free when building depth first since every node is then
+// appended at the end.
+//
+// Update() scans the dirty flags from the front; at a dirty node it
+// recomputes the node's whole subtree and continues after it, so each node is
+// recomputed at most once and clean subtrees cost one byte read per node.
+//
+
+#include <atomic>
+#include <cstring>
+#include "scenegraph.h"
+#include "jobsystem.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	template<typename T>
+	void InsertAt(std::vector<T>& nodes, uint32_t index, const T& value)
+	{
+		nodes.insert(nodes.begin() + index, value);
+	}
+
+	template<typename T>
+	void EraseRange(std::vector<T>& nodes, uint32_t begin, uint32_t end)
+	{
+		nodes.erase(nodes.begin() + begin, nodes.begin() + end);
+	}
+}
+
+NodeHandle SceneGraph::AddNode(NodeHandle parent, const mat4f& local, uint32_t render_handle, const aabb& bounds)
+{
+	const uint32_t count = GetCount();
+	uint32_t parentIndex = SCENEGRAPH_INVALID_INDEX;
+	uint32_t index = count;
+	uint32_t depth = 0;
+	if (parent.Slot != SCENEGRAPH_INVALID_INDEX)
+	{
+		parentIndex = Find(parent);
+		if (parentIndex == SCENEGRAPH_INVALID_INDEX)
+			return NodeHandle();
+		index = parentIndex + m_subtree_sizes[parentIndex];
+		depth = m_depths[parentIndex] + 1;
+		for (uint32_t ancestor = parentIndex; ancestor != SCENEGRAPH_INVALID_INDEX; ancestor = m_parents[ancestor])
+			m_subtree_sizes[ancestor]++;
+	}
+
+	uint32_t slot;
+	if (m_free_slots.empty())
+	{
+		slot = (uint32_t)m_indices.size();
+		m_indices.push_back(SCENEGRAPH_INVALID_INDEX);
+		m_generations.push_back(0);
+	}
+	else
+	{
+		slot = m_free_slots.back();
+		m_free_slots.pop_back();
+	}
+
+	// Nodes after the new one move up by one, and so do the indices referring to them
+	for (uint32_t i = index; i < count; i++)
+	{
+		if (m_parents[i] != SCENEGRAPH_INVALID_INDEX && m_parents[i] >= index)
+			m_parents[i]++;
+	}
+	InsertAt(m_parents, index, parentIndex);
+	InsertAt(m_subtree_sizes, index, 1u);
+	InsertAt(m_depths, index, depth);
+	InsertAt(m_local_matrices, index, local);
+	InsertAt(m_world_matrices, index, local);
+	InsertAt(m_bounds, index, bounds);
+	InsertAt(m_world_bounds, index, aabb());
+	InsertAt(m_render_handles, index, render_handle);
+	InsertAt(m_dirty, index, (uint8_t)1);
+	InsertAt(m_owners, index, slot);
+	for (uint32_t i = index; i <= count; i++)
+		m_indices[m_owners[i]] = i;
+
+	m_levels_valid = false;
+	return { slot, m_generations[slot] };
+}
+
+bool SceneGraph::RemoveNode(NodeHandle node)
+{
+	const uint32_t begin = Find(node);
+	if (begin == SCENEGRAPH_INVALID_INDEX)
+		return false;
+	const uint32_t size = m_subtree_sizes[begin];
+	const uint32_t end = begin + size;
+
+	for (uint32_t ancestor = m_parents[begin]; ancestor != SCENEGRAPH_INVALID_INDEX; ancestor = m_parents[ancestor])
+		m_subtree_sizes[ancestor] -= size;
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const uint32_t slot = m_owners[i];
+		m_indices[slot] = SCENEGRAPH_INVALID_INDEX;
+		m_generations[slot]++;
+		m_free_slots.push_back(slot);
+	}
+
+	EraseRange(m_parents, begin, end);
+	EraseRange(m_subtree_sizes, begin, end);
+	EraseRange(m_depths, begin, end);
+	EraseRange(m_local_matrices, begin, end);
+	EraseRange(m_world_matrices, begin, end);
+	EraseRange(m_bounds, begin, end);
+	EraseRange(m_world_bounds, begin, end);
+	EraseRange(m_render_handles, begin, end);
+	EraseRange(m_dirty, begin, end);
+	EraseRange(m_owners, begin, end);
+
+	// Nodes after the subtree move down, and no remaining node has a parent inside it
+	for (uint32_t i = begin; i < GetCount(); i++)
+	{
+		if (m_parents[i] != SCENEGRAPH_INVALID_INDEX && m_parents[i] >= end)
+			m_parents[i] -= size;
+		m_indices[m_owners[i]] = i;
+	}
+
+	m_levels_valid = false;
+	return true;
+}
+
+void SceneGraph::Clear() noexcept
+{
+	for (uint32_t slot : m_owners)
+	{
+		m_indices[slot] = SCENEGRAPH_INVALID_INDEX;
+		m_generations[slot]++;
+		m_free_slots.push_back(slot);
+	}
+	m_parents.clear();
+	m_subtree_sizes.clear();
+	m_depths.clear();
+	m_local_matrices.clear();
+	m_world_matrices.clear();
+	m_bounds.clear();
+	m_world_bounds.clear();
+	m_render_handles.clear();
+	m_dirty.clear();
+	m_owners.clear();
+	m_levels_valid = false;
+}
+
+uint32_t SceneGraph::Find(NodeHandle node) const noexcept
+{
+	if (node.Slot >= m_indices.size() || m_generations[node.Slot] != node.Generation)
+		return SCENEGRAPH_INVALID_INDEX;
+	return m_indices[node.Slot];
+}
+
+void SceneGraph::SetLocal(NodeHandle node, const mat4f& local) noexcept
+{
+	const uint32_t index = Find(node);
+	if (index == SCENEGRAPH_INVALID_INDEX || memcmp(&m_local_matrices[index], &local, sizeof(mat4f)) == 0)
+		return;
+	m_local_matrices[index] = local;
+	m_dirty[index] = 1;
+}
+
+uint32_t SceneGraph::Update()
+{
+	PROFILE_FUNCTION();
+	const uint32_t count = GetCount();
+	uint32_t updated = 0;
+	for (uint32_t i = 0; i < count;)
+	{
+		if (!m_dirty[i])
+		{
+			i++;
+			continue;
+		}
+		const uint32_t end = i + m_subtree_sizes[i];
+		for (uint32_t node = i; node < end; node++)
+		{
+			UpdateNode(node);
+			m_dirty[node] = 0;
+		}
+		updated += end - i;
+		i = end;
+	}
+	return updated;
+}
+
+uint32_t SceneGraph::UpdateParallel()
+{
+	PROFILE_FUNCTION();
+	if (!m_levels_valid)
+		BuildLevels();
+	m_changed.resize(GetCount());
+
+	// A node changes if it is dirty or its parent, one level up and finished, changed
+	std::atomic<uint32_t> updated{ 0 };
+	for (size_t level = 0; level + 1 < m_level_starts.size(); level++)
+	{
+		JobSystem::ParallelFor(m_level_starts[level], m_level_starts[level + 1], SCENEGRAPH_UPDATE_GRAIN, [this, &updated](size_t begin, size_t end)
+		{
+			uint32_t changedNodes = 0;
+			for (size_t i = begin; i < end; i++)
+			{
+				const uint32_t node = m_level_nodes[i];
+				const uint32_t parent = m_parents[node];
+				const bool changed = m_dirty[node] || (parent != SCENEGRAPH_INVALID_INDEX && m_changed[parent]);
+				m_changed[node] = changed;
+				if (!changed)
+					continue;
+				UpdateNode(node);
+				m_dirty[node] = 0;
+				changedNodes++;
+			}
+			updated += changedNodes;
+		});
+	}
+	return updated;
+}
+
+void SceneGraph::UpdateNode(uint32_t index) noexcept
+{
+	const uint32_t parent = m_parents[index];
+	mat4f& world = m_world_matrices[index];
+	world = parent == SCENEGRAPH_INVALID_INDEX ? m_local_matrices[index] : m_world_matrices[parent] * m_local_matrices[index];
+	m_world_bounds[index] = m_bounds[index].empty() ? aabb() : transform(world, m_bounds[index]);
+}
+
+//
+// Sort the node indices by depth with a counting sort, which keeps them in
+// depth-first order within a level
+//
+void SceneGraph::BuildLevels()
+{
+	const uint32_t count = GetCount();
+	uint32_t levels = 0;
+	for (uint32_t i = 0; i < count; i++)
+		levels = m_depths[i] + 1 > levels ? m_depths[i] + 1 : levels;
+
+	m_level_starts.assign(levels + 1, 0);
+	for (uint32_t i = 0; i < count; i++)
+		m_level_starts[m_depths[i] + 1]++;
+	for (uint32_t level = 0; level < levels; level++)
+		m_level_starts[level + 1] += m_level_starts[level];
+
+	std::vector<uint32_t> next(m_level_starts.begin(), m_level_starts.end() - 1);
+	m_level_nodes.resize(count);
+	for (uint32_t i = 0; i < count; i++)
+		m_level_nodes[next[m_depths[i]]++] = i;
+	m_levels_valid = true;
+}
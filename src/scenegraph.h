@@ -0,0 +1,153 @@
+/**
+ * @file scenegraph.h
+ * @brief Transform hierarchy stored in depth-first order
+ * @details Every node has a local transform relative to its parent, and its world transform is the
+ * parent's world transform times its local one. The nodes are kept in flat arrays in depth-first order:
+ * a parent comes before its children, and a node's subtree is the range of nodes that starts at it and
+ * is as long as the subtree. World transforms are therefore updated in one pass from the front, with
+ * the parent's result always computed and usually still in the cache.
+ *
+ * SetLocal() marks a node dirty, and Update() recomputes only the subtrees under dirty nodes. Where
+ * much of the graph changes, UpdateParallel() goes level by level instead, the nodes of a level split
+ * over the job system. Nodes are referred to by NodeHandle, which stays valid while nodes are added
+ * and removed elsewhere.
+*/
+
+#pragma once
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <cstdint>
+#include <vector>
+#include "vec/bounds.h"
+#include "vec/mat.h"
+
+//! Index of no node, the parent of a root and the result of SceneGraph::Find() for a dead handle
+#define SCENEGRAPH_INVALID_INDEX UINT32_MAX
+
+//! Render handle of a node that draws nothing
+#define SCENEGRAPH_NO_RENDER UINT32_MAX
+
+//! Nodes per job of SceneGraph::UpdateParallel()
+#define SCENEGRAPH_UPDATE_GRAIN 2048
+
+/**
+ * @brief Stable reference to a node of a SceneGraph.
+*/
+struct NodeHandle
+{
+	uint32_t Slot = SCENEGRAPH_INVALID_INDEX; //!< Slot of the node
+	uint32_t Generation = 0; //!< Generation of the slot when the node was added
+
+	bool operator==(const NodeHandle& other) const noexcept { return Slot == other.Slot && Generation == other.Generation; }
+	bool operator!=(const NodeHandle& other) const noexcept { return !(*this == other); }
+};
+
+/**
+ * @brief Hierarchy of transforms in depth-first order.
+ * @details Not thread safe, apart from the jobs UpdateParallel() starts itself.
+*/
+class SceneGraph
+{
+public:
+	/**
+	 * @brief Add a node as the last child of a parent.
+	 * @details Appending is cheapest when the parent's subtree is at the end of the arrays, e.g. when a
+	 * hierarchy is built depth first; otherwise the nodes after the new one move up by one.
+	 * @param[in] parent Parent node, or a default NodeHandle for a root.
+	 * @param[in] local Transform relative to the parent.
+	 * @param[in] render_handle What to draw at the node, its meaning is up to the owner, or SCENEGRAPH_NO_RENDER.
+	 * @param[in] bounds Object space bounds of what is drawn, an empty box has empty world bounds.
+	 * @return Handle of the node, or a default NodeHandle if the parent is not alive.
+	*/
+	NodeHandle AddNode(NodeHandle parent, const linalg::mat4f& local, uint32_t render_handle = SCENEGRAPH_NO_RENDER,
+		const linalg::aabb& bounds = linalg::aabb());
+
+	/**
+	 * @brief Remove a node and its subtree.
+	 * @return False if the handle does not refer to a live node.
+	*/
+	bool RemoveNode(NodeHandle node);
+
+	/**
+	 * @brief Remove all nodes, invalidating all handles.
+	*/
+	void Clear() noexcept;
+
+	/**
+	 * @brief True if the handle refers to a node that has not been removed.
+	*/
+	bool IsAlive(NodeHandle node) const noexcept { return Find(node) != SCENEGRAPH_INVALID_INDEX; }
+
+	/**
+	 * @brief Get the index of a node in the arrays, valid until a node is added or removed.
+	 * @return The index, or SCENEGRAPH_INVALID_INDEX if the handle does not refer to a live node.
+	*/
+	uint32_t Find(NodeHandle node) const noexcept;
+
+	/**
+	 * @brief Set the transform of a node relative to its parent.
+	 * @details Marks the node dirty unless the transform is unchanged.
+	*/
+	void SetLocal(NodeHandle node, const linalg::mat4f& local) noexcept;
+
+	/**
+	 * @brief Recompute the world transforms and bounds of the subtrees of dirty nodes.
+	 * @return Number of nodes recomputed.
+	*/
+	uint32_t Update();
+
+	/**
+	 * @brief Recompute the same nodes as Update(), one level at a time with the job system.
+	 * @details Visits every node, so it pays off when much of the graph is dirty.
+	 * @return Number of nodes recomputed.
+	*/
+	uint32_t UpdateParallel();
+
+	/**
+	 * @brief Get the number of nodes, the length of every array.
+	*/
+	uint32_t GetCount() const noexcept { return (uint32_t)m_owners.size(); }
+
+	/**
+	 * @brief Get the handle of the node at an index.
+	*/
+	NodeHandle GetHandle(uint32_t index) const noexcept { return { m_owners[index], m_generations[m_owners[index]] }; }
+
+	const uint32_t* GetParents() const noexcept { return m_parents.data(); } //!< Index of the parent of each node, SCENEGRAPH_INVALID_INDEX for roots
+	const uint32_t* GetSubtreeSizes() const noexcept { return m_subtree_sizes.data(); } //!< Nodes in the subtree of each node, itself included
+	const uint32_t* GetDepths() const noexcept { return m_depths.data(); } //!< 0 for roots
+	const linalg::mat4f* GetLocalMatrices() const noexcept { return m_local_matrices.data(); } //!< Transforms relative to the parents
+	const linalg::mat4f* GetWorldMatrices() const noexcept { return m_world_matrices.data(); } //!< World transforms as of the last update
+	const linalg::aabb* GetWorldBounds() const noexcept { return m_world_bounds.data(); } //!< World space bounds as of the last update
+	const uint32_t* GetRenderHandles() const noexcept { return m_render_handles.data(); } //!< What each node draws
+
+private:
+	void UpdateNode(uint32_t index) noexcept;
+	void BuildLevels();
+
+	// Nodes in depth-first order
+	std::vector<uint32_t> m_parents;
+	std::vector<uint32_t> m_subtree_sizes;
+	std::vector<uint32_t> m_depths;
+	std::vector<linalg::mat4f> m_local_matrices;
+	std::vector<linalg::mat4f> m_world_matrices;
+	std::vector<linalg::aabb> m_bounds;
+	std::vector<linalg::aabb> m_world_bounds;
+	std::vector<uint32_t> m_render_handles;
+	std::vector<uint8_t> m_dirty;
+	std::vector<uint32_t> m_owners; // Slot of each node
+
+	// Slots, indexed by NodeHandle::Slot
+	std::vector<uint32_t> m_indices; // Index of the node, SCENEGRAPH_INVALID_INDEX when free
+	std::vector<uint32_t> m_generations;
+	std::vector<uint32_t> m_free_slots;
+
+	// Node indices sorted by depth, and where each depth starts, for UpdateParallel()
+	std::vector<uint32_t> m_level_nodes;
+	std::vector<uint32_t> m_level_starts;
+	std::vector<uint8_t> m_changed;
+	bool m_levels_valid = false;
+};
+
+#endif
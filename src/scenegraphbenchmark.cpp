@@ -0,0 +1,294 @@
+//
+// Scene graph self test and update benchmark
+//
+// Local transforms are small rotations and translations, so that the world
+// transforms of thousand node chains stay well within float range. The
+// serial and parallel updates compute every node with the same product of
+// the same matrices, so their results must be identical bit for bit.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "scenegraphbenchmark.h"
+#include "scenegraph.h"
+#include "jobsystem.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	const char* const Shapes[] = { "deep", "wide", "tree" };
+	const unsigned ChainLength = 1000;
+	const unsigned Branching = 4;
+
+	mat4f LocalTransform(float angle)
+	{
+		return mat4f::translation(1.0f, 0.0f, 0.0f) * mat4f::rotation(angle, 0.0f, 1.0f, 0.0f);
+	}
+
+	// World transforms recomputed from scratch, parents coming first
+	std::vector<mat4f> ReferenceWorld(const SceneGraph& graph)
+	{
+		std::vector<mat4f> world(graph.GetCount());
+		for (uint32_t i = 0; i < graph.GetCount(); i++)
+		{
+			const uint32_t parent = graph.GetParents()[i];
+			world[i] = parent == SCENEGRAPH_INVALID_INDEX ? graph.GetLocalMatrices()[i] : world[parent] * graph.GetLocalMatrices()[i];
+		}
+		return world;
+	}
+
+	bool MatchesReference(const SceneGraph& graph)
+	{
+		const std::vector<mat4f> world = ReferenceWorld(graph);
+		return world.empty() || memcmp(world.data(), graph.GetWorldMatrices(), world.size() * sizeof(mat4f)) == 0;
+	}
+
+	// Every subtree is the contiguous range after its root
+	bool CheckOrder(const SceneGraph& graph)
+	{
+		for (uint32_t i = 0; i < graph.GetCount(); i++)
+		{
+			const uint32_t parent = graph.GetParents()[i];
+			if (parent != SCENEGRAPH_INVALID_INDEX && (parent >= i || i >= parent + graph.GetSubtreeSizes()[parent] ||
+				graph.GetDepths()[i] != graph.GetDepths()[parent] + 1))
+				return false;
+			if (graph.Find(graph.GetHandle(i)) != i)
+				return false;
+		}
+		return true;
+	}
+
+	bool CheckStructure(std::string& failure)
+	{
+		// a has the children b and d, b has the child c; e is added to b after d exists
+		SceneGraph graph;
+		const NodeHandle a = graph.AddNode(NodeHandle(), LocalTransform(0.1f), 7);
+		const NodeHandle b = graph.AddNode(a, LocalTransform(0.2f));
+		const NodeHandle c = graph.AddNode(b, LocalTransform(0.3f));
+		const NodeHandle d = graph.AddNode(a, LocalTransform(0.4f));
+		const NodeHandle e = graph.AddNode(b, LocalTransform(0.5f));
+		if (graph.Find(a) != 0 || graph.Find(b) != 1 || graph.Find(c) != 2 || graph.Find(e) != 3 || graph.Find(d) != 4)
+			return FailCheck(failure, "structure: nodes are not in depth-first order");
+		if (graph.GetSubtreeSizes()[0] != 5 || graph.GetSubtreeSizes()[1] != 3 || graph.GetParents()[4] != 0 || !CheckOrder(graph))
+			return FailCheck(failure, "structure: wrong subtree sizes or parents after inserting in the middle");
+		if (graph.GetRenderHandles()[0] != 7 || graph.GetRenderHandles()[1] != SCENEGRAPH_NO_RENDER)
+			return FailCheck(failure, "structure: wrong render handles");
+
+		if (graph.Update() != 5 || !MatchesReference(graph))
+			return FailCheck(failure, "update: first update did not compute every node");
+		graph.SetLocal(b, LocalTransform(0.6f));
+		if (graph.Update() != 3 || !MatchesReference(graph))
+			return FailCheck(failure, "update: a dirty node did not update exactly its subtree");
+		graph.SetLocal(b, LocalTransform(0.6f));
+		if (graph.Update() != 0)
+			return FailCheck(failure, "update: an unchanged transform made a node dirty");
+
+		// Removing b takes c and e with it
+		if (!graph.RemoveNode(b) || graph.IsAlive(b) || graph.IsAlive(c) || graph.IsAlive(e) || !graph.IsAlive(d))
+			return FailCheck(failure, "remove: wrong nodes removed");
+		if (graph.GetCount() != 2 || graph.Find(d) != 1 || graph.GetParents()[1] != 0 || graph.GetSubtreeSizes()[0] != 2 || !CheckOrder(graph))
+			return FailCheck(failure, "remove: wrong structure after removing a subtree");
+		if (graph.RemoveNode(c) || graph.AddNode(e, mat4f_identity).Slot != SCENEGRAPH_INVALID_INDEX)
+			return FailCheck(failure, "remove: a removed node was still accepted");
+
+		// Reused slots reject the handles of the removed nodes
+		const NodeHandle f = graph.AddNode(d, LocalTransform(0.7f));
+		if (graph.IsAlive(b) || graph.IsAlive(c) || graph.IsAlive(e) || !graph.IsAlive(f) || graph.Find(f) != 2)
+			return FailCheck(failure, "remove: a reused slot accepted an old handle");
+		graph.Update();
+		if (!MatchesReference(graph))
+			return FailCheck(failure, "remove: wrong world transforms after removing and adding");
+
+		graph.Clear();
+		if (graph.GetCount() != 0 || graph.IsAlive(a) || graph.IsAlive(f))
+			return FailCheck(failure, "clear: nodes still alive");
+		return true;
+	}
+
+	// Add nodes depth first, so that every node is appended
+	void Build(SceneGraph& graph, const char* shape, unsigned nodes, std::vector<NodeHandle>& handles)
+	{
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> angle(-0.1f, 0.1f);
+		handles.clear();
+		if (!strcmp(shape, "deep"))
+		{
+			for (unsigned i = 0; i < nodes; i++)
+				handles.push_back(graph.AddNode(i % ChainLength ? handles.back() : NodeHandle(), LocalTransform(angle(random))));
+		}
+		else if (!strcmp(shape, "wide"))
+		{
+			for (unsigned i = 0; i < nodes; i++)
+				handles.push_back(graph.AddNode(i ? handles[0] : NodeHandle(), LocalTransform(angle(random))));
+		}
+		else
+		{
+			// Preorder of a complete tree: a node's children follow its subtree's first node
+			struct Builder
+			{
+				static void Add(SceneGraph& graph, NodeHandle parent, unsigned depth, unsigned& remaining, std::vector<NodeHandle>& handles,
+					std::mt19937& random, std::uniform_real_distribution<float>& angle)
+				{
+					if (!remaining)
+						return;
+					remaining--;
+					handles.push_back(graph.AddNode(parent, LocalTransform(angle(random))));
+					const NodeHandle node = handles.back();
+					if (depth == 0)
+						return;
+					for (unsigned child = 0; child < Branching; child++)
+						Add(graph, node, depth - 1, remaining, handles, random, angle);
+				}
+			};
+			unsigned depth = 0;
+			for (unsigned total = 1, level = 1; total < nodes; depth++)
+			{
+				level *= Branching;
+				total += level;
+			}
+			unsigned remaining = nodes;
+			while (remaining)
+				Builder::Add(graph, NodeHandle(), depth, remaining, handles, random, angle);
+		}
+	}
+
+	// Make every root dirty, which makes every node change
+	void TouchRoots(SceneGraph& graph, float angle)
+	{
+		for (uint32_t i = 0; i < graph.GetCount(); i += graph.GetSubtreeSizes()[i])
+			graph.SetLocal(graph.GetHandle(i), LocalTransform(angle));
+	}
+}
+
+bool RunSceneGraphTest(std::string& failure)
+{
+	if (!CheckStructure(failure))
+		return false;
+
+	// Removing and adding in the middle of a larger tree keeps it consistent
+	SceneGraph graph;
+	std::vector<NodeHandle> handles;
+	Build(graph, "tree", 2000, handles);
+	std::mt19937 random(2);
+	for (int round = 0; round < 50; round++)
+	{
+		const NodeHandle node = handles[random() % handles.size()];
+		if (graph.IsAlive(node))
+		{
+			if (round % 2)
+				graph.RemoveNode(node);
+			else
+				handles.push_back(graph.AddNode(node, LocalTransform(0.01f * round)));
+		}
+	}
+	graph.Update();
+	if (!CheckOrder(graph) || !MatchesReference(graph))
+		return FailCheck(failure, "edits: inconsistent after removing and adding in the middle");
+	return true;
+}
+
+SceneGraphTiming RunSceneGraphTimings(const char* shape, unsigned nodes, unsigned frames)
+{
+	SceneGraphTiming timing;
+	timing.Shape = shape;
+	timing.Nodes = nodes;
+	timing.Frames = frames;
+
+	SceneGraph serial, parallel;
+	std::vector<NodeHandle> handles, parallelHandles;
+	Build(serial, shape, nodes, handles);
+	Build(parallel, shape, nodes, parallelHandles);
+	serial.Update();
+	parallel.UpdateParallel();
+	for (uint32_t i = 0; i < serial.GetCount(); i++)
+		timing.Levels = serial.GetDepths()[i] + 1 > timing.Levels ? serial.GetDepths()[i] + 1 : timing.Levels;
+
+	std::vector<double> full, partial, parallelTimes;
+	std::mt19937 random(3);
+	const unsigned changes = nodes * SCENEGRAPHBENCHMARK_PARTIAL_PERCENT / 100 + 1;
+	uint64_t partialNodes = 0;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const float angle = 0.001f * (frame + 1);
+		TouchRoots(serial, angle);
+		int64_t start = Profiler::Now();
+		serial.Update();
+		full.push_back(MillisecondsSince(start));
+
+		TouchRoots(parallel, angle);
+		start = Profiler::Now();
+		parallel.UpdateParallel();
+		parallelTimes.push_back(MillisecondsSince(start));
+
+		for (unsigned change = 0; change < changes; change++)
+			serial.SetLocal(handles[random() % handles.size()], LocalTransform(angle + 0.5f));
+		start = Profiler::Now();
+		partialNodes += serial.Update();
+		partial.push_back(MillisecondsSince(start));
+	}
+
+	// Bring the parallel graph to the same transforms as the serial one, updated partially
+	for (uint32_t i = 0; i < serial.GetCount(); i++)
+		parallel.SetLocal(parallel.GetHandle(i), serial.GetLocalMatrices()[i]);
+	parallel.UpdateParallel();
+	timing.Matched = serial.GetCount() == parallel.GetCount() && MatchesReference(serial) &&
+		memcmp(serial.GetWorldMatrices(), parallel.GetWorldMatrices(), serial.GetCount() * sizeof(mat4f)) == 0;
+
+	timing.PartialNodes = frames ? (double)partialNodes / frames : 0.0;
+	timing.FullMilliseconds = BenchmarkSummary::Compute(full);
+	timing.PartialMilliseconds = BenchmarkSummary::Compute(partial);
+	timing.ParallelMilliseconds = BenchmarkSummary::Compute(parallelTimes);
+	return timing;
+}
+
+bool RunSceneGraphBenchmark(unsigned nodes, unsigned frames, const std::string& report_filename)
+{
+	std::string testFailure;
+	const bool passed = RunSceneGraphTest(testFailure);
+	printf("Scene graph self test: %s\n", passed ? "passed" : testFailure.c_str());
+
+	JobSystem::Initialize();
+	const unsigned workers = JobSystem::GetWorkerCount();
+	printf("Scene graph, %u nodes, %u frames, %u workers...\n", nodes, frames, workers);
+	printf("\t%6s %8s %12s %12s %14s %12s\n", "Shape", "Levels", "Full ms", "Partial ms", "Partial nodes", "Parallel ms");
+	std::vector<SceneGraphTiming> timings;
+	bool matched = true;
+	for (const char* shape : Shapes)
+	{
+		timings.push_back(RunSceneGraphTimings(shape, nodes, frames));
+		const SceneGraphTiming& timing = timings.back();
+		printf("\t%6s %8u %12.3f %12.3f %14.0f %12.3f%s\n", shape, timing.Levels, timing.FullMilliseconds.P50, timing.PartialMilliseconds.P50,
+			timing.PartialNodes, timing.ParallelMilliseconds.P50, timing.Matched ? "" : "  MISMATCH");
+		matched = matched && timing.Matched;
+	}
+	JobSystem::Shutdown();
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(testFailure);
+		json.Key("nodes").Value(nodes);
+		json.Key("frames").Value(frames);
+		json.Key("workers").Value(workers);
+		json.Key("partial_percent").Value(SCENEGRAPHBENCHMARK_PARTIAL_PERCENT);
+		json.Key("shapes").BeginArray();
+		for (const SceneGraphTiming& timing : timings)
+		{
+			json.BeginObject();
+			json.Key("shape").Value(timing.Shape);
+			json.Key("levels").Value(timing.Levels);
+			json.Key("matched").Value(timing.Matched);
+			json.Key("full_p50_ms").Value(timing.FullMilliseconds.P50);
+			json.Key("partial_p50_ms").Value(timing.PartialMilliseconds.P50);
+			json.Key("partial_nodes").Value(timing.PartialNodes);
+			json.Key("parallel_p50_ms").Value(timing.ParallelMilliseconds.P50);
+			json.EndObject();
+		}
+		json.EndArray();
+	});
+	return passed && matched && written;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file scenegraphbenchmark.h
+ * @brief Self test of the scene graph and cost of updating deep and wide hierarchies
+ * @details The test checks the depth-first order, subtree sizes and handles as nodes are added and
+ * removed in the middle of the arrays, and that only dirty subtrees are recomputed. The benchmark times
+ * a full update, an update of a few dirty nodes and a full level-by-level parallel update of deep chains,
+ * of one root with many children and of a balanced tree, and checks the serial and parallel updates
+ * agree.
+*/
+
+#pragma once
+#ifndef SCENEGRAPHBENCHMARK_H
+#define SCENEGRAPHBENCHMARK_H
+
+#include <string>
+#include "benchmark.h"
+
+//! Nodes of each hierarchy of -graphbenchmark
+#define SCENEGRAPHBENCHMARK_DEFAULT_NODES 100000
+
+//! Frames per update kind of -graphbenchmark
+#define SCENEGRAPHBENCHMARK_DEFAULT_FRAMES 100
+
+//! Nodes whose local transform changes in a frame of the partial update, in percent
+#define SCENEGRAPHBENCHMARK_PARTIAL_PERCENT 1
+
+/**
+ * @brief Update times of one hierarchy.
+*/
+struct SceneGraphTiming
+{
+	const char* Shape = ""; //!< "deep", "wide" or "tree"
+	unsigned Nodes = 0; //!< Nodes in the hierarchy
+	unsigned Levels = 0; //!< Depth of the deepest node plus one
+	unsigned Frames = 0; //!< Frames per update kind
+	double PartialNodes = 0.0; //!< Average nodes recomputed by a partial update
+	bool Matched = false; //!< True if the serial and parallel updates computed the same world transforms
+	BenchmarkSummary FullMilliseconds; //!< Update() with every root dirty
+	BenchmarkSummary PartialMilliseconds; //!< Update() with a few random nodes dirty
+	BenchmarkSummary ParallelMilliseconds; //!< UpdateParallel() with every root dirty
+};
+
+/**
+ * @brief Run the self test of SceneGraph.
+*/
+bool RunSceneGraphTest(std::string& failure);
+
+/**
+ * @brief Time the updates of one hierarchy.
+ * @details Expects the job system to be started, or runs the parallel update on the calling thread.
+ * @param[in] shape "deep" for chains a thousand nodes long, "wide" for one root with all other nodes
+ * as children, "tree" for a tree with four children per node.
+*/
+SceneGraphTiming RunSceneGraphTimings(const char* shape, unsigned nodes, unsigned frames);
+
+/**
+ * @brief Run the self test and time the updates of every shape.
+ * @details Starts the job system for the parallel updates and leaves it stopped.
+ * @return True if the test passed, every shape matched and the report was written.
+*/
+bool RunSceneGraphBenchmark(unsigned nodes, unsigned frames, const std::string& report_filename);
+
+#endif
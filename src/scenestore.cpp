@@ -0,0 +1,215 @@
+//
+// Scene store
+//
+// The world matrix is built directly as T*R*S: the columns of the rotation
+// (Rodrigues' formula, as mat4f::rotation() builds it) scaled by the object
+// scale, and the position. Angles are kept within a turn by moving the
+// current and previous angle together, so interpolating between them stays
+// continuous.
+//
+
+#include <cmath>
+#include "scenestore.h"
+#include "jobsystem.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	// Move the last element of an array to an index, shortening the array by one
+	template<typename T>
+	void MoveLast(std::vector<T>& components, uint32_t to)
+	{
+		components[to] = components.back();
+		components.pop_back();
+	}
+}
+
+ObjectHandle SceneStore::Create(const ObjectDesc& desc)
+{
+	uint32_t slot;
+	if (m_free_slots.empty())
+	{
+		slot = (uint32_t)m_indices.size();
+		m_indices.push_back(SCENESTORE_INVALID_INDEX);
+		m_generations.push_back(0);
+	}
+	else
+	{
+		slot = m_free_slots.back();
+		m_free_slots.pop_back();
+	}
+
+	const uint32_t index = GetCount();
+	m_indices[slot] = index;
+	m_owners.push_back(slot);
+	m_positions.push_back(desc.Position);
+	m_previous_positions.push_back(desc.Position);
+	m_velocities.push_back(desc.Velocity);
+	m_scales.push_back(desc.Scale);
+	m_rotation_axes.push_back(desc.RotationAxis);
+	m_angles.push_back(desc.RotationAngle);
+	m_previous_angles.push_back(desc.RotationAngle);
+	m_angular_velocities.push_back(desc.AngularVelocity);
+	m_bounds.push_back(desc.Bounds);
+	m_world_matrices.push_back(mat4f_identity);
+	m_world_bounds.push_back(aabb());
+	m_render_handles.push_back(desc.RenderHandle);
+	UpdateWorld(index, index + 1, 1.0f);
+
+	return { slot, m_generations[slot] };
+}
+
+bool SceneStore::Destroy(ObjectHandle handle)
+{
+	const uint32_t index = Find(handle);
+	if (index == SCENESTORE_INVALID_INDEX)
+		return false;
+
+	// The last object takes the place of the removed one
+	const uint32_t last = GetCount() - 1;
+	m_indices[m_owners[last]] = index;
+	MoveLast(m_owners, index);
+	MoveLast(m_positions, index);
+	MoveLast(m_previous_positions, index);
+	MoveLast(m_velocities, index);
+	MoveLast(m_scales, index);
+	MoveLast(m_rotation_axes, index);
+	MoveLast(m_angles, index);
+	MoveLast(m_previous_angles, index);
+	MoveLast(m_angular_velocities, index);
+	MoveLast(m_bounds, index);
+	MoveLast(m_world_matrices, index);
+	MoveLast(m_world_bounds, index);
+	MoveLast(m_render_handles, index);
+
+	m_indices[handle.Slot] = SCENESTORE_INVALID_INDEX;
+	m_generations[handle.Slot]++;
+	m_free_slots.push_back(handle.Slot);
+	return true;
+}
+
+void SceneStore::Clear() noexcept
+{
+	for (uint32_t slot : m_owners)
+	{
+		m_indices[slot] = SCENESTORE_INVALID_INDEX;
+		m_generations[slot]++;
+		m_free_slots.push_back(slot);
+	}
+	m_owners.clear();
+	m_positions.clear();
+	m_previous_positions.clear();
+	m_velocities.clear();
+	m_scales.clear();
+	m_rotation_axes.clear();
+	m_angles.clear();
+	m_previous_angles.clear();
+	m_angular_velocities.clear();
+	m_bounds.clear();
+	m_world_matrices.clear();
+	m_world_bounds.clear();
+	m_render_handles.clear();
+}
+
+uint32_t SceneStore::Find(ObjectHandle handle) const noexcept
+{
+	if (handle.Slot >= m_indices.size() || m_generations[handle.Slot] != handle.Generation)
+		return SCENESTORE_INVALID_INDEX;
+	return m_indices[handle.Slot];
+}
+
+void SceneStore::SetPosition(ObjectHandle handle, const vec3f& position) noexcept
+{
+	const uint32_t index = Find(handle);
+	if (index == SCENESTORE_INVALID_INDEX)
+		return;
+	m_positions[index] = position;
+	m_previous_positions[index] = position;
+}
+
+void SceneStore::SetVelocity(ObjectHandle handle, const vec3f& velocity) noexcept
+{
+	const uint32_t index = Find(handle);
+	if (index != SCENESTORE_INVALID_INDEX)
+		m_velocities[index] = velocity;
+}
+
+void SceneStore::SetAngularVelocity(ObjectHandle handle, float angular_velocity) noexcept
+{
+	const uint32_t index = Find(handle);
+	if (index != SCENESTORE_INVALID_INDEX)
+		m_angular_velocities[index] = angular_velocity;
+}
+
+void SceneStore::Simulate(float delta_time)
+{
+	PROFILE_FUNCTION();
+	JobSystem::ParallelFor(0, GetCount(), SCENESTORE_UPDATE_GRAIN, [this, delta_time](size_t begin, size_t end)
+	{
+		const float Turn = 2.0f * fPI;
+		for (size_t i = begin; i < end; i++)
+		{
+			m_previous_positions[i] = m_positions[i];
+			m_positions[i] += m_velocities[i] * delta_time;
+
+			float angle = m_angles[i] + m_angular_velocities[i] * delta_time;
+			float previous = m_angles[i];
+			if (std::fabs(angle) > Turn)
+			{
+				const float turns = std::floor(angle / Turn);
+				angle -= turns * Turn;
+				previous -= turns * Turn;
+			}
+			m_previous_angles[i] = previous;
+			m_angles[i] = angle;
+		}
+	});
+}
+
+void SceneStore::UpdateWorld(float alpha)
+{
+	PROFILE_FUNCTION();
+	JobSystem::ParallelFor(0, GetCount(), SCENESTORE_UPDATE_GRAIN, [this, alpha](size_t begin, size_t end)
+	{
+		UpdateWorld((uint32_t)begin, (uint32_t)end, alpha);
+	});
+}
+
+void SceneStore::UpdateWorld(uint32_t begin, uint32_t end, float alpha) noexcept
+{
+	for (uint32_t i = begin; i < end; i++)
+	{
+		const vec3f position = lerp(m_previous_positions[i], m_positions[i], alpha);
+		const float angle = lerp(m_previous_angles[i], m_angles[i], alpha);
+		const float c = std::cos(angle), s = std::sin(angle), t = 1.0f - c;
+		const vec3f& u = m_rotation_axes[i];
+		const vec3f& scale = m_scales[i];
+
+		// Columns of R*S
+		const vec3f x = vec3f(t * u.x * u.x + c, t * u.x * u.y + s * u.z, t * u.x * u.z - s * u.y) * scale.x;
+		const vec3f y = vec3f(t * u.x * u.y - s * u.z, t * u.y * u.y + c, t * u.y * u.z + s * u.x) * scale.y;
+		const vec3f z = vec3f(t * u.x * u.z + s * u.y, t * u.y * u.z - s * u.x, t * u.z * u.z + c) * scale.z;
+		mat4f& m = m_world_matrices[i];
+		m.col[0] = vec4f(x.x, x.y, x.z, 0.0f);
+		m.col[1] = vec4f(y.x, y.y, y.z, 0.0f);
+		m.col[2] = vec4f(z.x, z.y, z.z, 0.0f);
+		m.col[3] = vec4f(position.x, position.y, position.z, 1.0f);
+
+		// As linalg::transform(), with the columns at hand
+		const aabb& bounds = m_bounds[i];
+		if (bounds.empty())
+		{
+			m_world_bounds[i] = aabb();
+			continue;
+		}
+		const vec3f center = bounds.center(), extents = bounds.extents();
+		const vec3f worldCenter = position + x * center.x + y * center.y + z * center.z;
+		const vec3f worldExtents(
+			std::fabs(x.x) * extents.x + std::fabs(y.x) * extents.y + std::fabs(z.x) * extents.z,
+			std::fabs(x.y) * extents.x + std::fabs(y.y) * extents.y + std::fabs(z.y) * extents.z,
+			std::fabs(x.z) * extents.x + std::fabs(y.z) * extents.y + std::fabs(z.z) * extents.z);
+		m_world_bounds[i] = aabb(worldCenter - worldExtents, worldCenter + worldExtents);
+	}
+}
@@ -0,0 +1,160 @@
+/**
+ * @file scenestore.h
+ * @brief Data-oriented storage of the objects of a scene
+ * @details Every component of the objects is kept in its own contiguous array, indexed alike, so a pass
+ * over one component reads only that component: the simulation reads positions and angles, culling reads
+ * world bounds and drawing reads world matrices and render handles. Removing an object moves the last
+ * object into its place, keeping the arrays dense.
+ *
+ * Objects are referred to by ObjectHandle, a slot and the generation of the slot. The slot maps to the
+ * current index of the object in the arrays, so handles stay valid while other objects are moved, and
+ * a destroyed object's handle fails IsAlive() even after the slot is reused.
+ *
+ * Simulate() and UpdateWorld() split the objects over the job system.
+*/
+
+#pragma once
+#ifndef SCENESTORE_H
+#define SCENESTORE_H
+
+#include <cstdint>
+#include <vector>
+#include "vec/bounds.h"
+#include "vec/mat.h"
+
+//! Objects per job of Simulate() and UpdateWorld()
+#define SCENESTORE_UPDATE_GRAIN 4096
+
+//! Index of no object, returned by SceneStore::Find()
+#define SCENESTORE_INVALID_INDEX UINT32_MAX
+
+/**
+ * @brief Stable reference to an object of a SceneStore.
+*/
+struct ObjectHandle
+{
+	uint32_t Slot = SCENESTORE_INVALID_INDEX; //!< Slot of the object
+	uint32_t Generation = 0; //!< Generation of the slot when the object was created
+
+	bool operator==(const ObjectHandle& other) const noexcept { return Slot == other.Slot && Generation == other.Generation; }
+	bool operator!=(const ObjectHandle& other) const noexcept { return !(*this == other); }
+};
+
+/**
+ * @brief Initial state of an object.
+*/
+struct ObjectDesc
+{
+	linalg::vec3f Position = { 0.0f, 0.0f, 0.0f }; //!< Position in world space
+	linalg::vec3f Velocity = { 0.0f, 0.0f, 0.0f }; //!< Units per second
+	linalg::vec3f Scale = { 1.0f, 1.0f, 1.0f }; //!< Scale along the object axes, applied before the rotation
+	linalg::vec3f RotationAxis = { 0.0f, 1.0f, 0.0f }; //!< Axis of rotation, normalized
+	float RotationAngle = 0.0f; //!< Radians around RotationAxis, as mat4f::rotation()
+	float AngularVelocity = 0.0f; //!< Radians per second around RotationAxis
+	linalg::aabb Bounds; //!< Object space bounds, an empty box has empty world bounds
+	uint32_t RenderHandle = 0; //!< What to draw the object with, its meaning is up to the owner of the store
+};
+
+/**
+ * @brief Objects of a scene as arrays of components.
+ * @details Not thread safe, apart from the jobs Simulate() and UpdateWorld() start themselves.
+*/
+class SceneStore
+{
+public:
+	/**
+	 * @brief Add an object.
+	 * @details Its world matrix and bounds are those of its initial state until the next UpdateWorld().
+	 * @return Handle of the object.
+	*/
+	ObjectHandle Create(const ObjectDesc& desc);
+
+	/**
+	 * @brief Remove an object, moving the last object into its place.
+	 * @return False if the handle does not refer to a live object.
+	*/
+	bool Destroy(ObjectHandle handle);
+
+	/**
+	 * @brief Remove all objects, invalidating all handles.
+	*/
+	void Clear() noexcept;
+
+	/**
+	 * @brief True if the handle refers to an object that has not been destroyed.
+	*/
+	bool IsAlive(ObjectHandle handle) const noexcept { return Find(handle) != SCENESTORE_INVALID_INDEX; }
+
+	/**
+	 * @brief Get the index of an object in the component arrays, valid until an object is destroyed.
+	 * @return The index, or SCENESTORE_INVALID_INDEX if the handle does not refer to a live object.
+	*/
+	uint32_t Find(ObjectHandle handle) const noexcept;
+
+	/**
+	 * @brief Get the number of objects, the length of every component array.
+	*/
+	uint32_t GetCount() const noexcept { return (uint32_t)m_owners.size(); }
+
+	/**
+	 * @brief Get the handle of the object at an index of the component arrays.
+	*/
+	ObjectHandle GetHandle(uint32_t index) const noexcept { return { m_owners[index], m_generations[m_owners[index]] }; }
+
+	/**
+	 * @brief Move an object, without interpolating from its previous position.
+	*/
+	void SetPosition(ObjectHandle handle, const linalg::vec3f& position) noexcept;
+
+	/**
+	 * @brief Set the velocity of an object.
+	*/
+	void SetVelocity(ObjectHandle handle, const linalg::vec3f& velocity) noexcept;
+
+	/**
+	 * @brief Set the angular velocity of an object.
+	*/
+	void SetAngularVelocity(ObjectHandle handle, float angular_velocity) noexcept;
+
+	/**
+	 * @brief Advance the positions and angles of all objects by one simulation step, in parallel.
+	 * @details The state before the step is kept for UpdateWorld() to interpolate from.
+	 * @param[in] delta_time Length of the step in seconds.
+	*/
+	void Simulate(float delta_time);
+
+	/**
+	 * @brief Compute the world matrices and world bounds of all objects, in parallel.
+	 * @param[in] alpha 0 for the state before the last Simulate(), 1 for the state after it.
+	*/
+	void UpdateWorld(float alpha);
+
+	const linalg::mat4f* GetWorldMatrices() const noexcept { return m_world_matrices.data(); } //!< Model-to-world matrices, T*R*S
+	const linalg::aabb* GetWorldBounds() const noexcept { return m_world_bounds.data(); } //!< World space bounds
+	const uint32_t* GetRenderHandles() const noexcept { return m_render_handles.data(); } //!< ObjectDesc::RenderHandle of each object
+
+private:
+	void UpdateWorld(uint32_t begin, uint32_t end, float alpha) noexcept;
+
+	// Components, indexed alike
+	std::vector<linalg::vec3f> m_positions;
+	std::vector<linalg::vec3f> m_previous_positions;
+	std::vector<linalg::vec3f> m_velocities;
+	std::vector<linalg::vec3f> m_scales;
+	std::vector<linalg::vec3f> m_rotation_axes;
+	std::vector<float> m_angles;
+	std::vector<float> m_previous_angles;
+	std::vector<float> m_angular_velocities;
+	std::vector<linalg::aabb> m_bounds;
+	std::vector<linalg::mat4f> m_world_matrices;
+	std::vector<linalg::aabb> m_world_bounds;
+	std::vector<uint32_t> m_render_handles;
+	std::vector<uint32_t> m_owners; // Slot of each object
+
+	// Slots, indexed by ObjectHandle::Slot
+	std::vector<uint32_t> m_indices; // Index of the object in the components, SCENESTORE_INVALID_INDEX when free
+	std::vector<uint32_t> m_generations;
+	std::vector<uint32_t> m_free_slots;
+};
+
+#endif
@@ -0,0 +1,211 @@
+//
+// Scene store self test and update benchmark
+//
+// A frame of the benchmark is one simulation step and one world update
+// interpolated halfway, as a frame of the scene with one step has. Both runs
+// start from the same field, so their results must be identical bit for bit:
+// every object is computed by the same code whichever thread runs it.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include "scenestorebenchmark.h"
+#include "scenestore.h"
+#include "jobsystem.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	const float Timestep = 1.0f / 60.0f;
+
+	float MaxDifference(const mat4f& a, const mat4f& b)
+	{
+		float difference = 0.0f;
+		for (int i = 0; i < 4; i++)
+		{
+			const vec4f d = a.col[i] - b.col[i];
+			difference = std::fmax(difference, std::fmax(std::fmax(std::fabs(d.x), std::fabs(d.y)), std::fmax(std::fabs(d.z), std::fabs(d.w))));
+		}
+		return difference;
+	}
+
+	bool CheckHandles(std::string& failure)
+	{
+		SceneStore store;
+		ObjectDesc desc;
+		desc.RenderHandle = 1;
+		const ObjectHandle a = store.Create(desc);
+		desc.RenderHandle = 2;
+		const ObjectHandle b = store.Create(desc);
+		desc.RenderHandle = 3;
+		const ObjectHandle c = store.Create(desc);
+
+		// Destroying b moves c, the last object, into its place
+		if (!store.Destroy(b) || store.IsAlive(b) || !store.IsAlive(a) || !store.IsAlive(c))
+			return FailCheck(failure, "handles: destroy changed the wrong objects");
+		if (store.GetCount() != 2 || store.Find(c) != 1 || store.GetRenderHandles()[1] != 3 || store.GetHandle(1) != c)
+			return FailCheck(failure, "handles: the last object did not move into the hole");
+		if (store.Destroy(b))
+			return FailCheck(failure, "handles: destroyed an object twice");
+
+		// The slot of b is reused with a new generation, and the old handle stays dead
+		desc.RenderHandle = 4;
+		const ObjectHandle d = store.Create(desc);
+		if (d.Slot != b.Slot || d.Generation == b.Generation || store.IsAlive(b) || !store.IsAlive(d))
+			return FailCheck(failure, "handles: a reused slot accepted the old handle");
+		if (store.GetRenderHandles()[store.Find(d)] != 4 || store.GetRenderHandles()[store.Find(a)] != 1)
+			return FailCheck(failure, "handles: components do not follow their objects");
+
+		// Destroying the last object leaves the others in place
+		if (!store.Destroy(d) || store.Find(a) != 0 || store.Find(c) != 1)
+			return FailCheck(failure, "handles: destroying the last object moved others");
+
+		store.Clear();
+		if (store.GetCount() != 0 || store.IsAlive(a) || store.IsAlive(c))
+			return FailCheck(failure, "handles: clear left objects alive");
+		const ObjectHandle e = store.Create(desc);
+		if (store.IsAlive(a) || store.IsAlive(c) || !store.IsAlive(e) || store.IsAlive(ObjectHandle()))
+			return FailCheck(failure, "handles: a cleared handle came back to life");
+		return true;
+	}
+
+	bool CheckWorld(std::string& failure)
+	{
+		SceneStore store;
+		ObjectDesc desc;
+		desc.Position = { 1.0f, -2.0f, 3.0f };
+		desc.Velocity = { 6.0f, 0.0f, -12.0f };
+		desc.Scale = { 0.5f, 2.0f, 1.5f };
+		desc.RotationAxis = vec3f(1.0f, 2.0f, -2.0f) / 3.0f;
+		desc.RotationAngle = 0.7f;
+		desc.AngularVelocity = 60.0f;
+		desc.Bounds = aabb(vec3f(-1.0f, -1.0f, -1.0f), vec3f(1.0f, 1.0f, 1.0f));
+		const ObjectHandle object = store.Create(desc);
+		desc.Bounds = aabb();
+		store.Create(desc);
+
+		const mat4f expected = mat4f::translation(desc.Position) * mat4f::rotation(desc.RotationAngle, desc.RotationAxis) * mat4f::scaling(desc.Scale);
+		if (MaxDifference(store.GetWorldMatrices()[0], expected) > 1e-5f)
+			return FailCheck(failure, "world: matrix of a new object is not T*R*S");
+		if (store.GetWorldBounds()[0].empty() || !store.GetWorldBounds()[1].empty())
+			return FailCheck(failure, "world: wrong bounds of a new object");
+
+		// Halfway through a step is halfway between the two states, even when the angle wraps around
+		store.Simulate(Timestep);
+		store.UpdateWorld(0.5f);
+		const vec3f position = desc.Position + desc.Velocity * (0.5f * Timestep);
+		const float angle = desc.RotationAngle + desc.AngularVelocity * (0.5f * Timestep);
+		const mat4f halfway = mat4f::translation(position) * mat4f::rotation(angle, desc.RotationAxis) * mat4f::scaling(desc.Scale);
+		if (MaxDifference(store.GetWorldMatrices()[0], halfway) > 1e-4f)
+			return FailCheck(failure, "world: interpolated matrix does not match");
+		for (int step = 0; step < 100; step++)
+			store.Simulate(Timestep);
+		store.UpdateWorld(0.5f);
+		const float steps = 100.5f;
+		const mat4f wrapped = mat4f::translation(desc.Position + desc.Velocity * (steps * Timestep)) *
+			mat4f::rotation(desc.RotationAngle + desc.AngularVelocity * (steps * Timestep), desc.RotationAxis) * mat4f::scaling(desc.Scale);
+		if (MaxDifference(store.GetWorldMatrices()[0], wrapped) > 1e-3f)
+			return FailCheck(failure, "world: interpolation jumps after the angle wrapped around");
+
+		store.SetPosition(object, { 0.0f, 0.0f, 0.0f });
+		store.UpdateWorld(0.0f);
+		if (!(store.GetWorldMatrices()[0].col[3].xyz() == vec3f(0.0f, 0.0f, 0.0f)))
+			return FailCheck(failure, "world: a moved object interpolates from its old position");
+		return true;
+	}
+
+	void CreateField(SceneStore& store, unsigned objects)
+	{
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+		for (unsigned i = 0; i < objects; i++)
+		{
+			ObjectDesc desc;
+			desc.Position = { position(random), position(random), position(random) };
+			desc.Velocity = { unit(random), unit(random), unit(random) };
+			desc.Scale = { scale(random), scale(random), scale(random) };
+			desc.RotationAxis = vec3f(unit(random), unit(random), unit(random) + 2.0f).normalize();
+			desc.RotationAngle = fPI * unit(random);
+			desc.AngularVelocity = fPI * unit(random);
+			desc.Bounds = aabb(vec3f(-0.5f, -0.5f, -0.5f), vec3f(0.5f, 0.5f, 0.5f));
+			desc.RenderHandle = i;
+			store.Create(desc);
+		}
+	}
+
+	BenchmarkSummary TimeFrames(SceneStore& store, unsigned frames)
+	{
+		std::vector<double> times;
+		for (unsigned frame = 0; frame < frames; frame++)
+		{
+			const int64_t start = Profiler::Now();
+			store.Simulate(Timestep);
+			store.UpdateWorld(0.5f);
+			times.push_back(MillisecondsSince(start));
+		}
+		return BenchmarkSummary::Compute(times);
+	}
+}
+
+bool RunSceneStoreTest(std::string& failure)
+{
+	return CheckHandles(failure) && CheckWorld(failure);
+}
+
+SceneStoreTiming RunSceneStoreTimings(unsigned objects, unsigned frames)
+{
+	SceneStoreTiming timing;
+	timing.Objects = objects;
+	timing.Frames = frames;
+
+	SceneStore serial, parallel;
+	CreateField(serial, objects);
+	CreateField(parallel, objects);
+
+	timing.SerialMilliseconds = TimeFrames(serial, frames);
+	JobSystem::Initialize();
+	timing.Workers = JobSystem::GetWorkerCount();
+	timing.ParallelMilliseconds = TimeFrames(parallel, frames);
+	JobSystem::Shutdown();
+
+	timing.Matched = memcmp(serial.GetWorldMatrices(), parallel.GetWorldMatrices(), objects * sizeof(mat4f)) == 0 &&
+		memcmp(serial.GetWorldBounds(), parallel.GetWorldBounds(), objects * sizeof(aabb)) == 0;
+	return timing;
+}
+
+bool RunSceneStoreBenchmark(unsigned objects, unsigned frames, const std::string& report_filename)
+{
+	std::string testFailure;
+	const bool passed = RunSceneStoreTest(testFailure);
+	printf("Scene store self test: %s\n", passed ? "passed" : testFailure.c_str());
+
+	printf("Scene store, %u objects, %u frames...\n", objects, frames);
+	const SceneStoreTiming timing = RunSceneStoreTimings(objects, frames);
+	const double speedup = timing.ParallelMilliseconds.P50 > 0.0 ? timing.SerialMilliseconds.P50 / timing.ParallelMilliseconds.P50 : 0.0;
+	printf("\tNo workers: %.3f ms per frame (p95 %.3f ms)\n", timing.SerialMilliseconds.P50, timing.SerialMilliseconds.P95);
+	printf("\t%u workers: %.3f ms per frame (p95 %.3f ms), %.1fx%s\n", timing.Workers, timing.ParallelMilliseconds.P50,
+		timing.ParallelMilliseconds.P95, speedup, timing.Matched ? "" : "  MISMATCH");
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(testFailure);
+		json.Key("objects").Value(timing.Objects);
+		json.Key("frames").Value(timing.Frames);
+		json.Key("workers").Value(timing.Workers);
+		json.Key("matched").Value(timing.Matched);
+		json.Key("serial_p50_ms").Value(timing.SerialMilliseconds.P50);
+		json.Key("serial_p95_ms").Value(timing.SerialMilliseconds.P95);
+		json.Key("parallel_p50_ms").Value(timing.ParallelMilliseconds.P50);
+		json.Key("parallel_p95_ms").Value(timing.ParallelMilliseconds.P95);
+		json.Key("speedup").Value(speedup);
+	});
+	return passed && timing.Matched && written;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file scenestorebenchmark.h
+ * @brief Self test of the scene store and cost of updating many dynamic objects
+ * @details The test checks that handles stay valid while other objects move in the component arrays,
+ * that destroyed and cleared handles are rejected even after their slots are reused, and that world
+ * matrices match the T*R*S product of mat4f. The benchmark simulates and updates the world matrices
+ * and bounds of a field of moving, spinning objects every frame, without and with job system workers,
+ * and checks both give the same results.
+*/
+
+#pragma once
+#ifndef SCENESTOREBENCHMARK_H
+#define SCENESTOREBENCHMARK_H
+
+#include <string>
+#include "benchmark.h"
+
+//! Objects in the field of -scenebenchmark
+#define SCENESTOREBENCHMARK_DEFAULT_OBJECTS 100000
+
+//! Frames per run of -scenebenchmark
+#define SCENESTOREBENCHMARK_DEFAULT_FRAMES 100
+
+/**
+ * @brief Update times of one field.
+*/
+struct SceneStoreTiming
+{
+	unsigned Objects = 0; //!< Objects in the field
+	unsigned Frames = 0; //!< Frames per run
+	unsigned Workers = 0; //!< Worker threads of the parallel run
+	bool Matched = false; //!< True if both runs computed the same world matrices and bounds
+	BenchmarkSummary SerialMilliseconds; //!< Simulate() and UpdateWorld() on the calling thread alone
+	BenchmarkSummary ParallelMilliseconds; //!< Simulate() and UpdateWorld() with workers
+};
+
+/**
+ * @brief Run the self test of SceneStore.
+*/
+bool RunSceneStoreTest(std::string& failure);
+
+/**
+ * @brief Time the update of a field of objects, first without workers and then with one less than the hardware threads.
+ * @details Expects the job system to be stopped, and leaves it stopped.
+*/
+SceneStoreTiming RunSceneStoreTimings(unsigned objects, unsigned frames);
+
+/**
+ * @brief Run the self test and time the serial and parallel runs.
+ * @return True if the test passed, both runs matched and the report was written.
+*/
+bool RunSceneStoreBenchmark(unsigned objects, unsigned frames, const std::string& report_filename);
+
+#endif
@@ -29,9 +29,19 @@ typedef struct shader_data
 	};
 	const SCHAR* file_path;
 	const char* entrypoint;
+	const char* defines;
+	const D3D_SHADER_MACRO* macros;
 	FILETIME last_write;
 } shader_data;
 
+static shader_cache activeCache = { 0 };
+
+void set_shader_cache(const shader_cache* pCache)
+{
+	shader_cache none = { 0 };
+	activeCache = pCache ? *pCache : none;
+}
+
 static BOOL load_file(const SCHAR* pPath, char** pData, uint32_t* pSize, FILETIME* pLastWrite)
 {
 	BOOL result = { 0 };
@@ -75,18 +85,52 @@ error:
 	return FALSE;
 }
 
-static ID3DBlob* compile_shader(SHADER_TYPE type, const char* pCode, uint32_t codeSize, const char* pEntrypoint)
+static ID3DBlob* load_cached_shader(const shader_compile_desc* pDesc)
+{
+	ID3DBlob* shader = NULL;
+	uint32_t size = 0;
+	void* bytecode = activeCache.load(activeCache.pUser, pDesc, &size);
+	if (bytecode == NULL)
+		return NULL;
+
+	if (SUCCEEDED(D3DCreateBlob(size, &shader)))
+		memcpy(shader->lpVtbl->GetBufferPointer(shader), bytecode, size);
+	free(bytecode);
+	return shader;
+}
+
+static ID3DBlob* compile_shader(const shader_data* pShader, const char* pCode, uint32_t codeSize)
 {
 	ID3DBlob* shader;
 	ID3DBlob* error;
+	LARGE_INTEGER start, end, frequency;
+	shader_compile_desc desc = { 0 };
+	const SHADER_TYPE type = pShader->type;
+
+	desc.pCode = pCode;
+	desc.codeSize = codeSize;
+	desc.pEntrypoint = pShader->entrypoint;
+	desc.pProfile = type == SHADER_VERTEX ? "vs_5_0" : "ps_5_0";
+	desc.pDefines = pShader->defines;
+	desc.flags = D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_IEEE_STRICTNESS;
+	desc.compilerVersion = D3D_COMPILER_VERSION;
+
+	if (activeCache.load)
+	{
+		shader = load_cached_shader(&desc);
+		if (shader)
+			return shader;
+	}
 
-	D3DCompile(pCode, codeSize, NULL, NULL, NULL, pEntrypoint,
-		type == SHADER_VERTEX ? "vs_5_0" : "ps_5_0",
-		D3DCOMPILE_ENABLE_STRICTNESS | D3DCOMPILE_IEEE_STRICTNESS,
+	QueryPerformanceCounter(&start);
+	D3DCompile(pCode, codeSize, NULL, pShader->macros, NULL, desc.pEntrypoint,
+		desc.pProfile,
+		desc.flags,
 		0,
 		&shader,
 		&error
 	);
+	QueryPerformanceCounter(&end);
 	if (error)
 	{
 		const char* shaderType = type == SHADER_VERTEX ? "ERROR! Vertex shader." : "ERROR! Pixel shader";
@@ -96,6 +140,12 @@ static ID3DBlob* compile_shader(SHADER_TYPE type, const char* pCode, uint32_t co
 		error->lpVtbl->Release(error);
 		return NULL;
 	}
+	if (activeCache.store && shader)
+	{
+		QueryPerformanceFrequency(&frequency);
+		activeCache.store(activeCache.pUser, &desc, shader->lpVtbl->GetBufferPointer(shader), (uint32_t)shader->lpVtbl->GetBufferSize(shader),
+			(double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart);
+	}
 	return shader;
 }
 
@@ -111,60 +161,99 @@ static inline BOOL create_vertex_Shader(ID3D11Device* pDevice, ID3DBlob* pCode,
 	return FAILED(hr) ? FALSE : TRUE;
 }
 
+// One allocation holds the shader_data and copies of its strings
+static shader_data* allocate_shader_data(const SCHAR* pPath, const char* pEntrypoint, const shader_define* pDefines, uint32_t defineCount)
+{
+	size_t pathSize = strlen(pPath) * sizeof(SCHAR) + 1;
+	size_t entrypointSize = strlen(pEntrypoint) + 1;
+	size_t macrosSize = (defineCount + 1) * sizeof(D3D_SHADER_MACRO);
+	size_t definesSize = 1;
+	for (uint32_t i = 0; i < defineCount; i++)
+		definesSize += strlen(pDefines[i].pName) + strlen(pDefines[i].pValue) + 2;
+
+	// The names and values are copied once for the macros and once as "NAME=VALUE" lines
+	shader_data* data = (shader_data*)calloc(1, sizeof(shader_data) + macrosSize + pathSize + entrypointSize + 2 * definesSize);
+	if (data == NULL)
+		return NULL;
+
+	char* cursor = (char*)data + sizeof(shader_data);
+	D3D_SHADER_MACRO* macros = (D3D_SHADER_MACRO*)cursor;
+	cursor += macrosSize;
+
+	memcpy(cursor, pPath, pathSize);
+	data->file_path = (const SCHAR*)cursor;
+	cursor += pathSize;
+
+	memcpy(cursor, pEntrypoint, entrypointSize);
+	data->entrypoint = cursor;
+	cursor += entrypointSize;
+
+	for (uint32_t i = 0; i < defineCount; i++)
+	{
+		size_t nameSize = strlen(pDefines[i].pName) + 1;
+		size_t valueSize = strlen(pDefines[i].pValue) + 1;
+		memcpy(cursor, pDefines[i].pName, nameSize);
+		macros[i].Name = cursor;
+		cursor += nameSize;
+		memcpy(cursor, pDefines[i].pValue, valueSize);
+		macros[i].Definition = cursor;
+		cursor += valueSize;
+	}
+	data->macros = macros;
+
+	data->defines = cursor;
+	for (uint32_t i = 0; i < defineCount; i++)
+	{
+		size_t nameLength = strlen(pDefines[i].pName);
+		size_t valueLength = strlen(pDefines[i].pValue);
+		memcpy(cursor, pDefines[i].pName, nameLength);
+		cursor += nameLength;
+		*cursor++ = '=';
+		memcpy(cursor, pDefines[i].pValue, valueLength);
+		cursor += valueLength;
+		*cursor++ = '\n';
+	}
+	*cursor = '\0';
+	return data;
+}
+
 SHADER_RESULT create_shader(ID3D11Device* pDevice, const SCHAR* pPath, const char* pEntrypoint, SHADER_TYPE type, const D3D11_INPUT_ELEMENT_DESC* pLayout, uint32_t layoutcount, shader_data** pShader)
+{
+	return create_shader_variant(pDevice, pPath, pEntrypoint, type, pLayout, layoutcount, NULL, 0, pShader);
+}
+
+SHADER_RESULT create_shader_variant(ID3D11Device* pDevice, const SCHAR* pPath, const char* pEntrypoint, SHADER_TYPE type, const D3D11_INPUT_ELEMENT_DESC* pLayout, uint32_t layoutcount, const shader_define* pDefines, uint32_t defineCount, shader_data** pShader)
 {
 	SHADER_RESULT result = { 0 };
 	FILETIME lastWrite = { 0 };
 	uint32_t fileSize = { 0 };
 	char* codeBuffer = { 0 };
+	shader_data* data = { 0 };
+	ID3DBlob* shaderByteCode = { 0 };
 
 	if (type != SHADER_PIXEL && type != SHADER_VERTEX)
-	{
-		result = SR_INVALID_TYPE;
-		goto error;
-	}
+		return SR_INVALID_TYPE;
 
-	BOOL fileStatus = load_file(pPath, &codeBuffer, &fileSize, &lastWrite);
+	data = allocate_shader_data(pPath, pEntrypoint, pDefines, defineCount);
+	if (data == NULL)
+		return SR_OUT_OF_MEMORY;
+	data->type = type;
 
-	if (!fileStatus)
+	if (!load_file(pPath, &codeBuffer, &fileSize, &lastWrite))
 	{
 		result = SR_FILE_LOAD_ERROR;
 		goto error;
 	}
+	data->last_write = lastWrite;
 
-	ID3DBlob* shaderByteCode = {0};
-	shaderByteCode = compile_shader(type, codeBuffer, fileSize, pEntrypoint);
-
+	shaderByteCode = compile_shader(data, codeBuffer, fileSize);
 	free(codeBuffer);
-
 	if (shaderByteCode == NULL)
 	{
 		result = SR_SHADER_SYNTAX_ERROR;
 		goto error;
 	}
 
-	size_t structureSize = sizeof(shader_data);
-	size_t pathSize = strlen(pPath) * sizeof(SCHAR) + 1;
-	size_t entrypointSize = strlen(pEntrypoint) + 1;
-	size_t totalSize = structureSize + pathSize + entrypointSize;
-
-	shader_data* data = {0};
-	data = (shader_data*)malloc(totalSize);
-	if (data == NULL)
-	{
-		result = SR_OUT_OF_MEMORY;
-		goto error;
-	}
-
-	data->file_path = ((SCHAR*)data) + structureSize;
-	data->entrypoint = data->file_path + pathSize;
-
-	memcpy((char*)data->file_path, pPath, pathSize);
-	memcpy((char*)data->entrypoint, pEntrypoint, entrypointSize);
-
-	data->type = type;
-	data->last_write = lastWrite;
-
 	switch (type)
 	{
 	case SHADER_VERTEX:
@@ -175,9 +264,9 @@ SHADER_RESULT create_shader(ID3D11Device* pDevice, const SCHAR* pPath, const cha
 			result = SR_INVALID_INPUT_LAYOUT;
 			goto error;
 		}
-		BOOL res = create_vertex_Shader(pDevice, shaderByteCode, &data->vetex_shader);
-		if (!res)
+		if (!create_vertex_Shader(pDevice, shaderByteCode, &data->vetex_shader))
 		{
+			data->input_layout->lpVtbl->Release(data->input_layout);
 			result = SR_SHADER_LINKING_ERROR;
 			goto error;
 		}
@@ -185,8 +274,7 @@ SHADER_RESULT create_shader(ID3D11Device* pDevice, const SCHAR* pPath, const cha
 	break;
 	case SHADER_PIXEL:
 	{
-		BOOL res = create_pixel_Shader(pDevice, shaderByteCode, &data->pixel_shader);
-		if (!res)
+		if (!create_pixel_Shader(pDevice, shaderByteCode, &data->pixel_shader))
 		{
 			result = SR_SHADER_LINKING_ERROR;
 			goto error;
@@ -198,22 +286,9 @@ SHADER_RESULT create_shader(ID3D11Device* pDevice, const SCHAR* pPath, const cha
 	return result;
 
 error:
-	switch (result)
-	{
-		case SR_SHADER_LINKING_ERROR:
-		{
-			if (type == SHADER_VERTEX)
-				data->input_layout->lpVtbl->Release(data->input_layout);
-		}
-		case SR_INVALID_INPUT_LAYOUT:
-		{
-			free(data);
-		}
-		case SR_OUT_OF_MEMORY:
-		{
-			shaderByteCode->lpVtbl->Release(shaderByteCode);
-		}
-	}
+	if (shaderByteCode)
+		shaderByteCode->lpVtbl->Release(shaderByteCode);
+	free(data);
 	return result;
 }
 
@@ -238,60 +313,72 @@ void delete_shader(shader_data* pShader)
 	free(pShader);
 }
 
-void bind_shader(ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, shader_data* pShader)
+int reload_shader(ID3D11Device* pDevice, shader_data* pShader)
 {
-	if (pShader == NULL || pShader->type == SHADER_INVALID)
-		return;
-
-	if (pDevice)
+	if (pDevice == NULL || pShader == NULL || pShader->type == SHADER_INVALID)
+		return 0;
+
+	FILETIME file_write = { 0 };
+	BOOL result = load_file(pShader->file_path, NULL, NULL, &file_write);
+	if (!result)
+		return -1;
+	if (CompareFileTime(&file_write, &pShader->last_write) <= 0)
+		return 0;
+
+	char* codeBuffer = NULL;
+	uint32_t fileSize = 0;
+	result = load_file(pShader->file_path, &codeBuffer, &fileSize, NULL);
+	if (!result)
+		return -1;
+	pShader->last_write = file_write;
+
+	int replaced = 0;
+	if (fileSize > 0)
 	{
-		FILETIME file_write = { 0 };
-		BOOL result = load_file(pShader->file_path, NULL, NULL, &file_write);
-		if (result && CompareFileTime(&file_write, &pShader->last_write) > 0)
+		ID3DBlob* shaderByteCode = compile_shader(pShader, codeBuffer, fileSize);
+
+		if (shaderByteCode != NULL)
 		{
-			pShader->last_write = file_write;
-			char* codeBuffer = NULL;
-			uint32_t fileSize = 0;
-			result = load_file(pShader->file_path, &codeBuffer, &fileSize, NULL);
-			if (result)
+			switch (pShader->type)
+			{
+			case SHADER_VERTEX:
+			{
+				ID3D11VertexShader* vs;
+				if (create_vertex_Shader(pDevice, shaderByteCode, &vs))
+				{
+					pShader->vetex_shader->lpVtbl->Release(pShader->vetex_shader);
+					pShader->vetex_shader = vs;
+					replaced = 1;
+				}
+			}
+			break;
+			case SHADER_PIXEL:
 			{
-				if (fileSize > 0)
+				ID3D11PixelShader* ps;
+				if (create_pixel_Shader(pDevice, shaderByteCode, &ps))
 				{
-					ID3DBlob* shaderByteCode = compile_shader(pShader->type, codeBuffer, fileSize, pShader->entrypoint);
-
-					if (shaderByteCode != NULL)
-					{
-						switch (pShader->type)
-						{
-						case SHADER_VERTEX:
-						{
-							ID3D11VertexShader* vs;
-							if (create_vertex_Shader(pDevice, shaderByteCode, &vs))
-							{
-								pShader->vetex_shader->lpVtbl->Release(pShader->vetex_shader);
-								pShader->vetex_shader = vs;
-							}
-						}
-						break;
-						case SHADER_PIXEL:
-						{
-							ID3D11PixelShader* ps;
-							if (create_pixel_Shader(pDevice, shaderByteCode, &ps))
-							{
-								pShader->pixel_shader->lpVtbl->Release(pShader->pixel_shader);
-								pShader->pixel_shader = ps;
-							}
-						}
-						break;
-						}
-
-						shaderByteCode->lpVtbl->Release(shaderByteCode);
-					}
+					pShader->pixel_shader->lpVtbl->Release(pShader->pixel_shader);
+					pShader->pixel_shader = ps;
+					replaced = 1;
 				}
-				free(codeBuffer);
 			}
+			break;
+			}
+
+			shaderByteCode->lpVtbl->Release(shaderByteCode);
 		}
 	}
+	free(codeBuffer);
+	return replaced;
+}
+
+void bind_shader(ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, shader_data* pShader)
+{
+	if (pShader == NULL || pShader->type == SHADER_INVALID)
+		return;
+
+	if (pDevice)
+		reload_shader(pDevice, pShader);
 
 	if (pDeviceContext)
 	{
@@ -308,6 +395,26 @@ void bind_shader(ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, sha
 	}
 }
 
+ID3D11VertexShader* get_vertex_shader(const shader_data* pShader)
+{
+	return pShader && pShader->type == SHADER_VERTEX ? pShader->vetex_shader : NULL;
+}
+
+ID3D11InputLayout* get_input_layout(const shader_data* pShader)
+{
+	return pShader && pShader->type == SHADER_VERTEX ? pShader->input_layout : NULL;
+}
+
+ID3D11PixelShader* get_pixel_shader(const shader_data* pShader)
+{
+	return pShader && pShader->type == SHADER_PIXEL ? pShader->pixel_shader : NULL;
+}
+
+const SCHAR* get_shader_path(const shader_data* pShader)
+{
+	return pShader ? pShader->file_path : NULL;
+}
+
 #ifdef _MSC_VER
 #pragma warning( pop ) 
 #endif
\ No newline at end of file
@@ -34,6 +34,9 @@ extern "C" {
 	typedef struct ID3D11Device ID3D11Device; //!< @private
 	typedef struct ID3D11DeviceContext ID3D11DeviceContext; //!< @private
 	typedef struct D3D11_INPUT_ELEMENT_DESC D3D11_INPUT_ELEMENT_DESC; //!< @private
+	typedef struct ID3D11VertexShader ID3D11VertexShader; //!< @private
+	typedef struct ID3D11InputLayout ID3D11InputLayout; //!< @private
+	typedef struct ID3D11PixelShader ID3D11PixelShader; //!< @private
 
 	/**
 	 * @brief Opaque data structure containing the shader data.
@@ -68,6 +71,49 @@ extern "C" {
 		SR_SHADER_LINKING_ERROR = -6,
 	} SHADER_RESULT;
 
+	/**
+	 * @brief Preprocessor define of a shader variant.
+	 * @see create_shader_variant()
+	*/
+	typedef struct shader_define
+	{
+		const char* pName; //!< Macro name
+		const char* pValue; //!< Macro value
+	} shader_define;
+
+	/**
+	 * @brief Inputs of a shader compilation, everything that determines the bytecode.
+	 * @see shader_cache
+	*/
+	typedef struct shader_compile_desc
+	{
+		const char* pCode; //!< HLSL source, not null terminated
+		uint32_t codeSize; //!< Bytes of HLSL source
+		const char* pEntrypoint; //!< Name of the main function
+		const char* pProfile; //!< Target profile, e.g. "vs_5_0"
+		const char* pDefines; //!< Preprocessor defines as "NAME=VALUE" lines, empty if none
+		uint32_t flags; //!< D3DCOMPILE flags
+		uint32_t compilerVersion; //!< D3D_COMPILER_VERSION of the compiler
+	} shader_compile_desc;
+
+	/**
+	 * @brief Callbacks of a cache of compiled bytecode.
+	 * @see set_shader_cache(const shader_cache*)
+	*/
+	typedef struct shader_cache
+	{
+		void* pUser; //!< Passed to the callbacks
+		void* (*load)(void* pUser, const shader_compile_desc* pDesc, uint32_t* pSize); //!< Return bytecode compiled from pDesc, allocated with malloc(), and set its size, or return NULL on a miss
+		void (*store)(void* pUser, const shader_compile_desc* pDesc, const void* pBytecode, uint32_t size, double compileMilliseconds); //!< Keep bytecode compiled from pDesc
+	} shader_cache;
+
+	/**
+	 * @brief Set the cache create_shader() and reload_shader() look up bytecode in before compiling.
+	 * @details Bytecode that is compiled is stored in the cache.
+	 * @param[in] pCache Callbacks, copied, or NULL to always compile.
+	*/
+	void set_shader_cache(const shader_cache* pCache);
+
 	/**
 	 * @brief Create a shader from a text file containing the HLSL code.
 	 * @param[in] pDevice Pointer to the active DX11 device.
@@ -81,6 +127,16 @@ extern "C" {
 	*/
 	SHADER_RESULT create_shader(ID3D11Device* pDevice, const SCHAR* pPath, const char* pEntrypoint, SHADER_TYPE type, const D3D11_INPUT_ELEMENT_DESC* pLayout, uint32_t layoutcount, shader_data** pShader);
 
+	/**
+	 * @brief Create a variant of a shader, compiled with preprocessor defines.
+	 * @details Like create_shader(), the defines are kept with the shader and used again when it is reloaded.
+	 * Variants can be created from several threads at once, if the shader cache callbacks are thread safe.
+	 * @param[in] pDefines Defines to compile with, copied.
+	 * @param[in] defineCount Number of defines.
+	 * @see create_shader(ID3D11Device*, const SCHAR*, const char*, SHADER_TYPE, const D3D11_INPUT_ELEMENT_DESC*, uint32_t, shader_data**)
+	*/
+	SHADER_RESULT create_shader_variant(ID3D11Device* pDevice, const SCHAR* pPath, const char* pEntrypoint, SHADER_TYPE type, const D3D11_INPUT_ELEMENT_DESC* pLayout, uint32_t layoutcount, const shader_define* pDefines, uint32_t defineCount, shader_data** pShader);
+
 	/**
 	 * @brief Deletes a shader created using create_shader.
 	 * @see create_shader(ID3D11Device*, const SCHAR*, const char*, SHADER_TYPEm const D3D11_INPUT_ELEMENT_DESC*, uint32_t, shader_data**)
@@ -90,7 +146,8 @@ extern "C" {
 
 	/**
 	 * @brief Bind a shader to the DX11 pipeline.
-	 * @details This function does hot reloading of the shader if a ID3D11DeviceContext is supplied.
+	 * @details This function does hot reloading of the shader if a ID3D11Device is supplied, which opens the
+	 * shader file on every bind. Pass NULL and call reload_shader() on file changes to avoid that.
 	 *
 	 * @param[in] pDevice Pointer to the active DX11 device, if this is left to NULL no reload of the shader will be done.
 	 * @param[in] pDeviceContext Pointer to the DX11 context that the shaders should be bound using, if NULL the shader binding will be skipped.
@@ -98,6 +155,45 @@ extern "C" {
 	*/
 	void bind_shader(ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, shader_data* pShader);
 
+	/**
+	 * @brief Recompile a shader if its file was written since it was last compiled.
+	 * @details Opens the file to compare its write time, so call it when the file is known to have
+	 * changed, e.g. from a FileWatcher, rather than every frame. The shader is kept if the new code does not compile.
+	 *
+	 * @param[in] pDevice Pointer to the active DX11 device.
+	 * @param[in] pShader Pointer to the shader that should be reloaded.
+	 * @return 1 if the shader was replaced, 0 if the file is unchanged or did not compile, -1 if the file could not be read.
+	*/
+	int reload_shader(ID3D11Device* pDevice, shader_data* pShader);
+
+	/**
+	 * @brief Get the vertex shader, e.g. to bind it through a state cache.
+	 * @param[in] pShader Pointer to a shader.
+	 * @return The current vertex shader, NULL if pShader is not a vertex shader.
+	*/
+	ID3D11VertexShader* get_vertex_shader(const shader_data* pShader);
+
+	/**
+	 * @brief Get the input layout of a vertex shader.
+	 * @param[in] pShader Pointer to a shader.
+	 * @return The input layout, NULL if pShader is not a vertex shader.
+	*/
+	ID3D11InputLayout* get_input_layout(const shader_data* pShader);
+
+	/**
+	 * @brief Get the pixel shader, e.g. to bind it through a state cache.
+	 * @param[in] pShader Pointer to a shader.
+	 * @return The current pixel shader, NULL if pShader is not a pixel shader.
+	*/
+	ID3D11PixelShader* get_pixel_shader(const shader_data* pShader);
+
+	/**
+	 * @brief Get the path the shader was created from.
+	 * @param[in] pShader Pointer to a shader.
+	 * @return The path as passed to create_shader(), NULL if pShader is NULL.
+	*/
+	const SCHAR* get_shader_path(const shader_data* pShader);
+
 #ifdef __cplusplus
 }
 #endif // __cplusplus
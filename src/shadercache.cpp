@@ -0,0 +1,71 @@
+//
+// Shader bytecode cache
+//
+// The callbacks are called from C, so they must not throw; a failure to
+// read or write the cache only costs a compile.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include "shadercache.h"
+
+ShaderCache::ShaderCache(const std::string& directory, uint64_t max_bytes)
+	: m_cache(directory, max_bytes)
+{
+	m_callbacks.pUser = this;
+	m_callbacks.load = &ShaderCache::Load;
+	m_callbacks.store = &ShaderCache::Store;
+}
+
+uint64_t ShaderCache::MakeKey(const shader_compile_desc& desc) noexcept
+{
+	return BlobHasher()
+		.Add(desc.pCode, desc.codeSize)
+		.Add(desc.pEntrypoint, strlen(desc.pEntrypoint))
+		.Add(desc.pProfile, strlen(desc.pProfile))
+		.Add(desc.pDefines, strlen(desc.pDefines))
+		.Add((uint64_t)desc.flags)
+		.Add((uint64_t)desc.compilerVersion)
+		.Get();
+}
+
+void* ShaderCache::Load(void* user, const shader_compile_desc* desc, uint32_t* size)
+{
+	try
+	{
+		ShaderCache* cache = (ShaderCache*)user;
+		const uint64_t key = MakeKey(*desc);
+		std::vector<char> bytecode;
+		{
+			std::lock_guard<std::mutex> lock(cache->m_mutex);
+			if (!cache->m_cache.Load(key, bytecode) || bytecode.empty())
+				return nullptr;
+		}
+
+		void* result = malloc(bytecode.size());
+		if (result)
+		{
+			memcpy(result, bytecode.data(), bytecode.size());
+			*size = (uint32_t)bytecode.size();
+		}
+		return result;
+	}
+	catch (const std::exception&)
+	{
+		return nullptr;
+	}
+}
+
+void ShaderCache::Store(void* user, const shader_compile_desc* desc, const void* bytecode, uint32_t size, double compile_milliseconds)
+{
+	try
+	{
+		ShaderCache* cache = (ShaderCache*)user;
+		const uint64_t key = MakeKey(*desc);
+		std::lock_guard<std::mutex> lock(cache->m_mutex);
+		cache->m_cache.Store(key, bytecode, size, compile_milliseconds);
+	}
+	catch (const std::exception&)
+	{
+	}
+}
@@ -0,0 +1,64 @@
+/**
+ * @file shadercache.h
+ * @brief Cache of compiled shader bytecode on disk
+ * @details Connects a BlobCache to create_shader() and reload_shader() through set_shader_cache(). The key
+ * hashes the HLSL source, entrypoint, profile, defines, compile flags and compiler version, so a shader is
+ * only compiled when one of them changed. The shaders are compiled without an include handler, so their
+ * source is all the text they are compiled from. The callbacks are locked, so variants can be compiled
+ * in parallel.
+*/
+
+#pragma once
+#ifndef SHADERCACHE_H
+#define SHADERCACHE_H
+
+#include <mutex>
+#include <string>
+#include "blobcache.h"
+#include "shader.h"
+
+/**
+ * @brief Shader bytecode cache in a directory.
+*/
+class ShaderCache
+{
+public:
+	/**
+	 * @brief Open the cache directory.
+	 * @param[in] directory Directory of the cache files, created if needed.
+	 * @param[in] max_bytes Size limit of the cache files.
+	*/
+	explicit ShaderCache(const std::string& directory, uint64_t max_bytes = BLOBCACHE_DEFAULT_MAX_BYTES);
+
+	ShaderCache(const ShaderCache&) = delete;
+	ShaderCache& operator=(const ShaderCache&) = delete;
+
+	/**
+	 * @brief Callbacks to pass to set_shader_cache(), valid for the lifetime of the cache.
+	*/
+	const shader_cache* GetCallbacks() const noexcept { return &m_callbacks; }
+
+	/**
+	 * @brief Get the hits, misses and time saved since the cache was opened.
+	*/
+	BlobCacheStats GetStats() const
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return m_cache.GetStats();
+	}
+
+	/**
+	 * @brief Key of the bytecode compiled from a description.
+	*/
+	static uint64_t MakeKey(const shader_compile_desc& desc) noexcept;
+
+private:
+	static void* Load(void* user, const shader_compile_desc* desc, uint32_t* size);
+	static void Store(void* user, const shader_compile_desc* desc, const void* bytecode, uint32_t size, double compile_milliseconds);
+
+	mutable std::mutex m_mutex; // guards m_cache
+	BlobCache m_cache;
+	shader_cache m_callbacks;
+};
+
+#endif
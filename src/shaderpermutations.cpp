@@ -0,0 +1,133 @@
+//
+// Shader permutations
+//
+// Every variant defines each feature the shader supports to 1 or 0, so the
+// HLSL tests them with #if. Variants are independent shader_data, compiled
+// by create_shader_variant() on as many jobs as there are missing masks;
+// the device is free-threaded and the shader cache is locked.
+//
+
+#include <algorithm>
+#include "shaderpermutations.h"
+#include "jobsystem.h"
+#include "profiler.h"
+
+namespace
+{
+	const char* const FeatureDefines[SHADERPERMUTATIONS_FEATURE_COUNT] = { "DIFFUSE_TEXTURE", "NORMAL_MAP", "SPECULAR_MAP" };
+
+	unsigned CountBits(uint32_t mask)
+	{
+		unsigned count = 0;
+		for (; mask; mask &= mask - 1)
+			count++;
+		return count;
+	}
+}
+
+ShaderPermutations::ShaderPermutations(ID3D11Device* device, const std::string& path, const std::string& entrypoint, SHADER_TYPE type,
+	uint32_t features, const D3D11_INPUT_ELEMENT_DESC* layout, uint32_t layout_count)
+	: m_device(device), m_path(path), m_entrypoint(entrypoint), m_type(type), m_features(features & SHADERPERMUTATIONS_ALL_FEATURES),
+	m_layout(layout, layout + layout_count)
+{
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+	for (shader_data* variant : m_variants)
+		if (variant)
+			delete_shader(variant);
+}
+
+bool ShaderPermutations::Compile(const std::vector<uint32_t>& masks)
+{
+	PROFILE_FUNCTION();
+	const int64_t start = Profiler::Now();
+
+	std::vector<uint32_t> missing = { 0 };
+	for (uint32_t mask : masks)
+		missing.push_back(mask & m_features);
+	std::sort(missing.begin(), missing.end());
+	missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+	missing.erase(std::remove_if(missing.begin(), missing.end(), [this](uint32_t mask) { return m_variants[mask] != nullptr; }), missing.end());
+
+	std::vector<shader_data*> compiled(missing.size(), nullptr);
+	JobSystem::ParallelFor(0, missing.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			std::vector<shader_define> defines;
+			for (uint32_t feature = 0; feature < SHADERPERMUTATIONS_FEATURE_COUNT; feature++)
+				if (m_features & (1u << feature))
+					defines.push_back({ FeatureDefines[feature], missing[i] & (1u << feature) ? "1" : "0" });
+
+			if (create_shader_variant(m_device, m_path.c_str(), m_entrypoint.c_str(), m_type, m_layout.data(), (uint32_t)m_layout.size(),
+				defines.data(), (uint32_t)defines.size(), &compiled[i]) != SR_OK)
+				compiled[i] = nullptr;
+		}
+	});
+
+	bool succeeded = true;
+	for (size_t i = 0; i < missing.size(); i++)
+	{
+		m_variants[missing[i]] = compiled[i];
+		if (compiled[i])
+			m_stats.Variants++;
+		else
+		{
+			m_stats.Failures++;
+			succeeded = false;
+		}
+	}
+	UpdateLookup();
+
+	m_stats.CompileMilliseconds += (Profiler::Now() - start) * 1e-6;
+	return succeeded;
+}
+
+int ShaderPermutations::Reload()
+{
+	std::vector<shader_data*> variants;
+	for (shader_data* variant : m_variants)
+		if (variant)
+			variants.push_back(variant);
+
+	std::vector<int> results(variants.size(), 0);
+	JobSystem::ParallelFor(0, variants.size(), 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			results[i] = reload_shader(m_device, variants[i]);
+	});
+
+	// Every variant reads the same file, so they are unreadable or changed together
+	int result = 0;
+	for (int variant : results)
+	{
+		if (variant < 0)
+			return -1;
+		if (variant > result)
+			result = variant;
+	}
+	return result;
+}
+
+void ShaderPermutations::UpdateLookup()
+{
+	// The compiled variant with the most features that are all in the mask
+	for (uint32_t mask = 0; mask <= m_features; mask++)
+	{
+		m_lookup[mask] = nullptr;
+		unsigned bestFeatures = 0;
+		for (uint32_t variant = 0; variant <= m_features; variant++)
+		{
+			if (!m_variants[variant] || (variant & ~mask))
+				continue;
+			const unsigned features = CountBits(variant);
+			if (!m_lookup[mask] || features > bestFeatures)
+			{
+				m_lookup[mask] = m_variants[variant];
+				bestFeatures = features;
+			}
+		}
+	}
+}
@@ -0,0 +1,117 @@
+/**
+ * @file shaderpermutations.h
+ * @brief Variants of a shader compiled from one file with feature flags
+ * @details Each feature of a shader is a preprocessor define, and each combination of features, a mask of
+ * ShaderFeature bits, is compiled into its own variant. Only the masks the materials of the scene use are
+ * compiled, all at once on the job system, and a variant is looked up at draw time by indexing an array with
+ * its mask. A mask that was not compiled uses the compiled variant with the most of its features.
+*/
+
+#pragma once
+#ifndef SHADERPERMUTATIONS_H
+#define SHADERPERMUTATIONS_H
+
+#include <string>
+#include <vector>
+#include "stdafx.h"
+#include "shader.h"
+
+//! Number of ShaderFeature bits
+#define SHADERPERMUTATIONS_FEATURE_COUNT 3
+
+//! Mask of every ShaderFeature
+#define SHADERPERMUTATIONS_ALL_FEATURES ((1u << SHADERPERMUTATIONS_FEATURE_COUNT) - 1)
+
+/**
+ * @brief Features a shader variant is compiled with, bits of a mask.
+*/
+enum class ShaderFeature : uint32_t
+{
+	DiffuseTexture = 1 << 0, //!< DIFFUSE_TEXTURE, a diffuse texture in t0
+	NormalMap = 1 << 1, //!< NORMAL_MAP, a tangent space normal map in t1
+	SpecularMap = 1 << 2, //!< SPECULAR_MAP, a specular map in t2
+};
+
+/**
+ * @brief Variant count and compile time of a ShaderPermutations.
+*/
+struct ShaderPermutationStats
+{
+	unsigned Variants = 0; //!< Variants compiled
+	unsigned Failures = 0; //!< Variants that did not compile
+	double CompileMilliseconds = 0.0; //!< Time spent in Compile(), including cache hits
+};
+
+/**
+ * @brief The compiled variants of one shader.
+*/
+class ShaderPermutations
+{
+public:
+	/**
+	 * @brief Set up the variants of a shader, compiling none of them.
+	 * @param[in] device Device to create the shaders on.
+	 * @param[in] path Path to the HLSL file.
+	 * @param[in] entrypoint Name of the main function.
+	 * @param[in] type Type of the shader.
+	 * @param[in] features Mask of the features the shader supports, other bits of a mask are ignored.
+	 * @param[in] layout Input layout of a vertex shader, or nullptr.
+	 * @param[in] layout_count Number of elements in layout.
+	*/
+	ShaderPermutations(ID3D11Device* device, const std::string& path, const std::string& entrypoint, SHADER_TYPE type,
+		uint32_t features, const D3D11_INPUT_ELEMENT_DESC* layout = nullptr, uint32_t layout_count = 0);
+
+	/**
+	 * @brief Deletes the variants.
+	*/
+	~ShaderPermutations();
+
+	ShaderPermutations(const ShaderPermutations&) = delete;
+	ShaderPermutations& operator=(const ShaderPermutations&) = delete;
+
+	/**
+	 * @brief Compile the variants of feature masks that are not compiled yet, in parallel.
+	 * @details The variant without features is always compiled, as the last fallback.
+	 * @param[in] masks Feature masks, in any order and with duplicates.
+	 * @return False if a variant did not compile, lookups of its mask fall back to another variant then.
+	*/
+	bool Compile(const std::vector<uint32_t>& masks);
+
+	/**
+	 * @brief Recompile the variants, in parallel, if the shader file changed.
+	 * @return As reload_shader(): 1 if the variants were replaced, 0 if unchanged or failed to compile,
+	 * -1 if the file could not be read.
+	*/
+	int Reload();
+
+	/**
+	 * @brief Get the variant of a feature mask.
+	 * @return The variant, or the compiled variant with the most of its features, nullptr if none is compiled.
+	*/
+	shader_data* Get(uint32_t mask) const noexcept { return m_lookup[mask & m_features]; }
+
+	/**
+	 * @brief Get the path of the HLSL file.
+	*/
+	const std::string& GetPath() const noexcept { return m_path; }
+
+	/**
+	 * @brief Get the number of variants and the time spent compiling them.
+	*/
+	const ShaderPermutationStats& GetStats() const noexcept { return m_stats; }
+
+private:
+	void UpdateLookup();
+
+	ID3D11Device* m_device;
+	std::string m_path;
+	std::string m_entrypoint;
+	SHADER_TYPE m_type;
+	uint32_t m_features;
+	std::vector<D3D11_INPUT_ELEMENT_DESC> m_layout;
+	shader_data* m_variants[1 << SHADERPERMUTATIONS_FEATURE_COUNT] = {}; // Indexed by mask, nullptr if not compiled
+	shader_data* m_lookup[1 << SHADERPERMUTATIONS_FEATURE_COUNT] = {}; // Variant used for each mask
+	ShaderPermutationStats m_stats;
+};
+
+#endif
@@ -0,0 +1,285 @@
+//
+// Golden-image test and benchmark of the CPU rasterizer
+//
+// Quads are given by a corner and two edges, with the normal passed along as
+// there is no cross product in linalg. Their corners go counter-clockwise
+// seen from the front, which is what the rasterizer keeps.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include "softrasterbenchmark.h"
+#include "softrasterizer.h"
+#include "jobsystem.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	struct Mesh
+	{
+		std::vector<Vertex> Vertices;
+		std::vector<unsigned> Indices;
+	};
+
+	// Meshes and texture shared by the scenes
+	struct SceneAssets
+	{
+		Mesh Cube;
+		Mesh Floor;
+		Mesh Wall;
+		Mesh Ramp;
+		SoftwareImage Checker;
+	};
+
+	struct Scene
+	{
+		const char* Name;
+		SoftwareShading Shading;
+		void (*Draw)(SoftwareRasterizer& rasterizer, const SceneAssets& assets);
+	};
+
+	void AddQuad(Mesh& mesh, const vec3f& corner, const vec3f& edge_u, const vec3f& edge_v, const vec3f& normal, float uv_scale)
+	{
+		const unsigned first = (unsigned)mesh.Vertices.size();
+		const vec3f positions[] = { corner, corner + edge_u, corner + edge_u + edge_v, corner + edge_v };
+		const vec2f texCoords[] = { { 0.0f, uv_scale }, { uv_scale, uv_scale }, { uv_scale, 0.0f }, { 0.0f, 0.0f } };
+		for (int i = 0; i < 4; i++)
+		{
+			Vertex vertex = {};
+			vertex.Position = positions[i];
+			vertex.Normal = normal;
+			vertex.TexCoord = texCoords[i];
+			mesh.Vertices.push_back(vertex);
+		}
+		for (unsigned index : { 0u, 1u, 2u, 0u, 2u, 3u })
+			mesh.Indices.push_back(first + index);
+	}
+
+	SceneAssets CreateAssets()
+	{
+		SceneAssets assets;
+
+		// Cube from -1 to 1
+		AddQuad(assets.Cube, { -1.0f, -1.0f, 1.0f }, { 2.0f, 0.0f, 0.0f }, { 0.0f, 2.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, 1.0f);
+		AddQuad(assets.Cube, { 1.0f, -1.0f, -1.0f }, { -2.0f, 0.0f, 0.0f }, { 0.0f, 2.0f, 0.0f }, { 0.0f, 0.0f, -1.0f }, 1.0f);
+		AddQuad(assets.Cube, { 1.0f, -1.0f, 1.0f }, { 0.0f, 0.0f, -2.0f }, { 0.0f, 2.0f, 0.0f }, { 1.0f, 0.0f, 0.0f }, 1.0f);
+		AddQuad(assets.Cube, { -1.0f, -1.0f, -1.0f }, { 0.0f, 0.0f, 2.0f }, { 0.0f, 2.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, 1.0f);
+		AddQuad(assets.Cube, { -1.0f, 1.0f, 1.0f }, { 2.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -2.0f }, { 0.0f, 1.0f, 0.0f }, 1.0f);
+		AddQuad(assets.Cube, { -1.0f, -1.0f, -1.0f }, { 2.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 2.0f }, { 0.0f, -1.0f, 0.0f }, 1.0f);
+
+		// Floor reaching from far ahead to behind the floor camera, so that it is clipped by the near plane
+		AddQuad(assets.Floor, { -20.0f, 0.0f, 10.0f }, { 40.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, -60.0f }, { 0.0f, 1.0f, 0.0f }, 4.0f);
+
+		// Wall facing the camera, and a ramp leaning back through it along y = 0
+		AddQuad(assets.Wall, { -1.5f, -1.0f, 0.0f }, { 3.0f, 0.0f, 0.0f }, { 0.0f, 2.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, 1.0f);
+		AddQuad(assets.Ramp, { -1.0f, -1.5f, 1.0f }, { 2.0f, 0.0f, 0.0f }, { 0.0f, 3.0f, -2.0f }, vec3f(0.0f, 2.0f, 3.0f).normalize(), 1.0f);
+
+		// 8x8 checkerboard
+		assets.Checker.Width = 8;
+		assets.Checker.Height = 8;
+		assets.Checker.Pixels.resize(64);
+		for (int i = 0; i < 64; i++)
+			assets.Checker.Pixels[i] = ((i % 8 + i / 8) & 1) ? 0xffffffffu : 0xff2040c0u;
+		return assets;
+	}
+
+	void Draw(SoftwareRasterizer& rasterizer, const Mesh& mesh, const mat4f& model_to_world, const mat4f& world_to_view,
+		const SoftwareImage* texture)
+	{
+		const mat4f projection = mat4f::projection(1.0f, (float)SOFTRASTERBENCHMARK_WIDTH / SOFTRASTERBENCHMARK_HEIGHT, 0.5f, 50.0f);
+		TransformationBuffer transforms;
+		FillTransformationBuffers(&model_to_world, 1, world_to_view, projection, &transforms);
+		rasterizer.Draw(transforms, mesh.Vertices.data(), mesh.Indices.data(), mesh.Indices.size(), texture);
+	}
+
+	void DrawCube(SoftwareRasterizer& rasterizer, const SceneAssets& assets)
+	{
+		Draw(rasterizer, assets.Cube, mat4f::rotation(0.4f, 1.0f, 0.0f, 0.0f) * mat4f::rotation(0.6f, 0.0f, 1.0f, 0.0f),
+			mat4f::translation(0.0f, 0.0f, -5.0f), nullptr);
+	}
+
+	void DrawFloor(SoftwareRasterizer& rasterizer, const SceneAssets& assets)
+	{
+		// Camera at (0, 2, 6), looking slightly down
+		Draw(rasterizer, assets.Floor, mat4f_identity, mat4f::rotation(0.25f, 1.0f, 0.0f, 0.0f) * mat4f::translation(0.0f, -2.0f, -6.0f),
+			&assets.Checker);
+	}
+
+	void DrawOverlap(SoftwareRasterizer& rasterizer, const SceneAssets& assets)
+	{
+		// Nearer surfaces drawn both before and after farther ones
+		const mat4f view = mat4f::translation(0.0f, 0.0f, -5.0f);
+		Draw(rasterizer, assets.Wall, mat4f_identity, view, nullptr);
+		Draw(rasterizer, assets.Cube, mat4f::translation(1.0f, 0.5f, 0.0f) * mat4f::rotation(0.7f, 0.0f, 1.0f, 0.0f) * mat4f::scaling(0.6f),
+			view, nullptr);
+		Draw(rasterizer, assets.Ramp, mat4f_identity, view, nullptr);
+	}
+
+	const Scene scenes[] =
+	{
+		{ "cube_normals", SoftwareShading::Normal, DrawCube },
+		{ "floor_texcoords", SoftwareShading::TexCoord, DrawFloor },
+		{ "floor_texture", SoftwareShading::DiffuseTexture, DrawFloor },
+		{ "depth_overlap", SoftwareShading::Normal, DrawOverlap },
+	};
+
+	void Render(SoftwareRasterizer& rasterizer, const Scene& scene, const SceneAssets& assets)
+	{
+		rasterizer.Clear(vec4f(0.1f, 0.1f, 0.1f, 1.0f));
+		rasterizer.SetShading(scene.Shading);
+		scene.Draw(rasterizer, assets);
+		rasterizer.Flush();
+	}
+
+	std::string PathIn(const std::string& directory, const char* name, const char* suffix)
+	{
+		return directory.empty() ? std::string(name) + suffix : directory + "/" + name + suffix;
+	}
+
+	std::string DirectoryOf(const std::string& filename)
+	{
+		const size_t slash = filename.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : filename.substr(0, slash);
+	}
+}
+
+bool RunSoftwareRasterizerTest(const std::string& golden_directory, const std::string& failure_directory,
+	std::vector<GoldenImageResult>& results, std::string& failure)
+{
+	const SceneAssets assets = CreateAssets();
+	SoftwareRasterizer single(SOFTRASTERBENCHMARK_WIDTH, SOFTRASTERBENCHMARK_HEIGHT, 1);
+	SoftwareRasterizer parallel(SOFTRASTERBENCHMARK_WIDTH, SOFTRASTERBENCHMARK_HEIGHT);
+	bool passed = true;
+	results.clear();
+
+	for (const Scene& scene : scenes)
+	{
+		Render(single, scene, assets);
+		Render(parallel, scene, assets);
+
+		GoldenImageResult result;
+		result.Name = scene.Name;
+		result.Triangles = parallel.GetStats().TrianglesSetup;
+		result.PixelsShaded = parallel.GetStats().PixelsShaded;
+
+		SoftwareImage golden;
+		std::string sceneFailure;
+		if (single.GetImage().MaxDifference(parallel.GetImage()) != 0)
+			sceneFailure = "the image depends on the number of jobs";
+		else if (!LoadSoftwareImage(PathIn(golden_directory, scene.Name, ".tga").c_str(), golden))
+			sceneFailure = "no reference image";
+		else
+		{
+			result.MaxDifference = parallel.GetImage().MaxDifference(golden);
+			result.DifferentPixels = parallel.GetImage().CountDifferences(golden, SOFTRASTERBENCHMARK_TOLERANCE);
+			if (result.DifferentPixels < 0)
+				sceneFailure = "the reference image has another size";
+			else if (result.DifferentPixels > SOFTRASTERBENCHMARK_MAX_DIFFERENT_PIXELS)
+				sceneFailure = std::to_string(result.DifferentPixels) + " pixels differ from the reference image";
+		}
+
+		result.Passed = sceneFailure.empty();
+		if (!result.Passed)
+		{
+			parallel.GetImage().WriteTGA(PathIn(failure_directory, scene.Name, "_failed.tga"));
+			if (passed)
+				failure = std::string(scene.Name) + ": " + sceneFailure;
+			passed = false;
+		}
+		results.push_back(result);
+	}
+	return passed;
+}
+
+bool WriteSoftwareRasterizerGoldenImages(const std::string& golden_directory, const std::string& report_filename)
+{
+	const SceneAssets assets = CreateAssets();
+	SoftwareRasterizer rasterizer(SOFTRASTERBENCHMARK_WIDTH, SOFTRASTERBENCHMARK_HEIGHT, 1);
+	std::vector<std::string> filenames;
+	std::vector<bool> imagesWritten;
+	for (const Scene& scene : scenes)
+	{
+		Render(rasterizer, scene, assets);
+		filenames.push_back(PathIn(golden_directory, scene.Name, ".tga"));
+		imagesWritten.push_back(rasterizer.GetImage().WriteTGA(filenames.back()));
+		printf("%s %s\n", imagesWritten.back() ? "Wrote" : "Could not write", filenames.back().c_str());
+	}
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("golden_directory").Value(golden_directory);
+		json.Key("images").BeginArray();
+		for (size_t i = 0; i < filenames.size(); i++)
+		{
+			json.BeginObject();
+			json.Key("filename").Value(filenames[i]);
+			json.Key("written").Value((bool)imagesWritten[i]);
+			json.EndObject();
+		}
+		json.EndArray();
+	});
+	return std::find(imagesWritten.begin(), imagesWritten.end(), false) == imagesWritten.end() && written;
+}
+
+bool RunSoftwareRasterizerBenchmark(const std::string& golden_directory, unsigned frames, const std::string& report_filename)
+{
+	JobSystem::Initialize();
+	const unsigned workers = JobSystem::GetWorkerCount();
+
+	std::vector<GoldenImageResult> results;
+	std::string testFailure;
+	const bool passed = RunSoftwareRasterizerTest(golden_directory, DirectoryOf(report_filename), results, testFailure);
+	printf("Software rasterizer golden images: %s\n", passed ? "passed" : testFailure.c_str());
+
+	printf("Software rasterizer, %dx%d, %u frames, %u workers...\n", SOFTRASTERBENCHMARK_WIDTH, SOFTRASTERBENCHMARK_HEIGHT,
+		frames, workers);
+	printf("\t%16s %8s %10s %10s %10s %10s\n", "Scene", "Passed", "Different", "Triangles", "Pixels", "p50 ms");
+	const SceneAssets assets = CreateAssets();
+	SoftwareRasterizer rasterizer(SOFTRASTERBENCHMARK_WIDTH, SOFTRASTERBENCHMARK_HEIGHT);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		std::vector<double> times;
+		for (unsigned frame = 0; frame < frames; frame++)
+		{
+			const int64_t start = Profiler::Now();
+			Render(rasterizer, scenes[i], assets);
+			times.push_back(MillisecondsSince(start));
+		}
+		GoldenImageResult& result = results[i];
+		result.Milliseconds = BenchmarkSummary::Compute(times);
+		printf("\t%16s %8s %10d %10u %10u %10.3f\n", result.Name, result.Passed ? "yes" : "no", result.DifferentPixels,
+			result.Triangles, result.PixelsShaded, result.Milliseconds.P50);
+	}
+	JobSystem::Shutdown();
+
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("test_passed").Value(passed);
+		json.Key("test_failure").Value(testFailure);
+		json.Key("golden_directory").Value(golden_directory);
+		json.Key("width").Value(SOFTRASTERBENCHMARK_WIDTH);
+		json.Key("height").Value(SOFTRASTERBENCHMARK_HEIGHT);
+		json.Key("tolerance").Value(SOFTRASTERBENCHMARK_TOLERANCE);
+		json.Key("frames").Value(frames);
+		json.Key("workers").Value(workers);
+		json.Key("scenes").BeginArray();
+		for (const GoldenImageResult& result : results)
+		{
+			json.BeginObject();
+			json.Key("name").Value(result.Name);
+			json.Key("passed").Value(result.Passed);
+			json.Key("max_difference").Value(result.MaxDifference);
+			json.Key("different_pixels").Value(result.DifferentPixels);
+			json.Key("triangles").Value(result.Triangles);
+			json.Key("pixels_shaded").Value(result.PixelsShaded);
+			json.Key("p50_ms").Value(result.Milliseconds.P50);
+			json.Key("p95_ms").Value(result.Milliseconds.P95);
+			json.EndObject();
+		}
+		json.EndArray();
+	});
+	return passed && written;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file softrasterbenchmark.h
+ * @brief Golden-image test of the CPU rasterizer and its frame time
+ * @details A few small scenes, built in code so that no assets are needed, are rendered with SoftwareRasterizer
+ * and compared with reference images checked into the repository: a rotated cube shaded by its normals,
+ * a floor reaching behind the camera shaded by its texture coordinates and by a checkerboard texture, which
+ * covers near plane clipping and perspective correct interpolation, and quads intersecting each other and a
+ * cube, which covers the depth test. Each scene is also rendered with one and with many jobs, which must give
+ * the same image. Images that differ from their reference are written next to the report for inspection.
+ *
+ * The references are written by the same code, and have to be written again and checked by eye whenever the
+ * rasterizer is meant to change its output.
+*/
+
+#pragma once
+#ifndef SOFTRASTERBENCHMARK_H
+#define SOFTRASTERBENCHMARK_H
+
+#include <string>
+#include <vector>
+#include "benchmark.h"
+
+//! Directory of the reference images of -rastertest and -rastergolden, relative to the working directory
+#define SOFTRASTERBENCHMARK_DEFAULT_GOLDEN_DIRECTORY "golden"
+
+//! Frames per scene of -rastertest
+#define SOFTRASTERBENCHMARK_DEFAULT_FRAMES 100
+
+//! Width of the rendered images
+#define SOFTRASTERBENCHMARK_WIDTH 128
+
+//! Height of the rendered images
+#define SOFTRASTERBENCHMARK_HEIGHT 96
+
+//! Largest difference of a colour component, in [0,255], that still counts as the same
+#define SOFTRASTERBENCHMARK_TOLERANCE 2
+
+//! Pixels that may differ by more than the tolerance, for edges that round differently between compilers
+#define SOFTRASTERBENCHMARK_MAX_DIFFERENT_PIXELS 16
+
+/**
+ * @brief Comparison of one scene with its reference image, and its cost.
+*/
+struct GoldenImageResult
+{
+	const char* Name = ""; //!< "cube_normals", "floor_texcoords", "floor_texture" or "depth_overlap", also the file name of the reference
+	bool Passed = false; //!< True if the image matched its reference and did not depend on the number of jobs
+	int MaxDifference = -1; //!< Largest component difference to the reference, -1 if it is missing or of another size
+	int DifferentPixels = -1; //!< Pixels differing by more than SOFTRASTERBENCHMARK_TOLERANCE, -1 if the reference is missing or of another size
+	unsigned Triangles = 0; //!< Triangles left after clipping and backface culling
+	unsigned PixelsShaded = 0; //!< Pixels that passed the depth test
+	BenchmarkSummary Milliseconds; //!< Time per frame, clearing, drawing and rasterizing
+};
+
+/**
+ * @brief Render every scene and compare it with its reference image.
+ * @param[in] golden_directory Directory of the reference images, one "<name>.tga" per scene.
+ * @param[in] failure_directory Directory to write "<name>_failed.tga" to for each scene that differs.
+ * @param[out] results Comparison of each scene, without timings.
+ * @param[out] failure Description of the first failed scene.
+ * @return True if all scenes matched.
+*/
+bool RunSoftwareRasterizerTest(const std::string& golden_directory, const std::string& failure_directory,
+	std::vector<GoldenImageResult>& results, std::string& failure);
+
+/**
+ * @brief Render every scene and write it as the new reference image, and write the list of images as JSON.
+ * @param[in] golden_directory Existing directory to write one "<name>.tga" per scene to.
+ * @param[in] report_filename File to write the list to.
+ * @return True if all images and the list were written.
+*/
+bool WriteSoftwareRasterizerGoldenImages(const std::string& golden_directory, const std::string& report_filename);
+
+/**
+ * @brief Run the golden-image test and time every scene.
+*/
+bool RunSoftwareRasterizerBenchmark(const std::string& golden_directory, unsigned frames, const std::string& report_filename);
+
+#endif
@@ -0,0 +1,494 @@
+//
+// CPU rasterizer
+//
+// Each value interpolated over a triangle is stored as a screen space plane
+// a*x + b*y + c, built from the edge functions: the edge function opposite a
+// vertex divided by the triangle area is that vertex's barycentric weight.
+// Attributes are interpolated divided by w together with 1/w, which are both
+// affine in screen space, and multiplied by w per pixel for perspective correctness.
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include "softrasterizer.h"
+#include "jobsystem.h"
+#include "memorytracker.h"
+#include "profiler.h"
+#include "stb_image.h"
+
+#ifdef LINALG_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace linalg;
+
+namespace
+{
+	int Wrap(int value, int size)
+	{
+		value %= size;
+		return value < 0 ? value + size : value;
+	}
+
+	vec4f Unpack(uint32_t colour)
+	{
+		const float scale = 1.0f / 255.0f;
+		return vec4f(
+			(float)(colour & 0xff) * scale,
+			(float)((colour >> 8) & 0xff) * scale,
+			(float)((colour >> 16) & 0xff) * scale,
+			(float)(colour >> 24) * scale);
+	}
+
+	uint32_t Pack(const vec4f& colour)
+	{
+		auto toByte = [](float value)
+		{
+			value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+			return (uint32_t)(value * 255.0f + 0.5f);
+		};
+		return toByte(colour.x) | (toByte(colour.y) << 8) | (toByte(colour.z) << 16) | (toByte(colour.w) << 24);
+	}
+}
+
+vec4f SoftwareImage::Sample(const vec2f& uv) const
+{
+	if (!Width || !Height)
+		return vec4f(1.0f);
+
+	// Texel centers are at half-integer coordinates
+	const float x = uv.x * Width - 0.5f;
+	const float y = uv.y * Height - 0.5f;
+	const float fx0 = std::floor(x), fy0 = std::floor(y);
+	const float tx = x - fx0, ty = y - fy0;
+	const int x0 = Wrap((int)fx0, Width), x1 = Wrap((int)fx0 + 1, Width);
+	const int y0 = Wrap((int)fy0, Height), y1 = Wrap((int)fy0 + 1, Height);
+
+	const vec4f c00 = Unpack(Pixels[(size_t)y0 * Width + x0]);
+	const vec4f c10 = Unpack(Pixels[(size_t)y0 * Width + x1]);
+	const vec4f c01 = Unpack(Pixels[(size_t)y1 * Width + x0]);
+	const vec4f c11 = Unpack(Pixels[(size_t)y1 * Width + x1]);
+	return (c00 * (1.0f - tx) + c10 * tx) * (1.0f - ty) + (c01 * (1.0f - tx) + c11 * tx) * ty;
+}
+
+bool SoftwareImage::WriteTGA(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::binary);
+	if (!file)
+		return false;
+
+	// Uncompressed true colour, 8 alpha bits, origin at the top-left
+	const uint8_t header[18] = {
+		0, 0, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+		(uint8_t)(Width & 0xff), (uint8_t)(Width >> 8),
+		(uint8_t)(Height & 0xff), (uint8_t)(Height >> 8),
+		32, 0x28 };
+	file.write((const char*)header, sizeof(header));
+
+	// TGA stores BGRA
+	std::vector<uint8_t> row((size_t)Width * 4);
+	for (int y = 0; y < Height; y++)
+	{
+		for (int x = 0; x < Width; x++)
+		{
+			const uint32_t colour = Pixels[(size_t)y * Width + x];
+			row[x * 4 + 0] = (uint8_t)(colour >> 16);
+			row[x * 4 + 1] = (uint8_t)(colour >> 8);
+			row[x * 4 + 2] = (uint8_t)colour;
+			row[x * 4 + 3] = (uint8_t)(colour >> 24);
+		}
+		file.write((const char*)row.data(), row.size());
+	}
+	return (bool)file;
+}
+
+int SoftwareImage::MaxDifference(const SoftwareImage& other) const
+{
+	if (Width != other.Width || Height != other.Height)
+		return -1;
+
+	int difference = 0;
+	for (size_t i = 0; i < Pixels.size(); i++)
+	{
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			const int a = (Pixels[i] >> shift) & 0xff;
+			const int b = (other.Pixels[i] >> shift) & 0xff;
+			difference = std::max(difference, std::abs(a - b));
+		}
+	}
+	return difference;
+}
+
+int SoftwareImage::CountDifferences(const SoftwareImage& other, int tolerance) const
+{
+	if (Width != other.Width || Height != other.Height)
+		return -1;
+
+	int count = 0;
+	for (size_t i = 0; i < Pixels.size(); i++)
+	{
+		for (int shift = 0; shift < 32; shift += 8)
+		{
+			const int a = (Pixels[i] >> shift) & 0xff;
+			const int b = (other.Pixels[i] >> shift) & 0xff;
+			if (std::abs(a - b) > tolerance)
+			{
+				count++;
+				break;
+			}
+		}
+	}
+	return count;
+}
+
+bool LoadSoftwareImage(const char* filename, SoftwareImage& image_out)
+{
+	MemoryTagScope memoryTag(MemoryTag::Textures);
+	int width, height, channels;
+	unsigned char* data = stbi_load(filename, &width, &height, &channels, 4);
+	if (!data)
+		return false;
+
+	image_out.Width = width;
+	image_out.Height = height;
+	image_out.Pixels.resize((size_t)width * height);
+	memcpy(image_out.Pixels.data(), data, image_out.Pixels.size() * 4);
+	stbi_image_free(data);
+	return true;
+}
+
+SoftwareRasterizer::SoftwareRasterizer(int width, int height, unsigned threads)
+	: m_threads(threads)
+{
+	Resize(width, height);
+}
+
+void SoftwareRasterizer::Resize(int width, int height)
+{
+	m_colour.Width = std::max(width, 1);
+	m_colour.Height = std::max(height, 1);
+	m_colour.Pixels.assign((size_t)m_colour.Width * m_colour.Height, 0);
+	m_depth_stride = (m_colour.Width + 3) & ~3;
+	m_depth.assign((size_t)m_depth_stride * m_colour.Height, 1.0f);
+	m_tiles_x = (m_colour.Width + SOFTRAST_TILE_SIZE - 1) / SOFTRAST_TILE_SIZE;
+	m_tiles_y = (m_colour.Height + SOFTRAST_TILE_SIZE - 1) / SOFTRAST_TILE_SIZE;
+	m_tile_bins.assign((size_t)m_tiles_x * m_tiles_y, std::vector<uint32_t>());
+	m_triangles.clear();
+}
+
+void SoftwareRasterizer::Clear(const vec4f& colour)
+{
+	std::fill(m_colour.Pixels.begin(), m_colour.Pixels.end(), Pack(colour));
+	std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+	m_triangles.clear();
+	m_stats = SoftwareRasterizerStats();
+}
+
+void SoftwareRasterizer::Draw(
+	const TransformationBuffer& transforms,
+	const Vertex* vertices,
+	const unsigned* indices,
+	size_t index_count,
+	const SoftwareImage* diffuse_texture)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	const mat4f modelToClip = transforms.ProjectionMatrix * transforms.WorldToViewMatrix * transforms.ModelToWorldMatrix;
+
+	for (size_t i = 0; i + 2 < index_count; i += 3)
+	{
+		// Vertex stage, as in vertex_shader.hlsl
+		ClipVertex triangle[3];
+		for (int k = 0; k < 3; k++)
+		{
+			const Vertex& vertex = vertices[indices[i + k]];
+			triangle[k].Position = modelToClip * vertex.Position.xyz1();
+			triangle[k].Normal = (transforms.ModelToWorldMatrix * vertex.Normal.xyz0()).xyz().normalize();
+			triangle[k].TexCoord = vertex.TexCoord;
+		}
+
+		// Clip against the near plane (z >= -w), giving up to four vertices
+		ClipVertex polygon[4];
+		int count = 0;
+		for (int k = 0; k < 3; k++)
+		{
+			const ClipVertex& a = triangle[k];
+			const ClipVertex& b = triangle[(k + 1) % 3];
+			const float da = a.Position.z + a.Position.w;
+			const float db = b.Position.z + b.Position.w;
+			if (da >= 0.0f)
+				polygon[count++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+			{
+				const float t = da / (da - db);
+				ClipVertex& v = polygon[count++];
+				v.Position = a.Position + (b.Position - a.Position) * t;
+				v.Normal = a.Normal + (b.Normal - a.Normal) * t;
+				v.TexCoord = a.TexCoord + (b.TexCoord - a.TexCoord) * t;
+			}
+		}
+		if (count >= 3)
+			SetupClipped(polygon, count, diffuse_texture);
+	}
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	m_stats.Drawcalls++;
+	m_stats.Triangles += (unsigned)(index_count / 3);
+	m_stats.SetupMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void SoftwareRasterizer::SetupClipped(const ClipVertex* polygon, int count, const SoftwareImage* texture)
+{
+	const int width = m_colour.Width, height = m_colour.Height;
+
+	// Project to the screen, y pointing down
+	float x[4], y[4], z[4], invW[4], attributes[4][5];
+	for (int k = 0; k < count; k++)
+	{
+		const vec4f& p = polygon[k].Position;
+		if (p.w <= 1e-6f)
+			return;
+		invW[k] = 1.0f / p.w;
+		x[k] = (p.x * invW[k] * 0.5f + 0.5f) * width;
+		y[k] = (0.5f - p.y * invW[k] * 0.5f) * height;
+		z[k] = p.z * invW[k] * 0.5f + 0.5f;
+		attributes[k][0] = polygon[k].Normal.x * invW[k];
+		attributes[k][1] = polygon[k].Normal.y * invW[k];
+		attributes[k][2] = polygon[k].Normal.z * invW[k];
+		attributes[k][3] = polygon[k].TexCoord.x * invW[k];
+		attributes[k][4] = polygon[k].TexCoord.y * invW[k];
+	}
+
+	// Triangulate as a fan
+	for (int k = 1; k + 1 < count; k++)
+	{
+		int v[3] = { 0, k, k + 1 };
+
+		// Counter-clockwise front faces are clockwise on the screen, since y is flipped
+		const float area = (x[v[1]] - x[v[0]]) * (y[v[2]] - y[v[0]]) - (x[v[2]] - x[v[0]]) * (y[v[1]] - y[v[0]]);
+		if (area > -1e-8f)
+			continue;
+		std::swap(v[1], v[2]);
+
+		SetupTriangle t;
+		const float minX = std::min(x[v[0]], std::min(x[v[1]], x[v[2]]));
+		const float maxX = std::max(x[v[0]], std::max(x[v[1]], x[v[2]]));
+		const float minY = std::min(y[v[0]], std::min(y[v[1]], y[v[2]]));
+		const float maxY = std::max(y[v[0]], std::max(y[v[1]], y[v[2]]));
+		t.MinX = std::max(0, (int)std::ceil(minX - 0.5f));
+		t.MaxX = std::min(width - 1, (int)std::floor(maxX - 0.5f));
+		t.MinY = std::max(0, (int)std::ceil(minY - 0.5f));
+		t.MaxY = std::min(height - 1, (int)std::floor(maxY - 0.5f));
+		if (t.MinX > t.MaxX || t.MinY > t.MaxY)
+			continue;
+
+		// Edge i is opposite vertex i
+		for (int e = 0; e < 3; e++)
+		{
+			const int a = v[(e + 1) % 3], b = v[(e + 2) % 3];
+			Plane& edge = t.Edges[e];
+			edge.A = y[a] - y[b];
+			edge.B = x[b] - x[a];
+			edge.C = -(edge.A * x[a] + edge.B * y[a]);
+			t.TopLeft[e] = edge.A > 0.0f || (edge.A == 0.0f && edge.B > 0.0f);
+		}
+
+		// Interpolate a value from its vertex values through the barycentric weights
+		const float invArea = -1.0f / area;
+		auto makePlane = [&](float q0, float q1, float q2)
+		{
+			Plane p;
+			p.A = (t.Edges[0].A * q0 + t.Edges[1].A * q1 + t.Edges[2].A * q2) * invArea;
+			p.B = (t.Edges[0].B * q0 + t.Edges[1].B * q1 + t.Edges[2].B * q2) * invArea;
+			p.C = (t.Edges[0].C * q0 + t.Edges[1].C * q1 + t.Edges[2].C * q2) * invArea;
+			return p;
+		};
+		t.Depth = makePlane(z[v[0]], z[v[1]], z[v[2]]);
+		t.InvW = makePlane(invW[v[0]], invW[v[1]], invW[v[2]]);
+		for (int a = 0; a < 5; a++)
+			t.Attributes[a] = makePlane(attributes[v[0]][a], attributes[v[1]][a], attributes[v[2]][a]);
+		t.Texture = texture;
+
+		m_triangles.push_back(t);
+	}
+}
+
+void SoftwareRasterizer::Flush()
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+
+	// Bin the triangles to the tiles their bounds overlap, keeping submission order
+	for (auto& bin : m_tile_bins)
+		bin.clear();
+	for (uint32_t i = 0; i < (uint32_t)m_triangles.size(); i++)
+	{
+		const SetupTriangle& t = m_triangles[i];
+		for (int ty = t.MinY / SOFTRAST_TILE_SIZE; ty <= t.MaxY / SOFTRAST_TILE_SIZE; ty++)
+			for (int tx = t.MinX / SOFTRAST_TILE_SIZE; tx <= t.MaxX / SOFTRAST_TILE_SIZE; tx++)
+				m_tile_bins[(size_t)ty * m_tiles_x + tx].push_back(i);
+	}
+
+	// Jobs take tiles from a shared counter
+	std::atomic<int> nextTile(0);
+	std::atomic<unsigned> pixels(0);
+	const int tileCount = m_tiles_x * m_tiles_y;
+	auto worker = [&]()
+	{
+		PROFILE_ZONE("Rasterize tiles");
+		unsigned jobPixels = 0;
+		for (int tile = nextTile++; tile < tileCount; tile = nextTile++)
+		{
+			if (!m_tile_bins[tile].empty())
+				RasterizeTile(tile % m_tiles_x, tile / m_tiles_x, m_tile_bins[tile], jobPixels);
+		}
+		pixels += jobPixels;
+	};
+
+	const unsigned threadLimit = m_threads ? m_threads : JobSystem::GetWorkerCount() + 1;
+	const unsigned jobs = m_triangles.empty() ? 1 : std::min(threadLimit, (unsigned)tileCount);
+	JobCounter counter;
+	for (unsigned i = 1; i < jobs; i++)
+		JobSystem::Run(worker, &counter);
+	worker();
+	JobSystem::Wait(counter);
+
+	const auto end = std::chrono::high_resolution_clock::now();
+	m_stats.TrianglesSetup += (unsigned)m_triangles.size();
+	m_stats.PixelsShaded += pixels.load();
+	m_stats.RasterMilliseconds += std::chrono::duration<double, std::milli>(end - start).count();
+	m_triangles.clear();
+}
+
+void SoftwareRasterizer::RasterizeTile(int tile_x, int tile_y, const std::vector<uint32_t>& triangles, unsigned& pixels_shaded)
+{
+	const int tileMinX = tile_x * SOFTRAST_TILE_SIZE;
+	const int tileMinY = tile_y * SOFTRAST_TILE_SIZE;
+	const int tileMaxX = std::min(tileMinX + SOFTRAST_TILE_SIZE, m_colour.Width) - 1;
+	const int tileMaxY = std::min(tileMinY + SOFTRAST_TILE_SIZE, m_colour.Height) - 1;
+
+	for (uint32_t index : triangles)
+	{
+		const SetupTriangle& t = m_triangles[index];
+		const int minX = std::max(t.MinX, tileMinX) & ~3;
+		const int maxX = std::min(t.MaxX, tileMaxX);
+		const int minY = std::max(t.MinY, tileMinY);
+		const int maxY = std::min(t.MaxY, tileMaxY);
+
+		for (int py = minY; py <= maxY; py++)
+		{
+			const float cy = (float)py + 0.5f;
+			float* depthRow = m_depth.data() + (size_t)py * m_depth_stride;
+			uint32_t* colourRow = m_colour.Pixels.data() + (size_t)py * m_colour.Width;
+
+#ifdef LINALG_SSE2
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 lastX = _mm_set1_ps((float)maxX + 1.0f);
+			__m128 edgeRow[3], edgeA[3], inclusive[3];
+			for (int e = 0; e < 3; e++)
+			{
+				edgeRow[e] = _mm_set1_ps(t.Edges[e].B * cy + t.Edges[e].C);
+				edgeA[e] = _mm_set1_ps(t.Edges[e].A);
+				inclusive[e] = _mm_castsi128_ps(_mm_set1_epi32(t.TopLeft[e] ? -1 : 0));
+			}
+
+			for (int px = minX; px <= maxX; px += 4)
+			{
+				const __m128 cx = _mm_add_ps(_mm_set1_ps((float)px), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+
+				// Coverage, with pixels exactly on an edge only belonging to top-left edges
+				__m128 mask = _mm_cmplt_ps(cx, lastX);
+				for (int e = 0; e < 3; e++)
+				{
+					const __m128 value = _mm_add_ps(_mm_mul_ps(edgeA[e], cx), edgeRow[e]);
+					const __m128 inside = _mm_or_ps(
+						_mm_and_ps(inclusive[e], _mm_cmpge_ps(value, zero)),
+						_mm_andnot_ps(inclusive[e], _mm_cmpgt_ps(value, zero)));
+					mask = _mm_and_ps(mask, inside);
+				}
+				if (!_mm_movemask_ps(mask))
+					continue;
+
+				// Depth test
+				const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.Depth.A), cx), _mm_set1_ps(t.Depth.B * cy + t.Depth.C));
+				const __m128 oldZ = _mm_loadu_ps(depthRow + px);
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(z, oldZ));
+				const int lanes = _mm_movemask_ps(mask);
+				if (!lanes)
+					continue;
+				_mm_storeu_ps(depthRow + px, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, oldZ)));
+
+				// Perspective-correct attributes
+				const __m128 invW = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.InvW.A), cx), _mm_set1_ps(t.InvW.B * cy + t.InvW.C));
+				const __m128 w = _mm_div_ps(_mm_set1_ps(1.0f), invW);
+				float attributes[5][4];
+				for (int a = 0; a < 5; a++)
+				{
+					const Plane& p = t.Attributes[a];
+					const __m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.A), cx), _mm_set1_ps(p.B * cy + p.C));
+					_mm_storeu_ps(attributes[a], _mm_mul_ps(value, w));
+				}
+
+				for (int lane = 0; lane < 4; lane++)
+				{
+					if (!(lanes & (1 << lane)))
+						continue;
+					const float pixelAttributes[5] = {
+						attributes[0][lane], attributes[1][lane], attributes[2][lane], attributes[3][lane], attributes[4][lane] };
+					colourRow[px + lane] = Shade(t, pixelAttributes);
+					pixels_shaded++;
+				}
+			}
+#else
+			for (int px = minX; px <= maxX; px++)
+			{
+				const float cx = (float)px + 0.5f;
+
+				bool covered = true;
+				for (int e = 0; e < 3 && covered; e++)
+				{
+					const float value = t.Edges[e].A * cx + t.Edges[e].B * cy + t.Edges[e].C;
+					covered = t.TopLeft[e] ? value >= 0.0f : value > 0.0f;
+				}
+				if (!covered)
+					continue;
+
+				const float z = t.Depth.A * cx + (t.Depth.B * cy + t.Depth.C);
+				if (!(z < depthRow[px]))
+					continue;
+				depthRow[px] = z;
+
+				const float w = 1.0f / (t.InvW.A * cx + (t.InvW.B * cy + t.InvW.C));
+				float pixelAttributes[5];
+				for (int a = 0; a < 5; a++)
+					pixelAttributes[a] = (t.Attributes[a].A * cx + (t.Attributes[a].B * cy + t.Attributes[a].C)) * w;
+				colourRow[px] = Shade(t, pixelAttributes);
+				pixels_shaded++;
+			}
+#endif
+		}
+	}
+}
+
+uint32_t SoftwareRasterizer::Shade(const SetupTriangle& triangle, const float attributes[5]) const
+{
+	// Pixel stage, the debug modes of pixel_shader.hlsl
+	switch (m_shading)
+	{
+	case SoftwareShading::DiffuseTexture:
+		if (triangle.Texture && triangle.Texture->Width)
+			return Pack(triangle.Texture->Sample(vec2f(attributes[3], attributes[4])));
+		break;
+	case SoftwareShading::TexCoord:
+		return Pack(vec4f(attributes[3], attributes[4], 0.0f, 1.0f));
+	default:
+		break;
+	}
+
+	const vec3f normal = vec3f(attributes[0], attributes[1], attributes[2]).normalize();
+	return Pack(vec4f(normal * 0.5f + vec3f(0.5f), 1.0f));
+}
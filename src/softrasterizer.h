@@ -0,0 +1,208 @@
+/**
+ * @file softrasterizer.h
+ * @brief CPU rasterizer rendering to an in-memory image
+ * @details Consumes the same vertices, index ranges, transformation matrices and diffuse textures
+ * as the Direct3D path, so that frames can be rendered and timed on machines without a GPU,
+ * e.g. for golden-image tests.
+ *
+ * Triangles are transformed, clipped and set up when drawn, then binned to screen tiles.
+ * Flush() rasterizes the tiles as parallel jobs, four pixels at a time with SSE2, with
+ * perspective-correct attributes. Each tile draws its triangles in submission order,
+ * so the image does not depend on the number of threads.
+*/
+
+#pragma once
+#ifndef SOFTRASTERIZER_H
+#define SOFTRASTERIZER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "vec/vec.h"
+#include "vec/mat.h"
+#include "vertex.h"
+#include "buffers.h"
+
+//! Width and height, in pixels, of the screen tiles that are rasterized in parallel
+#define SOFTRAST_TILE_SIZE 32
+
+/**
+ * @brief RGBA8 image, used both for textures and render targets.
+*/
+struct SoftwareImage
+{
+	int Width = 0; //!< Width in pixels
+	int Height = 0; //!< Height in pixels
+	std::vector<uint32_t> Pixels; //!< Row by row from the top, red in the lowest byte
+
+	/**
+	 * @brief Bilinear sample with wrapping texture coordinates.
+	 * @param[in] uv Texture coordinates, (0,0) at the top-left corner.
+	 * @return Colour with components in [0,1].
+	*/
+	linalg::vec4f Sample(const linalg::vec2f& uv) const;
+
+	/**
+	 * @brief Write the image to an uncompressed 32-bit TGA file.
+	 * @return True on success.
+	*/
+	bool WriteTGA(const std::string& filename) const;
+
+	/**
+	 * @brief Largest difference of any colour component between two images, for golden-image comparisons.
+	 * @return Difference in [0,255], or -1 if the sizes differ.
+	*/
+	int MaxDifference(const SoftwareImage& other) const;
+
+	/**
+	 * @brief Number of pixels where any colour component differs by more than a tolerance.
+	 * @details Lets golden-image comparisons accept a few edge pixels that round differently between compilers.
+	 * @return Number of pixels, or -1 if the sizes differ.
+	*/
+	int CountDifferences(const SoftwareImage& other, int tolerance) const;
+};
+
+/**
+ * @brief Load an image file (any format stb_image reads) as RGBA8.
+ * @param[in] filename File path to a valid image.
+ * @param[out] image_out Receives the image.
+ * @return True on success.
+*/
+bool LoadSoftwareImage(const char* filename, SoftwareImage& image_out);
+
+/**
+ * @brief What the pixel stage outputs, mirroring the debug modes of pixel_shader.hlsl.
+*/
+enum class SoftwareShading
+{
+	Normal, //!< World space normal mapped from [-1,1] to [0,1]
+	TexCoord, //!< Texture coordinates as red and green
+	DiffuseTexture, //!< Diffuse texture, falls back to Normal for drawcalls without one
+};
+
+/**
+ * @brief Statistics since the last Clear().
+*/
+struct SoftwareRasterizerStats
+{
+	unsigned Drawcalls = 0; //!< Number of Draw() calls
+	unsigned Triangles = 0; //!< Number of triangles submitted
+	unsigned TrianglesSetup = 0; //!< Number of triangles left after clipping and backface culling
+	unsigned PixelsShaded = 0; //!< Number of pixels that passed the depth test
+	double SetupMilliseconds = 0.0; //!< Time spent transforming, clipping and setting up triangles
+	double RasterMilliseconds = 0.0; //!< Time spent binning and rasterizing
+};
+
+/**
+ * @brief Tiled, multithreaded CPU rasterizer.
+ * @details Matches the fixed function state of the Direct3D path: counter-clockwise front faces,
+ * back faces culled, depth test LESS with GL style clip space depth in [-w,w].
+*/
+class SoftwareRasterizer
+{
+public:
+	/**
+	 * @brief Create a render target.
+	 * @param[in] width Width in pixels.
+	 * @param[in] height Height in pixels.
+	 * @param[in] threads Most jobs rasterizing tiles at once, 0 for one per JobSystem worker plus the calling thread.
+	*/
+	SoftwareRasterizer(int width, int height, unsigned threads = 0);
+
+	/**
+	 * @brief Change the size of the render target, which is cleared.
+	*/
+	void Resize(int width, int height);
+
+	/**
+	 * @brief Clear colour and depth, drop unflushed triangles and reset the statistics.
+	 * @param[in] colour Clear colour with components in [0,1].
+	*/
+	void Clear(const linalg::vec4f& colour);
+
+	/**
+	 * @brief Select the pixel stage output.
+	*/
+	void SetShading(SoftwareShading shading) noexcept { m_shading = shading; }
+
+	/**
+	 * @brief Draw an indexed triangle list.
+	 * @details Vertices are transformed like in vertex_shader.hlsl. The textures must stay alive until Flush().
+	 * @param[in] transforms Model, view and projection matrices.
+	 * @param[in] vertices Vertex array indexed by the indices.
+	 * @param[in] indices Triangle list indices, e.g. an index range of a model.
+	 * @param[in] index_count Number of indices, a multiple of 3.
+	 * @param[in] diffuse_texture Texture for SoftwareShading::DiffuseTexture, may be nullptr.
+	*/
+	void Draw(const TransformationBuffer& transforms, const Vertex* vertices, const unsigned* indices, size_t index_count, const SoftwareImage* diffuse_texture);
+
+	/**
+	 * @brief Rasterize everything drawn since the last Flush() or Clear().
+	*/
+	void Flush();
+
+	/**
+	 * @brief Get the colour buffer.
+	*/
+	const SoftwareImage& GetImage() const noexcept { return m_colour; }
+
+	/**
+	 * @brief Get the depth buffer, with depth 0 at the near and 1 at the far plane.
+	 * @details Rows are GetDepthStride() floats apart.
+	*/
+	const std::vector<float>& GetDepth() const noexcept { return m_depth; }
+
+	/**
+	 * @brief Get the distance between depth buffer rows, the width rounded up to a multiple of 4.
+	*/
+	int GetDepthStride() const noexcept { return m_depth_stride; }
+
+	/**
+	 * @brief Get the statistics since the last Clear().
+	*/
+	const SoftwareRasterizerStats& GetStats() const noexcept { return m_stats; }
+
+private:
+	// Clip space vertex with the attributes passed to the pixel stage
+	struct ClipVertex
+	{
+		linalg::vec4f Position;
+		linalg::vec3f Normal;
+		linalg::vec2f TexCoord;
+	};
+
+	// Plane equation a*x + b*y + c of a value over the screen
+	struct Plane
+	{
+		float A, B, C;
+	};
+
+	// Set up triangle, ready to rasterize
+	struct SetupTriangle
+	{
+		Plane Edges[3]; // positive inside
+		bool TopLeft[3]; // fill rule: pixels exactly on the edge belong to top and left edges
+		Plane Depth; // z/w in [0,1]
+		Plane InvW; // 1/w
+		Plane Attributes[5]; // normal and texture coordinates, divided by w
+		const SoftwareImage* Texture;
+		int MinX, MinY, MaxX, MaxY; // pixel bounds, inclusive
+	};
+
+	void SetupClipped(const ClipVertex* polygon, int count, const SoftwareImage* texture);
+	void RasterizeTile(int tile_x, int tile_y, const std::vector<uint32_t>& triangles, unsigned& pixels_shaded);
+	uint32_t Shade(const SetupTriangle& triangle, const float attributes[5]) const;
+
+	int m_tiles_x = 0;
+	int m_tiles_y = 0;
+	int m_depth_stride = 0;
+	unsigned m_threads;
+	SoftwareShading m_shading = SoftwareShading::Normal;
+	SoftwareImage m_colour;
+	std::vector<float> m_depth;
+	std::vector<SetupTriangle> m_triangles;
+	std::vector<std::vector<uint32_t>> m_tile_bins; // triangle indices per tile
+	SoftwareRasterizerStats m_stats;
+};
+
+#endif
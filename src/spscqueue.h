@@ -0,0 +1,86 @@
+/**
+ * @file spscqueue.h
+ * @brief Bounded lock-free queue between one producer and one consumer thread
+ * @details A ring buffer with a power of two capacity. The producer only writes the tail and the consumer
+ * only writes the head, each published with release and read with acquire, so neither side ever waits
+ * for the other. An empty TryPop() is one relaxed and one acquire load.
+*/
+
+#pragma once
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Bounded single producer, single consumer queue.
+ * @tparam T Element type, must be default constructible and movable.
+*/
+template<typename T>
+class SpscQueue
+{
+public:
+	/**
+	 * @brief Create an empty queue.
+	 * @param[in] capacity Maximum number of queued elements, rounded up to a power of two.
+	*/
+	explicit SpscQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		m_elements.resize(size);
+		m_mask = size - 1;
+	}
+
+	SpscQueue(const SpscQueue&) = delete;
+	SpscQueue& operator=(const SpscQueue&) = delete;
+
+	/**
+	 * @brief Append an element, producer thread only.
+	 * @return False if the queue is full, the element is left unchanged.
+	*/
+	bool TryPush(T& element)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) > m_mask)
+			return false;
+		m_elements[tail & m_mask] = std::move(element);
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Remove the oldest element, consumer thread only.
+	 * @return False if the queue is empty.
+	*/
+	bool TryPop(T& element)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+			return false;
+		element = std::move(m_elements[head & m_mask]);
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * @brief Maximum number of queued elements.
+	*/
+	size_t GetCapacity() const noexcept { return m_mask + 1; }
+
+private:
+	// Head and tail on separate cache lines, so the threads do not share one
+	std::atomic<size_t> m_head{ 0 };
+	char m_head_padding[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> m_tail{ 0 };
+	char m_tail_padding[64 - sizeof(std::atomic<size_t>)];
+
+	std::vector<T> m_elements;
+	size_t m_mask = 0;
+};
+
+#endif
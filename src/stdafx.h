@@ -11,6 +11,7 @@
 
 #include <string>
 #include <fstream>
+#include <iostream>
 
 #define SAFE_RELEASE(x) if( x ) { (x)->Release(); (x) = nullptr; }
 #define SAFE_DELETE(x) if( x ) { delete(x); (x) = nullptr; }
@@ -32,31 +33,30 @@ constexpr auto PI = (3.14159265358979323846f);
 
 //////////////////////////////////////////////////////////////////////////
 // to find memory leaks
+//
+// new, delete and the my* macros go through the tracking allocator in
+// memorytracker.h, plain malloc and free do not. In debug builds run with
+// -memstacks, the stack of every tracked allocation is recorded and the
+// live ones are reported at exit.
 //////////////////////////////////////////////////////////////////////////
 
+#include "memorytracker.h"
+
+#define myMalloc(s)       TrackedMalloc(s)
+#define myCalloc(c, s)    TrackedCalloc(c, s)
+#define myRealloc(p, s)   TrackedRealloc(p, s)
+#define myExpand(p, s)    TrackedExpand(p, s)
+#define myFree(p)         TrackedFree(p)
+#define myMemSize(p)      TrackedSize(p)
+#define myNew new
+#define myDelete delete
 #ifdef _DEBUG
-#define myMalloc(s)       _malloc_dbg(s, _NORMAL_BLOCK, __FILE__, __LINE__)
-#define myCalloc(c, s)    _calloc_dbg(c, s, _NORMAL_BLOCK, __FILE__, __LINE__)
-#define myRealloc(p, s)   _realloc_dbg(p, s, _NORMAL_BLOCK, __FILE__, __LINE__)
-#define myExpand(p, s)    _expand_dbg(p, s, _NORMAL_BLOCK, __FILE__, __LINE__)
-#define myFree(p)         _free_dbg(p, _NORMAL_BLOCK)
-#define myMemSize(p)      _msize_dbg(p, _NORMAL_BLOCK)
-#define myNew new(_NORMAL_BLOCK, __FILE__, __LINE__)
-#define myDelete delete  // Set to dump leaks at the program exit.
-#define myInitMemoryCheck() \
-	_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF)
+#define myInitMemoryCheck(capture_stacks) \
+	MemoryTracker::SetStackCapture(capture_stacks)
 #define myDumpMemoryLeaks() \
-	_CrtDumpMemoryLeaks()
+	MemoryTracker::WriteLeakReport(std::cout)
 #else
-#define myMalloc malloc
-#define myCalloc calloc
-#define myRealloc realloc
-#define myExpand _expand
-#define myFree free
-#define myMemSize _msize
-#define myNew new
-#define myDelete delete
-#define myInitMemoryCheck()
+#define myInitMemoryCheck(capture_stacks)
 #define myDumpMemoryLeaks()
 #endif 
 //////////////////////////////////////////////////////////////////////////
@@ -5,9 +5,14 @@
 //
 
 #include "Texture.h"
+#include "loadreport.h"
 
 #pragma warning (push, 1)
 #define STB_IMAGE_IMPLEMENTATION
+// Track image allocations, see memorytracker.h
+#define STBI_MALLOC(size) TrackedMalloc(size)
+#define STBI_REALLOC(pointer, size) TrackedRealloc(pointer, size)
+#define STBI_FREE(pointer) TrackedFree(pointer)
 #include "stb_image.h"
 #pragma warning (pop)
 
@@ -27,8 +32,12 @@ HRESULT LoadTextureFromFile(
     ID3D11Device* dxdevice,
     ID3D11DeviceContext* dxdevice_context,
     const char* filename,
-    Texture* texture_out)
+    Texture* texture_out,
+    LoadReport* report)
 {
+    PROFILE_FUNCTION();
+    MemoryTagScope memoryTag(MemoryTag::Textures);
+
     int mipLevels = 1;
     int mipLevelsSRV = 1;
     unsigned bindFlags = D3D11_BIND_SHADER_RESOURCE;
@@ -52,11 +61,22 @@ HRESULT LoadTextureFromFile(
     stbi_set_flip_vertically_on_load(1);
     int imageWidth = 0;
     int imageHeight = 0;
-    unsigned char* imageData = stbi_load(filename, &imageWidth, &imageHeight, NULL, 4);
+    unsigned char* imageData = nullptr;
+    {
+        LoadStage stage(report, "Texture decode");
+        imageData = stbi_load(filename, &imageWidth, &imageHeight, NULL, 4);
+    }
     if (imageData == nullptr)
     {
         return E_FAIL;
     }
+    if (report)
+    {
+        report->Textures++;
+        report->TextureBytes += (uint64_t)imageWidth * imageHeight * 4;
+    }
+
+    LoadStage uploadStage(report, "Upload");
 
     // Create texture
     D3D11_TEXTURE2D_DESC desc = {};
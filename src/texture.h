@@ -15,6 +15,8 @@
 
 //using Microsoft::WRL::ComPtr;
 
+struct LoadReport;
+
 /**
  * @brief Represents a texture.
 */
@@ -46,9 +48,10 @@ HRESULT LoadTextureFromFile(ID3D11Device* dxdevice,	const char* filename, Textur
  * @param[in] dxdevice_context If provided the ID3D11DeviceContext will be used to auto generate mip maps for the texture.
  * @param[in] filename File path to a valid image.
  * @param[out] texture_out Texture struct to store the resulting texture in.
+ * @param[in,out] report If provided, the decode and upload times and the texture size are added to it.
  * @return HRESULT of the texture creation.
 */
-HRESULT LoadTextureFromFile(ID3D11Device* dxdevice,	ID3D11DeviceContext* dxdevice_context, const char* filename, Texture* texture_out);
+HRESULT LoadTextureFromFile(ID3D11Device* dxdevice,	ID3D11DeviceContext* dxdevice_context, const char* filename, Texture* texture_out, LoadReport* report = nullptr);
 
 /**
  * @brief Loads a 3D texture from 6 individual images.
@@ -0,0 +1,137 @@
+//
+// Transform benchmark
+//
+// The per-object path is what filling a constant buffer looks like without
+// batching: two general matrix products and a 3x3 inverse for every object.
+// The camera moves every frame, so neither path can reuse the last frame.
+//
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include "transformbenchmark.h"
+#include "buffers.h"
+#include "jsonwriter.h"
+#include "profiler.h"
+
+using namespace linalg;
+
+namespace
+{
+	const float Tolerance = 1e-4f;
+
+	void FillPerObject(const mat4f& model_to_world, const mat4f& world_to_view, const mat4f& projection, TransformationBuffer& target)
+	{
+		mat3f normal = model_to_world.get_3x3().inverse();
+		normal.transpose();
+		target.ModelToWorldMatrix = model_to_world;
+		target.WorldToViewMatrix = world_to_view;
+		target.ProjectionMatrix = projection;
+		target.ModelViewProjectionMatrix = projection * world_to_view * model_to_world;
+		target.NormalMatrix = mat4f(normal);
+		target.CameraPosition = world_to_view.inverse().col[3];
+	}
+
+	// Largest difference of the matrices and camera position, each element relative to its size
+	float Compare(const TransformationBuffer& a, const TransformationBuffer& b)
+	{
+		const float* x = &a.ModelToWorldMatrix.col[0].x;
+		const float* y = &b.ModelToWorldMatrix.col[0].x;
+		float error = 0.0f;
+		for (size_t i = 0; i < sizeof(TransformationBuffer) / sizeof(float); i++)
+		{
+			const float scale = std::fmax(1.0f, std::fabs(y[i]));
+			error = std::fmax(error, std::fabs(x[i] - y[i]) / scale);
+		}
+		return error;
+	}
+
+	void WriteSummary(JsonWriter& json, const char* name, const BenchmarkSummary& summary, unsigned objects)
+	{
+		json.Key(name).BeginObject();
+		json.Key("p50_ms").Value(summary.P50);
+		json.Key("p95_ms").Value(summary.P95);
+		json.Key("ns_per_object").Value(objects ? summary.P50 * 1e6 / objects : 0.0);
+		json.EndObject();
+	}
+}
+
+TransformBenchmarkResult RunTransformFrames(unsigned objects, unsigned frames)
+{
+	TransformBenchmarkResult result;
+	result.Objects = objects;
+	result.Frames = frames;
+
+	// Objects with non-uniform scales, so that the normal matrix differs from the model matrix
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+	std::uniform_real_distribution<float> angle(0.0f, 2.0f * fPI);
+	std::uniform_real_distribution<float> axis(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> scale(0.5f, 2.0f);
+	std::vector<mat4f> field(objects);
+	for (mat4f& model : field)
+	{
+		vec3f rotationAxis(axis(random), axis(random), axis(random) + 2.0f);
+		rotationAxis.normalize();
+		model = mat4f::translation(position(random), position(random), position(random)) *
+			mat4f::rotation(angle(random), rotationAxis.x, rotationAxis.y, rotationAxis.z) *
+			mat4f::scaling(scale(random), scale(random), scale(random));
+	}
+	const mat4f projection = mat4f::projection(45.0f * fTO_RAD, 16.0f / 9.0f, 1.0f, 500.0f);
+
+	std::vector<TransformationBuffer> batched(objects), perObject(objects);
+	std::vector<double> batchedTimes, perObjectTimes;
+	for (unsigned frame = 0; frame < frames; frame++)
+	{
+		const mat4f view = mat4f::rotation(0.01f * frame, 0.0f, 1.0f, 0.0f) * mat4f::translation(0.0f, -2.0f, -0.1f * frame);
+
+		int64_t start = Profiler::Now();
+		FillTransformationBuffers(field.data(), field.size(), view, projection, batched.data());
+		batchedTimes.push_back(MillisecondsSince(start));
+
+		start = Profiler::Now();
+		for (unsigned i = 0; i < objects; i++)
+			FillPerObject(field[i], view, projection, perObject[i]);
+		perObjectTimes.push_back(MillisecondsSince(start));
+
+		// Checking every frame would double the time of a run without finding more
+		if (frame + 1 < frames)
+			continue;
+		for (unsigned i = 0; i < objects; i++)
+		{
+			const float error = Compare(batched[i], perObject[i]);
+			result.MaxError = std::fmax(result.MaxError, error);
+			if (!(error <= Tolerance))
+				result.Mismatches++;
+		}
+	}
+
+	result.BatchedMilliseconds = BenchmarkSummary::Compute(batchedTimes);
+	result.PerObjectMilliseconds = BenchmarkSummary::Compute(perObjectTimes);
+	return result;
+}
+
+bool RunTransformBenchmark(unsigned objects, unsigned frames, const std::string& report_filename)
+{
+	printf("Transforms, %u objects, %u frames...\n", objects, frames);
+	const TransformBenchmarkResult result = RunTransformFrames(objects, frames);
+	const double batched = objects ? result.BatchedMilliseconds.P50 * 1e6 / objects : 0.0;
+	const double perObject = objects ? result.PerObjectMilliseconds.P50 * 1e6 / objects : 0.0;
+	const double speedup = batched > 0.0 ? perObject / batched : 0.0;
+	printf("\tBatched: %.2f ns/object, per object: %.2f ns/object, %.1fx\n", batched, perObject, speedup);
+	printf("\tMax error %g, %u mismatches\n", result.MaxError, result.Mismatches);
+
+	const bool passed = objects > 0 && result.Mismatches == 0;
+	const bool written = WriteBenchmarkReport(report_filename, [&](JsonWriter& json)
+	{
+		json.Key("objects").Value(result.Objects);
+		json.Key("frames").Value(result.Frames);
+		json.Key("mismatches").Value(result.Mismatches);
+		json.Key("max_error").Value((double)result.MaxError);
+		WriteSummary(json, "batched", result.BatchedMilliseconds, objects);
+		WriteSummary(json, "per_object", result.PerObjectMilliseconds, objects);
+		json.Key("speedup").Value(speedup);
+		json.Key("passed").Value(passed);
+	});
+	return passed && written;
+}
@@ -0,0 +1,46 @@
+/**
+ * @file transformbenchmark.h
+ * @brief CPU cost of precomputing the model-view-projection and normal matrices of many objects
+ * @details Fills the transformation buffers of a field of random objects with FillTransformationBuffers()
+ * every frame, and compares it with filling them one object at a time with the general matrix product
+ * and inverse. Both must give the same matrices.
+*/
+
+#pragma once
+#ifndef TRANSFORMBENCHMARK_H
+#define TRANSFORMBENCHMARK_H
+
+#include <string>
+#include "benchmark.h"
+
+//! Number of objects in the field
+#define TRANSFORMBENCHMARK_DEFAULT_OBJECTS 100000
+
+//! Number of frames to time
+#define TRANSFORMBENCHMARK_DEFAULT_FRAMES 100
+
+/**
+ * @brief Times and results of one run.
+*/
+struct TransformBenchmarkResult
+{
+	unsigned Objects = 0; //!< Objects in the field
+	unsigned Frames = 0; //!< Frames run
+	unsigned Mismatches = 0; //!< Objects whose matrices differed between the two paths
+	float MaxError = 0.0f; //!< Largest difference of a matrix element, relative to its size
+	BenchmarkSummary BatchedMilliseconds; //!< FillTransformationBuffers() of all objects
+	BenchmarkSummary PerObjectMilliseconds; //!< Products and inverse of each object on its own
+};
+
+/**
+ * @brief Fill the transformation buffers of a field of random objects for a number of frames.
+*/
+TransformBenchmarkResult RunTransformFrames(unsigned objects, unsigned frames);
+
+/**
+ * @brief Time both paths over the field and compare their matrices.
+ * @return True if both paths gave the same matrices and the report was written.
+*/
+bool RunTransformBenchmark(unsigned objects, unsigned frames, const std::string& report_filename);
+
+#endif
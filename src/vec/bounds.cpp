@@ -0,0 +1,296 @@
+//
+//  Bounding volumes and intersection tests
+//
+//  The batched tests load four volumes at a time and transpose them to
+//  SoA form (x0 x1 x2 x3, y0 y1 y2 y3, ...), so that one plane/slab/axis
+//  is tested against four volumes per instruction. Remaining volumes are
+//  handled by the scalar tests in bounds.h, which are also used as the
+//  reference when SSE2 is not available. Sums are added in the same order
+//  as the scalar tests and min/max take NaNs the same way, so both paths give
+//  identical results for every volume.
+//
+
+#include "bounds.h"
+
+#ifdef LINALG_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace linalg
+{
+    frustum frustum::from_matrix(const mat4f& m)
+    {
+        // rows of the clip matrix
+        const vec4f r1(m.m11, m.m12, m.m13, m.m14);
+        const vec4f r2(m.m21, m.m22, m.m23, m.m24);
+        const vec4f r3(m.m31, m.m32, m.m33, m.m34);
+        const vec4f r4(m.m41, m.m42, m.m43, m.m44);
+
+        frustum f;
+        f.planes[Left] = plane(r4 + r1).normalize();
+        f.planes[Right] = plane(r4 - r1).normalize();
+        f.planes[Bottom] = plane(r4 + r2).normalize();
+        f.planes[Top] = plane(r4 - r2).normalize();
+        f.planes[Near] = plane(r4 + r3).normalize();
+        f.planes[Far] = plane(r4 - r3).normalize();
+        return f;
+    }
+
+    aabb transform(const mat4f& m, const aabb& b)
+    {
+        const vec3f c = b.center(), e = b.extents();
+
+        const vec3f tc = (m * c.xyz1()).xyz();
+        const vec3f te(
+            std::fabs(m.m11) * e.x + std::fabs(m.m12) * e.y + std::fabs(m.m13) * e.z,
+            std::fabs(m.m21) * e.x + std::fabs(m.m22) * e.y + std::fabs(m.m23) * e.z,
+            std::fabs(m.m31) * e.x + std::fabs(m.m32) * e.y + std::fabs(m.m33) * e.z);
+
+        return aabb::from_center_extents(tc, te);
+    }
+
+    sphere transform(const mat4f& m, const sphere& s)
+    {
+        const float sx = m.col[0].xyz().length_squared();
+        const float sy = m.col[1].xyz().length_squared();
+        const float sz = m.col[2].xyz().length_squared();
+        const float smax = sx > sy ? (sx > sz ? sx : sz) : (sy > sz ? sy : sz);
+
+        return sphere((m * s.center.xyz1()).xyz(), s.radius * std::sqrt(smax));
+    }
+
+    bool intersect(const ray& r, const aabb& b, float t_max, float& t_hit)
+    {
+        float t0 = 0.0f, t1 = t_max;
+        for (int i = 0; i < 3; i++)
+        {
+            float tn = (b.min.vec[i] - r.origin.vec[i]) * r.inv_dir.vec[i];
+            float tf = (b.max.vec[i] - r.origin.vec[i]) * r.inv_dir.vec[i];
+
+            // a ray parallel to the slab starting on one of its planes gives 0 * inf = NaN,
+            // it is within the (closed) slab for its whole length
+            if (tn != tn || tf != tf)
+                continue;
+            if (tn > tf) std::swap(tn, tf);
+            t0 = tn > t0 ? tn : t0;
+            t1 = tf < t1 ? tf : t1;
+            if (t0 > t1)
+                return false;
+        }
+        t_hit = t0;
+        return true;
+    }
+
+#ifdef LINALG_SSE2
+    //
+    // Load four boxes as SoA min/max
+    //
+    static inline void load4(const aabb* b, __m128 mn[3], __m128 mx[3])
+    {
+        mn[0] = _mm_setr_ps(b[0].min.x, b[1].min.x, b[2].min.x, b[3].min.x);
+        mn[1] = _mm_setr_ps(b[0].min.y, b[1].min.y, b[2].min.y, b[3].min.y);
+        mn[2] = _mm_setr_ps(b[0].min.z, b[1].min.z, b[2].min.z, b[3].min.z);
+        mx[0] = _mm_setr_ps(b[0].max.x, b[1].max.x, b[2].max.x, b[3].max.x);
+        mx[1] = _mm_setr_ps(b[0].max.y, b[1].max.y, b[2].max.y, b[3].max.y);
+        mx[2] = _mm_setr_ps(b[0].max.z, b[1].max.z, b[2].max.z, b[3].max.z);
+    }
+
+    //
+    // Write a 4-lane mask to out[0..3], returns number of set lanes
+    //
+    static inline size_t store4(int mask, uint8_t* out)
+    {
+        out[0] = (uint8_t)(mask & 1);
+        out[1] = (uint8_t)((mask >> 1) & 1);
+        out[2] = (uint8_t)((mask >> 2) & 1);
+        out[3] = (uint8_t)((mask >> 3) & 1);
+        return (size_t)(out[0] + out[1] + out[2] + out[3]);
+    }
+
+    static inline __m128 abs4(__m128 v)
+    {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+    }
+#endif
+
+    size_t frustum_cull(const frustum& f, const aabb* boxes, size_t count, uint8_t* out)
+    {
+        size_t i = 0, visible = 0;
+
+#ifdef LINALG_SSE2
+        const __m128 half = _mm_set1_ps(0.5f);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 mn[3], mx[3];
+            load4(boxes + i, mn, mx);
+
+            const __m128 cx = _mm_mul_ps(_mm_add_ps(mx[0], mn[0]), half);
+            const __m128 cy = _mm_mul_ps(_mm_add_ps(mx[1], mn[1]), half);
+            const __m128 cz = _mm_mul_ps(_mm_add_ps(mx[2], mn[2]), half);
+            const __m128 ex = _mm_mul_ps(_mm_sub_ps(mx[0], mn[0]), half);
+            const __m128 ey = _mm_mul_ps(_mm_sub_ps(mx[1], mn[1]), half);
+            const __m128 ez = _mm_mul_ps(_mm_sub_ps(mx[2], mn[2]), half);
+
+            __m128 outside = _mm_setzero_ps();
+            for (const plane& p : f.planes)
+            {
+                const __m128 nx = _mm_set1_ps(p.n.x), ny = _mm_set1_ps(p.n.y), nz = _mm_set1_ps(p.n.z);
+
+                // signed distance of the centers + projected radius of the boxes
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                                                 _mm_mul_ps(nz, cz)), _mm_set1_ps(p.d));
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs4(nx), ex), _mm_mul_ps(abs4(ny), ey)),
+                                      _mm_mul_ps(abs4(nz), ez));
+
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+            }
+            visible += store4(~_mm_movemask_ps(outside) & 0xF, out + i);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            out[i] = (uint8_t)f.intersects(boxes[i]);
+            visible += out[i];
+        }
+        return visible;
+    }
+
+    size_t frustum_cull(const frustum& f, const sphere* spheres, size_t count, uint8_t* out)
+    {
+        size_t i = 0, visible = 0;
+
+#ifdef LINALG_SSE2
+        for (; i + 4 <= count; i += 4)
+        {
+            const sphere* s = spheres + i;
+            const __m128 cx = _mm_setr_ps(s[0].center.x, s[1].center.x, s[2].center.x, s[3].center.x);
+            const __m128 cy = _mm_setr_ps(s[0].center.y, s[1].center.y, s[2].center.y, s[3].center.y);
+            const __m128 cz = _mm_setr_ps(s[0].center.z, s[1].center.z, s[2].center.z, s[3].center.z);
+            const __m128 nr = _mm_setr_ps(-s[0].radius, -s[1].radius, -s[2].radius, -s[3].radius);
+
+            __m128 outside = _mm_setzero_ps();
+            for (const plane& p : f.planes)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(p.n.x), cx), _mm_mul_ps(_mm_set1_ps(p.n.y), cy)),
+                                                 _mm_mul_ps(_mm_set1_ps(p.n.z), cz)), _mm_set1_ps(p.d));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(d, nr));
+            }
+            visible += store4(~_mm_movemask_ps(outside) & 0xF, out + i);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            out[i] = (uint8_t)f.intersects(spheres[i]);
+            visible += out[i];
+        }
+        return visible;
+    }
+
+    size_t intersect(const ray& r, const aabb* boxes, size_t count, float t_max, uint8_t* out, float* t_hits)
+    {
+        size_t i = 0, hits = 0;
+
+#ifdef LINALG_SSE2
+        const __m128 o[3] = { _mm_set1_ps(r.origin.x), _mm_set1_ps(r.origin.y), _mm_set1_ps(r.origin.z) };
+        const __m128 id[3] = { _mm_set1_ps(r.inv_dir.x), _mm_set1_ps(r.inv_dir.y), _mm_set1_ps(r.inv_dir.z) };
+        const __m128 inf = _mm_set1_ps((float)fINF);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 mn[3], mx[3];
+            load4(boxes + i, mn, mx);
+
+            __m128 t0 = _mm_setzero_ps(), t1 = _mm_set1_ps(t_max);
+            for (int a = 0; a < 3; a++)
+            {
+                const __m128 tn = _mm_mul_ps(_mm_sub_ps(mn[a], o[a]), id[a]);
+                const __m128 tf = _mm_mul_ps(_mm_sub_ps(mx[a], o[a]), id[a]);
+
+                // lanes where 0 * inf gave NaN do not limit the ray, as in the scalar test. minps/maxps
+                // return their second operand on NaN and on equal zeros, so t0/t1 go second
+                const __m128 slab = _mm_cmpord_ps(tn, tf);
+                const __m128 lo = _mm_and_ps(slab, _mm_min_ps(tn, tf));
+                const __m128 hi = _mm_or_ps(_mm_and_ps(slab, _mm_max_ps(tn, tf)), _mm_andnot_ps(slab, inf));
+                t0 = _mm_max_ps(lo, t0);
+                t1 = _mm_min_ps(hi, t1);
+            }
+            const __m128 hit = _mm_cmple_ps(t0, t1);
+            hits += store4(_mm_movemask_ps(hit), out + i);
+
+            if (t_hits)
+                _mm_storeu_ps(t_hits + i, _mm_or_ps(_mm_and_ps(hit, t0), _mm_andnot_ps(hit, inf)));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            float t = (float)fINF;
+            out[i] = (uint8_t)intersect(r, boxes[i], t_max, t);
+            if (t_hits)
+                t_hits[i] = out[i] ? t : (float)fINF;
+            hits += out[i];
+        }
+        return hits;
+    }
+
+    size_t overlap(const aabb& query, const aabb* boxes, size_t count, uint8_t* out)
+    {
+        size_t i = 0, hits = 0;
+
+#ifdef LINALG_SSE2
+        const __m128 qmn[3] = { _mm_set1_ps(query.min.x), _mm_set1_ps(query.min.y), _mm_set1_ps(query.min.z) };
+        const __m128 qmx[3] = { _mm_set1_ps(query.max.x), _mm_set1_ps(query.max.y), _mm_set1_ps(query.max.z) };
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 mn[3], mx[3];
+            load4(boxes + i, mn, mx);
+
+            __m128 hit = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int a = 0; a < 3; a++)
+                hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(qmn[a], mx[a]), _mm_cmpge_ps(qmx[a], mn[a])));
+            hits += store4(_mm_movemask_ps(hit), out + i);
+        }
+#endif
+        for (; i < count; i++)
+        {
+            out[i] = (uint8_t)query.overlaps(boxes[i]);
+            hits += out[i];
+        }
+        return hits;
+    }
+
+    aabb merge(const vec3f* points, size_t count, size_t stride)
+    {
+        const char* p = (const char*)points;
+        size_t i = 0;
+        aabb b;
+
+#ifdef LINALG_SSE2
+        if (count > 1)
+        {
+            // 4-wide loads read one float past each point, so the last point is done scalar.
+            // The bounds go second so that NaN coordinates are skipped, as by aabb::merge
+            __m128 mn = _mm_set1_ps((float)fINF), mx = _mm_set1_ps((float)fNINF);
+            for (; i + 1 < count; i++, p += stride)
+            {
+                const __m128 v = _mm_loadu_ps((const float*)p);
+                mn = _mm_min_ps(v, mn);
+                mx = _mm_max_ps(v, mx);
+            }
+            float fmn[4], fmx[4];
+            _mm_storeu_ps(fmn, mn);
+            _mm_storeu_ps(fmx, mx);
+            b = aabb(vec3f(fmn[0], fmn[1], fmn[2]), vec3f(fmx[0], fmx[1], fmx[2]));
+        }
+#endif
+        for (; i < count; i++, p += stride)
+            b.merge(*(const vec3f*)p);
+        return b;
+    }
+
+    aabb merge(const aabb* boxes, size_t count)
+    {
+        aabb b;
+        for (size_t i = 0; i < count; i++)
+            b.merge(boxes[i]);
+        return b;
+    }
+}
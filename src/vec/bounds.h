@@ -0,0 +1,324 @@
+/**
+ * @file bounds.h
+ * @brief Bounding volumes (AABB, sphere, plane, frustum, ray) and intersection tests
+ * @details Single-volume tests are inlined here, batched (SIMD) tests over arrays
+ * of volumes are implemented in bounds.cpp.
+*/
+
+#pragma once
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <cstddef>
+#include <cstdint>
+#include "math.h"
+#include "vec.h"
+#include "mat.h"
+
+namespace linalg
+{
+    /**
+     * @brief Axis-aligned bounding box
+     * @details An empty box has min > max, so that merging any point into it gives a
+     * degenerate box around that point.
+    */
+    class aabb
+    {
+    public:
+        vec3f min; //!< Lower corner
+        vec3f max; //!< Upper corner
+
+        /**
+         * @brief Constructor: empty (inverted) box
+        */
+        aabb() : min((float)fINF), max((float)fNINF) {}
+
+        /**
+         * @brief Constructor: from corners
+         * @param min Lower corner
+         * @param max Upper corner
+        */
+        aabb(const vec3f& min, const vec3f& max) : min(min), max(max) {}
+
+        /**
+         * @brief Constructor: from center and half extents
+        */
+        static aabb from_center_extents(const vec3f& center, const vec3f& extents)
+        {
+            return aabb(center - extents, center + extents);
+        }
+
+        /**
+         * @brief True if no point has been merged into the box
+        */
+        bool empty() const
+        {
+            return min.x > max.x || min.y > max.y || min.z > max.z;
+        }
+
+        vec3f center() const
+        {
+            return (min + max) * 0.5f;
+        }
+
+        //
+        // half extents
+        //
+        vec3f extents() const
+        {
+            return (max - min) * 0.5f;
+        }
+
+        //
+        // surface area, used as cost metric by e.g. BVH builders
+        //
+        float surface_area() const
+        {
+            vec3f d = max - min;
+            return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+
+        /**
+         * @brief Grow the box to contain p
+         * @return Reference to this
+        */
+        aabb& merge(const vec3f& p)
+        {
+            min.set(p.x < min.x ? p.x : min.x, p.y < min.y ? p.y : min.y, p.z < min.z ? p.z : min.z);
+            max.set(p.x > max.x ? p.x : max.x, p.y > max.y ? p.y : max.y, p.z > max.z ? p.z : max.z);
+            return *this;
+        }
+
+        /**
+         * @brief Grow the box to contain b
+         * @return Reference to this
+        */
+        aabb& merge(const aabb& b)
+        {
+            min.set(b.min.x < min.x ? b.min.x : min.x, b.min.y < min.y ? b.min.y : min.y, b.min.z < min.z ? b.min.z : min.z);
+            max.set(b.max.x > max.x ? b.max.x : max.x, b.max.y > max.y ? b.max.y : max.y, b.max.z > max.z ? b.max.z : max.z);
+            return *this;
+        }
+
+        bool contains(const vec3f& p) const
+        {
+            return p.x >= min.x && p.x <= max.x &&
+                   p.y >= min.y && p.y <= max.y &&
+                   p.z >= min.z && p.z <= max.z;
+        }
+
+        bool overlaps(const aabb& b) const
+        {
+            return min.x <= b.max.x && max.x >= b.min.x &&
+                   min.y <= b.max.y && max.y >= b.min.y &&
+                   min.z <= b.max.z && max.z >= b.min.z;
+        }
+    };
+
+    /**
+     * @brief Bounding sphere
+    */
+    class sphere
+    {
+    public:
+        vec3f center; //!< Sphere center
+        float radius = 0.0f; //!< Sphere radius
+
+        sphere() {}
+
+        sphere(const vec3f& center, float radius) : center(center), radius(radius) {}
+
+        /**
+         * @brief Sphere enclosing an AABB
+        */
+        static sphere from_aabb(const aabb& b)
+        {
+            return sphere(b.center(), b.extents().length());
+        }
+
+        bool overlaps(const sphere& s) const
+        {
+            float r = radius + s.radius;
+            return (center - s.center).length_squared() <= r * r;
+        }
+    };
+
+    /**
+     * @brief Plane n.p + d = 0, with points on the positive side considered inside
+    */
+    class plane
+    {
+    public:
+        vec3f n; //!< Plane normal
+        float d = 0.0f; //!< Plane offset
+
+        plane() {}
+
+        plane(const vec3f& n, float d) : n(n), d(d) {}
+
+        //
+        // plane from the coefficients of a row-combination of a clip matrix
+        //
+        plane(const vec4f& v) : n(v.x, v.y, v.z), d(v.w) {}
+
+        /**
+         * @brief Rescale so that the normal has unit length
+         * @return Reference to this
+        */
+        plane& normalize()
+        {
+            float len = n.length();
+            if (len > 1e-8f)
+            {
+                float ilen = 1.0f / len;
+                n *= ilen;
+                d *= ilen;
+            }
+            return *this;
+        }
+
+        /**
+         * @brief Signed distance to p (scaled by |n| if the plane is not normalized)
+        */
+        float distance(const vec3f& p) const
+        {
+            return n.dot(p) + d;
+        }
+    };
+
+    /**
+     * @brief Ray with precomputed reciprocal direction for slab tests
+    */
+    class ray
+    {
+    public:
+        vec3f origin; //!< Ray origin
+        vec3f dir; //!< Ray direction (need not be normalized)
+        vec3f inv_dir; //!< 1/dir, per component
+
+        ray() {}
+
+        ray(const vec3f& origin, const vec3f& dir) : origin(origin), dir(dir)
+        {
+            inv_dir = vec3f(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+        }
+
+        vec3f at(float t) const
+        {
+            return origin + dir * t;
+        }
+    };
+
+    /**
+     * @brief View frustum as six inward-facing planes
+    */
+    class frustum
+    {
+    public:
+        enum { Left = 0, Right, Bottom, Top, Near, Far, PlaneCount };
+
+        plane planes[PlaneCount]; //!< Left, right, bottom, top, near & far planes
+
+        /**
+         * @brief Extract the frustum planes from a clip matrix (Gribb & Hartmann)
+         * @details For clip_matrix = P the planes are in view space, for P*V in world space
+         * and for P*V*M in model space. P is expected to come from mat4f::projection
+         * (GL-style clip volume, -w <= z <= w).
+         * @param clip_matrix Matrix transforming into clip space.
+         * @return Frustum with normalized planes.
+        */
+        static frustum from_matrix(const mat4f& clip_matrix);
+
+        /**
+         * @brief Conservative AABB test
+         * @return False if the box is fully outside any of the planes.
+        */
+        bool intersects(const aabb& b) const
+        {
+            vec3f c = b.center(), e = b.extents();
+            for (const plane& p : planes)
+            {
+                float r = e.x * std::fabs(p.n.x) + e.y * std::fabs(p.n.y) + e.z * std::fabs(p.n.z);
+                if (p.distance(c) + r < 0.0f)
+                    return false;
+            }
+            return true;
+        }
+
+        /**
+         * @brief Sphere test
+         * @return False if the sphere is fully outside any of the planes.
+        */
+        bool intersects(const sphere& s) const
+        {
+            for (const plane& p : planes)
+                if (p.distance(s.center) < -s.radius)
+                    return false;
+            return true;
+        }
+    };
+
+    /**
+     * @brief Transform an AABB and return the AABB of the result (Arvo's method)
+     * @details Transforms center and half extents separately, which is far cheaper
+     * than transforming all eight corners. Assumes an affine matrix.
+    */
+    aabb transform(const mat4f& m, const aabb& b);
+
+    /**
+     * @brief Transform a sphere
+     * @details The radius is scaled by the largest axis scale of the matrix.
+    */
+    sphere transform(const mat4f& m, const sphere& s);
+
+    /**
+     * @brief Ray vs. AABB slab test
+     * @param r Ray to test.
+     * @param b Box to test against.
+     * @param t_max Hits further away than this are ignored.
+     * @param[out] t_hit Ray parameter of the entry point (0 if the origin is inside).
+     * @return True on hit.
+    */
+    bool intersect(const ray& r, const aabb& b, float t_max, float& t_hit);
+
+    //
+    // Batched tests
+    //
+    // Boxes/spheres are read from plain arrays and results are written to out[],
+    // 1 for visible/hit/overlapping and 0 otherwise. Each function returns the number
+    // of positive results. Four volumes are tested per iteration when SSE2 is available.
+    //
+
+    /**
+     * @brief Frustum vs. many AABBs
+    */
+    size_t frustum_cull(const frustum& f, const aabb* boxes, size_t count, uint8_t* out);
+
+    /**
+     * @brief Frustum vs. many spheres
+    */
+    size_t frustum_cull(const frustum& f, const sphere* spheres, size_t count, uint8_t* out);
+
+    /**
+     * @brief Ray vs. many AABBs
+     * @param t_hits Optional, receives the entry distance of each hit box (fINF for misses).
+    */
+    size_t intersect(const ray& r, const aabb* boxes, size_t count, float t_max, uint8_t* out, float* t_hits = nullptr);
+
+    /**
+     * @brief AABB vs. many AABBs
+    */
+    size_t overlap(const aabb& query, const aabb* boxes, size_t count, uint8_t* out);
+
+    /**
+     * @brief Bounds of an array of points
+    */
+    aabb merge(const vec3f* points, size_t count, size_t stride = sizeof(vec3f));
+
+    /**
+     * @brief Bounds of an array of boxes
+    */
+    aabb merge(const aabb* boxes, size_t count);
+}
+
+#endif /* BOUNDS_H */
@@ -9,7 +9,7 @@
 #define MATH_H
 
 #include <stdlib.h>
-//#include <cmath>
+#include <cmath>
 #include <algorithm>
 
 #ifndef DEBUG
@@ -37,6 +37,11 @@
 //!< Get closest whole integer that is smaller than or equal to x.
 #define simplefloor(x) ((double)((long)(x)-((x)<0.0)))
 
+//!< Defined when SSE2 intrinsics can be used by the batched (SIMD) code paths.
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define LINALG_SSE2
+#endif
+
 /**
  * @brief Generates a random floating point number between min and max.
  * @param min Minimum value to randomize.
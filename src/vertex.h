@@ -0,0 +1,25 @@
+/**
+ * @file vertex.h
+ * @brief Contains the Vertex definition
+ * @details Kept apart from the Direct3D dependent drawcall definitions so that CPU side code can use it.
+*/
+
+#pragma once
+#ifndef VERTEX_H
+#define VERTEX_H
+
+#include "vec/vec.h"
+
+/**
+ * @brief Structure defining a vertex
+*/
+struct Vertex
+{
+	linalg::vec3f Position; //!< 3D coordinate of the vertex
+	linalg::vec3f Normal; //!< Normal of the vertex
+	linalg::vec3f Tangent; //!< Tangent of the vertex
+	linalg::vec3f Binormal; //!< Binormal of the vertex
+	linalg::vec2f TexCoord; //!< 2D texture coordiante of the vertex
+};
+
+#endif